@@ -7,6 +7,10 @@
 
 #define HAVE_POSIX_SHM
 
+#define HAVE_MEMFD
+
+#define HAVE_NUMA
+
 #define CACHE_LINE_SIZE 64
 
 
@@ -19,5 +23,8 @@
 /* max number of slots in a queue */
 #define DF_SHM_QUEUE_LENGTH 8        
 
+/* spins of a blocking queue call between checks that the peer is alive (0: never check) */
+#define DF_SHM_PEER_CHECK_SPINS 65536
+
 #endif
 
@@ -7,6 +7,10 @@
 
 #cmakedefine HAVE_POSIX_SHM
 
+#cmakedefine HAVE_MEMFD
+
+#cmakedefine HAVE_NUMA
+
 #cmakedefine CACHE_LINE_SIZE @CACHE_LINE_SIZE@
 
 #cmakedefine PAGE_SIZE @PAGE_SIZE@
@@ -17,5 +21,8 @@
 /* max number of slots in a queue */
 #define DF_SHM_QUEUE_LENGTH 8        
 
+/* spins of a blocking queue call between checks that the peer is alive (0: never check) */
+#define DF_SHM_PEER_CHECK_SPINS 65536
+
 #endif
 
@@ -21,6 +21,21 @@
 #include <assert.h>
 #include "df_shm.h"
 #include "df_shm_method_hooks.h"
+#include "df_shm_mapping.h"
+#include "df_shm_registry.h"
+#include "df_shm_region_pool.h"
+
+/*
+ * Free the region sets of all shards of method (not the regions in them).
+ */
+static void free_shards (df_shm_method_t method)
+{
+    int i;
+    for(i = 0; i < DF_SHM_REGION_SHARDS; i ++) {
+        df_shm_region_set_free(&method->shards[i].created_regions);
+        df_shm_region_set_free(&method->shards[i].foreign_regions);
+    }
+}
 
 /*
  * Initialize specific underlying shared memory method and return a method
@@ -29,7 +44,7 @@
  */
 df_shm_method_t df_shm_init (enum DF_SHM_METHOD method, void *method_init_data)
 {
-    df_shm_method_t m = (df_shm_method_t) malloc(sizeof(df_shm_method));
+    df_shm_method_t m = (df_shm_method_t) calloc(1, sizeof(df_shm_method));
     if(!m) {
         fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         return NULL;
@@ -38,6 +53,7 @@ df_shm_method_t df_shm_init (enum DF_SHM_METHOD method, void *method_init_data)
     // load underlying method callback functions
     if((int)method >= 0 && method < DF_SHM_NUM_METHODS) {
         load_method_callbacks(method, m);            
+        m->method = method;
     }
     else {
         fprintf(stderr, "Error: method (%d) is not valid. %s:%d\n", method, __FILE__, __LINE__);    
@@ -56,49 +72,123 @@ df_shm_method_t df_shm_init (enum DF_SHM_METHOD method, void *method_init_data)
         }
     }
     
-    m->created_regions = NULL;
+    int i;
+    for(i = 0; i < DF_SHM_REGION_SHARDS; i ++) {
+        df_shm_region_shard *shard = &m->shards[i];
+        if(df_shm_region_set_init(&shard->created_regions) != 0 ||
+           df_shm_region_set_init(&shard->foreign_regions) != 0) {
+            break;
+        }
+        pthread_mutex_init(&shard->lock, NULL);
+    }
+    if(i < DF_SHM_REGION_SHARDS) {
+        free_shards(m);
+        if(m->finalize_func) {
+            (*m->finalize_func)(m->method_data);
+        }
+        free(m);
+        return NULL;
+    }
+    pthread_rwlock_init(&m->addr_index_lock, NULL);
     m->num_created_regions = 0;
-    m->foreign_regions = NULL;
     m->num_foreign_regions = 0;    
+    m->addr_index = NULL;
+    m->region_pool = NULL;
+    if(method_init_data) {
+        m->config = *(df_shm_config *) method_init_data;
+    }
+    m->fixed_addr = method_init_data && (((df_shm_config *) method_init_data)->flags & 
+        DF_SHM_FLAG_FIXED_ADDR) && (method == DF_SHM_METHOD_MMAP || 
+        method == DF_SHM_METHOD_POSIX_SHM || method == DF_SHM_METHOD_MEMFD);
     m->initialized = 1;
     return m;    
 }
 
 /*
- * Add a region to a list.
+ * Record a region created (creator != 0) or attached by this process. Return 0 on
+ * success and non-zero on error.
  */
-void add_region_to_list(df_shm_region_t *list, df_shm_region_t r)
+static int add_region (df_shm_method_t method, df_shm_region_t r, int creator)
 {
-    // insert at the beginning of the list
-    r->next = *list;
-    *list = r;
+    // lock order: shard lock, then address index lock
+    df_shm_region_shard *shard = &method->shards[df_shm_region_shard_index(r)];
+    df_shm_region_set *set = creator? &shard->created_regions : &shard->foreign_regions;
+    int rc = -1;
+    pthread_mutex_lock(&shard->lock);
+    if(df_shm_region_set_add(set, r) == 0) {
+        pthread_rwlock_wrlock(&method->addr_index_lock);
+        rc = df_shm_addr_index_add(&method->addr_index, r);
+        pthread_rwlock_unlock(&method->addr_index_lock);
+        if(rc != 0) {
+            df_shm_region_set_remove(set, r);
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+    if(rc != 0) {
+        return -1;
+    }
+    __atomic_add_fetch(creator? &method->num_created_regions : &method->num_foreign_regions, 
+        1, __ATOMIC_RELAXED);
+    return 0;
 }
 
 /*
- * Remove a region from a list. Return 0 on success and non-zero on error.
+ * Forget a region created (creator != 0) or attached by this process.
  */
-int remove_region_from_list(df_shm_region_t *list, df_shm_region_t r)
+static void remove_region (df_shm_method_t method, df_shm_region_t r, int creator)
 {
-    if(!*list) {
-        fprintf(stderr, "Warning: try to remove region from an empty list. %s:%d\n", __FILE__, __LINE__);
+    df_shm_region_shard *shard = &method->shards[df_shm_region_shard_index(r)];
+    df_shm_region_set *set = creator? &shard->created_regions : &shard->foreign_regions;
+    pthread_mutex_lock(&shard->lock);
+    int rc = df_shm_region_set_remove(set, r);
+    if(rc == 0) {
+        pthread_rwlock_wrlock(&method->addr_index_lock);
+        df_shm_addr_index_remove(&method->addr_index, r);
+        pthread_rwlock_unlock(&method->addr_index_lock);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    if(rc == 0) {
+        __atomic_sub_fetch(creator? &method->num_created_regions : &method->num_foreign_regions, 
+            1, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Return 1 if region r was registered as created (rather than attached) by this
+ * process. A process may also attach a region it created, through another handle.
+ */
+static int is_created_region (df_shm_method_t method, df_shm_region_t r)
+{
+    df_shm_region_shard *shard = &method->shards[df_shm_region_shard_index(r)];
+    pthread_mutex_lock(&shard->lock);
+    int rc = df_shm_region_set_contains(&shard->created_regions, r);
+    pthread_mutex_unlock(&shard->lock);
+    return rc;
+}
+
+/*
+ * Map the part of a growable region added since it was last refreshed and update
+ * region->size. Return 0 on success and non-zero on error.
+ */
+static int refresh_region_size (df_shm_method_t method, df_shm_region_t region)
+{
+    if(!method->refresh_region_func) {
+        return 0;
+    }
+    size_t size;
+    int rc = (*method->refresh_region_func) (method->method_data, region, &size);
+    if(rc) {
+        fprintf(stderr, "Error: method's refresh_region callback returns error: %d. %s:%d\n", 
+            rc, __FILE__, __LINE__);
         return -1;
     }
-    df_shm_region_t temp = *list, last = NULL;
-    while(temp) {
-        if(temp == r) {
-            if(last == NULL) {
-                *list = temp->next;
-            }
-            else {
-                last->next = temp->next;
-            }
-            return 0;
-        }
-        last = temp;
-        temp = temp->next;
+    if(size != region->size) {
+        // the address index orders regions by their size too
+        pthread_rwlock_wrlock(&method->addr_index_lock);
+        region->size = size;
+        pthread_rwlock_unlock(&method->addr_index_lock);
     }
-    fprintf(stderr, "Warning: the region is not found in list. %s:%d\n", __FILE__, __LINE__);
-    return 1;
+    return 0;
 }
 
 /*
@@ -115,14 +205,36 @@ df_shm_region_t df_create_shm_region (df_shm_method_t method,
     assert(method->initialized == 1);
     assert(size > 0);    
     
+    // in the fixed-address window the address is allocated by the window
+    if(method->fixed_addr) {
+        starting_addr = NULL;
+    }
+
+    // recycle a pooled region of the same size class if there is one
+    size_t pool_size = 0;
+    if(method->region_pool && !starting_addr) {
+        df_shm_region_t region = df_shm_region_pool_get(method->region_pool, size);
+        if(region) {
+            region->size = size;
+            region->creator_id = getpid();
+            if(add_region(method, region, 1) != 0) {
+                (*method->destroy_region_func) (method->method_data, region);
+                free(region);
+                return NULL;
+            }
+            return region;
+        }
+        pool_size = df_shm_region_pool_class_size(size);
+    }
+
     df_shm_region_t region = (df_shm_region_t) malloc(sizeof(df_shm_region));
     if(!region) {
         fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         return NULL;
     }    
     if(method->create_region_func) {
-        int rc = (*method->create_region_func) (method->method_data, size, starting_addr,
-            (void **)&(region->method_data), (void **)&(region->starting_addr));
+        int rc = (*method->create_region_func) (method->method_data, pool_size? pool_size : size, 
+            starting_addr, (void **)&(region->method_data), (void **)&(region->starting_addr));
         if(rc) {
             fprintf(stderr, "Error: method's create_region callback returns error: %d. %s:%d\n", rc, __FILE__, __LINE__);
             free(region);
@@ -136,8 +248,14 @@ df_shm_region_t df_create_shm_region (df_shm_method_t method,
     region->size = size;
     region->creator_id = getpid(); // the pid of the creator process
     region->shm_method = method;
-    add_region_to_list(&method->created_regions, region);
-    method->num_created_regions ++;
+    region->pool_size = pool_size;
+    if(add_region(method, region, 1) != 0) {
+        if(method->destroy_region_func) {
+            (*method->destroy_region_func) (method->method_data, region);
+        }
+        free(region);
+        return NULL;
+    }
     return region;
 }
 
@@ -159,6 +277,9 @@ df_shm_region_t df_create_named_shm_region (df_shm_method_t method,
     assert(method->initialized == 1);
     assert(size > 0);
 
+    if(method->fixed_addr) {
+        starting_addr = NULL;
+    }
     df_shm_region_t region = (df_shm_region_t) malloc(sizeof(df_shm_region));
     if(!region) {
         fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
@@ -168,8 +289,13 @@ df_shm_region_t df_create_named_shm_region (df_shm_method_t method,
         int rc = (*method->create_named_region_func) (method->method_data, name, name_size, 
             size, starting_addr,(void **)&(region->method_data), (void **)&(region->starting_addr));
         if(rc) {
-            fprintf(stderr, "Error: method's create_region callback returns error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+            // with DF_SHM_FLAG_EXCL, an existing name is an answer rather than an error
+            int err = errno;
+            if(err != EEXIST) {
+                fprintf(stderr, "Error: method's create_region callback returns error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+            }
             free(region);
+            errno = err;
             return NULL;
         }
     }
@@ -180,8 +306,14 @@ df_shm_region_t df_create_named_shm_region (df_shm_method_t method,
     region->size = size;
     region->creator_id = getpid(); // the pid of the creator process
     region->shm_method = method;
-    add_region_to_list(&method->created_regions, region);
-    method->num_created_regions ++;
+    region->pool_size = 0;
+    if(add_region(method, region, 1) != 0) {
+        if(method->destroy_region_func) {
+            (*method->destroy_region_func) (method->method_data, region);
+        }
+        free(region);
+        return NULL;
+    }
     return region;
 }
 
@@ -210,6 +342,21 @@ void * df_shm_region_contact_info (df_shm_method_t method,
         fprintf(stderr, "Warning: method's region_contact_info callback is not registered. %s:%d\n",
             __FILE__, __LINE__);    
     }
+
+    // prepend the region's address so that peers attach it at the same address
+    if(contact_info && method->fixed_addr) {
+        char *info = (char *) malloc(sizeof(void *) + *length);
+        if(!info) {
+            fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+            free(contact_info);
+            return NULL;
+        }
+        memcpy(info, &region->starting_addr, sizeof(void *));
+        memcpy(info + sizeof(void *), contact_info, *length);
+        free(contact_info);
+        contact_info = info;
+        *length += sizeof(void *);
+    }
     return contact_info;
 }
 
@@ -233,6 +380,10 @@ df_shm_region_t df_attach_shm_region (df_shm_method_t method,
     assert(method->initialized == 1);
     assert(contact_info != NULL);    
 
+    if(method->fixed_addr) {
+        memcpy(&starting_addr, contact_info, sizeof(void *));
+        contact_info = (char *) contact_info + sizeof(void *);
+    }
     df_shm_region_t region = (df_shm_region_t) malloc(sizeof(df_shm_region));
     if(!region) {
         fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
@@ -255,9 +406,16 @@ df_shm_region_t df_attach_shm_region (df_shm_method_t method,
     region->size = size;
     region->creator_id = creator_id;
     region->shm_method = method;
-    add_region_to_list(&method->foreign_regions, region);
-    method->num_foreign_regions ++;
-    return region;    
+    region->pool_size = 0;
+    // a growable region may have grown past size since the contact info was made
+    if(refresh_region_size(method, region) != 0 || add_region(method, region, 0) != 0) {
+        if(method->detach_region_func) {
+            (*method->detach_region_func) (method->method_data, region);
+        }
+        free(region);
+        return NULL;
+    }
+    return region;
 }
 
 /*
@@ -275,30 +433,42 @@ df_shm_region_t df_attach_named_shm_region (df_shm_method_t method,
     assert(method->initialized == 1);
     assert(name != NULL);
 
+    if(method->fixed_addr && !starting_addr) {
+        fprintf(stderr, "Error: attaching a named region at a fixed address requires its address. %s:%d\n",
+            __FILE__, __LINE__);
+        return NULL;
+    }
     df_shm_region_t region = (df_shm_region_t) malloc(sizeof(df_shm_region));
     if(!region) {
         fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         return NULL;
     }
-    if(method->attach_region_func) {
-        int rc = (*method->attach_region_func) (method->method_data, name,
+    if(method->attach_named_region_func) {
+        int rc = (*method->attach_named_region_func) (method->method_data, name, name_size,
             size, starting_addr, (void *)&(region->method_data), (void **)&(region->starting_addr));
         if(rc) {
-            fprintf(stderr, "Error: method's attach_region callback returns error: %d. %s:%d\n",
+            fprintf(stderr, "Error: method's attach_named_region callback returns error: %d. %s:%d\n",
                 rc, __FILE__, __LINE__);
             free(region);
             return NULL;
         }
     }
     else {
-        fprintf(stderr, "Warning: method's attach_region callback is not registered. %s:%d\n",
+        fprintf(stderr, "Warning: method's attach_named_region callback is not registered. %s:%d\n",
             __FILE__, __LINE__);
     }
     region->size = size;
     region->creator_id = DF_SHM_UNKNOWN_PID;
     region->shm_method = method;
-    add_region_to_list(&method->foreign_regions, region);
-    method->num_foreign_regions ++;
+    region->pool_size = 0;
+    // a growable region may have grown past size since the contact info was made
+    if(refresh_region_size(method, region) != 0 || add_region(method, region, 0) != 0) {
+        if(method->detach_region_func) {
+            (*method->detach_region_func) (method->method_data, region);
+        }
+        free(region);
+        return NULL;
+    }
     return region;
 }
 
@@ -313,12 +483,14 @@ int df_detach_shm_region (df_shm_region_t region)
     assert(region->shm_method->initialized == 1);
     
     df_shm_method_t method = region->shm_method;
+    int creator = is_created_region(method, region);
     
     if(method->detach_region_func) {
         int rc = (*method->detach_region_func) (method->method_data, region);
         if(rc) {
             fprintf(stderr, "Error: method's detach_region callback returns error: %d. %s:%d\n", 
                 rc, __FILE__, __LINE__);
+            remove_region(method, region, creator);
             free(region);
             return -1;
         }
@@ -327,8 +499,7 @@ int df_detach_shm_region (df_shm_region_t region)
         fprintf(stderr, "Warning: method's detach_region callback is not registered. %s:%d\n", 
             __FILE__, __LINE__);    
     }
-    remove_region_from_list(&method->foreign_regions, region);    
-    method->num_foreign_regions --;    
+    remove_region(method, region, creator);
     free(region); // TODO:?
     return 0;
 }
@@ -349,7 +520,15 @@ int df_destroy_shm_region (df_shm_region_t region)
     
     df_shm_method_t method = region->shm_method;
     
-    if(region->creator_id == getpid()) { // the region is created by this process
+    // the region is created by this process through this handle; a child forked
+    // after the create inherits the handle in its created set but only detaches it
+    if(region->creator_id == getpid() && is_created_region(method, region)) {
+        remove_region(method, region, 1);
+        if(region->pool_size && method->region_pool &&
+           df_shm_region_pool_put(method->region_pool, region) == 0) {
+            // kept mapped for a later create of the same size class
+            return 0;
+        }
         if(method->destroy_region_func) {
             int rc = (*method->destroy_region_func) (method->method_data, region);
             if(rc) {
@@ -363,7 +542,6 @@ int df_destroy_shm_region (df_shm_region_t region)
             fprintf(stderr, "Warning: method's destroy_region callback is not registered. %s:%d\n", 
                 __FILE__, __LINE__);    
         }        
-        remove_region_from_list(&method->created_regions, region);
         free(region);
         return 0;
     }
@@ -372,6 +550,121 @@ int df_destroy_shm_region (df_shm_region_t region)
     }
 }
 
+/*
+ * Grow a region created by this process to new_size bytes in place. Return 0 on
+ * success and non-zero on error.
+ */
+int df_resize_shm_region (df_shm_region_t region, size_t new_size)
+{
+    assert(region != NULL);    
+    assert(region->shm_method != NULL);
+    assert(region->shm_method->initialized == 1);
+
+    df_shm_method_t method = region->shm_method;
+    if(region->creator_id != getpid()) {
+        fprintf(stderr, "Error: only the creator can resize a region. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    if(!method->resize_region_func) {
+        fprintf(stderr, "Error: method %d cannot resize regions. %s:%d\n", 
+            method->method, __FILE__, __LINE__);
+        return -1;
+    }
+    if(new_size <= region->size) {
+        return 0;
+    }
+    int rc = (*method->resize_region_func) (method->method_data, region, new_size);
+    if(rc) {
+        fprintf(stderr, "Error: method's resize_region callback returns error: %d. %s:%d\n", 
+            rc, __FILE__, __LINE__);
+        return -1;
+    }
+    pthread_rwlock_wrlock(&method->addr_index_lock);
+    region->size = new_size;
+    pthread_rwlock_unlock(&method->addr_index_lock);
+    return 0;
+}
+
+/*
+ * Bring the local mapping of a growable region up to date. Return the current size
+ * of the region or 0 on error.
+ */
+size_t df_refresh_shm_region (df_shm_region_t region)
+{
+    assert(region != NULL);    
+    assert(region->shm_method != NULL);
+    assert(region->shm_method->initialized == 1);
+
+    if(refresh_region_size(region->shm_method, region) != 0) {
+        return 0;
+    }
+    return region->size;
+}
+
+/*
+ * Report the effective NUMA placement of a shm region. Return 0 on success and 
+ * non-zero on error.
+ */
+int df_shm_region_placement (df_shm_region_t region, df_shm_placement_t placement)
+{
+    assert(region != NULL);
+    assert(placement != NULL);
+
+    return df_shm_query_placement(region->starting_addr, region->size, placement);
+}
+
+/*
+ * Find the shm region of method which contains the local address addr. Return NULL
+ * if addr is not in any region of method. The caller must make sure that the region
+ * is not destroyed or detached by another thread while using the returned handle.
+ */
+df_shm_region_t df_shm_lookup_addr (df_shm_method_t method, const void *addr, size_t *offset)
+{
+    assert(method != NULL);
+    assert(method->initialized == 1);
+
+    pthread_rwlock_rdlock(&method->addr_index_lock);
+    df_shm_region_t region = df_shm_addr_index_find(method->addr_index, addr);
+    pthread_rwlock_unlock(&method->addr_index_lock);
+    if(region && offset) {
+        *offset = ADDR2OFFSET(region, addr);
+    }
+    return region;
+}
+
+/*
+ * Enable recycling of regions of method which are kept mapped up to max_pooled_bytes.
+ * Return 0 on success and non-zero on error.
+ */
+int df_shm_enable_region_pool (df_shm_method_t method, size_t max_pooled_bytes)
+{
+    assert(method != NULL);
+    assert(method->initialized == 1);
+
+    if(method->region_pool) {
+        fprintf(stderr, "Error: region pool is already enabled. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    method->region_pool = df_shm_region_pool_create(method, max_pooled_bytes);
+    return method->region_pool? 0 : -1;
+}
+
+/*
+ * Let a background thread keep count regions of the size class of 'size' ready in
+ * the region pool of method. Return 0 on success and non-zero on error.
+ */
+int df_shm_prefill_region_pool (df_shm_method_t method, size_t size, int count)
+{
+    assert(method != NULL);
+    assert(method->initialized == 1);
+
+    if(!method->region_pool) {
+        fprintf(stderr, "Error: region pool is not enabled. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    return df_shm_region_pool_prefill(method->region_pool, size, count);
+}
+
 /*
  * Finalize function when finishing using the shared memory method. This function
  * performs various cleanups and free the method handle data structure. Return 0 
@@ -382,20 +675,34 @@ int df_shm_finalize (df_shm_method_t method)
     assert(method != NULL);
     assert(method->initialized == 1);
 
-    // make sure all regions are detached and destroyed
-    df_shm_region_t r, next;
-    r = method->created_regions;
-    while(r) {
-        next = r->next;
-        df_destroy_shm_region(r);
-        r = next;
+    // make sure all regions are detached and destroyed; no other thread may use
+    // the handle from now on
+    if(method->region_pool) {
+        df_shm_region_pool_destroy(method->region_pool);
+        method->region_pool = NULL;
     }
-    r = method->foreign_regions;
-    while(r) {
-        next = r->next;
-        df_detach_shm_region(r);
-        r = next;
+    int s;
+    for(s = 0; s < DF_SHM_REGION_SHARDS; s ++) {
+        df_shm_region_shard *shard = &method->shards[s];
+        size_t i, count;
+        pthread_mutex_lock(&shard->lock);
+        df_shm_region_t *regions = df_shm_region_set_list(&shard->created_regions, &count);
+        pthread_mutex_unlock(&shard->lock);
+        for(i = 0; i < count; i ++) {
+            df_destroy_shm_region(regions[i]);
+        }
+        free(regions);
+        pthread_mutex_lock(&shard->lock);
+        regions = df_shm_region_set_list(&shard->foreign_regions, &count);
+        pthread_mutex_unlock(&shard->lock);
+        for(i = 0; i < count; i ++) {
+            df_detach_shm_region(regions[i]);
+        }
+        free(regions);
+        pthread_mutex_destroy(&shard->lock);
     }
+    free_shards(method);
+    pthread_rwlock_destroy(&method->addr_index_lock);
     
     if(method->finalize_func) {
         int rc = (*method->finalize_func) (method->method_data);
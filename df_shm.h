@@ -6,7 +6,7 @@
  *
  * This header file provides an abstract interface to manipulate shared 
  * memory (create, attach, detach, destroy) on top of several underlying
- * shared memory mechanisms (SysV, mmap, POSIX shm). 
+ * shared memory mechanisms (SysV, mmap, POSIX shm, memfd, anonymous mappings). 
  *
  * written by Fang Zheng (fzheng@cc.gatech.edu)
  */
@@ -17,9 +17,12 @@ extern "C" {
  
 #include <unistd.h>
 #include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
     
 /* Macros */
 #define DF_SHM_UNKNOWN_PID ((pid_t) -1)
+#define DF_SHM_REGION_SHARDS 16     // number of independently locked region set shards
 
 /*
  * supported underlying shared memory method
@@ -28,9 +31,88 @@ enum DF_SHM_METHOD {
     DF_SHM_METHOD_MMAP = 0,      // shared memory backed up a mmap()-ed file
     DF_SHM_METHOD_SYSV = 1,      // System V shared memory
     DF_SHM_METHOD_POSIX_SHM = 2, // POSIX shared memory
+    DF_SHM_METHOD_MEMFD = 3,     // anonymous memfd_create() objects passed over Unix sockets
+    DF_SHM_METHOD_ANON = 4,      // MAP_SHARED | MAP_ANONYMOUS mappings shared between threads
+                                 // and with children forked after the region is created
     DF_SHM_NUM_METHODS 
 }; 
 
+/*
+ * flags of df_shm_config
+ */
+#define DF_SHM_FLAG_HUGEPAGE  0x1  // back regions with huge pages (hugetlbfs or SHM_HUGETLB);
+                                   // fall back to transparent huge pages if none are available
+#define DF_SHM_FLAG_POPULATE  0x2  // fault in all pages of a region when it is created or attached
+#define DF_SHM_FLAG_RESERVE   0x4  // allocate the backing pages of a file-backed region on creation;
+                                   // creation fails if memory is short instead of a later SIGBUS
+#define DF_SHM_FLAG_MLOCK     0x8  // lock the pages of a region in memory (subject to RLIMIT_MEMLOCK)
+#define DF_SHM_FLAG_SEAL      0x10 // seal the size of memfd regions so peers can rely on it
+#define DF_SHM_FLAG_TMPFILE   0x20 // back mmap regions with unlinked O_TMPFILE files in backing_dir,
+                                   // which have no name and are never written back
+#define DF_SHM_FLAG_FIXED_ADDR 0x40 // map regions at the same address in every process, inside a
+                                    // window of address space reserved by all processes (mmap, POSIX
+                                    // shm and memfd methods); attaching fails if the address is taken
+#define DF_SHM_FLAG_EXCL      0x80 // create named regions of the mmap and POSIX shm methods only if
+                                   // the name does not exist yet; otherwise creation fails with
+                                   // errno EEXIST instead of taking over the existing file or object
+
+#define DF_SHM_PATH_LENGTH 256
+#define DF_SHM_NAME_LENGTH 32
+
+/*
+ * NUMA placement policy of shm regions. The policy is applied to a region when it
+ * is created or attached, before any of its pages are faulted in. A policy set by 
+ * an attaching process governs pages which are not yet faulted in.
+ */
+enum DF_SHM_NUMA_POLICY {
+    DF_SHM_NUMA_DEFAULT = 0,     // no policy: pages land on the node of first touch
+    DF_SHM_NUMA_BIND = 1,        // allocate pages only on the nodes in numa_nodemask
+    DF_SHM_NUMA_INTERLEAVE = 2,  // interleave pages over the nodes in numa_nodemask
+    DF_SHM_NUMA_PREFERRED = 3,   // prefer the first node in numa_nodemask
+    DF_SHM_NUMA_LOCAL = 4        // prefer the node the calling process runs on; set by the 
+                                 // consumer on attach to place a queue on the consumer's node
+};
+
+/*
+ * configuration of a shm method handle, passed to df_shm_init() as method_init_data.
+ * Passing NULL selects the defaults (all fields zero). Fields left zero or empty
+ * take the default values noted below.
+ */
+typedef struct _df_shm_config {
+    int flags;                // bitwise OR of DF_SHM_FLAG_* values
+    size_t huge_page_size;    // huge page size in bytes; 0 means the system default
+    enum DF_SHM_NUMA_POLICY numa_policy; // placement policy of regions
+    unsigned long numa_nodemask;         // bit i set means NUMA node i
+    char backing_dir[DF_SHM_PATH_LENGTH]; // directory of mmap backing files and SysV key files;
+                                          // default is /dev/shm if it is a tmpfs, otherwise /tmp.
+                                          // A warning is printed if it is not memory-backed
+    mode_t mode;              // permissions of created files, shm objects and segments; default 0600
+    char name_prefix[DF_SHM_NAME_LENGTH]; // prefix of generated file and object names; default "df_shm"
+    size_t max_region_size;   // if non-zero, regions of the mmap, POSIX shm and memfd methods are
+                              // growable up to this size with df_resize_shm_region(); creator and
+                              // attachers must use the same value. Growable regions use normal
+                              // (or transparent huge) pages
+    void *fixed_window_base;  // start of the address window of DF_SHM_FLAG_FIXED_ADDR; all processes
+                              // must use the same window. Default 0x600000000000. Its allocator is
+                              // the POSIX shm object /<name_prefix>_window.<base in hex>, which
+                              // starts afresh once every process recorded in it has exited
+    size_t fixed_window_size; // size of the window in bytes; default 64 GB. Window space is not
+                              // reused, so recycle regions with the region pool
+} df_shm_config, *df_shm_config_t;
+
+#define DF_SHM_MAX_NUMA_NODES (8 * sizeof(unsigned long))
+
+/*
+ * effective NUMA placement of a shm region
+ */
+typedef struct _df_shm_placement {
+    enum DF_SHM_NUMA_POLICY policy;  // policy in effect for the region
+    unsigned long nodemask;          // nodes of the policy
+    size_t num_pages;                // number of (base) pages in the region
+    size_t resident_pages;           // number of pages faulted in
+    size_t pages_per_node[DF_SHM_MAX_NUMA_NODES]; // resident pages on each node
+} df_shm_placement, *df_shm_placement_t;
+
 //typedef struct _df_shm_region df_shm_region, *df_shm_region_t;
 /*
  * a shared memory region
@@ -41,9 +123,32 @@ typedef struct _df_shm_region {
     pid_t creator_id;    // the pid of process who created this region
     void *method_data;
     struct _df_shm_method *shm_method;
-    struct _df_shm_region *next;
+    struct _df_shm_region *same_addr_next; // other handles of the same mapping in the address index
+    size_t pool_size;    // size class the region was created with if it can be recycled; 0 otherwise
 } df_shm_region, *df_shm_region_t;
 
+/*
+ * set of shm regions: open addressing hash table keyed by region handle
+ */
+typedef struct _df_shm_region_set {
+    df_shm_region_t *slots;  // NULL means empty slot
+    size_t capacity;         // power of 2
+    size_t count;
+} df_shm_region_set;
+
+/*
+ * a shard of the regions of a method handle; a region goes to the shard picked
+ * by hashing its handle so that threads working on different regions rarely
+ * contend for the same lock
+ */
+typedef struct _df_shm_region_shard {
+    pthread_mutex_t lock;
+    df_shm_region_set created_regions;  // shm regions created by this process
+    df_shm_region_set foreign_regions;  // shm regions attached by this process
+} df_shm_region_shard;
+
+typedef struct _df_shm_region_pool *df_shm_region_pool_t;
+
 typedef int (* shm_method_init_func) (void *input_data, void **method_data);
 
 typedef int (* shm_method_create_region_func) (void *method_data, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
@@ -56,35 +161,50 @@ typedef int (* shm_method_destroy_region_func) (void *method_data, df_shm_region
  
 typedef int (* shm_method_attach_region_func) (void *method_data, void *contact_info, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
  
+typedef int (* shm_method_attach_named_region_func) (void *method_data, void *name, int name_size, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
+ 
 typedef int (* shm_method_detach_region_func) (void *method_data, df_shm_region_t region);
  
+typedef int (* shm_method_resize_region_func) (void *method_data, df_shm_region_t region, size_t new_size);
+
+typedef int (* shm_method_refresh_region_func) (void *method_data, df_shm_region_t region, size_t *size);
+
 typedef int (* shm_method_finalize_func) (void *method_data);
 
 /*
- * underlying shared memory method handle
+ * underlying shared memory method handle; regions can be created, attached,
+ * detached and destroyed by multiple threads concurrently through one handle
  */ 
 typedef struct _df_shm_method {
     enum DF_SHM_METHOD method;     
     int initialized;
     void *method_data;   // data private to this method
-    df_shm_region_t created_regions;  // NULL-terminated list of shm regions created by this process
-    int num_created_regions;
-    df_shm_region_t foreign_regions;  // NULL-terminated list of shm regions attached by this process
-    int num_foreign_regions;
+    df_shm_region_shard shards[DF_SHM_REGION_SHARDS];
+    int num_created_regions;   // updated atomically
+    int num_foreign_regions;   // updated atomically
+    pthread_rwlock_t addr_index_lock;
+    void *addr_index;    // tsearch() tree of all regions ordered by address
+    df_shm_region_pool_t region_pool;  // recycled regions; NULL if recycling is not enabled
+    int fixed_addr;      // DF_SHM_FLAG_FIXED_ADDR is set: contact info carries the region's address
+    df_shm_config config;  // configuration the handle was initialized with (zero for the defaults)
     shm_method_init_func init_func;
     shm_method_create_region_func create_region_func;
     shm_method_create_named_region_func create_named_region_func;
     shm_method_region_contact_info_func region_contact_func;
     shm_method_destroy_region_func destroy_region_func;
     shm_method_attach_region_func attach_region_func;
+    shm_method_attach_named_region_func attach_named_region_func;
     shm_method_detach_region_func detach_region_func;
+    shm_method_resize_region_func resize_region_func;    // NULL if regions cannot grow
+    shm_method_refresh_region_func refresh_region_func;  // NULL if regions cannot grow
     shm_method_finalize_func finalize_func;
 } df_shm_method, *df_shm_method_t;
 
 /*
  * Initialize specific underlying shared memory method and return a method
- * handle. This handle should be used in subsequent calls. If the return
- * value is NULL, then the call is failed.
+ * handle. This handle should be used in subsequent calls. method_init_data
+ * points to a df_shm_config or is NULL for default configuration. If the 
+ * return value is NULL, then the call is failed.
  */
 df_shm_method_t df_shm_init (enum DF_SHM_METHOD method, 
                              void *method_init_data
@@ -105,7 +225,8 @@ df_shm_region_t df_create_shm_region (df_shm_method_t method,
  * the underlying shm method will interpret the opaque 'name' object and create
  * the shared memory region. This is useful to create a shared memory region at
  * a "well-known" place so other processes can directly attach to it without need
- * to exchange the region's contact info.
+ * to exchange the region's contact info. With DF_SHM_FLAG_EXCL it returns NULL
+ * with errno EEXIST if the name is taken.
  */
 df_shm_region_t df_create_named_shm_region (df_shm_method_t method, 
                                             void *name, 
@@ -140,6 +261,8 @@ int df_destroy_shm_region (df_shm_region_t region);
  * Attach to a shared memory region which is created by some other process and can be 
  * located by contact_info. The underlying shm method will intepret contact_info.
  * starting_addr specified the local address to which the shm region should be attached.
+ * With DF_SHM_FLAG_FIXED_ADDR, the region is attached at the creator's address carried
+ * by contact_info and starting_addr is ignored.
  * Return a handle of shm_region if successful; otherwise return NULL.
  */ 
 df_shm_region_t df_attach_shm_region (df_shm_method_t method,  
@@ -151,7 +274,8 @@ df_shm_region_t df_attach_shm_region (df_shm_method_t method,
 
 /*
  * Attach to a named shared memory region which is usually created by some other 
- * process with df_create_named_shm_region() function. 
+ * process with df_create_named_shm_region() function. With DF_SHM_FLAG_FIXED_ADDR,
+ * starting_addr must be the address at which the creator mapped the region.
  */
 df_shm_region_t df_attach_named_shm_region (df_shm_method_t method,
                                             void *name,
@@ -166,6 +290,22 @@ df_shm_region_t df_attach_named_shm_region (df_shm_method_t method,
  */ 
 int df_detach_shm_region (df_shm_region_t region);
 
+/*
+ * Grow a region created by this process to new_size bytes in place: its starting
+ * address and all offsets into it stay valid. The method handle must be configured
+ * with max_region_size (mmap, POSIX shm and memfd methods) and new_size must not
+ * exceed it; sizes up to the current size are a no-op. Peers map the new part when
+ * they call df_refresh_shm_region(). Return 0 on success and non-zero on error.
+ */
+int df_resize_shm_region (df_shm_region_t region, size_t new_size);
+
+/*
+ * Bring the local mapping of a growable region up to date with resizes done by its
+ * creator and update region->size. This costs one load if the region has not grown
+ * since the last call. Return the current size of the region, or 0 on error.
+ */
+size_t df_refresh_shm_region (df_shm_region_t region);
+
 /*
  * Finalize function when finishing using the shared memory method. This function
  * performs various cleanups and free the method handle data structure. Return 0 
@@ -173,6 +313,39 @@ int df_detach_shm_region (df_shm_region_t region);
  */ 
 int df_shm_finalize (df_shm_method_t method);
 
+/*
+ * Report the effective NUMA placement of a shm region: the policy in effect and the 
+ * number of resident pages on each node. Return 0 on success and non-zero on error
+ * (e.g. NUMA is not supported).
+ */
+int df_shm_region_placement (df_shm_region_t region, df_shm_placement_t placement);
+
+/*
+ * Find the shm region of method which contains the local address addr and return 
+ * the offset of addr in the region in *offset (if offset is not NULL). Return NULL
+ * if addr is not in any region of method. The lookup takes O(log n) for n regions.
+ */
+df_shm_region_t df_shm_lookup_addr (df_shm_method_t method, const void *addr, size_t *offset);
+
+/*
+ * Enable recycling of regions of method. Regions created by df_create_shm_region()
+ * without a starting address are then created with their size rounded up to a
+ * power of 2 number of pages; when destroyed, they stay mapped (up to 
+ * max_pooled_bytes in total) and are handed back by later creates of the same
+ * size class, keeping their contact info. Recycled regions are NOT zeroed: they
+ * hold whatever their last user wrote, and peers must have detached them before
+ * they are destroyed. Call this before using method from multiple threads. Return
+ * 0 on success and non-zero on error.
+ */
+int df_shm_enable_region_pool (df_shm_method_t method, size_t max_pooled_bytes);
+
+/*
+ * Ask a background thread to create regions ahead of time so that count regions
+ * of the size class of 'size' are ready in the pool of method, within its byte
+ * limit. The call returns immediately. Return 0 on success and non-zero on error.
+ */
+int df_shm_prefill_region_pool (df_shm_method_t method, size_t size, int count);
+
 /*
  * convert a local virtual address to offset relative to the starting address of shm region
  */
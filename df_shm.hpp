@@ -0,0 +1,572 @@
+#ifndef _DF_SHM_HPP_
+#define _DF_SHM_HPP_
+/*
+ * DataFabrics shared memory transport for inter-process and inter-thread
+ * communication on mulitcore.
+ *
+ * This header file defines a header-only C++17 interface on top of the C API:
+ *   - df::method, df::region, df::queue and df::endpoint own the corresponding
+ *     handles and release them when they go out of scope;
+ *   - df::typed_queue<T, N> is a df_queue of N slots carrying one T each, whose
+ *     slot geometry is fixed at compile time so that sending and receiving are
+ *     inlined to direct slot accesses without size checks.
+ * Received messages and slots being filled are handed out as views; a view
+ * releases its slot to the peer (or publishes it) when it goes out of scope.
+ * Constructors throw std::runtime_error if the underlying C call fails (the C
+ * layer prints the details to stderr). A region must not outlive its method.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "df_shm.h"
+#include "df_shm_queue.h"
+
+#if __cplusplus > 201703L && defined(__has_include)
+#if __has_include(<span>)
+#include <span>
+#define DF_HAVE_STD_SPAN 1
+#endif
+#endif
+
+namespace df {
+
+#ifdef DF_HAVE_STD_SPAN
+using std::span;
+inline constexpr size_t dynamic_extent = std::dynamic_extent;
+#else
+inline constexpr size_t dynamic_extent = (size_t) -1;
+
+/*
+ * minimal stand-in for std::span (C++20) when it is not available
+ */
+template <class T, size_t Extent = dynamic_extent>
+class span {
+public:
+    typedef T element_type;
+
+    constexpr span (T *data, size_t size) noexcept : data_(data), size_(size) {}
+    constexpr T *data () const noexcept { return data_; }
+    constexpr size_t size () const noexcept { return Extent == dynamic_extent? size_ : Extent; }
+    constexpr size_t size_bytes () const noexcept { return size() * sizeof(T); }
+    constexpr bool empty () const noexcept { return size() == 0; }
+    constexpr T &operator[] (size_t i) const noexcept { return data_[i]; }
+    constexpr T *begin () const noexcept { return data_; }
+    constexpr T *end () const noexcept { return data_ + size(); }
+
+private:
+    T *data_;
+    size_t size_;
+};
+#endif
+
+class region;
+
+/*
+ * an initialized shm method (df_shm_init() / df_shm_finalize())
+ */
+class method {
+public:
+    explicit method (enum DF_SHM_METHOD type, const df_shm_config *config = nullptr)
+        : handle_(df_shm_init(type, (void *) config)) {
+        if(!handle_) {
+            throw std::runtime_error("df_shm_init() failed");
+        }
+    }
+    ~method () { reset(); }
+    method (method &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    method &operator= (method &&other) noexcept {
+        if(this != &other) {
+            reset();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    method (const method &) = delete;
+    method &operator= (const method &) = delete;
+
+    df_shm_method_t get () const noexcept { return handle_; }
+
+    void reset () noexcept {
+        if(handle_) {
+            df_shm_finalize(handle_);
+            handle_ = nullptr;
+        }
+    }
+
+    inline region create_region (size_t size, void *starting_addr = nullptr);
+    inline region attach_region (const std::vector<char> &contact_info, size_t size,
+                                 void *starting_addr = nullptr, pid_t creator_id = 0);
+
+private:
+    df_shm_method_t handle_;
+};
+
+/*
+ * a shm region created or attached by this process; destroyed (or detached) when
+ * the object goes out of scope
+ */
+class region {
+public:
+    region () noexcept : handle_(nullptr) {}
+    explicit region (df_shm_region_t handle) noexcept : handle_(handle) {}
+    ~region () { reset(); }
+    region (region &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    region &operator= (region &&other) noexcept {
+        if(this != &other) {
+            reset();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    region (const region &) = delete;
+    region &operator= (const region &) = delete;
+
+    df_shm_region_t get () const noexcept { return handle_; }
+    void *data () const noexcept { return handle_->starting_addr; }
+    size_t size () const noexcept { return handle_->size; }
+    explicit operator bool () const noexcept { return handle_ != nullptr; }
+
+    /*
+     * Return the contact info by which other processes attach the region.
+     */
+    std::vector<char> contact_info () const {
+        int length = 0;
+        void *info = df_shm_region_contact_info(handle_->shm_method, handle_, &length);
+        if(!info) {
+            throw std::runtime_error("df_shm_region_contact_info() failed");
+        }
+        std::vector<char> result((char *) info, (char *) info + length);
+        free(info);
+        return result;
+    }
+
+    df_shm_region_t release () noexcept { return std::exchange(handle_, nullptr); }
+    void reset () noexcept {
+        if(handle_) {
+            df_destroy_shm_region(handle_);
+            handle_ = nullptr;
+        }
+    }
+
+private:
+    df_shm_region_t handle_;
+};
+
+region method::create_region (size_t size, void *starting_addr)
+{
+    df_shm_region_t r = df_create_shm_region(handle_, size, starting_addr);
+    if(!r) {
+        throw std::runtime_error("df_create_shm_region() failed");
+    }
+    return region(r);
+}
+
+region method::attach_region (const std::vector<char> &contact_info, size_t size,
+                              void *starting_addr, pid_t creator_id)
+{
+    df_shm_region_t r = df_attach_shm_region(handle_, creator_id, (void *) contact_info.data(),
+        size, starting_addr);
+    if(!r) {
+        throw std::runtime_error("df_attach_shm_region() failed");
+    }
+    return region(r);
+}
+
+/*
+ * a received message of an untyped queue; the slot is released when the message
+ * goes out of scope
+ */
+class message {
+public:
+    message (df_queue_ep_t ep, void *data, size_t length) noexcept : ep_(ep), data_(data),
+        length_(length) {}
+    ~message () {
+        if(ep_) {
+            df_release(ep_);
+        }
+    }
+    message (message &&other) noexcept : ep_(std::exchange(other.ep_, nullptr)),
+        data_(other.data_), length_(other.length_) {}
+    message (const message &) = delete;
+    message &operator= (const message &) = delete;
+    message &operator= (message &&) = delete;
+
+    span<const char> bytes () const noexcept { return span<const char>((const char *) data_, length_); }
+    const void *data () const noexcept { return data_; }
+    size_t size () const noexcept { return length_; }
+
+private:
+    df_queue_ep_t ep_;
+    void *data_;
+    size_t length_;
+};
+
+/*
+ * a sender or receiver endpoint of an untyped queue
+ */
+class endpoint {
+public:
+    explicit endpoint (df_queue_ep_t ep) : ep_(ep) {
+        if(!ep_) {
+            throw std::runtime_error("cannot get queue endpoint");
+        }
+    }
+    ~endpoint () {
+        if(ep_) {
+            df_destroy_ep(ep_);
+        }
+    }
+    endpoint (endpoint &&other) noexcept : ep_(std::exchange(other.ep_, nullptr)) {}
+    endpoint (const endpoint &) = delete;
+    endpoint &operator= (const endpoint &) = delete;
+    endpoint &operator= (endpoint &&) = delete;
+
+    df_queue_ep_t get () const noexcept { return ep_; }
+
+    /*
+     * Send length bytes, waiting for an empty slot. Return false if the payload
+     * exceeds the queue's limit or the receiver is gone.
+     */
+    bool send (const void *data, size_t length) { return df_enqueue(ep_, (void *) data, length) == 0; }
+    bool try_send (const void *data, size_t length) { return df_try_enqueue(ep_, (void *) data, length) == 0; }
+
+    /*
+     * Wait for the next message. Throw std::runtime_error if the sender is gone.
+     */
+    message receive () {
+        void *data;
+        size_t length;
+        if(df_dequeue(ep_, &data, &length) != 0) {
+            throw std::runtime_error("queue sender is gone");
+        }
+        return message(ep_, data, length);
+    }
+
+private:
+    df_queue_ep_t ep_;
+};
+
+/*
+ * an untyped df_queue laid out at a given address, typically in a region
+ */
+class queue {
+public:
+    /*
+     * Return the number of bytes a queue of the given geometry occupies.
+     */
+    static size_t size_bytes (uint32_t num_slots, size_t max_payload_size) {
+        return df_calculate_queue_size(num_slots, max_payload_size);
+    }
+
+    /*
+     * Create a queue at addr; it is destroyed when the object goes out of scope.
+     */
+    static queue create (void *addr, uint32_t num_slots, size_t max_payload_size) {
+        df_queue_t q = df_create_queue(addr, num_slots, max_payload_size);
+        if(!q) {
+            throw std::runtime_error("df_create_queue() failed");
+        }
+        return queue(q, true);
+    }
+
+    /*
+     * Use a queue created at addr by another process.
+     */
+    static queue open (void *addr) noexcept { return queue((df_queue_t) addr, false); }
+
+    ~queue () {
+        if(owner_) {
+            df_destroy_queue(queue_);
+        }
+    }
+    queue (queue &&other) noexcept : queue_(other.queue_), owner_(std::exchange(other.owner_, false)) {}
+    queue (const queue &) = delete;
+    queue &operator= (const queue &) = delete;
+    queue &operator= (queue &&) = delete;
+
+    df_queue_t get () const noexcept { return queue_; }
+    endpoint sender () const { return endpoint(df_get_queue_sender_ep(queue_)); }
+    endpoint receiver () const { return endpoint(df_get_queue_receiver_ep(queue_)); }
+
+private:
+    queue (df_queue_t q, bool owner) noexcept : queue_(q), owner_(owner) {}
+
+    df_queue_t queue_;
+    bool owner_;
+};
+
+/*
+ * a df_queue of N slots each carrying one T. The layout is that of df_create_queue()
+ * with max_payload_size sizeof(T), but the slot geometry is a compile-time constant
+ * and endpoints keep no per-slot table, so send and receive are a few inlined loads
+ * and stores. Both ends must use the same typed_queue<T, N>.
+ */
+template <class T, uint32_t N>
+class typed_queue {
+    static_assert(std::is_trivially_copyable_v<T>, "queue payloads are copied as bytes");
+    static_assert(N > 0, "a queue needs at least one slot");
+    static_assert(sizeof(df_queue_slot) % alignof(T) == 0, "payload alignment exceeds slot header");
+
+public:
+    static constexpr size_t slot_size =
+        (sizeof(df_queue_slot) + sizeof(T) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    static constexpr size_t size_bytes = sizeof(df_queue) + N * slot_size;
+
+    /*
+     * Create the queue at addr (size_bytes bytes); it is destroyed when the object
+     * goes out of scope.
+     */
+    static typed_queue create (void *addr) {
+        df_queue_t q = df_create_queue(addr, N, sizeof(T));
+        if(!q || q->slot_size != slot_size) {
+            throw std::runtime_error("df_create_queue() failed");
+        }
+        return typed_queue(q, true);
+    }
+
+    /*
+     * Use a queue created at addr by another process. Throw std::runtime_error if
+     * its geometry is not that of this type.
+     */
+    static typed_queue open (void *addr) {
+        df_queue_t q = (df_queue_t) addr;
+        if(!q->initialized || q->max_num_slots != N || q->slot_size != slot_size) {
+            throw std::runtime_error("queue geometry does not match typed_queue");
+        }
+        return typed_queue(q, false);
+    }
+
+    ~typed_queue () {
+        if(owner_) {
+            df_destroy_queue(queue_);
+        }
+    }
+    typed_queue (typed_queue &&other) noexcept : queue_(other.queue_),
+        owner_(std::exchange(other.owner_, false)) {}
+    typed_queue (const typed_queue &) = delete;
+    typed_queue &operator= (const typed_queue &) = delete;
+    typed_queue &operator= (typed_queue &&) = delete;
+
+    df_queue_t get () const noexcept { return queue_; }
+
+    class sender;
+    class receiver;
+
+    /*
+     * a slot being filled by the sender; published to the receiver when the view
+     * goes out of scope
+     */
+    class write_view {
+    public:
+        ~write_view () {
+            if(sender_) {
+                sender_->publish_view(slot_);
+            }
+        }
+        write_view (write_view &&other) noexcept : sender_(std::exchange(other.sender_, nullptr)),
+            slot_(other.slot_) {}
+        write_view (const write_view &) = delete;
+        write_view &operator= (const write_view &) = delete;
+        write_view &operator= (write_view &&) = delete;
+
+        span<T, 1> value () const noexcept { return span<T, 1>(payload(slot_), 1); }
+        T &operator* () const noexcept { return *payload(slot_); }
+        T *operator-> () const noexcept { return payload(slot_); }
+
+    private:
+        friend class sender;
+        write_view (sender *s, df_queue_slot_t slot) noexcept : sender_(s), slot_(slot) {}
+        sender *sender_;
+        df_queue_slot_t slot_;
+    };
+
+    /*
+     * a received slot; released to the sender when the view goes out of scope
+     */
+    class read_view {
+    public:
+        ~read_view () {
+            if(receiver_) {
+                receiver_->release_view(slot_);
+            }
+        }
+        read_view (read_view &&other) noexcept : receiver_(std::exchange(other.receiver_, nullptr)),
+            slot_(other.slot_) {}
+        read_view (const read_view &) = delete;
+        read_view &operator= (const read_view &) = delete;
+        read_view &operator= (read_view &&) = delete;
+
+        span<const T, 1> value () const noexcept { return span<const T, 1>(payload(slot_), 1); }
+        const T &operator* () const noexcept { return *payload(slot_); }
+        const T *operator-> () const noexcept { return payload(slot_); }
+
+    private:
+        friend class receiver;
+        read_view (receiver *r, df_queue_slot_t slot) noexcept : receiver_(r), slot_(slot) {}
+        receiver *receiver_;
+        df_queue_slot_t slot_;
+    };
+
+    /*
+     * the sending end; only one thread may use it at a time. The next slot is taken
+     * when a view is handed out, so several views may be filled at once; each must
+     * be published before the sender comes round the ring (N slots) to its slot again.
+     */
+    class sender {
+    public:
+        explicit sender (const typed_queue &q) noexcept : slots_(q.queue_->slots), index_(0),
+            views_(0) {}
+
+        /*
+         * Wait for an empty slot and return a view to fill it in place.
+         */
+        write_view prepare () noexcept {
+            assert(views_ < N);
+            df_queue_slot_t slot = current();
+            while(__atomic_load_n(&slot->status, __ATOMIC_ACQUIRE) != SLOT_EMPTY) { }
+            advance();
+            views_ ++;
+            return write_view(this, slot);
+        }
+
+        /*
+         * Copy value into the next slot, waiting for it to be empty.
+         */
+        void send (const T &value) noexcept {
+            df_queue_slot_t slot = current();
+            while(__atomic_load_n(&slot->status, __ATOMIC_ACQUIRE) != SLOT_EMPTY) { }
+            memcpy(slot->data, &value, sizeof(T));
+            publish(slot);
+            advance();
+        }
+
+        /*
+         * Copy value into the next slot if it is empty. Return false if it is not.
+         */
+        bool try_send (const T &value) noexcept {
+            df_queue_slot_t slot = current();
+            if(__atomic_load_n(&slot->status, __ATOMIC_ACQUIRE) != SLOT_EMPTY) {
+                return false;
+            }
+            memcpy(slot->data, &value, sizeof(T));
+            publish(slot);
+            advance();
+            return true;
+        }
+
+    private:
+        friend class write_view;
+        df_queue_slot_t current () const noexcept {
+            return (df_queue_slot_t) (slots_ + index_ * slot_size);
+        }
+        void advance () noexcept {
+            index_ = index_ + 1 == N? 0 : index_ + 1;
+        }
+        void publish (df_queue_slot_t slot) noexcept {
+            slot->size = sizeof(T);
+            // release ordering publishes the payload with the status
+            __atomic_store_n(&slot->status, SLOT_FULL, __ATOMIC_RELEASE);
+        }
+        void publish_view (df_queue_slot_t slot) noexcept {
+            publish(slot);
+            views_ --;
+        }
+
+        char *slots_;
+        uint32_t index_;
+        uint32_t views_; // write views alive
+    };
+
+    /*
+     * the receiving end; only one thread may use it at a time. As with the sender,
+     * several views may be alive at once, and each must be released before the
+     * receiver comes round the ring to its slot again.
+     */
+    class receiver {
+    public:
+        explicit receiver (const typed_queue &q) noexcept : slots_(q.queue_->slots), index_(0),
+            views_(0) {}
+
+        /*
+         * Wait for the next message and return a view of it in place.
+         */
+        read_view receive () noexcept {
+            assert(views_ < N);
+            df_queue_slot_t slot = current();
+            while(__atomic_load_n(&slot->status, __ATOMIC_ACQUIRE) != SLOT_FULL) { }
+            advance();
+            views_ ++;
+            return read_view(this, slot);
+        }
+
+        /*
+         * Wait for the next message and return a copy of it.
+         */
+        T receive_copy () noexcept {
+            df_queue_slot_t slot = current();
+            while(__atomic_load_n(&slot->status, __ATOMIC_ACQUIRE) != SLOT_FULL) { }
+            T value;
+            memcpy(&value, slot->data, sizeof(T));
+            release(slot);
+            advance();
+            return value;
+        }
+
+        /*
+         * Copy the next message into *value if there is one. Return false if there
+         * is none.
+         */
+        bool try_receive (T *value) noexcept {
+            df_queue_slot_t slot = current();
+            if(__atomic_load_n(&slot->status, __ATOMIC_ACQUIRE) != SLOT_FULL) {
+                return false;
+            }
+            memcpy(value, slot->data, sizeof(T));
+            release(slot);
+            advance();
+            return true;
+        }
+
+    private:
+        friend class read_view;
+        df_queue_slot_t current () const noexcept {
+            return (df_queue_slot_t) (slots_ + index_ * slot_size);
+        }
+        void advance () noexcept {
+            index_ = index_ + 1 == N? 0 : index_ + 1;
+        }
+        void release (df_queue_slot_t slot) noexcept {
+            // release ordering keeps our reads of the payload before the status
+            __atomic_store_n(&slot->status, SLOT_EMPTY, __ATOMIC_RELEASE);
+        }
+        void release_view (df_queue_slot_t slot) noexcept {
+            release(slot);
+            views_ --;
+        }
+
+        char *slots_;
+        uint32_t index_;
+        uint32_t views_; // read views alive
+    };
+
+    sender make_sender () const noexcept { return sender(*this); }
+    receiver make_receiver () const noexcept { return receiver(*this); }
+
+private:
+    typed_queue (df_queue_t q, bool owner) noexcept : queue_(q), owner_(owner) {}
+
+    static T *payload (df_queue_slot_t slot) noexcept { return (T *) (void *) slot->data; }
+
+    df_queue_t queue_;
+    bool owner_;
+};
+
+} // namespace df
+
+#endif
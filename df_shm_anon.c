@@ -0,0 +1,449 @@
+/*
+ * Anonymous shared mapping method
+ *
+ * Regions are MAP_SHARED | MAP_ANONYMOUS mappings: there is no file, key or name
+ * behind them, so they can only be shared between threads of a process and with
+ * children forked after the region is created, which inherit the mapping. Regions
+ * are kept in a process-wide table indexed by region id; the table is inherited
+ * by forked children as well, so attach is a constant-time lookup of the id in
+ * the contact info. Entries of unmapped regions are reused; a generation number
+ * in the contact info tells a region from an earlier one with the same id.
+ *
+ * An entry counts the handles of one process only. A forked child inherits the
+ * handles of its parent along with the table, but these do not keep the mapping
+ * in the child: the child's count starts when it first attaches the region, and
+ * the child unmaps it when it detaches its last own handle.
+ *
+ */
+#include "df_config.h"
+
+#ifdef HAVE_MMAP
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "df_shm.h"
+#include "df_shm_mapping.h"
+
+#define INITIAL_TABLE_SIZE 64
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+/*
+ * an entry of the process-wide region table
+ */
+typedef struct _anon_entry {
+    void *addr;        // NULL if the entry is unused
+    size_t length;
+    size_t page_size;
+    pid_t creator_pid;
+    uint64_t generation; // bumped each time the entry is used for a new region
+    char *name;        // name of a named region or NULL
+    pid_t owner_pid;   // process whose handles refs counts
+    int refs;          // handles of owner_pid; unmapped when it drops to 0
+    int destroyed;     // set once the creator destroyed the region
+    uint64_t next_free; // next unused entry if this one is unused
+} anon_entry, *anon_entry_t;
+
+#define NO_FREE_ENTRY UINT64_MAX
+
+static pthread_mutex_t anon_lock = PTHREAD_MUTEX_INITIALIZER;
+static anon_entry_t anon_table = NULL;
+static uint64_t anon_table_size = 0;
+static uint64_t anon_next_id = 0;  // entries from here on have never been used
+static uint64_t anon_free_head = NO_FREE_ENTRY;  // list of unused entries below anon_next_id
+
+/*
+ * global method level bookkeeping data
+ */
+typedef struct _shm_anon_method_data {
+    df_shm_config config;
+    size_t huge_page_size;  // 0 if huge pages are not used
+    pid_t my_pid;
+} shm_anon_method_data, *shm_anon_method_data_t;
+
+/*
+ * per-region data
+ */
+typedef struct _shm_anon_region_data {
+    uint64_t id;        // index into the region table
+    pid_t pid;          // process which took the handle's reference
+    uint64_t generation; // generation of the entry when the handle was made
+    void *attach_addr;
+    size_t mapped_length;
+} shm_anon_region_data, *shm_anon_region_data_t;
+
+/*
+ * contact info of an anonymous region
+ */
+typedef struct _anon_contact {
+    pid_t creator_pid;
+    uint64_t id;
+    uint64_t generation;
+} anon_contact;
+
+int df_shm_method_anon_init (void *input_data, void **method_data)
+{
+    shm_anon_method_data_t m_data = (shm_anon_method_data_t)
+        malloc(sizeof(shm_anon_method_data));
+    if(!m_data) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    df_shm_load_config(&m_data->config, input_data);
+    m_data->my_pid = getpid();
+    m_data->huge_page_size = 0;
+    if(m_data->config.flags & DF_SHM_FLAG_HUGEPAGE) {
+        m_data->huge_page_size = df_shm_huge_page_size(&m_data->config);
+    }
+    *method_data = m_data;
+    return 0;
+}
+
+/*
+ * Map an anonymous shared range of 'size' bytes in pages of page_size.
+ * Return MAP_FAILED on error.
+ */
+static void *anon_map (size_t size, size_t page_size, void *starting_addr)
+{
+    int flags = MAP_SHARED | MAP_ANONYMOUS;
+    if(page_size > PAGE_SIZE) {
+        flags |= MAP_HUGETLB | (__builtin_ctzl(page_size) << MAP_HUGE_SHIFT);
+    }
+    void *addr = mmap(starting_addr, df_shm_round_size(size, page_size),
+        PROT_READ | PROT_WRITE, flags, -1, 0);
+    if(addr == MAP_FAILED) {
+        fprintf(stderr, "Error: mmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+    }
+    else if(starting_addr != NULL && addr != starting_addr) {
+        fprintf(stderr, "Warning: shared memory region attached to %p instead of %p. %s:%d\n",
+            addr, starting_addr, __FILE__, __LINE__);
+    }
+    return addr;
+}
+
+/*
+ * Add a mapped region to the table. Return its id or -1 on error, and its
+ * generation in *generation.
+ */
+static int64_t anon_register (void *addr, size_t length, size_t page_size, const char *name,
+                              uint64_t *generation)
+{
+    pthread_mutex_lock(&anon_lock);
+    uint64_t id = anon_free_head;
+    if(id != NO_FREE_ENTRY) {
+        anon_free_head = anon_table[id].next_free;
+    }
+    else if(anon_next_id == anon_table_size) {
+        uint64_t new_size = anon_table_size? 2 * anon_table_size : INITIAL_TABLE_SIZE;
+        anon_entry_t new_table = (anon_entry_t) realloc(anon_table, new_size * sizeof(anon_entry));
+        if(!new_table) {
+            pthread_mutex_unlock(&anon_lock);
+            fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+            return -1;
+        }
+        memset(new_table + anon_table_size, 0, (new_size - anon_table_size) * sizeof(anon_entry));
+        anon_table = new_table;
+        anon_table_size = new_size;
+    }
+    if(id == NO_FREE_ENTRY) {
+        id = anon_next_id ++;
+    }
+    anon_entry_t e = &anon_table[id];
+    e->addr = addr;
+    e->length = length;
+    e->page_size = page_size;
+    e->creator_pid = getpid();
+    e->generation ++;
+    e->name = name? strdup(name) : NULL;
+    e->owner_pid = e->creator_pid;
+    e->refs = 1;
+    e->destroyed = 0;
+    *generation = e->generation;
+    pthread_mutex_unlock(&anon_lock);
+    return (int64_t) id;
+}
+
+/*
+ * Drop the reference of a handle and unmap the region after the last one of this
+ * process. A handle inherited from the parent holds no reference here. Called
+ * with anon_lock held. Return 0 on success and -1 on error.
+ */
+static int anon_release (shm_anon_region_data_t region_data)
+{
+    anon_entry_t e = &anon_table[region_data->id];
+    if(region_data->pid != getpid() || -- e->refs > 0) {
+        return 0;
+    }
+    void *addr = e->addr;
+    size_t length = e->length;
+    free(e->name);
+    e->name = NULL;
+    e->addr = NULL;
+    e->next_free = anon_free_head;
+    anon_free_head = region_data->id;
+    if(munmap(addr, length) == -1) {
+        fprintf(stderr, "Error: munmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+        return -1;
+    }
+    return 0;
+}
+
+static int anon_create (shm_anon_method_data_t m_data,
+                        const char *name,
+                        size_t size,
+                        void *starting_addr,
+                        void **return_data,
+                        void **attach_address
+                       )
+{
+    shm_anon_region_data_t region_data = (shm_anon_region_data_t)
+        malloc(sizeof(shm_anon_region_data));
+    if(!region_data) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    size_t page_size = PAGE_SIZE;
+    void *addr = MAP_FAILED;
+    if(m_data->huge_page_size > PAGE_SIZE) {
+        // mapping fails if there are not enough free huge pages
+        addr = anon_map(size, m_data->huge_page_size, starting_addr);
+        if(addr == MAP_FAILED) {
+            fprintf(stderr, "Warning: cannot create region of %lu bytes in huge pages; "
+                "using transparent huge pages. %s:%d\n", size, __FILE__, __LINE__);
+        }
+        else {
+            page_size = m_data->huge_page_size;
+        }
+    }
+    if(addr == MAP_FAILED) {
+        addr = anon_map(size, PAGE_SIZE, starting_addr);
+    }
+    if(addr == MAP_FAILED) {
+        free(region_data);
+        return -1;
+    }
+    size_t length = df_shm_round_size(size, page_size);
+
+    int64_t id = anon_register(addr, length, page_size, name, &region_data->generation);
+    if(id < 0) {
+        munmap(addr, length);
+        free(region_data);
+        return -1;
+    }
+    region_data->id = (uint64_t) id;
+    region_data->pid = getpid();
+    region_data->attach_addr = addr;
+    region_data->mapped_length = length;
+    df_shm_advise_mapping(&m_data->config, addr, length, page_size);
+
+    *return_data = region_data;
+    *attach_address = addr;
+    return 0;
+}
+
+int df_shm_method_anon_create_region (void *method_data,
+                                      size_t size,
+                                      void *starting_addr,
+                                      void **return_data,
+                                      void **attach_address
+                                     )
+{
+    shm_anon_method_data_t m_data = (shm_anon_method_data_t) method_data;
+
+    return anon_create(m_data, NULL, size, starting_addr, return_data, attach_address);
+}
+
+/*
+ * Create a shm region which can be attached by 'name' (a string) within this
+ * process and its children forked afterwards.
+ */
+int df_shm_method_anon_create_named_region (void *method_data,
+                                            void *name,
+                                            int name_size,
+                                            size_t size,
+                                            void *starting_addr,
+                                            void **return_data,
+                                            void **attach_address
+                                           )
+{
+    shm_anon_method_data_t m_data = (shm_anon_method_data_t) method_data;
+
+    return anon_create(m_data, (const char *) name, size, starting_addr, return_data,
+        attach_address);
+}
+
+void * df_shm_method_anon_region_contact (void *method_data, df_shm_region_t region, int *length)
+{
+    shm_anon_region_data_t region_data = (shm_anon_region_data_t) region->method_data;
+
+    anon_contact *contact = (anon_contact *) malloc(sizeof(anon_contact));
+    if(!contact) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return NULL;
+    }
+    contact->creator_pid = region->creator_id;
+    contact->id = region_data->id;
+    contact->generation = region_data->generation;
+    *length = sizeof(anon_contact);
+    return contact;
+}
+
+/*
+ * Destroy a region. Its memory is unmapped once all handles attached in this
+ * process are detached as well.
+ */
+int df_shm_method_anon_destroy_region (void *method_data, df_shm_region_t region)
+{
+    shm_anon_region_data_t region_data = (shm_anon_region_data_t) region->method_data;
+
+    pthread_mutex_lock(&anon_lock);
+    anon_table[region_data->id].destroyed = 1;
+    int rc = anon_release(region_data);
+    pthread_mutex_unlock(&anon_lock);
+    if(rc == 0) {
+        free(region_data);
+    }
+    return rc;
+}
+
+/*
+ * Take a reference to table entry id. Called with anon_lock held.
+ */
+static int anon_attach_entry (shm_anon_method_data_t m_data,
+                              uint64_t id,
+                              size_t size,
+                              void *starting_addr,
+                              void **return_data,
+                              void **attach_address
+                             )
+{
+    anon_entry_t e = &anon_table[id];
+    if(size > e->length) {
+        fprintf(stderr, "Error: region has %lu bytes; cannot attach %lu bytes. %s:%d\n",
+            e->length, size, __FILE__, __LINE__);
+        return -1;
+    }
+    if(starting_addr != NULL && starting_addr != e->addr) {
+        fprintf(stderr, "Warning: shared memory region attached to %p instead of %p. %s:%d\n",
+            e->addr, starting_addr, __FILE__, __LINE__);
+    }
+    shm_anon_region_data_t region_data = (shm_anon_region_data_t)
+        malloc(sizeof(shm_anon_region_data));
+    if(!region_data) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    // the first reference in a forked child starts the child's own count
+    pid_t pid = getpid();
+    if(e->owner_pid != pid) {
+        e->owner_pid = pid;
+        e->refs = 0;
+    }
+    e->refs ++;
+    region_data->id = id;
+    region_data->pid = pid;
+    region_data->generation = e->generation;
+    region_data->attach_addr = e->addr;
+    region_data->mapped_length = e->length;
+
+    *return_data = region_data;
+    *attach_address = e->addr;
+    return 0;
+}
+
+/*
+ * Attach a region created by this process or, before this process was forked,
+ * by one of its ancestors.
+ */
+int df_shm_method_anon_attach_region (void *method_data,
+                                      void *contact_info,
+                                      size_t size,
+                                      void *starting_addr,
+                                      void **return_data,
+                                      void **attach_address
+                                     )
+{
+    shm_anon_method_data_t m_data = (shm_anon_method_data_t) method_data;
+    anon_contact contact;
+    memcpy(&contact, contact_info, sizeof(anon_contact));
+
+    pthread_mutex_lock(&anon_lock);
+    int rc = -1;
+    if(contact.id < anon_next_id && anon_table[contact.id].addr != NULL &&
+       !anon_table[contact.id].destroyed &&
+       anon_table[contact.id].creator_pid == contact.creator_pid &&
+       anon_table[contact.id].generation == contact.generation) {
+        rc = anon_attach_entry(m_data, contact.id, size, starting_addr, return_data,
+            attach_address);
+    }
+    else {
+        fprintf(stderr, "Error: region %lu of process %d is not mapped in this process. %s:%d\n",
+            contact.id, contact.creator_pid, __FILE__, __LINE__);
+    }
+    pthread_mutex_unlock(&anon_lock);
+    return rc;
+}
+
+/*
+ * Attach a region by the name it was created with.
+ */
+int df_shm_method_anon_attach_named_region (void *method_data,
+                                            void *name,
+                                            int name_size,
+                                            size_t size,
+                                            void *starting_addr,
+                                            void **return_data,
+                                            void **attach_address
+                                           )
+{
+    shm_anon_method_data_t m_data = (shm_anon_method_data_t) method_data;
+
+    pthread_mutex_lock(&anon_lock);
+    int rc = -1;
+    uint64_t id;
+    for(id = 0; id < anon_next_id; id ++) {
+        anon_entry_t e = &anon_table[id];
+        if(e->addr != NULL && !e->destroyed && e->name && !strcmp(e->name, (char *) name)) {
+            rc = anon_attach_entry(m_data, id, size, starting_addr, return_data, attach_address);
+            break;
+        }
+    }
+    if(id == anon_next_id) {
+        fprintf(stderr, "Error: no region named %s in this process. %s:%d\n",
+            (char *) name, __FILE__, __LINE__);
+    }
+    pthread_mutex_unlock(&anon_lock);
+    return rc;
+}
+
+int df_shm_method_anon_detach_region (void *method_data, df_shm_region_t region)
+{
+    shm_anon_region_data_t region_data = (shm_anon_region_data_t) region->method_data;
+
+    pthread_mutex_lock(&anon_lock);
+    int rc = anon_release(region_data);
+    pthread_mutex_unlock(&anon_lock);
+    if(rc == 0) {
+        free(region_data);
+    }
+    return rc;
+}
+
+int df_shm_method_anon_finalize (void *method_data)
+{
+    shm_anon_method_data_t m_data = (shm_anon_method_data_t) method_data;
+    free(m_data);
+    return 0;
+}
+
+#endif /* HAVE_MMAP */
@@ -0,0 +1,392 @@
+/*
+ * DataFabrics shared memory transport for inter-process and inter-thread
+ * communication on mulitcore.
+ *
+ * This file implements the bootstrap service. The hub listens at the abstract
+ * socket "\0<name>" only while processes register; every process then listens at
+ * "\0<name>.<session>.<rank>" for point-to-point connections, where session is the
+ * hub's pid so that groups which reuse a name do not mix. Abstract sockets leave
+ * nothing in the file system and disappear with the processes.
+ */
+
+#define _GNU_SOURCE // accept4()
+#include "df_config.h"
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "df_shm_bootstrap.h"
+
+/*
+ * registration request of a process and the hub's reply
+ */
+typedef struct _bootstrap_hello {
+    int32_t size;
+    int32_t pid;
+} bootstrap_hello;
+
+typedef struct _bootstrap_welcome {
+    int32_t rank;
+    int32_t session;
+} bootstrap_welcome;
+
+/*
+ * Fill in the abstract socket address "\0<name>" or "\0<name>.<session>.<rank>"
+ * (if rank >= 0) and return its length.
+ */
+static socklen_t make_address (struct sockaddr_un *addr, const char *name, pid_t session, int rank)
+{
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    int n;
+    if(rank < 0) {
+        n = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, "%s", name);
+    }
+    else {
+        n = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, "%s.%d.%d", name, session, rank);
+    }
+    return offsetof(struct sockaddr_un, sun_path) + 1 + n;
+}
+
+static int write_full (int fd, const void *data, size_t length)
+{
+    const char *p = (const char *) data;
+    while(length > 0) {
+        ssize_t n = send(fd, p, length, MSG_NOSIGNAL);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        length -= n;
+    }
+    return 0;
+}
+
+static int read_full (int fd, void *data, size_t length)
+{
+    char *p = (char *) data;
+    while(length > 0) {
+        ssize_t n = recv(fd, p, length, MSG_WAITALL);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        if(n == 0) {
+            // the other process has gone
+            return -1;
+        }
+        p += n;
+        length -= n;
+    }
+    return 0;
+}
+
+static double now ()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Create a socket listening at "\0<name>.<session>.<rank>" for point-to-point
+ * connections. Return the socket or -1 on error.
+ */
+static int listen_p2p (df_bootstrap_t b)
+{
+    struct sockaddr_un addr;
+    socklen_t addr_length = make_address(&addr, b->name, b->session, b->rank);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0 || bind(fd, (struct sockaddr *) &addr, addr_length) != 0 || listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Error: cannot listen at %s.%d.%d (errno %d). %s:%d\n", b->name,
+            b->session, b->rank, errno, __FILE__, __LINE__);
+        if(fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Accept the other processes as the hub. Return 0 on success and -1 on error.
+ */
+static int register_members (df_bootstrap_t b, int hub_listen_fd, double deadline)
+{
+    int i;
+    for(i = 1; i < b->size; i ++) {
+        struct pollfd pfd = { hub_listen_fd, POLLIN, 0 };
+        int timeout = (int) ((deadline - now()) * 1000);
+        if(timeout <= 0 || poll(&pfd, 1, timeout) != 1) {
+            fprintf(stderr, "Error: %d of %d processes joined %s in time. %s:%d\n", i, b->size,
+                b->name, __FILE__, __LINE__);
+            return -1;
+        }
+        int fd = accept4(hub_listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if(fd < 0) {
+            fprintf(stderr, "Error: accept() failed (errno %d). %s:%d\n", errno, __FILE__, __LINE__);
+            return -1;
+        }
+        b->member_fds[i] = fd;
+        bootstrap_hello hello;
+        if(read_full(fd, &hello, sizeof(hello)) != 0 || hello.size != b->size) {
+            fprintf(stderr, "Error: process %d joined %s with a group size of %d instead of %d. %s:%d\n",
+                hello.pid, b->name, hello.size, b->size, __FILE__, __LINE__);
+            return -1;
+        }
+        bootstrap_welcome welcome = { i, b->session };
+        if(write_full(fd, &welcome, sizeof(welcome)) != 0) {
+            fprintf(stderr, "Error: cannot reply to process %d. %s:%d\n", hello.pid, __FILE__, __LINE__);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Register with the hub through connection fd. Return 0 on success and -1 on error.
+ */
+static int register_with_hub (df_bootstrap_t b, int fd)
+{
+    bootstrap_hello hello = { b->size, getpid() };
+    bootstrap_welcome welcome;
+    if(write_full(fd, &hello, sizeof(hello)) != 0 || read_full(fd, &welcome, sizeof(welcome)) != 0) {
+        fprintf(stderr, "Error: cannot register at %s. %s:%d\n", b->name, __FILE__, __LINE__);
+        return -1;
+    }
+    b->hub_fd = fd;
+    b->rank = welcome.rank;
+    b->session = welcome.session;
+    return 0;
+}
+
+df_bootstrap_t df_bootstrap_init (const char *name, int size)
+{
+    if(!name) {
+        name = getenv("DF_BOOTSTRAP_NAME");
+        if(!name) {
+            name = DF_BOOTSTRAP_DEFAULT_NAME;
+        }
+    }
+    if(size <= 0 && getenv("DF_BOOTSTRAP_SIZE")) {
+        size = atoi(getenv("DF_BOOTSTRAP_SIZE"));
+    }
+    if(size <= 0) {
+        fprintf(stderr, "Error: bootstrap group size is not set. %s:%d\n", __FILE__, __LINE__);
+        return NULL;
+    }
+    if(strlen(name) + 24 >= DF_BOOTSTRAP_NAME_LENGTH) {
+        fprintf(stderr, "Error: rendezvous name %s is too long. %s:%d\n", name, __FILE__, __LINE__);
+        return NULL;
+    }
+
+    df_bootstrap_t b = (df_bootstrap_t) calloc(1, sizeof(df_bootstrap));
+    int *fds = (int *) malloc(3 * size * sizeof(int));
+    if(!b || !fds) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        free(b);
+        free(fds);
+        return NULL;
+    }
+    int i;
+    for(i = 0; i < 3 * size; i ++) {
+        fds[i] = -1;
+    }
+    strcpy(b->name, name);
+    b->size = size;
+    b->listen_fd = -1;
+    b->hub_fd = -1;
+    b->member_fds = fds;
+    b->out_fds = fds + size;
+    b->in_fds = fds + 2 * size;
+
+    // whoever binds the rendezvous address first is the hub; the others connect to it
+    struct sockaddr_un addr;
+    socklen_t addr_length = make_address(&addr, name, 0, -1);
+    double deadline = now() + DF_BOOTSTRAP_TIMEOUT;
+    int rc = -1;
+    while(now() < deadline) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd < 0) {
+            fprintf(stderr, "Error: socket() failed (errno %d). %s:%d\n", errno, __FILE__, __LINE__);
+            break;
+        }
+        if(bind(fd, (struct sockaddr *) &addr, addr_length) == 0) {
+            b->rank = 0;
+            b->session = getpid();
+            if(listen(fd, SOMAXCONN) == 0 && (b->listen_fd = listen_p2p(b)) >= 0) {
+                rc = register_members(b, fd, deadline);
+            }
+            // free the rendezvous name for the next group
+            close(fd);
+            break;
+        }
+        if(connect(fd, (struct sockaddr *) &addr, addr_length) == 0) {
+            rc = register_with_hub(b, fd);
+            if(rc == 0 && (b->listen_fd = listen_p2p(b)) < 0) {
+                rc = -1;
+            }
+            break;
+        }
+        // the hub is between bind() and listen(), or has just closed the rendezvous socket
+        close(fd);
+        usleep(1000);
+    }
+
+    // nobody sends point-to-point before everyone listens
+    if(rc == 0) {
+        rc = df_bootstrap_barrier(b);
+    }
+    else if(now() >= deadline) {
+        fprintf(stderr, "Error: cannot join %s in time. %s:%d\n", name, __FILE__, __LINE__);
+    }
+    if(rc != 0) {
+        df_bootstrap_finalize(b);
+        return NULL;
+    }
+    return b;
+}
+
+int df_bootstrap_finalize (df_bootstrap_t b)
+{
+    int i;
+    for(i = 0; i < 3 * b->size; i ++) {
+        if(b->member_fds[i] >= 0) {
+            close(b->member_fds[i]);
+        }
+    }
+    if(b->listen_fd >= 0) {
+        close(b->listen_fd);
+    }
+    if(b->hub_fd >= 0) {
+        close(b->hub_fd);
+    }
+    free(b->member_fds);
+    free(b);
+    return 0;
+}
+
+int df_bootstrap_rank (df_bootstrap_t b)
+{
+    return b->rank;
+}
+
+int df_bootstrap_size (df_bootstrap_t b)
+{
+    return b->size;
+}
+
+int df_bootstrap_send (df_bootstrap_t b, int peer, const void *data, size_t length)
+{
+    if(peer < 0 || peer >= b->size || peer == b->rank) {
+        fprintf(stderr, "Error: invalid peer %d. %s:%d\n", peer, __FILE__, __LINE__);
+        return -1;
+    }
+    if(b->out_fds[peer] < 0) {
+        struct sockaddr_un addr;
+        socklen_t addr_length = make_address(&addr, b->name, b->session, peer);
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int32_t rank = b->rank;
+        if(fd < 0 || connect(fd, (struct sockaddr *) &addr, addr_length) != 0 ||
+           write_full(fd, &rank, sizeof(rank)) != 0) {
+            fprintf(stderr, "Error: cannot connect to process %d (errno %d). %s:%d\n", peer, errno,
+                __FILE__, __LINE__);
+            if(fd >= 0) close(fd);
+            return -1;
+        }
+        b->out_fds[peer] = fd;
+    }
+    uint64_t header = length;
+    if(write_full(b->out_fds[peer], &header, sizeof(header)) != 0 ||
+       write_full(b->out_fds[peer], data, length) != 0) {
+        fprintf(stderr, "Error: cannot send to process %d (errno %d). %s:%d\n", peer, errno,
+            __FILE__, __LINE__);
+        return -1;
+    }
+    return 0;
+}
+
+int df_bootstrap_recv (df_bootstrap_t b, int peer, void *data, size_t length)
+{
+    if(peer < 0 || peer >= b->size || peer == b->rank) {
+        fprintf(stderr, "Error: invalid peer %d. %s:%d\n", peer, __FILE__, __LINE__);
+        return -1;
+    }
+    // accept connections until peer's arrives
+    while(b->in_fds[peer] < 0) {
+        int fd = accept4(b->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        int32_t from;
+        if(fd < 0 || read_full(fd, &from, sizeof(from)) != 0 || from < 0 || from >= b->size ||
+           b->in_fds[from] >= 0) {
+            fprintf(stderr, "Error: bad connection at %s (errno %d). %s:%d\n", b->name, errno,
+                __FILE__, __LINE__);
+            if(fd >= 0) close(fd);
+            return -1;
+        }
+        b->in_fds[from] = fd;
+    }
+    uint64_t header;
+    if(read_full(b->in_fds[peer], &header, sizeof(header)) != 0) {
+        fprintf(stderr, "Error: cannot receive from process %d. %s:%d\n", peer, __FILE__, __LINE__);
+        return -1;
+    }
+    if(header != length) {
+        fprintf(stderr, "Error: message of %lu bytes from process %d instead of %lu. %s:%d\n",
+            (unsigned long) header, peer, (unsigned long) length, __FILE__, __LINE__);
+        return -1;
+    }
+    if(read_full(b->in_fds[peer], data, length) != 0) {
+        fprintf(stderr, "Error: cannot receive from process %d. %s:%d\n", peer, __FILE__, __LINE__);
+        return -1;
+    }
+    return 0;
+}
+
+int df_bootstrap_allgather (df_bootstrap_t b, const void *data, size_t length, void *all)
+{
+    uint64_t header = length;
+    if(b->rank != 0) {
+        // the hub's reply starts with a header even if length is 0, so that a barrier waits
+        if(write_full(b->hub_fd, &header, sizeof(header)) != 0 ||
+           write_full(b->hub_fd, data, length) != 0 ||
+           read_full(b->hub_fd, &header, sizeof(header)) != 0 ||
+           read_full(b->hub_fd, all, b->size * length) != 0) {
+            fprintf(stderr, "Error: lost connection to the hub. %s:%d\n", __FILE__, __LINE__);
+            return -1;
+        }
+        return 0;
+    }
+
+    // the hub collects the contributions in rank order and returns them to everyone
+    if(length > 0) {
+        memcpy(all, data, length);
+    }
+    int i;
+    for(i = 1; i < b->size; i ++) {
+        uint64_t member_length;
+        if(read_full(b->member_fds[i], &member_length, sizeof(member_length)) != 0 ||
+           member_length != length ||
+           read_full(b->member_fds[i], (char *) all + i * length, length) != 0) {
+            fprintf(stderr, "Error: bad contribution from process %d. %s:%d\n", i, __FILE__, __LINE__);
+            return -1;
+        }
+    }
+    for(i = 1; i < b->size; i ++) {
+        if(write_full(b->member_fds[i], &header, sizeof(header)) != 0 ||
+           write_full(b->member_fds[i], all, b->size * length) != 0) {
+            fprintf(stderr, "Error: lost connection to process %d. %s:%d\n", i, __FILE__, __LINE__);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int df_bootstrap_barrier (df_bootstrap_t b)
+{
+    return df_bootstrap_allgather(b, NULL, 0, NULL);
+}
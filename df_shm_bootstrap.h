@@ -0,0 +1,93 @@
+#ifndef _DF_SHM_BOOTSTRAP_H_
+#define _DF_SHM_BOOTSTRAP_H_
+/*
+ * DataFabrics shared memory transport for inter-process and inter-thread
+ * communication on mulitcore.
+ *
+ * This header file defines a small bootstrap service for processes on one node
+ * which need to exchange region contact info, creator pids and sizes without MPI
+ * or another launcher. N processes started with the same rendezvous name meet at
+ * an abstract Unix-domain socket: the first one to bind it becomes the hub and
+ * rank 0, the others connect and get ranks 1 .. N-1 in arrival order.
+ *
+ * Collectives (allgather, barrier) go through the hub. Point-to-point messages
+ * go over direct connections between the two processes, made on first use.
+ * Messages between a pair of processes are delivered in order.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "df_config.h"
+#include <stddef.h>
+#include <unistd.h>
+
+#define DF_BOOTSTRAP_DEFAULT_NAME "df_shm_bootstrap"
+#define DF_BOOTSTRAP_NAME_LENGTH 80   // longest rendezvous name including the terminating null
+#define DF_BOOTSTRAP_TIMEOUT 60       // seconds to wait for all processes to register
+
+/*
+ * handle of a process in a bootstrap group
+ */
+typedef struct _df_bootstrap {
+    char name[DF_BOOTSTRAP_NAME_LENGTH]; // rendezvous name
+    int rank;
+    int size;
+    pid_t session;                // pid of the hub; names the point-to-point sockets
+    int listen_fd;                // socket on which peers connect to this process
+    int hub_fd;                   // connection to the hub (ranks > 0)
+    int *member_fds;              // connections to the other processes (hub only)
+    int *out_fds;                 // connections to send to each process, or -1
+    int *in_fds;                  // connections to receive from each process, or -1
+} df_bootstrap, *df_bootstrap_t;
+
+/*
+ * Join the group of size processes which meet at rendezvous name 'name'. If name
+ * is NULL, the DF_BOOTSTRAP_NAME environment variable or DF_BOOTSTRAP_DEFAULT_NAME
+ * is used; if size is not positive, the DF_BOOTSTRAP_SIZE environment variable is
+ * used. Block until all processes have joined (at most DF_BOOTSTRAP_TIMEOUT seconds).
+ * Return NULL on error.
+ */
+df_bootstrap_t df_bootstrap_init (const char *name, int size);
+
+/*
+ * Leave the group and free the handle. Return 0 on success and -1 on error.
+ */
+int df_bootstrap_finalize (df_bootstrap_t b);
+
+/*
+ * Return the rank of this process (0 .. size-1) or the number of processes.
+ */
+int df_bootstrap_rank (df_bootstrap_t b);
+int df_bootstrap_size (df_bootstrap_t b);
+
+/*
+ * Send length bytes of data to process peer. Return 0 on success and -1 on error.
+ */
+int df_bootstrap_send (df_bootstrap_t b, int peer, const void *data, size_t length);
+
+/*
+ * Receive the next message from process peer into data, which must be exactly
+ * length bytes long. Return 0 on success and -1 on error (including a message of
+ * another length).
+ */
+int df_bootstrap_recv (df_bootstrap_t b, int peer, void *data, size_t length);
+
+/*
+ * Gather length bytes of data from every process into all (size * length bytes,
+ * in rank order) on every process. All processes must pass the same length.
+ * Return 0 on success and -1 on error.
+ */
+int df_bootstrap_allgather (df_bootstrap_t b, const void *data, size_t length, void *all);
+
+/*
+ * Wait until all processes have entered the barrier. Return 0 on success and -1 on error.
+ */
+int df_bootstrap_barrier (df_bootstrap_t b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
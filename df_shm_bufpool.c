@@ -0,0 +1,246 @@
+/*
+ * DataFabrics shared memory transport for inter-process and inter-thread
+ * communication on mulitcore.
+ *
+ * This file implements a pool of fixed-size buffers backed by a lock-free
+ * free list. The free list head is an index tagged with a counter which is
+ * bumped on every update, so a stale compare-and-swap never succeeds (ABA).
+ */
+
+#include "df_config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include "df_shm_bufpool.h"
+
+#define TAGGED_INDEX(head) ((uint32_t)(head))
+#define TAGGED_TAG(head) ((uint32_t)((head) >> 32))
+#define MAKE_TAGGED(tag, index) (((uint64_t)(tag) << 32) | (uint64_t)(index))
+
+/*
+ * Calculate distance between two adjacent buffers in the pool.
+ */
+static size_t df_calculate_bufpool_stride (size_t buffer_size)
+{
+    assert(buffer_size > 0);
+
+    size_t stride = sizeof(df_bufpool_buf) + buffer_size;
+    if(stride % CACHE_LINE_SIZE) {
+        stride += CACHE_LINE_SIZE - (stride % CACHE_LINE_SIZE);
+    }
+    return stride;
+}
+
+/*
+ * Calculate how many bytes a buffer pool with specified configuration would occupy.
+ */
+size_t df_calculate_bufpool_size (uint32_t num_buffers, size_t buffer_size)
+{
+    assert(num_buffers > 0);
+
+    return sizeof(df_bufpool) + num_buffers * df_calculate_bufpool_stride(buffer_size);
+}
+
+static inline df_bufpool_buf_t df_bufpool_index2buf (df_bufpool_t pool, uint32_t index)
+{
+    return (df_bufpool_buf_t) (pool->buffers + (size_t) index * pool->stride);
+}
+
+/*
+ * Create a buffer pool at specified memory location. Return a handle of df_bufpool
+ * (which is at addr) on success; otherwise return NULL.
+ */
+df_bufpool_t df_create_bufpool (void *addr, uint32_t num_buffers, size_t buffer_size)
+{
+    assert(addr != NULL);
+    assert(num_buffers > 0);
+    assert(buffer_size > 0);
+
+    if(num_buffers == DF_BUFPOOL_NIL) {
+        fprintf(stderr, "Error: too many buffers (%u). %s:%d\n", num_buffers, __FILE__, __LINE__);
+        return NULL;
+    }
+    if((uint64_t)addr % CACHE_LINE_SIZE) {
+        fprintf(stderr, "Warning: buffer pool address (%p) is not cacheline-aligned. %s:%d\n",
+            addr, __FILE__, __LINE__);
+    }
+
+    df_bufpool_t pool = (df_bufpool_t) addr;
+    pool->initialized = 0;
+    pool->num_buffers = num_buffers;
+    pool->buffer_size = buffer_size;
+    pool->stride = df_calculate_bufpool_stride(buffer_size);
+    pool->total_size = df_calculate_bufpool_size(num_buffers, buffer_size);
+
+    // chain all buffers into the free list
+    uint32_t i;
+    for(i = 0; i < num_buffers; i ++) {
+        df_bufpool_buf_t buf = df_bufpool_index2buf(pool, i);
+        buf->index = i;
+        buf->size = 0;
+        buf->next = (i + 1 < num_buffers)? i + 1 : DF_BUFPOOL_NIL;
+    }
+    __atomic_store_n(&pool->free_head, MAKE_TAGGED(0, 0), __ATOMIC_RELEASE);
+
+    pool->initialized = 1;
+    return pool;
+}
+
+/*
+ * Destroy a buffer pool. Return 0 on success and non-zero on error.
+ */
+int df_destroy_bufpool (df_bufpool_t pool)
+{
+    if(pool) {
+        pool->initialized = 0;
+        return 0;
+    }
+    else {
+        fprintf(stderr, "Error: buffer pool is NULL. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+}
+
+/*
+ * Take a free buffer from the pool. Return 0 on success and -1 if the pool is empty.
+ */
+int df_bufpool_get (df_bufpool_t pool, df_bufpool_desc_t *desc)
+{
+    assert(pool != NULL);
+    assert(pool->initialized);
+    assert(desc != NULL);
+
+    uint64_t head = __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE);
+    uint64_t new_head;
+    df_bufpool_buf_t buf;
+    do {
+        if(TAGGED_INDEX(head) == DF_BUFPOOL_NIL) {
+            return -1;
+        }
+        // the buffer may be taken by someone else meanwhile, in which case
+        // 'next' is garbage but the tag makes the following CAS fail
+        buf = df_bufpool_index2buf(pool, TAGGED_INDEX(head));
+        uint32_t next = __atomic_load_n(&buf->next, __ATOMIC_RELAXED);
+        new_head = MAKE_TAGGED(TAGGED_TAG(head) + 1, next);
+    } while(!__atomic_compare_exchange_n(&pool->free_head, &head, new_head, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    buf->size = 0;
+    *desc = DF_BUFPOOL_ADDR2DESC(pool, buf->data);
+    return 0;
+}
+
+/*
+ * Return a buffer to the pool.
+ */
+void df_bufpool_put (df_bufpool_t pool, df_bufpool_desc_t desc)
+{
+    assert(pool != NULL);
+    assert(pool->initialized);
+    assert(desc >= sizeof(df_bufpool) + sizeof(df_bufpool_buf));
+    assert(desc < pool->total_size);
+
+    df_bufpool_buf_t buf = (df_bufpool_buf_t)
+        ((char *) DF_BUFPOOL_DESC2ADDR(pool, desc) - sizeof(df_bufpool_buf));
+    uint32_t index = buf->index;
+    assert(index < pool->num_buffers);
+
+    uint64_t head = __atomic_load_n(&pool->free_head, __ATOMIC_RELAXED);
+    uint64_t new_head;
+    do {
+        __atomic_store_n(&buf->next, TAGGED_INDEX(head), __ATOMIC_RELAXED);
+        new_head = MAKE_TAGGED(TAGGED_TAG(head) + 1, index);
+    } while(!__atomic_compare_exchange_n(&pool->free_head, &head, new_head, 0,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * Enqueue a buffer descriptor into queue. Return 0 on success and non-zero otherwise.
+ */
+int df_enqueue_buffer (df_queue_ep_t ep, df_bufpool_t pool, df_bufpool_desc_t desc, size_t length)
+{
+    assert(pool != NULL);
+    assert(pool->initialized);
+
+    if(length > pool->buffer_size) {
+        fprintf(stderr, "Error: buffer length (%lu) exceeds pool limit (%lu). %s:%d\n",
+            length, pool->buffer_size, __FILE__, __LINE__);
+        return -1;
+    }
+    df_bufpool_buf_t buf = (df_bufpool_buf_t)
+        ((char *) DF_BUFPOOL_DESC2ADDR(pool, desc) - sizeof(df_bufpool_buf));
+    buf->size = length;
+
+    // the queue publishes the slot with release semantics, which also orders
+    // the buffer contents and size written above
+    return df_enqueue(ep, &desc, sizeof(desc));
+}
+
+/*
+ * Locate the buffer named by the descriptor in the current slot and release the slot.
+ */
+static int df_bufpool_take_slot (df_queue_ep_t ep, df_bufpool_t pool, void *msg, size_t msg_length,
+                                 df_bufpool_desc_t *desc, void **data, size_t *length)
+{
+    if(msg_length != sizeof(df_bufpool_desc_t)) {
+        fprintf(stderr, "Error: message (%lu bytes) is not a buffer descriptor. %s:%d\n",
+            msg_length, __FILE__, __LINE__);
+        df_release(ep);
+        return 1;
+    }
+    memcpy(desc, msg, sizeof(df_bufpool_desc_t));
+    df_release(ep);
+
+    df_bufpool_buf_t buf = (df_bufpool_buf_t)
+        ((char *) DF_BUFPOOL_DESC2ADDR(pool, *desc) - sizeof(df_bufpool_buf));
+    *data = buf->data;
+    *length = buf->size;
+    return 0;
+}
+
+/*
+ * Dequeue a buffer descriptor from queue. This is a blocking call. Return 0 on success
+ * and non-zero on error.
+ */
+int df_dequeue_buffer (df_queue_ep_t ep, df_bufpool_t pool, df_bufpool_desc_t *desc,
+                       void **data, size_t *length)
+{
+    assert(pool != NULL);
+    assert(pool->initialized);
+    assert(desc != NULL);
+    assert(data != NULL);
+    assert(length != NULL);
+
+    void *msg;
+    size_t msg_length;
+    int rc = df_dequeue(ep, &msg, &msg_length);
+    if(rc) {
+        return rc;
+    }
+    return df_bufpool_take_slot(ep, pool, msg, msg_length, desc, data, length);
+}
+
+/*
+ * Test-and-dequeue of a buffer descriptor.
+ * return value: 0: dequeue successful; -1: no full slot; 1: tried dequeue but failed.
+ */
+int df_try_dequeue_buffer (df_queue_ep_t ep, df_bufpool_t pool, df_bufpool_desc_t *desc,
+                           void **data, size_t *length)
+{
+    assert(pool != NULL);
+    assert(pool->initialized);
+    assert(desc != NULL);
+    assert(data != NULL);
+    assert(length != NULL);
+
+    void *msg;
+    size_t msg_length;
+    int rc = df_try_dequeue(ep, &msg, &msg_length);
+    if(rc) {
+        return rc;
+    }
+    return df_bufpool_take_slot(ep, pool, msg, msg_length, desc, data, length);
+}
@@ -0,0 +1,133 @@
+#ifndef _DF_SHM_BUFPOOL_H_
+#define _DF_SHM_BUFPOOL_H_
+/*
+ * DataFabrics shared memory transport for inter-process and inter-thread
+ * communication on mulitcore.
+ *
+ * This header file defines a pool of fixed-size buffers which can be laid out
+ * in a shared memory region. Free buffers are kept in a lock-free list so any
+ * process attached to the region can get and put buffers concurrently.
+ * A buffer is identified by an 8-byte descriptor (its offset relative to the
+ * pool) which is valid in every process regardless of where the region is
+ * attached, so large payloads can be passed through a df_queue by descriptor
+ * instead of by copy.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "df_config.h"
+#include <stdint.h>
+#include <unistd.h>
+#include <stddef.h>
+#include "df_shm_queue.h"
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+/*
+ * a buffer descriptor: offset of the buffer's data relative to the pool
+ */
+typedef uint64_t df_bufpool_desc_t;
+
+/* index value terminating the free list */
+#define DF_BUFPOOL_NIL ((uint32_t) -1)
+
+/*
+ * header in front of every buffer in the pool
+ */
+typedef struct _df_bufpool_buf {
+    uint32_t next;                // index of next free buffer (valid only when on free list)
+    uint32_t index;               // index of this buffer in the pool
+    size_t size;                  // length of valid data set by the sender
+    char padding[CACHE_LINE_SIZE - 2*sizeof(uint32_t) - sizeof(size_t)];
+    char data[0];                 // buffer payload
+} df_bufpool_buf, *df_bufpool_buf_t;
+
+/*
+ * the buffer pool data structure laid out in memory
+ */
+typedef struct _df_bufpool {
+    int32_t initialized;
+    uint32_t num_buffers;         // number of buffers; set during initialization
+    size_t buffer_size;           // size limit of each buffer's payload
+    size_t stride;                // distance in bytes between two adjacent buffers
+    size_t total_size;            // total size of the pool (including this header)
+    char padding1[CACHE_LINE_SIZE - sizeof(int32_t) - sizeof(uint32_t) - 3*sizeof(size_t)];
+
+    uint64_t free_head;           // head of free list: ABA tag (high 32 bits) | buffer index (low 32 bits)
+    char padding2[CACHE_LINE_SIZE - sizeof(uint64_t)];
+
+    char buffers[0];              // where buffers are
+} df_bufpool, *df_bufpool_t;
+
+/*
+ * convert a buffer descriptor to local virtual address of the buffer's payload
+ */
+#define DF_BUFPOOL_DESC2ADDR(pool, desc) (void *)((char *)(pool) + (size_t)(desc))
+
+/*
+ * convert a local virtual address of a buffer's payload to a buffer descriptor
+ */
+#define DF_BUFPOOL_ADDR2DESC(pool, addr) (df_bufpool_desc_t)((char *)(addr) - (char *)(pool))
+
+/*
+ * Calculate how many bytes a buffer pool with specified configuration would occupy.
+ */
+size_t df_calculate_bufpool_size (uint32_t num_buffers, size_t buffer_size);
+
+/*
+ * Create a buffer pool at specified memory location (usually inside a shm region).
+ * num_buffers specifies the number of buffers in the pool and buffer_size specifies
+ * the maximum size of each buffer in bytes. All buffers are initially free.
+ * Return a handle of df_bufpool (which is at addr) on success; otherwise return NULL.
+ */
+df_bufpool_t df_create_bufpool (void *addr, uint32_t num_buffers, size_t buffer_size);
+
+/*
+ * Destroy a buffer pool. Return 0 on success and non-zero on error.
+ */
+int df_destroy_bufpool (df_bufpool_t pool);
+
+/*
+ * Take a free buffer from the pool. This is a non-blocking call. Return 0 and set
+ * *desc to the buffer's descriptor on success; return -1 if the pool is empty.
+ */
+int df_bufpool_get (df_bufpool_t pool, df_bufpool_desc_t *desc);
+
+/*
+ * Return a buffer to the pool. Any process attached to the pool may return a buffer
+ * taken by another process.
+ */
+void df_bufpool_put (df_bufpool_t pool, df_bufpool_desc_t desc);
+
+/*
+ * Enqueue a buffer descriptor into queue. The sender fills the buffer in place and
+ * passes the length of valid data; only the 8-byte descriptor is copied into the
+ * queue slot. This is a blocking call. Return 0 on success and non-zero otherwise.
+ */
+int df_enqueue_buffer (df_queue_ep_t ep, df_bufpool_t pool, df_bufpool_desc_t desc, size_t length);
+
+/*
+ * Dequeue a buffer descriptor from queue. The queue slot is released immediately;
+ * *data points to the buffer's payload and *length contains the length of valid data.
+ * The receiver owns the buffer and must return it with df_bufpool_put() when done.
+ * This is a blocking call. Return 0 on success and non-zero on error.
+ */
+int df_dequeue_buffer (df_queue_ep_t ep, df_bufpool_t pool, df_bufpool_desc_t *desc,
+                       void **data, size_t *length);
+
+/*
+ * Test-and-dequeue of a buffer descriptor.
+ * return value: 0: dequeue successful; -1: no full slot; 1: tried dequeue but failed.
+ */
+int df_try_dequeue_buffer (df_queue_ep_t ep, df_bufpool_t pool, df_bufpool_desc_t *desc,
+                           void **data, size_t *length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
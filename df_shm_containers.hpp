@@ -0,0 +1,713 @@
+#ifndef _DF_SHM_CONTAINERS_HPP_
+#define _DF_SHM_CONTAINERS_HPP_
+/*
+ * DataFabrics shared memory transport for inter-process and inter-thread
+ * communication on mulitcore.
+ *
+ * This header file defines a header-only C++ layer for building data structures
+ * inside a shm region:
+ *   - df::offset_ptr<T>: a self-relative pointer which stays valid in every process
+ *     no matter where the region is attached;
+ *   - df::region_arena: a size-class allocator laid out at the start of a region;
+ *   - df::allocator<T>: an allocator handing out memory of a region_arena;
+ *   - df::vector<T>, df::hash_map<K, V> (open addressing) and df::object_pool<T>
+ *     (small objects), which live in the region and can be used from any process
+ *     attached to it.
+ * Objects stored in the region must not hold raw pointers, virtual functions or
+ * process-local resources; use offset_ptr for links between them. The arena and
+ * object_pool are safe for concurrent use by several processes; vector and
+ * hash_map must be synchronized by the caller. All processes must run the same
+ * binary (or at least agree on the layout of the stored types and on Hash).
+ */
+
+#include "df_config.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "df_shm.h"
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+namespace df {
+
+/*
+ * self-relative pointer: stores the distance from itself to the target, so a
+ * pointer inside a region is valid in every process attached to the region.
+ * An offset_ptr must itself live in the same region as its target (or both in
+ * the same local object).
+ */
+template <class T>
+class offset_ptr {
+public:
+    typedef T element_type;
+    typedef typename std::add_lvalue_reference<T>::type reference;
+
+    offset_ptr () : off_(null_offset) {}
+    offset_ptr (T *p) { set(p); }
+    offset_ptr (std::nullptr_t) : off_(null_offset) {}
+    offset_ptr (const offset_ptr &other) { set(other.get()); }
+    template <class U, class = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+    offset_ptr (const offset_ptr<U> &other) { set(other.get()); }
+
+    offset_ptr &operator= (const offset_ptr &other) { set(other.get()); return *this; }
+    offset_ptr &operator= (T *p) { set(p); return *this; }
+    offset_ptr &operator= (std::nullptr_t) { off_ = null_offset; return *this; }
+
+    T *get () const {
+        // integer arithmetic: the target is not part of this object
+        return off_ == null_offset? nullptr :
+            (T *) ((uintptr_t) this + off_);
+    }
+    reference operator* () const { return *get(); }
+    T *operator-> () const { return get(); }
+    reference operator[] (ptrdiff_t i) const { return get()[i]; }
+    explicit operator bool () const { return off_ != null_offset; }
+
+    offset_ptr &operator+= (ptrdiff_t n) { set(get() + n); return *this; }
+    offset_ptr &operator-= (ptrdiff_t n) { set(get() - n); return *this; }
+    offset_ptr &operator++ () { return *this += 1; }
+    offset_ptr &operator-- () { return *this -= 1; }
+    offset_ptr operator++ (int) { offset_ptr old(get()); ++ *this; return old; }
+    offset_ptr operator-- (int) { offset_ptr old(get()); -- *this; return old; }
+    friend offset_ptr operator+ (const offset_ptr &p, ptrdiff_t n) { return offset_ptr(p.get() + n); }
+    friend offset_ptr operator- (const offset_ptr &p, ptrdiff_t n) { return offset_ptr(p.get() - n); }
+    friend ptrdiff_t operator- (const offset_ptr &a, const offset_ptr &b) { return a.get() - b.get(); }
+
+    friend bool operator== (const offset_ptr &a, const offset_ptr &b) { return a.get() == b.get(); }
+    friend bool operator!= (const offset_ptr &a, const offset_ptr &b) { return a.get() != b.get(); }
+    friend bool operator< (const offset_ptr &a, const offset_ptr &b) { return a.get() < b.get(); }
+
+private:
+    // a pointer one byte past itself is never a valid target of T
+    static constexpr ptrdiff_t null_offset = 1;
+
+    void set (T *p) {
+        off_ = p? (ptrdiff_t) ((uintptr_t) p - (uintptr_t) this) : (ptrdiff_t) null_offset;
+    }
+
+    ptrdiff_t off_;
+};
+
+/*
+ * spin lock which works across processes when placed in a shm region
+ */
+class spinlock {
+public:
+    spinlock () : locked_(0) {}
+    void lock () {
+        while(locked_.exchange(1, std::memory_order_acquire)) {
+            while(locked_.load(std::memory_order_relaxed)) {
+                cpu_relax();
+            }
+        }
+    }
+    void unlock () { locked_.store(0, std::memory_order_release); }
+
+private:
+    static_assert(ATOMIC_INT_LOCK_FREE == 2, "lock-free atomics are needed in shared memory");
+
+    static void cpu_relax () {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    std::atomic<uint32_t> locked_;
+};
+
+/*
+ * RAII holder of a spinlock
+ */
+class spinlock_guard {
+public:
+    explicit spinlock_guard (spinlock &l) : lock_(l) { lock_.lock(); }
+    ~spinlock_guard () { lock_.unlock(); }
+    spinlock_guard (const spinlock_guard &) = delete;
+    spinlock_guard &operator= (const spinlock_guard &) = delete;
+private:
+    spinlock &lock_;
+};
+
+/*
+ * allocator laid out at the start of a shm region. Memory is handed out in
+ * power-of-two size classes from the end of the used part; freed blocks are
+ * kept on a free list per class and reused by later allocations of the class.
+ * Blocks are aligned to their size up to PAGE_SIZE, so blocks of a cache line
+ * or more never share cache lines with other blocks.
+ */
+class region_arena {
+public:
+    static const uint64_t magic_value = 0x64665f6172656e61ULL;  // "df_arena"
+    static const int num_classes = 48;
+    static const size_t min_block = 16;
+
+    /*
+     * Lay out an arena over size bytes at base, which should be page-aligned (as
+     * the start of a region is). Return NULL if size is too small.
+     */
+    static region_arena *create (void *base, size_t size) {
+        if(size < sizeof(region_arena)) {
+            return nullptr;
+        }
+        return new (base) region_arena(size);
+    }
+    static region_arena *create (df_shm_region_t region) {
+        return create(region->starting_addr, region->size);
+    }
+
+    /*
+     * Return the arena created at base by another process, or NULL if there is none.
+     */
+    static region_arena *attach (void *base) {
+        region_arena *arena = (region_arena *) base;
+        return arena->magic_ == magic_value? arena : nullptr;
+    }
+    static region_arena *attach (df_shm_region_t region) {
+        return attach(region->starting_addr);
+    }
+
+    /*
+     * Allocate bytes bytes aligned to alignment. Return NULL if the arena is full.
+     */
+    void *allocate (size_t bytes, size_t alignment = alignof(max_align_t)) {
+        int c = size_class(bytes, alignment);
+        if(c < 0) {
+            return nullptr;
+        }
+        spinlock_guard guard(lock_);
+        if(free_[c]) {
+            char *block = (char *) this + free_[c];
+            free_[c] = *(uint64_t *) block;
+            return block;
+        }
+        size_t block_size = (size_t) 1 << c;
+        size_t block_align = block_size < PAGE_SIZE? block_size : PAGE_SIZE;
+        size_t offset = (top_ + block_align - 1) & ~(block_align - 1);
+        if(offset > size_ || size_ - offset < block_size) {
+            return nullptr;
+        }
+        top_ = offset + block_size;
+        return (char *) this + offset;
+    }
+
+    /*
+     * Return a block allocated with the same bytes and alignment to the arena.
+     */
+    void deallocate (void *p, size_t bytes, size_t alignment = alignof(max_align_t)) {
+        if(!p) {
+            return;
+        }
+        int c = size_class(bytes, alignment);
+        spinlock_guard guard(lock_);
+        *(uint64_t *) p = free_[c];
+        free_[c] = (char *) p - (char *) this;
+    }
+
+    /*
+     * Allocate and construct an object of type T in the arena. Return NULL if the
+     * arena is full.
+     */
+    template <class T, class... Args>
+    T *construct (Args&&... args) {
+        void *p = allocate(sizeof(T), alignof(T));
+        return p? new (p) T(std::forward<Args>(args)...) : nullptr;
+    }
+
+    /*
+     * Destroy an object made by construct() and free its memory.
+     */
+    template <class T>
+    void destroy (T *p) {
+        if(p) {
+            p->~T();
+            deallocate(p, sizeof(T), alignof(T));
+        }
+    }
+
+    /*
+     * A single root object through which attaching processes find the data
+     * structures in the region.
+     */
+    template <class T>
+    void set_root (T *p) { root_ = (void *) p; }
+    template <class T>
+    T *root () const { return (T *) root_.get(); }
+
+    size_t size () const { return size_; }
+    size_t used () const { return top_; }
+
+private:
+    explicit region_arena (size_t size) : magic_(magic_value), size_(size),
+        top_(sizeof(region_arena)) {
+        memset(free_, 0, sizeof(free_));
+    }
+
+    /*
+     * Return the size class of a request, or -1 if it cannot be satisfied.
+     */
+    static int size_class (size_t bytes, size_t alignment) {
+        if(alignment > PAGE_SIZE || (alignment & (alignment - 1)) != 0) {
+            return -1;
+        }
+        size_t n = bytes > alignment? bytes : alignment;
+        if(n < min_block) {
+            n = min_block;
+        }
+        int c = 64 - __builtin_clzll(n - 1);
+        return c < num_classes? c : -1;
+    }
+
+    uint64_t magic_;
+    size_t size_;
+    size_t top_;               // offset of the first never-allocated byte
+    spinlock lock_;
+    offset_ptr<void> root_;
+    uint64_t free_[num_classes];  // offset of the first free block of each class; 0 if none
+};
+
+/*
+ * allocator handing out memory of a region_arena. It can be stored in the region
+ * and used by any process attached to it.
+ */
+template <class T>
+class allocator {
+public:
+    typedef T value_type;
+    template <class U> struct rebind { typedef allocator<U> other; };
+
+    explicit allocator (region_arena *arena) : arena_(arena) {}
+    allocator (const allocator &other) : arena_(other.arena()) {}
+    template <class U>
+    allocator (const allocator<U> &other) : arena_(other.arena()) {}
+    allocator &operator= (const allocator &other) { arena_ = other.arena(); return *this; }
+
+    /*
+     * Allocate memory for n objects. Throw std::bad_alloc if the arena is full.
+     */
+    T *allocate (size_t n) {
+        void *p = arena_->allocate(n * sizeof(T), alignof(T));
+        if(!p) {
+            throw std::bad_alloc();
+        }
+        return (T *) p;
+    }
+    void deallocate (T *p, size_t n) { arena_->deallocate(p, n * sizeof(T), alignof(T)); }
+
+    region_arena *arena () const { return arena_.get(); }
+
+    template <class U>
+    bool operator== (const allocator<U> &other) const { return arena() == other.arena(); }
+    template <class U>
+    bool operator!= (const allocator<U> &other) const { return arena() != other.arena(); }
+
+private:
+    offset_ptr<region_arena> arena_;
+};
+
+/*
+ * growable array of T in a region
+ */
+template <class T>
+class vector {
+public:
+    typedef T value_type;
+    typedef T *iterator;
+    typedef const T *const_iterator;
+
+    explicit vector (region_arena *arena, size_t capacity = 0) : alloc_(arena), data_(),
+        size_(0), capacity_(0) {
+        reserve(capacity);
+    }
+    ~vector () {
+        clear();
+        if(data_) {
+            alloc_.deallocate(data_.get(), capacity_);
+        }
+    }
+
+    size_t size () const { return size_; }
+    size_t capacity () const { return capacity_; }
+    bool empty () const { return size_ == 0; }
+    T *data () { return data_.get(); }
+    const T *data () const { return data_.get(); }
+    T &operator[] (size_t i) { return data_[i]; }
+    const T &operator[] (size_t i) const { return data_[i]; }
+    T &back () { return data_[size_ - 1]; }
+    iterator begin () { return data_.get(); }
+    iterator end () { return data_.get() + size_; }
+    const_iterator begin () const { return data_.get(); }
+    const_iterator end () const { return data_.get() + size_; }
+
+    /*
+     * Make room for n elements. Throw std::bad_alloc if the arena is full.
+     */
+    void reserve (size_t n) {
+        if(n <= capacity_) {
+            return;
+        }
+        T *p = alloc_.allocate(n);
+        T *old = data_.get();
+        size_t i;
+        for(i = 0; i < size_; i ++) {
+            new (p + i) T(std::move(old[i]));
+            old[i].~T();
+        }
+        if(old) {
+            alloc_.deallocate(old, capacity_);
+        }
+        data_ = p;
+        capacity_ = n;
+    }
+
+    template <class... Args>
+    T &emplace_back (Args&&... args) {
+        if(size_ == capacity_) {
+            reserve(capacity_? 2 * capacity_ : 8);
+        }
+        T *p = new (data_.get() + size_) T(std::forward<Args>(args)...);
+        size_ ++;
+        return *p;
+    }
+    void push_back (const T &v) { emplace_back(v); }
+    void push_back (T &&v) { emplace_back(std::move(v)); }
+    void pop_back () { data_[-- size_].~T(); }
+
+    void resize (size_t n) {
+        reserve(n);
+        while(size_ < n) {
+            emplace_back();
+        }
+        while(size_ > n) {
+            pop_back();
+        }
+    }
+    void clear () {
+        while(size_ > 0) {
+            pop_back();
+        }
+    }
+
+    vector (const vector &) = delete;
+    vector &operator= (const vector &) = delete;
+
+private:
+
+    allocator<T> alloc_;
+    offset_ptr<T> data_;
+    size_t size_;
+    size_t capacity_;
+};
+
+/*
+ * hash map with open addressing and linear probing in a region. The hash of
+ * each slot is kept in a separate dense array so probing touches few cache lines,
+ * and erasing shifts later entries back instead of leaving tombstones. Pointers
+ * returned by find() and insert() are invalidated when the map grows.
+ */
+template <class Key, class T, class Hash = std::hash<Key>, class KeyEqual = std::equal_to<Key> >
+class hash_map {
+public:
+    typedef Key key_type;
+    typedef T mapped_type;
+
+    explicit hash_map (region_arena *arena, size_t capacity = 0) : arena_(arena), hashes_(),
+        slots_(), capacity_(0), size_(0) {
+        if(capacity) {
+            reserve(capacity);
+        }
+    }
+    ~hash_map () {
+        clear();
+        free_table(hashes_.get(), slots_.get(), capacity_);
+    }
+
+    size_t size () const { return size_; }
+    size_t capacity () const { return capacity_; }
+    bool empty () const { return size_ == 0; }
+
+    /*
+     * Return the value of key, or NULL if key is not in the map.
+     */
+    T *find (const Key &key) {
+        size_t i = find_index(key);
+        return i < capacity_? &slots_[i].value : nullptr;
+    }
+    const T *find (const Key &key) const { return const_cast<hash_map *>(this)->find(key); }
+
+    /*
+     * Insert key with a value constructed from args unless key is already in the
+     * map. Return the value of key and whether it was inserted. Throw
+     * std::bad_alloc if the arena is full.
+     */
+    template <class... Args>
+    std::pair<T *, bool> emplace (const Key &key, Args&&... args) {
+        T *v = find(key);
+        if(v) {
+            return std::make_pair(v, false);
+        }
+        // keep the load factor at most 3/4
+        if(4 * (size_ + 1) > 3 * capacity_) {
+            reserve(capacity_? capacity_ : 1);
+        }
+        uint64_t h = hash_of(key);
+        size_t i = probe_empty(hashes_.get(), h, capacity_ - 1);
+        slot *s = new (slots_.get() + i) slot(key, std::forward<Args>(args)...);
+        hashes_[i] = h;
+        size_ ++;
+        return std::make_pair(&s->value, true);
+    }
+    std::pair<T *, bool> insert (const Key &key, const T &value) { return emplace(key, value); }
+    T &operator[] (const Key &key) { return *emplace(key).first; }
+
+    /*
+     * Remove key from the map. Return true if it was in the map.
+     */
+    bool erase (const Key &key) {
+        size_t i = find_index(key);
+        if(i == capacity_) {
+            return false;
+        }
+        uint64_t *hashes = hashes_.get();
+        slot *slots = slots_.get();
+        size_t mask = capacity_ - 1;
+        slots[i].~slot();
+        hashes[i] = 0;
+        // move back later entries of the probe sequence which can fill the hole
+        size_t j;
+        for(j = (i + 1) & mask; hashes[j]; j = (j + 1) & mask) {
+            size_t home = hashes[j] & mask;
+            if(((j - home) & mask) >= ((j - i) & mask)) {
+                new (slots + i) slot(std::move(slots[j]));
+                hashes[i] = hashes[j];
+                slots[j].~slot();
+                hashes[j] = 0;
+                i = j;
+            }
+        }
+        size_ --;
+        return true;
+    }
+
+    void clear () {
+        uint64_t *hashes = hashes_.get();
+        size_t i;
+        for(i = 0; i < capacity_ && size_ > 0; i ++) {
+            if(hashes[i]) {
+                slots_[i].~slot();
+                hashes[i] = 0;
+                size_ --;
+            }
+        }
+    }
+
+    /*
+     * Make room for n entries without growing. Throw std::bad_alloc if the arena
+     * is full.
+     */
+    void reserve (size_t n) {
+        size_t capacity = 8;
+        while(3 * capacity < 4 * n) {
+            capacity *= 2;
+        }
+        if(capacity <= capacity_) {
+            return;
+        }
+        allocator<uint64_t> hash_alloc(arena_.get());
+        allocator<slot> slot_alloc(arena_.get());
+        uint64_t *hashes = hash_alloc.allocate(capacity);
+        slot *slots;
+        try {
+            slots = slot_alloc.allocate(capacity);
+        }
+        catch(...) {
+            hash_alloc.deallocate(hashes, capacity);
+            throw;
+        }
+        memset(hashes, 0, capacity * sizeof(uint64_t));
+        uint64_t *old_hashes = hashes_.get();
+        slot *old_slots = slots_.get();
+        size_t i;
+        for(i = 0; i < capacity_; i ++) {
+            if(old_hashes[i]) {
+                size_t j = probe_empty(hashes, old_hashes[i], capacity - 1);
+                new (slots + j) slot(std::move(old_slots[i]));
+                hashes[j] = old_hashes[i];
+                old_slots[i].~slot();
+            }
+        }
+        free_table(old_hashes, old_slots, capacity_);
+        hashes_ = hashes;
+        slots_ = slots;
+        capacity_ = capacity;
+    }
+
+    /*
+     * Call f(key, value) for each entry.
+     */
+    template <class F>
+    void for_each (F f) {
+        uint64_t *hashes = hashes_.get();
+        size_t i;
+        for(i = 0; i < capacity_; i ++) {
+            if(hashes[i]) {
+                f((const Key &) slots_[i].key, slots_[i].value);
+            }
+        }
+    }
+
+    hash_map (const hash_map &) = delete;
+    hash_map &operator= (const hash_map &) = delete;
+
+private:
+
+    struct slot {
+        template <class... Args>
+        slot (const Key &k, Args&&... args) : key(k), value(std::forward<Args>(args)...) {}
+        slot (slot &&other) : key(std::move(other.key)), value(std::move(other.value)) {}
+        Key key;
+        T value;
+    };
+
+    // 0 marks an empty slot, so stored hashes have the top bit set
+    static uint64_t hash_of (const Key &key) {
+        return (uint64_t) Hash()(key) * 0x9e3779b97f4a7c15ULL | (1ULL << 63);
+    }
+    // return the slot of key, or capacity_ if key is not in the map
+    size_t find_index (const Key &key) const {
+        if(size_ == 0) {
+            return capacity_;
+        }
+        uint64_t h = hash_of(key);
+        size_t mask = capacity_ - 1;
+        const uint64_t *hashes = hashes_.get();
+        const slot *slots = slots_.get();
+        size_t i;
+        for(i = h & mask; hashes[i]; i = (i + 1) & mask) {
+            if(hashes[i] == h && KeyEqual()(slots[i].key, key)) {
+                return i;
+            }
+        }
+        return capacity_;
+    }
+    static size_t probe_empty (const uint64_t *hashes, uint64_t h, size_t mask) {
+        size_t i = h & mask;
+        while(hashes[i]) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+    void free_table (uint64_t *hashes, slot *slots, size_t capacity) {
+        if(capacity) {
+            allocator<uint64_t>(arena_.get()).deallocate(hashes, capacity);
+            allocator<slot>(arena_.get()).deallocate(slots, capacity);
+        }
+    }
+
+    offset_ptr<region_arena> arena_;
+    offset_ptr<uint64_t> hashes_;
+    offset_ptr<slot> slots_;
+    size_t capacity_;     // number of slots; a power of 2
+    size_t size_;
+};
+
+/*
+ * pool of small objects of type T in a region. Objects are carved out of chunks
+ * of ChunkObjects objects allocated from the arena, and freed objects are reused
+ * first. Safe for concurrent use by all processes attached to the region.
+ */
+template <class T, size_t ChunkObjects = 64>
+class object_pool {
+public:
+    explicit object_pool (region_arena *arena) : arena_(arena), free_(), chunks_() {}
+
+    /*
+     * Free all chunks. Objects still in use are not destroyed.
+     */
+    ~object_pool () {
+        while(chunks_) {
+            chunk *c = chunks_.get();
+            chunks_ = c->next.get();
+            arena_->deallocate(c, sizeof(chunk), alignof(chunk));
+        }
+    }
+
+    /*
+     * Construct an object from args. Return NULL if the arena is full.
+     */
+    template <class... Args>
+    T *create (Args&&... args) {
+        node *n;
+        {
+            spinlock_guard guard(lock_);
+            if(!free_ && !add_chunk()) {
+                return nullptr;
+            }
+            n = free_.get();
+            free_ = n->next.get();
+        }
+        return new (n) T(std::forward<Args>(args)...);
+    }
+
+    /*
+     * Destroy an object made by create() and put its memory back into the pool.
+     */
+    void destroy (T *p) {
+        if(!p) {
+            return;
+        }
+        p->~T();
+        node *n = (node *) (void *) p;
+        spinlock_guard guard(lock_);
+        new (&n->next) offset_ptr<node>(free_.get());
+        free_ = n;
+    }
+
+    object_pool (const object_pool &) = delete;
+    object_pool &operator= (const object_pool &) = delete;
+
+private:
+
+    union node {
+        offset_ptr<node> next;   // while the node is free
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        node () {}
+    };
+    struct chunk {
+        node nodes[ChunkObjects];
+        offset_ptr<chunk> next;
+    };
+
+    // called with lock_ held
+    bool add_chunk () {
+        chunk *c = (chunk *) arena_->allocate(sizeof(chunk), alignof(chunk));
+        if(!c) {
+            return false;
+        }
+        new (&c->next) offset_ptr<chunk>(chunks_.get());
+        chunks_ = c;
+        size_t i;
+        for(i = 0; i < ChunkObjects; i ++) {
+            new (&c->nodes[i].next) offset_ptr<node>(i + 1 < ChunkObjects? &c->nodes[i + 1] : free_.get());
+        }
+        free_ = &c->nodes[0];
+        return true;
+    }
+
+    offset_ptr<region_arena> arena_;
+    spinlock lock_;
+    offset_ptr<node> free_;
+    offset_ptr<chunk> chunks_;
+};
+
+} // namespace df
+
+#endif
@@ -0,0 +1,441 @@
+/*
+ * DataFabrics shared memory transport for inter-process and inter-thread
+ * communication on mulitcore.
+ *
+ * This file implements the directory of named queues. The directory region holds
+ * a header and a table of entries. The header's state_users word packs the state
+ * of the directory and the number of processes which have it open, so joining,
+ * leaving and tearing down are single compare-and-swaps. Each entry has its own
+ * state word; an entry is written only between claiming it (EMPTY -> CLAIMED) and
+ * publishing it (CLAIMED -> READY), and is read-only afterwards. The state word of
+ * a claimed entry carries the pid of the publisher, so an entry left claimed by a
+ * publisher which died is removed instead of being waited for forever.
+ */
+
+#include "df_config.h"
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include "df_shm.h"
+#include "df_shm_queue.h"
+#include "df_shm_directory.h"
+
+#define DIRECTORY_MAGIC 0x64665f7368646972ULL  // "df_shdir"
+#define OPEN_ATTEMPTS 1000
+#define OPEN_RETRY_USEC 1000
+
+/*
+ * states of the directory
+ */
+enum DIRECTORY_STATE {
+    DIRECTORY_UNINIT = 0,         // region just created (zero-filled)
+    DIRECTORY_INIT = 1,           // being initialized by the first process
+    DIRECTORY_READY = 2,
+    DIRECTORY_CLOSED = 3          // closed by the last process; must not be joined
+};
+
+/*
+ * states of a directory entry
+ */
+enum ENTRY_STATE {
+    ENTRY_EMPTY = 0,
+    ENTRY_CLAIMED = 1,            // being written by a publisher
+    ENTRY_READY = 2,
+    ENTRY_REMOVED = 3             // unpublished; never reused so probe sequences stay intact
+};
+
+#define WORD_STATE(w) ((uint32_t) ((w) >> 32))
+#define WORD_USERS(w) ((uint32_t) (w))
+#define MAKE_WORD(state, users) (((uint64_t) (state) << 32) | (uint64_t) (users))
+
+#define ENTRY_WORD_STATE(w) ((uint32_t) (w))
+#define ENTRY_WORD_PID(w) ((pid_t) ((w) >> 32))
+#define CLAIMED_BY(pid) (((uint64_t) (uint32_t) (pid) << 32) | ENTRY_CLAIMED)
+#define CLAIM_CHECK_SPINS (1 << 16)   // spins on a claimed entry between checks of its publisher
+
+/*
+ * one published queue
+ */
+typedef struct _df_directory_entry {
+    uint64_t state;               // ENTRY_* state (low 32 bits) | pid of the publisher if claimed
+    uint64_t hash;                // hash of name
+    char name[DF_DIRECTORY_NAME_LENGTH];
+    df_queue_info info;
+} df_directory_entry;
+
+/*
+ * the directory laid out in the region
+ */
+struct _df_directory_table {
+    uint64_t magic;
+    uint64_t state_users;         // DIRECTORY_* state (high 32 bits) | number of users (low 32 bits)
+    uint32_t max_entries;
+    char padding[CACHE_LINE_SIZE - 2*sizeof(uint64_t) - sizeof(uint32_t)];
+    df_directory_entry entries[0];
+};
+
+/*
+ * FNV-1a hash of a queue name
+ */
+static uint64_t hash_name (const char *name)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for(; *name; name ++) {
+        h = (h ^ (unsigned char) *name) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/*
+ * Return the state of an entry, waiting while it is being written. An entry whose
+ * publisher is gone is removed.
+ */
+static uint32_t wait_entry (df_directory_entry *e)
+{
+    uint64_t w;
+    uint32_t spins = 0;
+    while(ENTRY_WORD_STATE(w = __atomic_load_n(&e->state, __ATOMIC_ACQUIRE)) == ENTRY_CLAIMED) {
+        if(++ spins < CLAIM_CHECK_SPINS) {
+            continue;
+        }
+        spins = 0;
+        if(kill(ENTRY_WORD_PID(w), 0) == -1 && errno == ESRCH) {
+            __atomic_compare_exchange_n(&e->state, &w, ENTRY_REMOVED, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        }
+    }
+    return ENTRY_WORD_STATE(w);
+}
+
+/*
+ * Return the published entry of name, or NULL if there is none.
+ */
+static df_directory_entry *find_entry (struct _df_directory_table *table, const char *name)
+{
+    uint64_t h = hash_name(name);
+    uint32_t n = table->max_entries;
+    uint32_t i = h % n;
+    uint32_t probes;
+    for(probes = 0; probes < n; probes ++, i = (i + 1) % n) {
+        df_directory_entry *e = &table->entries[i];
+        uint32_t state = wait_entry(e);
+        if(state == ENTRY_EMPTY) {
+            return NULL;
+        }
+        if(state == ENTRY_READY && e->hash == h && strcmp(e->name, name) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Map the directory region: create it, or attach it if it exists. The region is
+ * created exclusively, so of two processes creating it at once one fails and
+ * attaches the other's instead of wiping it. Return NULL on error, with errno
+ * EAGAIN if another process is creating or removing the region right now.
+ */
+static df_shm_region_t open_region (df_directory_t dir, size_t size)
+{
+    int name_size = strlen(dir->name) + 1;
+    df_shm_region_t region = df_create_named_shm_region(dir->method, dir->name, name_size, size, NULL);
+    if(region || errno != EEXIST) {
+        return region;
+    }
+    region = df_attach_named_shm_region(dir->method, dir->name, name_size, size, NULL);
+    // ENOENT: the last user has just removed it; EAGAIN: its creator has not sized it yet
+    if(!region && (errno == ENOENT || errno == EAGAIN)) {
+        errno = EAGAIN;
+    }
+    return region;
+}
+
+/*
+ * Join the directory as one more user, initializing it if the region is new.
+ * Return 0 on success, 1 if the directory has been closed and -1 on error.
+ */
+static int join_table (struct _df_directory_table *table, uint32_t max_entries)
+{
+    uint64_t w = __atomic_load_n(&table->state_users, __ATOMIC_ACQUIRE);
+    while(1) {
+        switch(WORD_STATE(w)) {
+            case DIRECTORY_UNINIT:
+                if(__atomic_compare_exchange_n(&table->state_users, &w, MAKE_WORD(DIRECTORY_INIT, 1),
+                    0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+                    // the entries of a new region are zero, i.e. empty
+                    table->magic = DIRECTORY_MAGIC;
+                    table->max_entries = max_entries;
+                    __atomic_store_n(&table->state_users, MAKE_WORD(DIRECTORY_READY, 1), __ATOMIC_RELEASE);
+                    return 0;
+                }
+                break;
+            case DIRECTORY_INIT:
+                w = __atomic_load_n(&table->state_users, __ATOMIC_ACQUIRE);
+                break;
+            case DIRECTORY_READY:
+                if(table->magic != DIRECTORY_MAGIC || table->max_entries != max_entries) {
+                    fprintf(stderr, "Error: directory has %u entries instead of %u. %s:%d\n",
+                        table->max_entries, max_entries, __FILE__, __LINE__);
+                    return -1;
+                }
+                if(__atomic_compare_exchange_n(&table->state_users, &w, w + 1,
+                    0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+                    return 0;
+                }
+                break;
+            default:
+                return 1;
+        }
+    }
+}
+
+/*
+ * Free a directory handle and its method handle.
+ */
+static void free_directory (df_directory_t dir)
+{
+    if(dir->method) {
+        df_shm_finalize(dir->method);
+    }
+    free(dir->name);
+    free(dir);
+}
+
+df_directory_t df_open_directory (df_shm_method_t method, const char *name, uint32_t max_entries)
+{
+    assert(method != NULL);
+    assert(method->initialized == 1);
+    assert(name != NULL);
+
+    if(method->fixed_addr) {
+        fprintf(stderr, "Error: directory cannot be opened with DF_SHM_FLAG_FIXED_ADDR. %s:%d\n",
+            __FILE__, __LINE__);
+        return NULL;
+    }
+    // anon regions reach only forked children, and each open would create a new one
+    if(method->method != DF_SHM_METHOD_MMAP && method->method != DF_SHM_METHOD_POSIX_SHM) {
+        fprintf(stderr, "Error: method (%d) does not support regions named by strings. %s:%d\n",
+            method->method, __FILE__, __LINE__);
+        return NULL;
+    }
+    if(max_entries == 0) {
+        max_entries = DF_DIRECTORY_DEFAULT_ENTRIES;
+    }
+    size_t size = sizeof(struct _df_directory_table) + max_entries * sizeof(df_directory_entry);
+
+    df_directory_t dir = (df_directory_t) calloc(1, sizeof(df_directory));
+    if(!dir) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return NULL;
+    }
+    df_shm_config config = method->config;
+    config.flags |= DF_SHM_FLAG_EXCL;
+    dir->method = df_shm_init(method->method, &config);
+    dir->name = strdup(name);
+    if(!dir->method || !dir->name) {
+        fprintf(stderr, "Error: cannot set up directory %s. %s:%d\n", name, __FILE__, __LINE__);
+        free_directory(dir);
+        return NULL;
+    }
+
+    // another process may be creating the region, or closing the last handle of it
+    int attempt;
+    for(attempt = 0; attempt < OPEN_ATTEMPTS; attempt ++) {
+        dir->region = open_region(dir, size);
+        if(dir->region) {
+            dir->table = (struct _df_directory_table *) dir->region->starting_addr;
+            int rc = join_table(dir->table, max_entries);
+            if(rc == 0) {
+                return dir;
+            }
+            // the region belongs to its other users, or to the last one, who removes it
+            df_detach_shm_region(dir->region);
+            if(rc < 0) {
+                break;
+            }
+        }
+        else if(errno != EAGAIN) {
+            break;
+        }
+        usleep(OPEN_RETRY_USEC);
+    }
+    if(attempt == OPEN_ATTEMPTS) {
+        fprintf(stderr, "Error: cannot open directory %s. %s:%d\n", name, __FILE__, __LINE__);
+    }
+    free_directory(dir);
+    return NULL;
+}
+
+/*
+ * Remove the name of the directory region, which the last user has detached.
+ */
+static int remove_region (df_directory_t dir)
+{
+    int rc = dir->method->method == DF_SHM_METHOD_MMAP? unlink(dir->name) : shm_unlink(dir->name);
+    if(rc == -1) {
+        fprintf(stderr, "Error: cannot remove %s: %d. %s:%d\n", dir->name, errno, __FILE__, __LINE__);
+    }
+    return rc;
+}
+
+int df_close_directory (df_directory_t dir)
+{
+    assert(dir != NULL);
+
+    struct _df_directory_table *table = dir->table;
+    uint64_t w = __atomic_load_n(&table->state_users, __ATOMIC_ACQUIRE);
+    int last;
+    do {
+        last = WORD_USERS(w) == 1;
+    } while(!__atomic_compare_exchange_n(&table->state_users, &w,
+        last? MAKE_WORD(DIRECTORY_CLOSED, 0) : w - 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    // the last user removes the region, whichever process created it; others only
+    // unmap it
+    int rc = df_detach_shm_region(dir->region);
+    if(last && remove_region(dir) != 0) {
+        rc = -1;
+    }
+    free_directory(dir);
+    return rc;
+}
+
+int df_publish_queue (df_directory_t dir, const char *queue_name, df_shm_region_t region,
+                      df_queue_t queue)
+{
+    assert(dir != NULL);
+    assert(queue_name != NULL);
+    assert(region != NULL);
+    assert(queue != NULL);
+
+    if(strlen(queue_name) >= DF_DIRECTORY_NAME_LENGTH) {
+        fprintf(stderr, "Error: queue name %s is too long. %s:%d\n", queue_name, __FILE__, __LINE__);
+        return -1;
+    }
+    char *base = (char *) region->starting_addr;
+    if((char *) queue < base || (char *) queue - base + queue->total_size > region->size) {
+        fprintf(stderr, "Error: queue %p is not in region %p. %s:%d\n", queue, base,
+            __FILE__, __LINE__);
+        return -1;
+    }
+    int contact_length;
+    void *contact_info = df_shm_region_contact_info(region->shm_method, region, &contact_length);
+    if(!contact_info) {
+        return -1;
+    }
+    if(contact_length > DF_DIRECTORY_CONTACT_LENGTH) {
+        fprintf(stderr, "Error: contact info of %d bytes is too long. %s:%d\n", contact_length,
+            __FILE__, __LINE__);
+        free(contact_info);
+        return -1;
+    }
+
+    struct _df_directory_table *table = dir->table;
+    uint64_t h = hash_name(queue_name);
+    uint32_t n = table->max_entries;
+    uint32_t i = h % n;
+    uint32_t probes;
+    for(probes = 0; probes < n; probes ++, i = (i + 1) % n) {
+        df_directory_entry *e = &table->entries[i];
+        uint32_t state = wait_entry(e);
+        if(state == ENTRY_EMPTY) {
+            uint64_t w = ENTRY_EMPTY;
+            if(__atomic_compare_exchange_n(&e->state, &w, CLAIMED_BY(getpid()), 0,
+                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                e->hash = h;
+                strcpy(e->name, queue_name);
+                e->info.method = region->shm_method->method;
+                e->info.creator_id = region->creator_id;
+                e->info.region_size = region->size;
+                e->info.queue_offset = (char *) queue - base;
+                e->info.max_num_slots = queue->max_num_slots;
+                e->info.max_payload_size = queue->max_payload_size;
+                e->info.contact_length = contact_length;
+                memcpy(e->info.contact_info, contact_info, contact_length);
+                __atomic_store_n(&e->state, ENTRY_READY, __ATOMIC_RELEASE);
+                free(contact_info);
+                return 0;
+            }
+            // another publisher got the entry first; see whether it took the name
+            state = wait_entry(e);
+        }
+        if(state == ENTRY_READY && e->hash == h && strcmp(e->name, queue_name) == 0) {
+            fprintf(stderr, "Error: queue %s is already published. %s:%d\n", queue_name,
+                __FILE__, __LINE__);
+            free(contact_info);
+            return -1;
+        }
+    }
+    fprintf(stderr, "Error: directory is full (%u entries). %s:%d\n", n, __FILE__, __LINE__);
+    free(contact_info);
+    return -1;
+}
+
+int df_unpublish_queue (df_directory_t dir, const char *queue_name)
+{
+    assert(dir != NULL);
+    assert(queue_name != NULL);
+
+    df_directory_entry *e = find_entry(dir->table, queue_name);
+    uint64_t w = ENTRY_READY;
+    if(!e || !__atomic_compare_exchange_n(&e->state, &w, ENTRY_REMOVED, 0,
+        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        fprintf(stderr, "Error: queue %s is not published. %s:%d\n", queue_name, __FILE__, __LINE__);
+        return -1;
+    }
+    return 0;
+}
+
+int df_lookup_queue (df_directory_t dir, const char *queue_name, df_queue_info_t info)
+{
+    assert(dir != NULL);
+    assert(queue_name != NULL);
+    assert(info != NULL);
+
+    df_directory_entry *e = find_entry(dir->table, queue_name);
+    if(!e) {
+        return -1;
+    }
+    memcpy(info, &e->info, sizeof(df_queue_info));
+    return 0;
+}
+
+df_queue_t df_attach_queue (df_directory_t dir, df_shm_method_t method, const char *queue_name,
+                            df_shm_region_t *region)
+{
+    assert(dir != NULL);
+    assert(method != NULL);
+    assert(queue_name != NULL);
+    assert(region != NULL);
+
+    df_queue_info info;
+    if(df_lookup_queue(dir, queue_name, &info) != 0) {
+        return NULL;
+    }
+    if(info.method != method->method) {
+        fprintf(stderr, "Error: queue %s is in a region of method %d, not %d. %s:%d\n", queue_name,
+            info.method, method->method, __FILE__, __LINE__);
+        return NULL;
+    }
+    df_shm_region_t r = df_attach_shm_region(method, info.creator_id, info.contact_info,
+        info.region_size, NULL);
+    if(!r) {
+        return NULL;
+    }
+    df_queue_t queue = (df_queue_t) ((char *) r->starting_addr + info.queue_offset);
+    if(!queue->initialized || queue->max_num_slots != info.max_num_slots ||
+       queue->max_payload_size != info.max_payload_size) {
+        fprintf(stderr, "Error: queue %s does not match its directory entry. %s:%d\n", queue_name,
+            __FILE__, __LINE__);
+        df_detach_shm_region(r);
+        return NULL;
+    }
+    *region = r;
+    return queue;
+}
@@ -0,0 +1,109 @@
+#ifndef _DF_SHM_DIRECTORY_H_
+#define _DF_SHM_DIRECTORY_H_
+/*
+ * DataFabrics shared memory transport for inter-process and inter-thread
+ * communication on mulitcore.
+ *
+ * This header file defines a directory of named queues kept in a named shm
+ * region. A process publishes a queue it created under a name with one call,
+ * and any other process on the node finds and attaches it by name with one
+ * call, without exchanging contact info, pids or sizes out of band.
+ *
+ * The directory is a fixed-size open-addressing table updated with atomic
+ * operations only: publishing claims an empty entry with compare-and-swap and
+ * lookups never take a lock (they only wait for an entry which is being written).
+ * Entries are not reused once removed, so size the directory for all queues
+ * published during its lifetime.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "df_config.h"
+#include <stdint.h>
+#include <unistd.h>
+#include <stddef.h>
+#include "df_shm.h"
+#include "df_shm_queue.h"
+
+#define DF_DIRECTORY_NAME_LENGTH 64      // longest queue name including the terminating null
+#define DF_DIRECTORY_CONTACT_LENGTH 256  // longest region contact info
+#define DF_DIRECTORY_DEFAULT_ENTRIES 1024
+#define DF_DIRECTORY_DEFAULT_NAME "/df_shm_directory"  // a POSIX shm object name
+
+/*
+ * what a process needs to attach a published queue
+ */
+typedef struct _df_queue_info {
+    enum DF_SHM_METHOD method;    // shm method of the region holding the queue
+    pid_t creator_id;             // process which created the region
+    size_t region_size;           // size of the region
+    size_t queue_offset;          // offset of the queue in the region
+    uint32_t max_num_slots;       // geometry of the queue
+    size_t max_payload_size;
+    int contact_length;           // length of contact_info
+    char contact_info[DF_DIRECTORY_CONTACT_LENGTH]; // contact info of the region
+} df_queue_info, *df_queue_info_t;
+
+/*
+ * handle of a directory opened by this process
+ */
+typedef struct _df_directory {
+    df_shm_method_t method;       // handle of the region: the caller's configuration plus DF_SHM_FLAG_EXCL
+    char *name;                   // name of the region
+    df_shm_region_t region;       // the named region holding the directory
+    struct _df_directory_table *table;
+} df_directory, *df_directory_t;
+
+/*
+ * Open the directory in the named region 'name' (a file path for the mmap method or
+ * a "/name" for the POSIX shm method; other methods are rejected), creating it if
+ * it does not exist. All processes must pass the same max_entries (0 selects
+ * DF_DIRECTORY_DEFAULT_ENTRIES). The directory and its entries persist while any
+ * process has it open. method must not use DF_SHM_FLAG_FIXED_ADDR; the region is
+ * mapped through a handle of the directory's own with method's configuration, so
+ * finalizing method leaves the directory open. Return NULL on error.
+ */
+df_directory_t df_open_directory (df_shm_method_t method, const char *name, uint32_t max_entries);
+
+/*
+ * Close a directory. The last process to close it removes it. Return 0 on success
+ * and non-zero on error.
+ */
+int df_close_directory (df_directory_t dir);
+
+/*
+ * Publish queue, which lies in region (created by this process), under queue_name.
+ * Return 0 on success and non-zero on error, e.g. if the name is already published
+ * or the directory is full.
+ */
+int df_publish_queue (df_directory_t dir, const char *queue_name, df_shm_region_t region,
+                      df_queue_t queue);
+
+/*
+ * Remove queue_name from the directory. Return 0 on success and non-zero if the
+ * name is not published.
+ */
+int df_unpublish_queue (df_directory_t dir, const char *queue_name);
+
+/*
+ * Copy the information of the queue published under queue_name into *info. Return
+ * 0 on success and -1 if the name is not published.
+ */
+int df_lookup_queue (df_directory_t dir, const char *queue_name, df_queue_info_t info);
+
+/*
+ * Attach the region of the queue published under queue_name through method (of the
+ * same kind as the queue creator's) and return the queue; *region returns the region,
+ * which the caller detaches with df_detach_shm_region() when done. Return NULL if the
+ * name is not published (without printing an error, so callers can poll) or on error.
+ */
+df_queue_t df_attach_queue (df_directory_t dir, df_shm_method_t method, const char *queue_name,
+                            df_shm_region_t *region);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
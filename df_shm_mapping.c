@@ -0,0 +1,564 @@
+/*
+ * Helper functions shared by the underlying shared memory methods to
+ * size and map shm regions according to the method's configuration.
+ *
+ */
+#define _GNU_SOURCE // fallocate()
+#include "df_config.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <mntent.h>
+#include <sys/mman.h>
+#include <sys/vfs.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef HAVE_NUMA
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+#include "df_shm.h"
+#include "df_shm_mapping.h"
+#include "df_shm_window.h"
+
+#ifndef HUGETLBFS_MAGIC
+#define HUGETLBFS_MAGIC 0x958458f6
+#endif
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+#ifndef TMPFS_MAGIC
+#define TMPFS_MAGIC 0x01021994
+#endif
+
+#define DEFAULT_BACKING_DIR "/dev/shm"
+#define FALLBACK_BACKING_DIR "/tmp"
+#define DEFAULT_MODE 0600
+#define DEFAULT_NAME_PREFIX "df_shm"
+#define DEFAULT_WINDOW_BASE ((void *) 0x600000000000UL)
+#define DEFAULT_WINDOW_SIZE (1UL << 36)
+
+#define MEMINFO_PATH "/proc/meminfo"
+#define MOUNTS_PATH "/proc/mounts"
+
+/* number of pages queried per move_pages() call */
+#define PLACEMENT_BATCH 1024
+
+/*
+ * Return 1 if dir is on tmpfs or hugetlbfs and 0 otherwise.
+ */
+static int is_memory_backed (const char *dir)
+{
+    struct statfs fs;
+    if(statfs(dir, &fs) == -1) {
+        return 0;
+    }
+    return fs.f_type == TMPFS_MAGIC || fs.f_type == HUGETLBFS_MAGIC;
+}
+
+/*
+ * Copy the configuration passed to df_shm_init() into *config and fill in defaults.
+ */
+void df_shm_load_config (df_shm_config *config, void *input_data)
+{
+    memset(config, 0, sizeof(df_shm_config));
+    if(input_data) {
+        memcpy(config, input_data, sizeof(df_shm_config));
+    }
+    config->backing_dir[DF_SHM_PATH_LENGTH - 1] = '\0';
+    config->name_prefix[DF_SHM_NAME_LENGTH - 1] = '\0';
+
+    if(!config->backing_dir[0]) {
+        strcpy(config->backing_dir, is_memory_backed(DEFAULT_BACKING_DIR)?
+            DEFAULT_BACKING_DIR : FALLBACK_BACKING_DIR);
+    }
+    if(!config->mode) {
+        config->mode = DEFAULT_MODE;
+    }
+    if(!config->name_prefix[0]) {
+        strcpy(config->name_prefix, DEFAULT_NAME_PREFIX);
+    }
+    if(!config->fixed_window_base) {
+        config->fixed_window_base = DEFAULT_WINDOW_BASE;
+    }
+    if(!config->fixed_window_size) {
+        config->fixed_window_size = DEFAULT_WINDOW_SIZE;
+    }
+}
+
+int df_shm_check_backing_dir (const char *dir)
+{
+    if(is_memory_backed(dir)) {
+        return 1;
+    }
+    fprintf(stderr, "Warning: %s is not on tmpfs or hugetlbfs; shm regions in it will be "
+        "written back to disk. %s:%d\n", dir, __FILE__, __LINE__);
+    return 0;
+}
+
+/*
+ * Parse a size string such as "2048 kB", "2M" or "1G".
+ */
+static size_t parse_size (const char *str)
+{
+    char *end;
+    size_t size = (size_t) strtoull(str, &end, 10);
+    while(*end == ' ') end ++;
+    switch(*end) {
+        case 'k': case 'K': size <<= 10; break;
+        case 'm': case 'M': size <<= 20; break;
+        case 'g': case 'G': size <<= 30; break;
+        default: break;
+    }
+    return size;
+}
+
+/*
+ * Return the system default huge page size (0 if not supported).
+ */
+static size_t df_shm_default_huge_page_size ()
+{
+    static size_t default_size = (size_t) -1;
+    if(default_size != (size_t) -1) {
+        return default_size;
+    }
+
+    default_size = 0;
+    FILE *f = fopen(MEMINFO_PATH, "r");
+    if(!f) {
+        return default_size;
+    }
+    char line[256];
+    while(fgets(line, sizeof(line), f)) {
+        if(!strncmp(line, "Hugepagesize:", strlen("Hugepagesize:"))) {
+            default_size = parse_size(line + strlen("Hugepagesize:"));
+            break;
+        }
+    }
+    fclose(f);
+    return default_size;
+}
+
+size_t df_shm_huge_page_size (const df_shm_config *config)
+{
+    if(config->huge_page_size) {
+        return config->huge_page_size;
+    }
+    return df_shm_default_huge_page_size();
+}
+
+int df_shm_find_hugetlbfs (size_t page_size, char *path, int path_len)
+{
+    FILE *f = setmntent(MOUNTS_PATH, "r");
+    if(!f) {
+        return -1;
+    }
+    int rc = -1;
+    struct mntent *ent;
+    while((ent = getmntent(f)) != NULL) {
+        if(strcmp(ent->mnt_type, "hugetlbfs")) {
+            continue;
+        }
+        size_t mount_page_size = df_shm_default_huge_page_size();
+        char *opt = hasmntopt(ent, "pagesize");
+        if(opt) {
+            mount_page_size = parse_size(opt + strlen("pagesize="));
+        }
+        if(mount_page_size == page_size && strlen(ent->mnt_dir) < path_len) {
+            strcpy(path, ent->mnt_dir);
+            rc = 0;
+            break;
+        }
+    }
+    endmntent(f);
+    return rc;
+}
+
+size_t df_shm_fd_page_size (int fd)
+{
+    struct statfs fs;
+    if(fstatfs(fd, &fs) == 0 && fs.f_type == HUGETLBFS_MAGIC) {
+        return (size_t) fs.f_bsize;
+    }
+    return PAGE_SIZE;
+}
+
+int df_shm_check_fd_length (int fd, const char *name, size_t length)
+{
+    struct stat st;
+    if(fstat(fd, &st) == -1) {
+        fprintf(stderr, "Error: fstat() on %s failed: %d %s:%d\n", name, errno, __FILE__, __LINE__);
+        return -1;
+    }
+    if(st.st_size == 0) {
+        // its creator has not sized it yet
+        errno = EAGAIN;
+        return -1;
+    }
+    if((size_t) st.st_size < length) {
+        errno = EINVAL;
+        fprintf(stderr, "Error: %s has %ld bytes, fewer than the %lu to be mapped. %s:%d\n",
+            name, (long) st.st_size, length, __FILE__, __LINE__);
+        return -1;
+    }
+    return 0;
+}
+
+size_t df_shm_round_size (size_t size, size_t page_size)
+{
+    if(page_size && size % page_size) {
+        size += page_size - (size % page_size);
+    }
+    return size;
+}
+
+void *df_shm_map_fd (int fd, size_t length, void *starting_addr)
+{
+    if(starting_addr != NULL && (uint64_t)starting_addr % PAGE_SIZE) {
+        fprintf(stderr, "Warning: the starting address (%p) is not page-aligned. %s:%d\n",
+            starting_addr, __FILE__, __LINE__);
+    }
+
+    void *addr = mmap(starting_addr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(addr == MAP_FAILED) {
+        fprintf(stderr, "Error: mmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+        return MAP_FAILED;
+    }
+    if(starting_addr != NULL && addr != starting_addr) {
+        fprintf(stderr, "Warning: shared memory region attached to %p instead of %p. %s:%d\n",
+            addr, starting_addr, __FILE__, __LINE__);
+    }
+    return addr;
+}
+
+size_t df_shm_header_length (const df_shm_config *config)
+{
+    return config->max_region_size? DF_SHM_HEADER_LENGTH : 0;
+}
+
+/*
+ * Map a region at its address in the fixed-address window: starting_addr is where
+ * the region proper starts, or NULL to allocate an address for a new region.
+ */
+static void *map_region_fixed (const df_shm_config *config, int fd, size_t length, 
+                               void *starting_addr, size_t *mapped_length)
+{
+    size_t header_length = df_shm_header_length(config);
+    size_t total = config->max_region_size? 
+        header_length + df_shm_round_size(config->max_region_size, PAGE_SIZE) : length;
+    if(length > total) {
+        fprintf(stderr, "Error: region of %lu bytes exceeds max_region_size %lu. %s:%d\n",
+            length - header_length, config->max_region_size, __FILE__, __LINE__);
+        return MAP_FAILED;
+    }
+    char *base = starting_addr? (char *) starting_addr - header_length : 
+        (char *) df_shm_window_alloc(total);
+    if(!base || df_shm_window_claim(base, total) != 0) {
+        return MAP_FAILED;
+    }
+
+    // take the range out of the reservation; MAP_FIXED_NOREPLACE then fails instead of
+    // clobbering anything which got there in between
+    munmap(base, total);
+    void *addr;
+    if(config->max_region_size) {
+        addr = mmap(base, total, PROT_NONE, 
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+        if(addr == base && mmap(base, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, 
+            fd, 0) == MAP_FAILED) {
+            fprintf(stderr, "Error: mmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+            df_shm_window_unmap(base, total);
+            return MAP_FAILED;
+        }
+    }
+    else {
+        addr = mmap(base, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+    }
+    if(addr != base) {
+        fprintf(stderr, "Error: cannot map shm region at fixed address %p: %d. %s:%d\n",
+            base, addr == MAP_FAILED? errno : EEXIST, __FILE__, __LINE__);
+        if(addr != MAP_FAILED) {
+            munmap(addr, total);
+        }
+        df_shm_window_unmap(base, total);
+        return MAP_FAILED;
+    }
+    *mapped_length = total;
+    return addr;
+}
+
+void *df_shm_map_region_fd (const df_shm_config *config, int fd, size_t length, 
+                            void *starting_addr, size_t *mapped_length)
+{
+    if(config->flags & DF_SHM_FLAG_FIXED_ADDR) {
+        return map_region_fixed(config, fd, length, starting_addr, mapped_length);
+    }
+    if(!config->max_region_size) {
+        *mapped_length = length;
+        return df_shm_map_fd(fd, length, starting_addr);
+    }
+
+    // reserve address space for the largest size so the region can grow in place
+    size_t window = DF_SHM_HEADER_LENGTH + df_shm_round_size(config->max_region_size, PAGE_SIZE);
+    if(length > window) {
+        fprintf(stderr, "Error: region of %lu bytes exceeds max_region_size %lu. %s:%d\n",
+            length - DF_SHM_HEADER_LENGTH, config->max_region_size, __FILE__, __LINE__);
+        return MAP_FAILED;
+    }
+    void *hint = starting_addr? (char *) starting_addr - DF_SHM_HEADER_LENGTH : NULL;
+    void *addr = mmap(hint, window, PROT_NONE, 
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(addr == MAP_FAILED) {
+        fprintf(stderr, "Error: reserving %lu bytes with mmap() returns %d. %s:%d\n", 
+            window, errno, __FILE__, __LINE__);
+        return MAP_FAILED;
+    }
+    if(hint != NULL && addr != hint) {
+        fprintf(stderr, "Warning: shared memory region attached to %p instead of %p. %s:%d\n",
+            (char *) addr + DF_SHM_HEADER_LENGTH, starting_addr, __FILE__, __LINE__);
+    }
+    if(mmap(addr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        fprintf(stderr, "Error: mmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+        munmap(addr, window);
+        return MAP_FAILED;
+    }
+    *mapped_length = window;
+    return addr;
+}
+
+int df_shm_unmap_region (void *addr, size_t mapped_length)
+{
+    return df_shm_window_unmap(addr, mapped_length);
+}
+
+int df_shm_grow_mapping (const df_shm_config *config, int fd, void *addr, 
+                         size_t old_length, size_t new_length, size_t page_size)
+{
+    size_t window = DF_SHM_HEADER_LENGTH + df_shm_round_size(config->max_region_size, PAGE_SIZE);
+    if(new_length > window) {
+        fprintf(stderr, "Error: region of %lu bytes exceeds max_region_size %lu. %s:%d\n",
+            new_length - DF_SHM_HEADER_LENGTH, config->max_region_size, __FILE__, __LINE__);
+        return -1;
+    }
+    if(new_length <= old_length) {
+        return 0;
+    }
+
+    // map the new part of fd over the reserved address space after the old part
+    char *tail = (char *) addr + old_length;
+    if(mmap(tail, new_length - old_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, 
+        fd, old_length) == MAP_FAILED) {
+        fprintf(stderr, "Error: mmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+        return -1;
+    }
+    df_shm_advise_mapping(config, tail, new_length - old_length, page_size);
+    return 0;
+}
+
+void df_shm_init_header (void *addr, size_t size)
+{
+    df_shm_region_header *header = (df_shm_region_header *) addr;
+    header->size = size;
+    header->generation = 0;
+    __atomic_store_n(&header->magic, DF_SHM_REGION_MAGIC, __ATOMIC_RELEASE);
+}
+
+int df_shm_check_header (void *addr)
+{
+    df_shm_region_header *header = (df_shm_region_header *) addr;
+    if(__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != DF_SHM_REGION_MAGIC) {
+        fprintf(stderr, "Error: region has no valid header; is max_region_size set by its "
+            "creator? %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    return 0;
+}
+
+void df_shm_publish_size (void *addr, size_t size)
+{
+    df_shm_region_header *header = (df_shm_region_header *) addr;
+    __atomic_store_n(&header->size, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&header->generation, 1, __ATOMIC_RELEASE);
+}
+
+uint64_t df_shm_header_generation (void *addr, size_t *size)
+{
+    df_shm_region_header *header = (df_shm_region_header *) addr;
+    uint64_t generation = __atomic_load_n(&header->generation, __ATOMIC_ACQUIRE);
+    *size = __atomic_load_n(&header->size, __ATOMIC_RELAXED);
+    return generation;
+}
+
+/*
+ * Fault in all pages of a mapped range without changing its contents.
+ */
+static void df_shm_populate (void *addr, size_t length, size_t page_size)
+{
+#ifdef MADV_POPULATE_WRITE
+    if(madvise(addr, length, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+    if(errno != EINVAL) {
+        fprintf(stderr, "Warning: madvise(MADV_POPULATE_WRITE) returns %d. %s:%d\n",
+            errno, __FILE__, __LINE__);
+        return;
+    }
+    // kernel older than 5.14: touch the pages instead
+#endif
+    size_t offset;
+    for(offset = 0; offset < length; offset += page_size) {
+        __atomic_fetch_add((char *)addr + offset, 0, __ATOMIC_RELAXED);
+    }
+}
+
+#ifdef HAVE_NUMA
+/*
+ * Set the NUMA policy of a mapped range. For shared memory the policy is kept with
+ * the shm object, so it governs page faults from every process mapping it.
+ */
+static void df_shm_set_numa_policy (const df_shm_config *config, void *addr, size_t length)
+{
+    int mode;
+    unsigned long nodemask = config->numa_nodemask;
+    switch(config->numa_policy) {
+        case DF_SHM_NUMA_BIND: mode = MPOL_BIND; break;
+        case DF_SHM_NUMA_INTERLEAVE: mode = MPOL_INTERLEAVE; break;
+        case DF_SHM_NUMA_PREFERRED:
+            mode = MPOL_PREFERRED;
+            nodemask &= -nodemask; // only the first node
+            break;
+        case DF_SHM_NUMA_LOCAL: {
+            unsigned cpu, node;
+            if(syscall(SYS_getcpu, &cpu, &node, NULL) == -1) {
+                fprintf(stderr, "Warning: getcpu() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+                return;
+            }
+            mode = MPOL_PREFERRED;
+            nodemask = 1UL << node;
+            break;
+        }
+        default:
+            return;
+    }
+    if(nodemask == 0) {
+        fprintf(stderr, "Warning: NUMA policy %d without nodes is ignored. %s:%d\n",
+            config->numa_policy, __FILE__, __LINE__);
+        return;
+    }
+    if(syscall(SYS_mbind, addr, length, mode, &nodemask, DF_SHM_MAX_NUMA_NODES + 1, 0) == -1) {
+        fprintf(stderr, "Warning: mbind() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+    }
+}
+#endif
+
+int df_shm_reserve_mapping (const df_shm_config *config, int fd, void *addr, size_t offset, size_t length)
+{
+    if(!(config->flags & DF_SHM_FLAG_RESERVE)) {
+        return 0;
+    }
+#ifdef HAVE_NUMA
+    // fallocate() allocates the pages now, so the policy has to be in place first
+    if(config->numa_policy != DF_SHM_NUMA_DEFAULT) {
+        df_shm_set_numa_policy(config, addr, length);
+    }
+#endif
+    if(fallocate(fd, 0, offset, length) == -1) {
+        if(errno == EOPNOTSUPP) {
+            fprintf(stderr, "Warning: file system does not support fallocate(). %s:%d\n",
+                __FILE__, __LINE__);
+            return 0;
+        }
+        fprintf(stderr, "Error: fallocate() of %lu bytes returns %d. %s:%d\n",
+            length, errno, __FILE__, __LINE__);
+        return -1;
+    }
+    return 0;
+}
+
+void df_shm_advise_mapping (const df_shm_config *config, void *addr, size_t length, size_t page_size)
+{
+    if(config->numa_policy != DF_SHM_NUMA_DEFAULT) {
+#ifdef HAVE_NUMA
+        df_shm_set_numa_policy(config, addr, length);
+#else
+        fprintf(stderr, "Warning: NUMA placement is not supported. %s:%d\n", __FILE__, __LINE__);
+#endif
+    }
+
+    if((config->flags & DF_SHM_FLAG_HUGEPAGE) && page_size <= PAGE_SIZE) {
+        // no hugetlb pages backing this region: ask for transparent huge pages instead
+#ifdef MADV_HUGEPAGE
+        if(madvise(addr, length, MADV_HUGEPAGE) == -1) {
+            fprintf(stderr, "Warning: madvise(MADV_HUGEPAGE) returns %d. %s:%d\n",
+                errno, __FILE__, __LINE__);
+        }
+#else
+        fprintf(stderr, "Warning: transparent huge pages are not supported. %s:%d\n",
+            __FILE__, __LINE__);
+#endif
+    }
+
+    // populate after the policies above are set so that they apply to the new pages
+    if(config->flags & DF_SHM_FLAG_POPULATE) {
+        df_shm_populate(addr, length, page_size > PAGE_SIZE ? page_size : PAGE_SIZE);
+    }
+    if(config->flags & DF_SHM_FLAG_MLOCK) {
+        if(mlock(addr, length) == -1) {
+            fprintf(stderr, "Warning: mlock() of %lu bytes returns %d. %s:%d\n",
+                length, errno, __FILE__, __LINE__);
+        }
+    }
+}
+
+int df_shm_query_placement (void *addr, size_t length, df_shm_placement_t placement)
+{
+#ifdef HAVE_NUMA
+    memset(placement, 0, sizeof(df_shm_placement));
+
+    // policy of the range
+    int mode;
+    unsigned long nodemask = 0;
+    if(syscall(SYS_get_mempolicy, &mode, &nodemask, DF_SHM_MAX_NUMA_NODES + 1, addr, MPOL_F_ADDR) == -1) {
+        fprintf(stderr, "Error: get_mempolicy() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+        return -1;
+    }
+    switch(mode) {
+        case MPOL_BIND: placement->policy = DF_SHM_NUMA_BIND; break;
+        case MPOL_INTERLEAVE: placement->policy = DF_SHM_NUMA_INTERLEAVE; break;
+        case MPOL_PREFERRED: placement->policy = DF_SHM_NUMA_PREFERRED; break;
+        default: placement->policy = DF_SHM_NUMA_DEFAULT; break;
+    }
+    placement->nodemask = nodemask;
+
+    // node of each resident page; pages not faulted in yet report -ENOENT
+    void *pages[PLACEMENT_BATCH];
+    int status[PLACEMENT_BATCH];
+    placement->num_pages = (length + PAGE_SIZE - 1) / PAGE_SIZE;
+    size_t i, j;
+    for(i = 0; i < placement->num_pages; i += PLACEMENT_BATCH) {
+        size_t count = placement->num_pages - i;
+        if(count > PLACEMENT_BATCH) count = PLACEMENT_BATCH;
+        for(j = 0; j < count; j ++) {
+            pages[j] = (char *)addr + (i + j) * PAGE_SIZE;
+        }
+        if(syscall(SYS_move_pages, 0, count, pages, NULL, status, 0) == -1) {
+            fprintf(stderr, "Error: move_pages() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+            return -1;
+        }
+        for(j = 0; j < count; j ++) {
+            if(status[j] >= 0 && status[j] < DF_SHM_MAX_NUMA_NODES) {
+                placement->resident_pages ++;
+                placement->pages_per_node[status[j]] ++;
+            }
+        }
+    }
+    return 0;
+#else
+    fprintf(stderr, "Error: NUMA placement is not supported. %s:%d\n", __FILE__, __LINE__);
+    return -1;
+#endif
+}
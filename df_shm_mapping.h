@@ -0,0 +1,153 @@
+#ifndef _DF_SHM_MAPPING_H_
+#define _DF_SHM_MAPPING_H_
+
+#include <stdint.h>
+#include "df_shm.h"
+#include "df_config.h"
+
+/*
+ * Helper functions shared by the underlying shared memory methods to
+ * size and map shm regions according to the method's df_shm_config.
+ * Not part of the public interface.
+ */
+
+/*
+ * Copy the configuration passed to df_shm_init() into *config and fill in defaults
+ * for fields left unset. NULL input_data selects the default configuration.
+ */
+void df_shm_load_config (df_shm_config *config, void *input_data);
+
+/*
+ * Warn if dir is not on a memory-backed file system (tmpfs or hugetlbfs), in which
+ * case dirty pages of shm regions are written back to disk. Return 1 if dir is
+ * memory-backed and 0 otherwise.
+ */
+int df_shm_check_backing_dir (const char *dir);
+
+/*
+ * Return the huge page size to use for the configuration: the configured one, or
+ * the system default huge page size. Return 0 if huge pages are not supported.
+ */
+size_t df_shm_huge_page_size (const df_shm_config *config);
+
+/*
+ * Find a mounted hugetlbfs whose page size is page_size and copy its mount point
+ * into path (of length path_len). Return 0 on success and -1 if there is none.
+ */
+int df_shm_find_hugetlbfs (size_t page_size, char *path, int path_len);
+
+/*
+ * Return the page size of the file system backing fd (the huge page size if the
+ * file is on hugetlbfs, otherwise PAGE_SIZE).
+ */
+size_t df_shm_fd_page_size (int fd);
+
+/*
+ * Check that the file or shm object of fd (called name) holds at least length
+ * bytes, so that mapping length bytes of it cannot fault past its end. Return 0
+ * if it does and -1 otherwise, with errno EAGAIN if it is still empty (its creator
+ * has not sized it yet) and EINVAL if it is too small.
+ */
+int df_shm_check_fd_length (int fd, const char *name, size_t length);
+
+/*
+ * Round size up to a multiple of page_size.
+ */
+size_t df_shm_round_size (size_t size, size_t page_size);
+
+/*
+ * Map length bytes of fd shared at starting_addr (a hint). Warn if the region
+ * ends up at another address. Return MAP_FAILED on error.
+ */
+void *df_shm_map_fd (int fd, size_t length, void *starting_addr);
+
+/*
+ * header at the start of the backing object of a growable region; the region
+ * proper starts DF_SHM_HEADER_LENGTH bytes after it
+ */
+#define DF_SHM_REGION_MAGIC 0x64665f73686d6772ULL  // "df_shmgr"
+#define DF_SHM_HEADER_LENGTH PAGE_SIZE
+
+typedef struct _df_shm_region_header {
+    uint64_t magic;
+    uint64_t generation;    // incremented by each resize, after size is updated
+    uint64_t size;          // size of the region (without the header) in bytes
+} df_shm_region_header;
+
+/*
+ * Return the length of the header in front of regions of the configuration:
+ * DF_SHM_HEADER_LENGTH if regions are growable and 0 otherwise.
+ */
+size_t df_shm_header_length (const df_shm_config *config);
+
+/*
+ * Map length bytes of fd shared so that the region proper (after the header, if any)
+ * starts at starting_addr, which is a hint unless DF_SHM_FLAG_FIXED_ADDR is set. For
+ * growable regions, address space for the header and max_region_size bytes is
+ * reserved first and fd is mapped over its start. With DF_SHM_FLAG_FIXED_ADDR the
+ * mapping is placed in the fixed-address window, at a newly allocated address if
+ * starting_addr is NULL, and fails if the address is taken. *mapped_length returns
+ * the length to pass to df_shm_unmap_region() later. Return MAP_FAILED on error.
+ */
+void *df_shm_map_region_fd (const df_shm_config *config, int fd, size_t length, 
+                            void *starting_addr, size_t *mapped_length);
+
+/*
+ * Unmap a mapping made by df_shm_map_region_fd(). Return 0 on success and -1 on error.
+ */
+int df_shm_unmap_region (void *addr, size_t mapped_length);
+
+/*
+ * Extend the mapping of fd at addr (made by df_shm_map_region_fd()) from old_length
+ * to new_length bytes and apply the configuration's options to the new part. 
+ * Return 0 on success and -1 on error.
+ */
+int df_shm_grow_mapping (const df_shm_config *config, int fd, void *addr, 
+                         size_t old_length, size_t new_length, size_t page_size);
+
+/*
+ * Initialize the header of a growable region of 'size' bytes mapped at addr.
+ */
+void df_shm_init_header (void *addr, size_t size);
+
+/*
+ * Check the header of a growable region mapped at addr. Return 0 if it is valid and
+ * -1 otherwise.
+ */
+int df_shm_check_header (void *addr);
+
+/*
+ * Publish a new size of the growable region mapped at addr to its peers.
+ */
+void df_shm_publish_size (void *addr, size_t size);
+
+/*
+ * Return the generation of the growable region mapped at addr and its size at that
+ * generation in *size.
+ */
+uint64_t df_shm_header_generation (void *addr, size_t *size);
+
+/*
+ * Allocate the backing pages of length bytes of fd from offset, which are mapped at
+ * addr, if DF_SHM_FLAG_RESERVE is set. The NUMA policy is set on the mapping first
+ * so that the pages are allocated under it; call this before anything is written
+ * to the range. Return 0 on success and -1 if the pages cannot be allocated.
+ */
+int df_shm_reserve_mapping (const df_shm_config *config, int fd, void *addr, size_t offset, size_t length);
+
+/*
+ * Apply the configuration's options to a freshly mapped range of page_size pages,
+ * e.g. ask for transparent huge pages when hugetlb pages were requested but are not
+ * available, and set the NUMA placement policy before pages are faulted in. Then
+ * pre-fault and lock the range if requested.
+ * Failures are not fatal and only produce warnings.
+ */
+void df_shm_advise_mapping (const df_shm_config *config, void *addr, size_t length, size_t page_size);
+
+/*
+ * Query the NUMA policy of a mapped range and the nodes its resident pages are on.
+ * Return 0 on success and -1 on error.
+ */
+int df_shm_query_placement (void *addr, size_t length, df_shm_placement_t placement);
+
+#endif
@@ -0,0 +1,696 @@
+/*
+ * memfd shared memory method
+ *
+ * Regions are anonymous memfd_create() objects: they have no file system names,
+ * are never written back to disk and go away with the last mapping or descriptor,
+ * even if the processes using them crash. The creator keeps the descriptor of each
+ * region open and hands it out over a Unix domain socket (SCM_RIGHTS) bound to an
+ * abstract address; a small server thread is started on the first region creation.
+ *
+ */
+#define _GNU_SOURCE // memfd_create(), file seals, struct ucred
+#include "df_config.h"
+
+#ifdef HAVE_MEMFD
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "df_shm.h"
+#include "df_shm_mapping.h"
+#include "df_shm_window.h"
+
+#define SOCKET_NAME_LENGTH 64
+#define LISTEN_BACKLOG 64
+#define REQUEST_TIMEOUT_SEC 1 // how long the server waits for a connected client's request
+
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB 0x0004U
+#endif
+#ifndef MFD_HUGE_SHIFT
+#define MFD_HUGE_SHIFT 26
+#endif
+
+/*
+ * a region exported by this process, looked up by id when a peer asks for it
+ */
+typedef struct _memfd_export {
+    uint64_t id;
+    int fd;
+    struct _memfd_export *next;
+} memfd_export, *memfd_export_t;
+
+/*
+ * global method level bookkeeping data
+ */
+typedef struct _shm_memfd_method_data {
+    df_shm_config config;
+    size_t huge_page_size;   // 0 if huge pages are not used
+    pid_t my_pid;
+    char socket_name[SOCKET_NAME_LENGTH]; // abstract socket address (without leading '\0')
+    int listen_fd;           // -1 until the server thread is started
+    pthread_t server_thread;
+    pthread_mutex_t lock;    // protects exports, next_id and listen_fd
+    memfd_export_t exports;
+    uint64_t next_id;
+} shm_memfd_method_data, *shm_memfd_method_data_t;
+
+/*
+ * per-region data
+ */
+typedef struct _shm_memfd_region_data {
+    int fd;            // memfd descriptor; kept open by the creator and by attachers
+                       // of growable regions, -1 otherwise
+    uint64_t id;
+    size_t file_length;
+    size_t page_size;
+    void *attach_addr;
+    size_t mapped_length;
+    size_t header_length;  // DF_SHM_HEADER_LENGTH if the region is growable, 0 otherwise
+    uint64_t generation;   // generation of the header the local mapping is up to date with
+} shm_memfd_region_data, *shm_memfd_region_data_t;
+
+/*
+ * Build the abstract socket address for socket_name. Return the address length.
+ */
+static socklen_t memfd_socket_addr (const char *socket_name, struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    size_t len = strlen(socket_name);
+    memcpy(addr->sun_path + 1, socket_name, len); // sun_path[0] = '\0': abstract namespace
+    return (socklen_t) (offsetof(struct sockaddr_un, sun_path) + 1 + len);
+}
+
+/*
+ * Send a reply to a region request: the status and, on success, the region's fd.
+ */
+static int memfd_send_fd (int sock, int status, int fd)
+{
+    struct iovec iov = { &status, sizeof(status) };
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if(status == 0) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    if(sendmsg(sock, &msg, MSG_NOSIGNAL) == -1) {
+        fprintf(stderr, "Error: sendmsg() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Receive a reply to a region request. Return the fd or -1 on error.
+ */
+static int memfd_recv_fd (int sock)
+{
+    int status = -1;
+    struct iovec iov = { &status, sizeof(status) };
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if(n != sizeof(status)) {
+        fprintf(stderr, "Error: recvmsg() returns %ld (errno %d). %s:%d\n",
+            (long) n, errno, __FILE__, __LINE__);
+        return -1;
+    }
+    if(status != 0) {
+        fprintf(stderr, "Error: region is not exported by its creator. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if(!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        fprintf(stderr, "Error: reply does not carry a file descriptor. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+/*
+ * Serve one region request: read the region id and reply with its fd. Only
+ * processes of the same user are served.
+ */
+static void memfd_serve_request (shm_memfd_method_data_t m_data, int sock)
+{
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if(getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1 ||
+       cred.uid != geteuid()) {
+        memfd_send_fd(sock, -1, -1);
+        return;
+    }
+
+    // one server thread serves all attachers, so a silent client must not hold it
+    struct timeval timeout = { REQUEST_TIMEOUT_SEC, 0 };
+    if(setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1) {
+        fprintf(stderr, "Error: setsockopt() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+        return;
+    }
+    uint64_t id;
+    if(recv(sock, &id, sizeof(id), MSG_WAITALL) != sizeof(id)) {
+        fprintf(stderr, "Error: cannot read region request. %s:%d\n", __FILE__, __LINE__);
+        return;
+    }
+
+    // the fd stays valid while the lock is held since destroy removes the export first
+    pthread_mutex_lock(&m_data->lock);
+    memfd_export_t e;
+    for(e = m_data->exports; e != NULL; e = e->next) {
+        if(e->id == id) break;
+    }
+    if(e) {
+        memfd_send_fd(sock, 0, e->fd);
+    }
+    else {
+        memfd_send_fd(sock, -1, -1);
+    }
+    pthread_mutex_unlock(&m_data->lock);
+}
+
+static void *memfd_server (void *arg)
+{
+    shm_memfd_method_data_t m_data = (shm_memfd_method_data_t) arg;
+    while(1) {
+        int sock = accept4(m_data->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if(sock == -1) {
+            if(errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break; // listening socket shut down by finalize
+        }
+        memfd_serve_request(m_data, sock);
+        close(sock);
+    }
+    return NULL;
+}
+
+/*
+ * Bind the abstract socket and start the server thread if not done yet. Called
+ * with m_data->lock held. Return 0 on success and -1 on error.
+ */
+static int memfd_start_server (shm_memfd_method_data_t m_data)
+{
+    if(m_data->listen_fd != -1) {
+        return 0;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd == -1) {
+        fprintf(stderr, "Error: socket() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+        return -1;
+    }
+    struct sockaddr_un addr;
+    socklen_t addr_len = memfd_socket_addr(m_data->socket_name, &addr);
+    if(bind(fd, (struct sockaddr *) &addr, addr_len) == -1 || listen(fd, LISTEN_BACKLOG) == -1) {
+        fprintf(stderr, "Error: cannot listen on socket @%s: %d. %s:%d\n",
+            m_data->socket_name, errno, __FILE__, __LINE__);
+        close(fd);
+        return -1;
+    }
+    m_data->listen_fd = fd;
+    int rc = pthread_create(&m_data->server_thread, NULL, memfd_server, m_data);
+    if(rc) {
+        fprintf(stderr, "Error: pthread_create() returns %d. %s:%d\n", rc, __FILE__, __LINE__);
+        close(fd);
+        m_data->listen_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int df_shm_method_memfd_init (void *input_data, void **method_data)
+{
+    shm_memfd_method_data_t m_data = (shm_memfd_method_data_t)
+        malloc(sizeof(shm_memfd_method_data));
+    if(!m_data) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    df_shm_load_config(&m_data->config, input_data);
+    // regions are placed in the address window shared with peers
+    if((m_data->config.flags & DF_SHM_FLAG_FIXED_ADDR) && df_shm_window_open(&m_data->config) != 0) {
+        free(m_data);
+        return -1;
+    }
+    m_data->my_pid = getpid();
+    m_data->huge_page_size = 0;
+    if(m_data->config.flags & DF_SHM_FLAG_HUGEPAGE) {
+        m_data->huge_page_size = df_shm_huge_page_size(&m_data->config);
+    }
+
+    // several method handles may live in one process
+    static int counter = 0;
+    snprintf(m_data->socket_name, SOCKET_NAME_LENGTH, "%s_memfd.%d.%d", m_data->config.name_prefix,
+        m_data->my_pid,
+        __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED));
+    m_data->listen_fd = -1;
+    pthread_mutex_init(&m_data->lock, NULL);
+    m_data->exports = NULL;
+    m_data->next_id = 0;
+    *method_data = m_data;
+    return 0;
+}
+
+/*
+ * Create a memfd of 'size' bytes in pages of page_size (plus the header of a growable
+ * region) and map it to local address space. Return 0 on success and -1 on error.
+ */
+static int memfd_create_object (shm_memfd_region_data_t region_data,
+                                const df_shm_config *config,
+                                size_t size,
+                                size_t page_size,
+                                void *starting_addr
+                               )
+{
+    unsigned int flags = MFD_CLOEXEC | MFD_ALLOW_SEALING;
+    if(page_size > PAGE_SIZE) {
+        flags |= MFD_HUGETLB | ((unsigned int) __builtin_ctzl(page_size) << MFD_HUGE_SHIFT);
+    }
+    int fd = memfd_create(config->name_prefix, flags);
+    if(fd == -1) {
+        fprintf(stderr, "Error: memfd_create() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+        return -1;
+    }
+
+    // size the memfd
+    region_data->header_length = df_shm_header_length(config);
+    size_t length = region_data->header_length + df_shm_round_size(size, page_size);
+    if(ftruncate(fd, length) == -1) {
+        fprintf(stderr, "Error: ftruncate() memfd to size %lu failed: %d %s:%d\n",
+            length, errno, __FILE__, __LINE__);
+        close(fd);
+        return -1;
+    }
+    // fix the size so that peers can never see the region shrink under them; 
+    // growable regions may still grow
+    if(config->flags & DF_SHM_FLAG_SEAL) {
+        int seals = F_SEAL_SHRINK | (region_data->header_length? 0 : F_SEAL_GROW | F_SEAL_SEAL);
+        if(fcntl(fd, F_ADD_SEALS, seals) == -1) {
+            fprintf(stderr, "Error: sealing memfd returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+            close(fd);
+            return -1;
+        }
+    }
+
+    // map the memfd to local address space
+    region_data->attach_addr = df_shm_map_region_fd(config, fd, length, starting_addr,
+        &region_data->mapped_length);
+    if(region_data->attach_addr == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    if(df_shm_reserve_mapping(config, fd, region_data->attach_addr, 0, length) != 0) {
+        df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length);
+        close(fd);
+        return -1;
+    }
+    if(region_data->header_length) {
+        df_shm_init_header(region_data->attach_addr, length - region_data->header_length);
+    }
+    region_data->fd = fd;
+    region_data->file_length = length;
+    region_data->page_size = page_size;
+    region_data->generation = 0;
+    return 0;
+}
+
+int df_shm_method_memfd_create_region (void *method_data,
+                                       size_t size,
+                                       void *starting_addr,
+                                       void **return_data,
+                                       void **attach_address
+                                      )
+{
+    shm_memfd_method_data_t m_data = (shm_memfd_method_data_t) method_data;
+
+    // create per-region data
+    shm_memfd_region_data_t region_data = (shm_memfd_region_data_t)
+        malloc(sizeof(shm_memfd_region_data));
+    memfd_export_t e = (memfd_export_t) malloc(sizeof(memfd_export));
+    if(!region_data || !e) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        free(region_data);
+        free(e);
+        return -1;
+    }
+
+    int rc = -1;
+    if(m_data->huge_page_size > PAGE_SIZE && !m_data->config.max_region_size) {
+        // fails if there are not enough free huge pages
+        rc = memfd_create_object(region_data, &m_data->config, size, m_data->huge_page_size,
+            starting_addr);
+        if(rc) {
+            fprintf(stderr, "Warning: cannot create region of %lu bytes in huge pages; "
+                "using transparent huge pages. %s:%d\n", size, __FILE__, __LINE__);
+        }
+    }
+    if(rc) {
+        rc = memfd_create_object(region_data, &m_data->config, size, PAGE_SIZE, starting_addr);
+    }
+    if(rc) {
+        free(region_data);
+        free(e);
+        return -1;
+    }
+
+    // export the region to peers
+    pthread_mutex_lock(&m_data->lock);
+    if(memfd_start_server(m_data) != 0) {
+        pthread_mutex_unlock(&m_data->lock);
+        df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length);
+        close(region_data->fd);
+        free(region_data);
+        free(e);
+        return -1;
+    }
+    region_data->id = m_data->next_id ++;
+    e->id = region_data->id;
+    e->fd = region_data->fd;
+    e->next = m_data->exports;
+    m_data->exports = e;
+    pthread_mutex_unlock(&m_data->lock);
+
+    df_shm_advise_mapping(&m_data->config, region_data->attach_addr,
+        region_data->file_length, region_data->page_size);
+
+    *return_data = region_data;
+    *attach_address = (char *) region_data->attach_addr + region_data->header_length;
+    return 0;
+}
+
+/*
+ * memfd regions have no names.
+ */
+int df_shm_method_memfd_create_named_region (void *method_data,
+                                             void *name,
+                                             int name_size,
+                                             size_t size,
+                                             void *starting_addr,
+                                             void **return_data,
+                                             void **attach_address
+                                            )
+{
+    fprintf(stderr, "Error: memfd method does not support named regions. %s:%d\n",
+        __FILE__, __LINE__);
+    return -1;
+}
+
+/*
+ * the contact info of a memfd shm region has the following fields:
+ * - socket name of the creator (strlen bytes terminated by '\0')
+ * - region id (sizeof(uint64_t) bytes)
+ * - file size (sizeof(size_t) bytes)
+ * - page size (sizeof(size_t) bytes)
+ */
+void * df_shm_method_memfd_region_contact (void *method_data, df_shm_region_t region, int *length)
+{
+    shm_memfd_method_data_t m_data = (shm_memfd_method_data_t) method_data;
+    shm_memfd_region_data_t region_data = (shm_memfd_region_data_t) region->method_data;
+
+    int socket_name_len = strlen(m_data->socket_name) + 1;
+    int len = socket_name_len + sizeof(uint64_t) + 2 * sizeof(size_t);
+    char *contact_string = (char *) malloc(len);
+    if(!contact_string) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return NULL;
+    }
+    strcpy(contact_string, m_data->socket_name);
+    memcpy(contact_string + socket_name_len, &(region_data->id), sizeof(uint64_t));
+    memcpy(contact_string + socket_name_len + sizeof(uint64_t), &(region_data->file_length),
+        sizeof(size_t));
+    memcpy(contact_string + socket_name_len + sizeof(uint64_t) + sizeof(size_t),
+        &(region_data->page_size), sizeof(size_t));
+    *length = len;
+    return contact_string;
+}
+
+int df_shm_method_memfd_destroy_region (void *method_data, df_shm_region_t region)
+{
+    shm_memfd_method_data_t m_data = (shm_memfd_method_data_t) method_data;
+    shm_memfd_region_data_t region_data = (shm_memfd_region_data_t) region->method_data;
+
+    // stop exporting the region
+    pthread_mutex_lock(&m_data->lock);
+    memfd_export_t *p = &m_data->exports;
+    while(*p && (*p)->id != region_data->id) {
+        p = &(*p)->next;
+    }
+    if(*p) {
+        memfd_export_t e = *p;
+        *p = e->next;
+        free(e);
+    }
+    pthread_mutex_unlock(&m_data->lock);
+
+    // unmap the shm region; the memory is freed once peers have unmapped it too
+    if(df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length) != 0) {
+        return -1;
+    }
+    if(close(region_data->fd) == -1) {
+        fprintf(stderr, "Error: close() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+        return -1;
+    }
+    free(region_data);
+    return 0;
+}
+
+/*
+ * Get the fd of a region from its creator and map it. Return 0 on success and -1
+ * on error.
+ */
+int df_shm_method_memfd_attach_region (void *method_data,
+                                       void *contact_info,
+                                       size_t size,
+                                       void *starting_addr,
+                                       void **return_data,
+                                       void **attach_address
+                                      )
+{
+    shm_memfd_method_data_t m_data = (shm_memfd_method_data_t) method_data;
+
+    // get socket name, region id and page size from contact info
+    char *socket_name = (char *) contact_info;
+    int socket_name_len = strlen(socket_name) + 1;
+    uint64_t id;
+    size_t page_size;
+    memcpy(&id, socket_name + socket_name_len, sizeof(uint64_t));
+    memcpy(&page_size, socket_name + socket_name_len + sizeof(uint64_t) + sizeof(size_t),
+        sizeof(size_t));
+
+    // ask the creator for the region's fd
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(sock == -1) {
+        fprintf(stderr, "Error: socket() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+        return -1;
+    }
+    struct sockaddr_un addr;
+    socklen_t addr_len = memfd_socket_addr(socket_name, &addr);
+    if(connect(sock, (struct sockaddr *) &addr, addr_len) == -1) {
+        fprintf(stderr, "Error: cannot connect to socket @%s: %d. %s:%d\n",
+            socket_name, errno, __FILE__, __LINE__);
+        close(sock);
+        return -1;
+    }
+    if(send(sock, &id, sizeof(id), MSG_NOSIGNAL) != sizeof(id)) {
+        fprintf(stderr, "Error: send() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+        close(sock);
+        return -1;
+    }
+    int fd = memfd_recv_fd(sock);
+    close(sock);
+    if(fd == -1) {
+        return -1;
+    }
+
+    // create per-region data
+    shm_memfd_region_data_t region_data = (shm_memfd_region_data_t)
+        malloc(sizeof(shm_memfd_region_data));
+    if(!region_data) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        close(fd);
+        return -1;
+    }
+
+    // map the memfd to local address space in the same page size as creator
+    region_data->header_length = df_shm_header_length(&m_data->config);
+    size_t length = region_data->header_length + df_shm_round_size(size, page_size);
+    if(df_shm_check_fd_length(fd, socket_name, length) != 0) {
+        close(fd);
+        free(region_data);
+        return -1;
+    }
+    region_data->attach_addr = df_shm_map_region_fd(&m_data->config, fd, length, starting_addr,
+        &region_data->mapped_length);
+    if(region_data->attach_addr == MAP_FAILED) {
+        close(fd);
+        free(region_data);
+        return -1;
+    }
+    if(region_data->header_length) {
+        // keep the fd to map the region as it grows
+        if(df_shm_check_header(region_data->attach_addr) != 0) {
+            df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length);
+            close(fd);
+            free(region_data);
+            return -1;
+        }
+        region_data->fd = fd;
+    }
+    else {
+        close(fd);
+        region_data->fd = -1;
+    }
+    region_data->id = id;
+    region_data->file_length = length;
+    region_data->page_size = page_size;
+    region_data->generation = UINT64_MAX; // look at the header on the first refresh
+    df_shm_advise_mapping(&m_data->config, region_data->attach_addr,
+        region_data->file_length, region_data->page_size);
+
+    *return_data = region_data;
+    *attach_address = (char *) region_data->attach_addr + region_data->header_length;
+    return 0;
+}
+
+/*
+ * memfd regions have no names.
+ */
+int df_shm_method_memfd_attach_named_region (void *method_data,
+                                             void *name,
+                                             int name_size,
+                                             size_t size,
+                                             void *starting_addr,
+                                             void **return_data,
+                                             void **attach_address
+                                            )
+{
+    fprintf(stderr, "Error: memfd method does not support named regions. %s:%d\n",
+        __FILE__, __LINE__);
+    return -1;
+}
+
+int df_shm_method_memfd_detach_region (void *method_data, df_shm_region_t region)
+{
+    shm_memfd_region_data_t region_data = (shm_memfd_region_data_t) region->method_data;
+
+    // unmap the shm region
+    if(df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length) != 0) {
+        return -1;
+    }
+    if(region_data->fd != -1) {
+        close(region_data->fd);
+    }
+    free(region_data);
+    return 0;
+}
+
+int df_shm_method_memfd_resize_region (void *method_data, df_shm_region_t region, size_t new_size)
+{
+    shm_memfd_method_data_t m_data = (shm_memfd_method_data_t) method_data;
+    shm_memfd_region_data_t region_data = (shm_memfd_region_data_t) region->method_data;
+
+    if(!region_data->header_length) {
+        fprintf(stderr, "Error: region is not growable; set max_region_size. %s:%d\n", 
+            __FILE__, __LINE__);
+        return -1;
+    }
+    size_t length = region_data->header_length + df_shm_round_size(new_size, region_data->page_size);
+    if(length <= region_data->file_length) {
+        return 0;
+    }
+
+    // extend the memfd first so that peers never map past its end
+    if(ftruncate(region_data->fd, length) == -1) {
+        fprintf(stderr, "Error: ftruncate() memfd to size %lu failed: %d %s:%d\n",
+            length, errno, __FILE__, __LINE__);
+        return -1;
+    }
+    if(df_shm_grow_mapping(&m_data->config, region_data->fd, region_data->attach_addr, 
+           region_data->file_length, length, region_data->page_size) != 0 ||
+       df_shm_reserve_mapping(&m_data->config, region_data->fd, (char *) region_data->attach_addr + 
+           region_data->file_length, region_data->file_length, length - region_data->file_length) != 0) {
+        return -1;
+    }
+    region_data->file_length = length;
+    df_shm_publish_size(region_data->attach_addr, length - region_data->header_length);
+    region_data->generation = df_shm_header_generation(region_data->attach_addr, &new_size);
+    return 0;
+}
+
+int df_shm_method_memfd_refresh_region (void *method_data, df_shm_region_t region, size_t *size)
+{
+    shm_memfd_method_data_t m_data = (shm_memfd_method_data_t) method_data;
+    shm_memfd_region_data_t region_data = (shm_memfd_region_data_t) region->method_data;
+
+    if(!region_data->header_length) {
+        *size = region->size;
+        return 0;
+    }
+    size_t new_size;
+    uint64_t generation = df_shm_header_generation(region_data->attach_addr, &new_size);
+    size_t length = region_data->header_length + new_size;
+    if(generation != region_data->generation && length > region_data->file_length) {
+        if(df_shm_grow_mapping(&m_data->config, region_data->fd, region_data->attach_addr, 
+            region_data->file_length, length, region_data->page_size) != 0) {
+            return -1;
+        }
+        region_data->file_length = length;
+    }
+    region_data->generation = generation;
+    *size = region_data->file_length - region_data->header_length;
+    return 0;
+}
+
+int df_shm_method_memfd_finalize (void *method_data)
+{
+    shm_memfd_method_data_t m_data = (shm_memfd_method_data_t) method_data;
+
+    // stop the server thread: shutting down the listening socket fails its accept()
+    if(m_data->listen_fd != -1) {
+        shutdown(m_data->listen_fd, SHUT_RDWR);
+        pthread_join(m_data->server_thread, NULL);
+        close(m_data->listen_fd);
+    }
+    while(m_data->exports) {
+        memfd_export_t e = m_data->exports;
+        m_data->exports = e->next;
+        free(e);
+    }
+    pthread_mutex_destroy(&m_data->lock);
+    if(m_data->config.flags & DF_SHM_FLAG_FIXED_ADDR) {
+        df_shm_window_close();
+    }
+    free(m_data);
+    return 0;
+}
+
+#endif /* HAVE_MEMFD */
@@ -18,7 +18,10 @@ int df_shm_method_mmap_create_named_region (void *method_data, void *name, int n
 void * df_shm_method_mmap_region_contact (void *method_data, df_shm_region_t region, int *length); 
 int df_shm_method_mmap_destroy_region (void *method_data, df_shm_region_t region); 
 int df_shm_method_mmap_attach_region (void *method_data, void *contact_info, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
+int df_shm_method_mmap_attach_named_region (void *method_data, void *name, int name_size, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
 int df_shm_method_mmap_detach_region (void *method_data, df_shm_region_t region); 
+int df_shm_method_mmap_resize_region (void *method_data, df_shm_region_t region, size_t new_size);
+int df_shm_method_mmap_refresh_region (void *method_data, df_shm_region_t region, size_t *size);
 int df_shm_method_mmap_finalize (void *method_data);
 #endif
 
@@ -32,6 +35,7 @@ int df_shm_method_sysv_create_named_region (void *method_data, void *name, int n
 void * df_shm_method_sysv_region_contact (void *method_data, df_shm_region_t region, int *length); 
 int df_shm_method_sysv_destroy_region (void *method_data, df_shm_region_t region); 
 int df_shm_method_sysv_attach_region (void *method_data, void *contact_info, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
+int df_shm_method_sysv_attach_named_region (void *method_data, void *name, int name_size, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
 int df_shm_method_sysv_detach_region (void *method_data, df_shm_region_t region); 
 int df_shm_method_sysv_finalize (void *method_data);
 #endif 
@@ -46,10 +50,45 @@ int df_shm_method_posixshm_create_named_region (void *method_data, void *name, i
 void * df_shm_method_posixshm_region_contact (void *method_data, df_shm_region_t region, int *length); 
 int df_shm_method_posixshm_destroy_region (void *method_data, df_shm_region_t region); 
 int df_shm_method_posixshm_attach_region (void *method_data, void *contact_info, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
+int df_shm_method_posixshm_attach_named_region (void *method_data, void *name, int name_size, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
 int df_shm_method_posixshm_detach_region (void *method_data, df_shm_region_t region); 
+int df_shm_method_posixshm_resize_region (void *method_data, df_shm_region_t region, size_t new_size);
+int df_shm_method_posixshm_refresh_region (void *method_data, df_shm_region_t region, size_t *size);
 int df_shm_method_posixshm_finalize (void *method_data);
 #endif
 
+#ifdef HAVE_MEMFD
+/*
+ * DF_SHM_METHOD_MEMFD: memfd_create() objects passed over Unix domain sockets
+ */
+int df_shm_method_memfd_init (void *input_data, void **method_data);
+int df_shm_method_memfd_create_region (void *method_data, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
+int df_shm_method_memfd_create_named_region (void *method_data, void *name, int name_size, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
+void * df_shm_method_memfd_region_contact (void *method_data, df_shm_region_t region, int *length); 
+int df_shm_method_memfd_destroy_region (void *method_data, df_shm_region_t region); 
+int df_shm_method_memfd_attach_region (void *method_data, void *contact_info, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
+int df_shm_method_memfd_attach_named_region (void *method_data, void *name, int name_size, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
+int df_shm_method_memfd_detach_region (void *method_data, df_shm_region_t region); 
+int df_shm_method_memfd_resize_region (void *method_data, df_shm_region_t region, size_t new_size);
+int df_shm_method_memfd_refresh_region (void *method_data, df_shm_region_t region, size_t *size);
+int df_shm_method_memfd_finalize (void *method_data);
+#endif
+
+#ifdef HAVE_MMAP
+/*
+ * DF_SHM_METHOD_ANON: anonymous shared mappings
+ */
+int df_shm_method_anon_init (void *input_data, void **method_data);
+int df_shm_method_anon_create_region (void *method_data, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
+int df_shm_method_anon_create_named_region (void *method_data, void *name, int name_size, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
+void * df_shm_method_anon_region_contact (void *method_data, df_shm_region_t region, int *length); 
+int df_shm_method_anon_destroy_region (void *method_data, df_shm_region_t region); 
+int df_shm_method_anon_attach_region (void *method_data, void *contact_info, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
+int df_shm_method_anon_attach_named_region (void *method_data, void *name, int name_size, size_t size, void *starting_addr, void **return_data, void **attach_addr); 
+int df_shm_method_anon_detach_region (void *method_data, df_shm_region_t region); 
+int df_shm_method_anon_finalize (void *method_data);
+#endif
+
 /*
  * Load callback functions for the specified underlying shm method.
  */
@@ -63,7 +102,10 @@ void load_method_callbacks(enum DF_SHM_METHOD method, df_shm_method_t m)
         m->region_contact_func = df_shm_method_mmap_region_contact;
         m->destroy_region_func = df_shm_method_mmap_destroy_region;
         m->attach_region_func = df_shm_method_mmap_attach_region;
+        m->attach_named_region_func = df_shm_method_mmap_attach_named_region;
         m->detach_region_func = df_shm_method_mmap_detach_region;
+        m->resize_region_func = df_shm_method_mmap_resize_region;
+        m->refresh_region_func = df_shm_method_mmap_refresh_region;
         m->finalize_func = df_shm_method_mmap_finalize;
 #else
         fprintf(stderr, "Error: df_shm/mmap method is not available\n");
@@ -79,6 +121,7 @@ void load_method_callbacks(enum DF_SHM_METHOD method, df_shm_method_t m)
         m->region_contact_func = df_shm_method_sysv_region_contact;
         m->destroy_region_func = df_shm_method_sysv_destroy_region;
         m->attach_region_func = df_shm_method_sysv_attach_region;
+        m->attach_named_region_func = df_shm_method_sysv_attach_named_region;
         m->detach_region_func = df_shm_method_sysv_detach_region;
         m->finalize_func = df_shm_method_sysv_finalize;
 #else
@@ -95,10 +138,49 @@ void load_method_callbacks(enum DF_SHM_METHOD method, df_shm_method_t m)
         m->region_contact_func = df_shm_method_posixshm_region_contact;
         m->destroy_region_func = df_shm_method_posixshm_destroy_region;
         m->attach_region_func = df_shm_method_posixshm_attach_region;
+        m->attach_named_region_func = df_shm_method_posixshm_attach_named_region;
         m->detach_region_func = df_shm_method_posixshm_detach_region;
+        m->resize_region_func = df_shm_method_posixshm_resize_region;
+        m->refresh_region_func = df_shm_method_posixshm_refresh_region;
         m->finalize_func = df_shm_method_posixshm_finalize;
 #else
         fprintf(stderr, "Error: df_shm/posix_shm method is not available\n");
+#endif
+        return;
+    }
+
+    if(method == DF_SHM_METHOD_MEMFD) {
+#ifdef HAVE_MEMFD
+        m->init_func  = df_shm_method_memfd_init;
+        m->create_region_func = df_shm_method_memfd_create_region;
+        m->create_named_region_func = df_shm_method_memfd_create_named_region;
+        m->region_contact_func = df_shm_method_memfd_region_contact;
+        m->destroy_region_func = df_shm_method_memfd_destroy_region;
+        m->attach_region_func = df_shm_method_memfd_attach_region;
+        m->attach_named_region_func = df_shm_method_memfd_attach_named_region;
+        m->detach_region_func = df_shm_method_memfd_detach_region;
+        m->resize_region_func = df_shm_method_memfd_resize_region;
+        m->refresh_region_func = df_shm_method_memfd_refresh_region;
+        m->finalize_func = df_shm_method_memfd_finalize;
+#else
+        fprintf(stderr, "Error: df_shm/memfd method is not available\n");
+#endif
+        return;
+    }
+
+    if(method == DF_SHM_METHOD_ANON) {
+#ifdef HAVE_MMAP
+        m->init_func  = df_shm_method_anon_init;
+        m->create_region_func = df_shm_method_anon_create_region;
+        m->create_named_region_func = df_shm_method_anon_create_named_region;
+        m->region_contact_func = df_shm_method_anon_region_contact;
+        m->destroy_region_func = df_shm_method_anon_destroy_region;
+        m->attach_region_func = df_shm_method_anon_attach_region;
+        m->attach_named_region_func = df_shm_method_anon_attach_named_region;
+        m->detach_region_func = df_shm_method_anon_detach_region;
+        m->finalize_func = df_shm_method_anon_finalize;
+#else
+        fprintf(stderr, "Error: df_shm/anon method is not available\n");
 #endif
         return;
     }
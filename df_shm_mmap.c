@@ -2,6 +2,7 @@
  * shared memory method by mmap()-ed a common backstore file
  *
  */
+#define _GNU_SOURCE // O_TMPFILE
 #include "df_config.h"
 
 #ifdef HAVE_MMAP
@@ -17,16 +18,20 @@
 #include <string.h>
 #include <errno.h>
 #include "df_shm.h"
+#include "df_shm_mapping.h"
+#include "df_shm_window.h"
 
 
-#define PATH_LENGTH 100
-#define DEFAULT_OPEN_MODE 0600
+#define PATH_LENGTH (DF_SHM_PATH_LENGTH + 64)
 
 /*
  * global method level bookkeeping data
  */
 typedef struct _shm_mmap_method_data {
     char base_path[PATH_LENGTH]; 
+    char huge_base_path[PATH_LENGTH]; // base path on hugetlbfs; empty if huge pages are not used
+    size_t huge_page_size;
+    df_shm_config config;
     pid_t my_pid;
 } shm_mmap_method_data, *shm_mmap_method_data_t;
  
@@ -34,28 +39,178 @@ typedef struct _shm_mmap_method_data {
  * per-region data
  */ 
 typedef struct _shm_mmap_region_data {
-    char *file_name;   
+    char *file_name;   // for an O_TMPFILE backstore, the /proc path of fd
+    int fd;            // fd of an O_TMPFILE backstore kept open by the creator; -1 otherwise
     size_t file_length;
+    size_t page_size;  // page size of the backstore file system
     void *attach_addr;
     size_t mapped_length;  
+    size_t header_length;  // DF_SHM_HEADER_LENGTH if the region is growable, 0 otherwise
+    uint64_t generation;   // generation of the header the local mapping is up to date with
 } shm_mmap_region_data, *shm_mmap_region_data_t; 
  
 int df_shm_method_mmap_init (void *input_data, void **method_data)
 {
-    // TODO: get config parameters from input_data. ignore it now.
     shm_mmap_method_data_t m_data = (shm_mmap_method_data_t) malloc(sizeof(shm_mmap_method_data));
     if(!m_data) {
         fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         return -1;    
     }
+    df_shm_load_config(&m_data->config, input_data);
+    // regions are placed in the address window shared with peers
+    if((m_data->config.flags & DF_SHM_FLAG_FIXED_ADDR) && df_shm_window_open(&m_data->config) != 0) {
+        free(m_data);
+        return -1;
+    }
     m_data->my_pid = getpid();
     
     // create base path for backstore file
-    sprintf(m_data->base_path, "/tmp/df_shm_mmap.%d.XXXXXX", m_data->my_pid);
+    df_shm_check_backing_dir(m_data->config.backing_dir);
+    sprintf(m_data->base_path, "%s/%s_mmap.%d.XXXXXX", m_data->config.backing_dir, 
+        m_data->config.name_prefix, m_data->my_pid);
+
+    // backstore files of huge page regions are created on hugetlbfs
+    m_data->huge_base_path[0] = '\0';
+    m_data->huge_page_size = 0;
+    if(m_data->config.flags & DF_SHM_FLAG_HUGEPAGE) {
+        char mount_point[PATH_LENGTH];
+        m_data->huge_page_size = df_shm_huge_page_size(&m_data->config);
+        if(m_data->huge_page_size && 
+           df_shm_find_hugetlbfs(m_data->huge_page_size, mount_point, PATH_LENGTH) == 0) {
+            // a truncated path would put the files somewhere else; fall back instead
+            int len = snprintf(m_data->huge_base_path, PATH_LENGTH, "%s/%s_mmap.%d.XXXXXX", mount_point, 
+                m_data->config.name_prefix, m_data->my_pid);
+            if(len < 0 || len >= PATH_LENGTH) {
+                m_data->huge_base_path[0] = '\0';
+                fprintf(stderr, "Warning: hugetlbfs path under %s is too long; "
+                    "using transparent huge pages. %s:%d\n", mount_point, __FILE__, __LINE__);
+            }
+        }
+        else {
+            fprintf(stderr, "Warning: no hugetlbfs mounted for page size %lu; "
+                "using transparent huge pages. %s:%d\n", m_data->huge_page_size, __FILE__, __LINE__);
+        }
+    }
     *method_data = m_data;
     return 0;
 }
 
+/*
+ * Size the backstore file to hold 'size' bytes in pages of page_size (plus the
+ * header of a growable region) and map it to local address space.
+ */
+static int mmap_size_and_map (shm_mmap_region_data_t region_data, 
+                              const df_shm_config *config,
+                              int fd, 
+                              size_t size, 
+                              size_t page_size, 
+                              void *starting_addr
+                             )
+{
+    region_data->header_length = df_shm_header_length(config);
+    size_t length = region_data->header_length + df_shm_round_size(size, page_size);
+
+    // size the backstore file
+    if(ftruncate(fd, length) == -1) {
+        fprintf(stderr, "Error: ftruncate() file %s to size %lu failed: %d %s:%d\n", 
+            region_data->file_name, length, errno, __FILE__, __LINE__);
+        return -1;
+    }
+    region_data->file_length = length;
+    region_data->page_size = page_size;
+    
+    // map the file to local address space
+    region_data->attach_addr = df_shm_map_region_fd(config, fd, length, starting_addr, 
+        &region_data->mapped_length);
+    if(region_data->attach_addr == MAP_FAILED) {
+        return -1;
+    }    
+    if(df_shm_reserve_mapping(config, fd, region_data->attach_addr, 0, length) != 0) {
+        df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length);
+        return -1;
+    }
+    if(region_data->header_length) {
+        df_shm_init_header(region_data->attach_addr, length - region_data->header_length);
+    }
+    region_data->generation = 0;
+    return 0;
+}
+
+/*
+ * Atomically generate a unique file name from template and create the backstore file.
+ * Return 0 on success and -1 on error.
+ */
+static int mmap_create_backstore (shm_mmap_region_data_t region_data,
+                                  const df_shm_config *config,
+                                  const char *template,
+                                  size_t size,
+                                  size_t page_size,
+                                  void *starting_addr
+                                 )
+{
+    region_data->file_name = strdup(template);
+    int fd = mkstemp(region_data->file_name);
+    if(fd == -1) {
+        fprintf(stderr, "Error: calling mkstemp() on %s failed: %d %s:%d\n", 
+            region_data->file_name, errno, __FILE__, __LINE__);
+        free(region_data->file_name);
+        return -1;
+    }
+    region_data->fd = -1;
+    
+    // mkstemp() creates the file with mode 0600
+    if((config->mode != 0600 && fchmod(fd, config->mode) == -1) || 
+       mmap_size_and_map(region_data, config, fd, size, page_size, starting_addr) != 0) {
+        close(fd);
+        unlink(region_data->file_name);
+        free(region_data->file_name);
+        return -1;
+    }
+
+    // close the file descrptor
+    if(close(fd) == -1) {
+        fprintf(stderr, "Error: close() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+        df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length);
+        unlink(region_data->file_name);
+        free(region_data->file_name);
+        return -1;    
+    }
+    return 0;
+}
+
+/*
+ * Create an unnamed O_TMPFILE backstore file in dir. The file is kept open and
+ * other processes reach it through /proc/<pid>/fd/<fd> of the creator. Return 0 
+ * on success and -1 on error.
+ */
+static int mmap_create_tmpfile (shm_mmap_region_data_t region_data,
+                                const df_shm_config *config,
+                                const char *dir,
+                                pid_t my_pid,
+                                size_t size,
+                                size_t page_size,
+                                void *starting_addr
+                               )
+{
+    int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, config->mode);
+    if(fd == -1) {
+        fprintf(stderr, "Error: calling open(O_TMPFILE) on %s failed: %d %s:%d\n", 
+            dir, errno, __FILE__, __LINE__);
+        return -1;
+    }
+    char path[PATH_LENGTH];
+    sprintf(path, "/proc/%d/fd/%d", my_pid, fd);
+    region_data->file_name = strdup(path);
+    region_data->fd = fd;
+
+    if(mmap_size_and_map(region_data, config, fd, size, page_size, starting_addr) != 0) {
+        close(fd);
+        free(region_data->file_name);
+        return -1;
+    }
+    return 0;
+}
+
 int df_shm_method_mmap_create_region (void *method_data, 
                                       size_t size, 
                                       void *starting_addr, 
@@ -73,63 +228,44 @@ int df_shm_method_mmap_create_region (void *method_data,
         return -1;    
     }
     
-    // atomically generate a unique file name(base_path.xxxxxx) and create the backstore file
-    region_data->file_name =strdup(m_data->base_path);
-    int fd = mkstemp(region_data->file_name);
-    if(fd == -1) {
-        fprintf(stderr, "Error: calling mkstemp() on %s failed: %d %s:%d\n", 
-            region_data->file_name, errno, __FILE__, __LINE__);
-        free(region_data->file_name);
-        free(region_data);
-        return -1;
+    int rc = -1;
+    if(m_data->huge_base_path[0] && !m_data->config.max_region_size) {
+        // mapping fails if there are not enough free huge pages
+        rc = mmap_create_backstore(region_data, &m_data->config, m_data->huge_base_path, size, 
+            m_data->huge_page_size, starting_addr);
+        if(rc) {
+            fprintf(stderr, "Warning: cannot create region of %lu bytes on hugetlbfs; "
+                "using transparent huge pages. %s:%d\n", size, __FILE__, __LINE__);
+        }
     }
-    
-    // size the backstore file
-    if(ftruncate(fd, size) == -1) {
-        fprintf(stderr, "Error: ftruncate() file %s to size %lu failed: %d %s:%d\n", 
-            region_data->file_name, size, errno, __FILE__, __LINE__);
-        free(region_data->file_name);
-        free(region_data);
-        return -1;
+    if(rc && (m_data->config.flags & DF_SHM_FLAG_TMPFILE)) {
+        rc = mmap_create_tmpfile(region_data, &m_data->config, m_data->config.backing_dir, 
+            m_data->my_pid, size, PAGE_SIZE, starting_addr);
+        if(rc) {
+            fprintf(stderr, "Warning: cannot create unnamed file in %s; using a named one. %s:%d\n",
+                m_data->config.backing_dir, __FILE__, __LINE__);
+        }
     }
-    region_data->file_length = size;
-    
-    if(starting_addr != NULL && (uint64_t)starting_addr % PAGE_SIZE) {
-        fprintf(stderr, "Warning: the starting address (%p) is not page-aligned. %s:%d\n", 
-            starting_addr, __FILE__, __LINE__);    
+    if(rc) {
+        rc = mmap_create_backstore(region_data, &m_data->config, m_data->base_path, size, 
+            PAGE_SIZE, starting_addr);
     }
-    
-    // map the file to local address space
-    region_data->attach_addr = mmap(starting_addr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if(region_data->attach_addr == NULL) {
-        fprintf(stderr, "Error: mmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
-        free(region_data->file_name);
+    if(rc) {
         free(region_data);
         return -1;
-    }    
-    region_data->mapped_length = size;
-    if(region_data->attach_addr != starting_addr) {
-        fprintf(stderr, "Warning: shared memory region attached to %p instead of %p. %s:%d\n", 
-            region_data->attach_addr, starting_addr, __FILE__, __LINE__);
-    }
-    
-    // close the file descrptor
-    if(close(fd) == -1) {
-        fprintf(stderr, "Error: close() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
-        munmap(region_data->attach_addr, region_data->mapped_length);
-        free(region_data->file_name);
-        free(region_data);
-        return -1;    
     }
+    df_shm_advise_mapping(&m_data->config, region_data->attach_addr, 
+        region_data->file_length, region_data->page_size);
     
     *return_data = region_data;
-    *attach_address = region_data->attach_addr;
+    *attach_address = (char *) region_data->attach_addr + region_data->header_length;
     return 0;
 }
 
 /*
  * Create a shm region using the backstore file specified by 'name'.
  * 'name' parameter is a string specifying the path of backstore file.
+ * If the path is on hugetlbfs, the region is backed by huge pages.
  */
 int df_shm_method_mmap_create_named_region (void *method_data,
                                       void *name,
@@ -150,57 +286,44 @@ int df_shm_method_mmap_create_named_region (void *method_data,
         return -1;
     }
 
-    // atomically generate a unique file name(base_path.xxxxxx) and create the backstore file
     region_data->file_name =strdup((char *)name);
-    int fd = open(region_data->file_name, O_RDWR | O_CREAT | O_TRUNC, DEFAULT_OPEN_MODE);
+    region_data->fd = -1;
+    int excl = m_data->config.flags & DF_SHM_FLAG_EXCL;
+    int fd = open(region_data->file_name, O_RDWR | O_CREAT | (excl? O_EXCL : O_TRUNC), 
+        m_data->config.mode);
     if(fd == -1) {
-        fprintf(stderr, "Error: calling open() on %s failed: %d %s:%d\n",
-            region_data->file_name, errno, __FILE__, __LINE__);
-        free(region_data->file_name);
-        free(region_data);
-        return -1;
-    }
-
-    // size the backstore file
-    if(ftruncate(fd, size) == -1) {
-        fprintf(stderr, "Error: ftruncate() file %s to size %lu failed: %d %s:%d\n",
-            region_data->file_name, size, errno, __FILE__, __LINE__);
+        int err = errno;
+        if(!excl || err != EEXIST) {
+            fprintf(stderr, "Error: calling open() on %s failed: %d %s:%d\n",
+                region_data->file_name, err, __FILE__, __LINE__);
+        }
         free(region_data->file_name);
         free(region_data);
+        errno = err;
         return -1;
     }
-    region_data->file_length = size;
 
-    if(starting_addr != NULL && (uint64_t)starting_addr % PAGE_SIZE) {
-        fprintf(stderr, "Warning: the starting address (%p) is not page-aligned. %s:%d\n",
-            starting_addr, __FILE__, __LINE__);
-    }
-
-    // map the file to local address space
-    region_data->attach_addr = mmap(starting_addr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if(region_data->attach_addr == NULL) {
-        fprintf(stderr, "Error: mmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+    if(mmap_size_and_map(region_data, &m_data->config, fd, size, df_shm_fd_page_size(fd), 
+        starting_addr) != 0) {
+        close(fd);
         free(region_data->file_name);
         free(region_data);
         return -1;
     }
-    region_data->mapped_length = size;
-    if(region_data->attach_addr != starting_addr) {
-        fprintf(stderr, "Warning: shared memory region attached to %p instead of %p. %s:%d\n",
-            region_data->attach_addr, starting_addr, __FILE__, __LINE__);
-    }
 
     // close the file descrptor
     if(close(fd) == -1) {
         fprintf(stderr, "Error: close() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
-        munmap(region_data->attach_addr, region_data->mapped_length);
+        df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length);
         free(region_data->file_name);
         free(region_data);
         return -1;
     }
+    df_shm_advise_mapping(&m_data->config, region_data->attach_addr, 
+        region_data->file_length, region_data->page_size);
 
     *return_data = region_data;
-    *attach_address = region_data->attach_addr;
+    *attach_address = (char *) region_data->attach_addr + region_data->header_length;
     return 0;
 }
 
@@ -208,6 +331,7 @@ int df_shm_method_mmap_create_named_region (void *method_data,
  * the contact info of a mmap shm region has the following fields:
  * - file_name (strlen bytes terminated by '\0')
  * - file size (sizeof(size_t) bytes)
+ * - page size (sizeof(size_t) bytes)
  */
 void * df_shm_method_mmap_region_contact (void *method_data, df_shm_region_t region, int *length)
 {
@@ -215,7 +339,7 @@ void * df_shm_method_mmap_region_contact (void *method_data, df_shm_region_t reg
 
     void *contact_string;
     int file_name_len = strlen(region_data->file_name) + 1;
-    int len = file_name_len + sizeof(size_t);
+    int len = file_name_len + 2 * sizeof(size_t);
     contact_string = malloc(len);
     if(!contact_string) {
         fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
@@ -223,6 +347,8 @@ void * df_shm_method_mmap_region_contact (void *method_data, df_shm_region_t reg
     }
     strcpy(contact_string, region_data->file_name);
     memcpy(((char *)contact_string + file_name_len), &(region_data->file_length), sizeof(size_t));
+    memcpy(((char *)contact_string + file_name_len + sizeof(size_t)), &(region_data->page_size), 
+        sizeof(size_t));
     *length = len;
     return contact_string;
 }
@@ -233,13 +359,19 @@ int df_shm_method_mmap_destroy_region (void *method_data, df_shm_region_t region
     shm_mmap_region_data_t region_data = region->method_data;
 
     // unmap the shm region
-    if(munmap(region_data->attach_addr, region_data->mapped_length) == -1) {
-        fprintf(stderr, "Error: munmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+    if(df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length) != 0) {
         return -1;    
     }
 
+    // close an unnamed backstore file, which frees it once peers have unmapped it
+    if(region_data->fd != -1) {
+        if(close(region_data->fd) == -1) {
+            fprintf(stderr, "Error: close() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+            return -1;
+        }
+    }
     // remove the backstore file
-    if(unlink(region_data->file_name) == -1) {
+    else if(unlink(region_data->file_name) == -1) {
         fprintf(stderr, "Error: calling unlink() on %s returns %d. %s:%d\n", region_data->file_name, 
             errno, __FILE__, __LINE__);
         return -1;    
@@ -249,16 +381,19 @@ int df_shm_method_mmap_destroy_region (void *method_data, df_shm_region_t region
     return 0;
 }
 
-int df_shm_method_mmap_attach_region (void *method_data, 
-                                      void *contact_info, 
-                                      size_t size, 
-                                      void *starting_addr, 
-                                      void **return_data, 
-                                      void **attach_address
-                                     )
+/*
+ * Open and map a backstore file created by another process. page_size of 0 means
+ * the page size is taken from the file system backing the file.
+ */
+static int mmap_attach_backstore (shm_mmap_method_data_t m_data,
+                                  char *file_name,
+                                  size_t page_size,
+                                  size_t size,
+                                  void *starting_addr,
+                                  void **return_data,
+                                  void **attach_address
+                                 )
 {
-    shm_mmap_method_data_t m_data = (shm_mmap_method_data_t) method_data;
-
     // create per-region data
     shm_mmap_region_data_t region_data = (shm_mmap_region_data_t) 
         malloc(sizeof(shm_mmap_region_data));
@@ -266,12 +401,9 @@ int df_shm_method_mmap_attach_region (void *method_data,
         fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         return -1;    
     }
-    
-    // TODO: get shm segment info from contact info
-    char *file_name = (char *) contact_info;
 
     // open the backstore file
-    int fd = open(file_name, O_RDWR, DEFAULT_OPEN_MODE);
+    int fd = open(file_name, O_RDWR);
     if(fd == -1) {
         fprintf(stderr, "Error: calling open() on %s failed: %d %s:%d\n", 
             file_name, errno, __FILE__, __LINE__);
@@ -279,51 +411,96 @@ int df_shm_method_mmap_attach_region (void *method_data,
         return -1;
     }
     region_data->file_name = strdup(file_name);
-
-    // TODO: pass file length through contact_info    
-    region_data->file_length = *(size_t *) ((char *)contact_info + strlen(file_name) + 1);
+    region_data->fd = -1;
+    region_data->page_size = page_size? page_size : df_shm_fd_page_size(fd);
     
-    if(starting_addr != NULL && (uint64_t)starting_addr % PAGE_SIZE) {
-        fprintf(stderr, "Warning: the starting address (%p) is not page-aligned. %s:%d\n", 
-            starting_addr, __FILE__, __LINE__);    
+    // map the file to local address space in the same page size as creator
+    region_data->header_length = df_shm_header_length(&m_data->config);
+    size_t length = region_data->header_length + df_shm_round_size(size, region_data->page_size);
+    region_data->file_length = length;
+    if(df_shm_check_fd_length(fd, file_name, length) != 0) {
+        close(fd);
+        free(region_data->file_name);
+        free(region_data);
+        return -1;
     }
-    
-    // map the file to local address space
-    region_data->attach_addr = mmap(starting_addr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if(region_data->attach_addr == NULL) {
-        fprintf(stderr, "Error: mmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+    region_data->attach_addr = df_shm_map_region_fd(&m_data->config, fd, length, starting_addr,
+        &region_data->mapped_length);
+    if(region_data->attach_addr == MAP_FAILED) {
+        close(fd);
         free(region_data->file_name);
         free(region_data);
         return -1;
     }    
-    region_data->mapped_length = size;
-    if(region_data->attach_addr != starting_addr) {
-        fprintf(stderr, "Warning: shared memory region attached to %p instead of %p. %s:%d\n", 
-            region_data->attach_addr, starting_addr, __FILE__, __LINE__);
+    if(region_data->header_length && df_shm_check_header(region_data->attach_addr) != 0) {
+        df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length);
+        close(fd);
+        free(region_data->file_name);
+        free(region_data);
+        return -1;
     }
+    region_data->generation = UINT64_MAX; // look at the header on the first refresh
     
     // close the file descrptor
     if(close(fd) == -1) {
         fprintf(stderr, "Error: close() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
-        munmap(region_data->attach_addr, region_data->mapped_length);
+        df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length);
         free(region_data->file_name);
         free(region_data);
         return -1;    
     }
+    df_shm_advise_mapping(&m_data->config, region_data->attach_addr, 
+        region_data->file_length, region_data->page_size);
 
     *return_data = region_data;
-    *attach_address = region_data->attach_addr;
+    *attach_address = (char *) region_data->attach_addr + region_data->header_length;
     return 0;
 }
 
+int df_shm_method_mmap_attach_region (void *method_data, 
+                                      void *contact_info, 
+                                      size_t size, 
+                                      void *starting_addr, 
+                                      void **return_data, 
+                                      void **attach_address
+                                     )
+{
+    shm_mmap_method_data_t m_data = (shm_mmap_method_data_t) method_data;
+
+    // get file name and page size from contact info
+    char *file_name = (char *) contact_info;
+    size_t page_size;
+    memcpy(&page_size, file_name + strlen(file_name) + 1 + sizeof(size_t), sizeof(size_t));
+
+    return mmap_attach_backstore(m_data, file_name, page_size, size, starting_addr, 
+        return_data, attach_address);
+}
+
+/*
+ * Attach a shm region using the backstore file specified by 'name'.
+ */
+int df_shm_method_mmap_attach_named_region (void *method_data, 
+                                            void *name, 
+                                            int name_size,
+                                            size_t size, 
+                                            void *starting_addr, 
+                                            void **return_data, 
+                                            void **attach_address
+                                           )
+{
+    shm_mmap_method_data_t m_data = (shm_mmap_method_data_t) method_data;
+
+    return mmap_attach_backstore(m_data, (char *) name, 0, size, starting_addr, 
+        return_data, attach_address);
+}
+
 int df_shm_method_mmap_detach_region (void *method_data, df_shm_region_t region)
 {
     shm_mmap_method_data_t m_data = (shm_mmap_method_data_t) method_data;    
     shm_mmap_region_data_t region_data = region->method_data;
 
     // unmap the shm region
-    if(munmap(region_data->attach_addr, region_data->mapped_length) == -1) {
-        fprintf(stderr, "Error: munmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+    if(df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length) != 0) {
         return -1;    
     }
     free(region_data->file_name);
@@ -331,12 +508,108 @@ int df_shm_method_mmap_detach_region (void *method_data, df_shm_region_t region)
     return 0;    
 }
 
+/*
+ * Open the backstore file of a growable region. Return the fd (to be closed with
+ * mmap_close_fd()) or -1 on error.
+ */
+static int mmap_open_fd (shm_mmap_region_data_t region_data)
+{
+    if(region_data->fd != -1) {
+        return region_data->fd;
+    }
+    int fd = open(region_data->file_name, O_RDWR);
+    if(fd == -1) {
+        fprintf(stderr, "Error: calling open() on %s failed: %d %s:%d\n", 
+            region_data->file_name, errno, __FILE__, __LINE__);
+    }
+    return fd;
+}
+
+static void mmap_close_fd (shm_mmap_region_data_t region_data, int fd)
+{
+    if(fd != region_data->fd) {
+        close(fd);
+    }
+}
+
+int df_shm_method_mmap_resize_region (void *method_data, df_shm_region_t region, size_t new_size)
+{
+    shm_mmap_method_data_t m_data = (shm_mmap_method_data_t) method_data;    
+    shm_mmap_region_data_t region_data = region->method_data;
+
+    if(!region_data->header_length) {
+        fprintf(stderr, "Error: region is not growable; set max_region_size. %s:%d\n", 
+            __FILE__, __LINE__);
+        return -1;
+    }
+    size_t length = region_data->header_length + df_shm_round_size(new_size, region_data->page_size);
+    if(length <= region_data->file_length) {
+        return 0;
+    }
+    int fd = mmap_open_fd(region_data);
+    if(fd == -1) {
+        return -1;
+    }
+
+    // extend the file first so that peers never map past its end
+    if(ftruncate(fd, length) == -1) {
+        fprintf(stderr, "Error: ftruncate() file %s to size %lu failed: %d %s:%d\n", 
+            region_data->file_name, length, errno, __FILE__, __LINE__);
+        mmap_close_fd(region_data, fd);
+        return -1;
+    }
+    if(df_shm_grow_mapping(&m_data->config, fd, region_data->attach_addr, 
+           region_data->file_length, length, region_data->page_size) != 0 ||
+       df_shm_reserve_mapping(&m_data->config, fd, (char *) region_data->attach_addr + 
+           region_data->file_length, region_data->file_length, length - region_data->file_length) != 0) {
+        mmap_close_fd(region_data, fd);
+        return -1;
+    }
+    mmap_close_fd(region_data, fd);
+    region_data->file_length = length;
+    df_shm_publish_size(region_data->attach_addr, length - region_data->header_length);
+    region_data->generation = df_shm_header_generation(region_data->attach_addr, &new_size);
+    return 0;
+}
+
+int df_shm_method_mmap_refresh_region (void *method_data, df_shm_region_t region, size_t *size)
+{
+    shm_mmap_method_data_t m_data = (shm_mmap_method_data_t) method_data;    
+    shm_mmap_region_data_t region_data = region->method_data;
+
+    if(!region_data->header_length) {
+        *size = region->size;
+        return 0;
+    }
+    size_t new_size;
+    uint64_t generation = df_shm_header_generation(region_data->attach_addr, &new_size);
+    size_t length = region_data->header_length + new_size;
+    if(generation != region_data->generation && length > region_data->file_length) {
+        int fd = mmap_open_fd(region_data);
+        if(fd == -1) {
+            return -1;
+        }
+        int rc = df_shm_grow_mapping(&m_data->config, fd, region_data->attach_addr, 
+            region_data->file_length, length, region_data->page_size);
+        mmap_close_fd(region_data, fd);
+        if(rc) {
+            return -1;
+        }
+        region_data->file_length = length;
+    }
+    region_data->generation = generation;
+    *size = region_data->file_length - region_data->header_length;
+    return 0;
+}
+
 int df_shm_method_mmap_finalize (void *method_data)
 {
     shm_mmap_method_data_t m_data = (shm_mmap_method_data_t) method_data;    
+    if(m_data->config.flags & DF_SHM_FLAG_FIXED_ADDR) {
+        df_shm_window_close();
+    }
     free(m_data);
     return 0;
 }
 
 #endif /* HAVE_MMAP */  
-
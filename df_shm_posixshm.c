@@ -17,17 +17,21 @@
 #include <string.h>
 #include <errno.h>
 #include "df_shm.h"
+#include "df_shm_mapping.h"
+#include "df_shm_window.h"
 
-#define PATH_LENGTH 100
-#define DEFAULT_OPEN_MODE 0600
+#define PATH_LENGTH (DF_SHM_PATH_LENGTH + 64)
 
 /*
  * global method level bookkeeping data
  */
 typedef struct _shm_posixshm_method_data {
     char base_path[PATH_LENGTH]; 
+    char huge_base_path[PATH_LENGTH]; // base path on hugetlbfs; empty if huge pages are not used
+    size_t huge_page_size;
+    df_shm_config config;
     pid_t my_pid;
-    int counter;
+    int counter;       // advanced atomically so that threads get distinct names
 } shm_posixshm_method_data, *shm_posixshm_method_data_t;
  
 /*
@@ -36,109 +40,213 @@ typedef struct _shm_posixshm_method_data {
 typedef struct _shm_posixshm_region_data {
     char *file_name;   
     size_t file_length;
+    size_t page_size;  // page size of the shm object; larger than PAGE_SIZE means
+                       // file_name is a file on hugetlbfs rather than a shm_open() name
     void *attach_addr;
     size_t mapped_length;  
+    size_t header_length;  // DF_SHM_HEADER_LENGTH if the region is growable, 0 otherwise
+    uint64_t generation;   // generation of the header the local mapping is up to date with
 } shm_posixshm_region_data, *shm_posixshm_region_data_t; 
+
+/*
+ * Open a shm object: huge page objects are files on hugetlbfs since shm_open()
+ * always creates objects on tmpfs.
+ */
+static int posixshm_open (const char *name, int flags, mode_t mode, size_t page_size)
+{
+    if(page_size > PAGE_SIZE) {
+        return open(name, flags, mode);
+    }
+    return shm_open(name, flags, mode);
+}
+
+static int posixshm_unlink (const char *name, size_t page_size)
+{
+    if(page_size > PAGE_SIZE) {
+        return unlink(name);
+    }
+    return shm_unlink(name);
+}
  
 int df_shm_method_posixshm_init (void *input_data, void **method_data)
 {
-    // TODO: get config parameters from input_data. ignore it now.
     shm_posixshm_method_data_t m_data = (shm_posixshm_method_data_t) 
         malloc(sizeof(shm_posixshm_method_data));
     if(!m_data) {
         fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         return -1;    
     }
+    df_shm_load_config(&m_data->config, input_data);
+    // regions are placed in the address window shared with peers
+    if((m_data->config.flags & DF_SHM_FLAG_FIXED_ADDR) && df_shm_window_open(&m_data->config) != 0) {
+        free(m_data);
+        return -1;
+    }
     m_data->my_pid = getpid();
     
     // create base path for shm object file name
     // the shm object will actually created under /dev/shm/
-    sprintf(m_data->base_path, "/df_shm_posixshm.%d\0", m_data->my_pid);
+    sprintf(m_data->base_path, "/%s_posixshm.%d", m_data->config.name_prefix, m_data->my_pid);
     m_data->counter = 0;
+
+    // huge page shm objects are created on hugetlbfs
+    m_data->huge_base_path[0] = '\0';
+    m_data->huge_page_size = 0;
+    if(m_data->config.flags & DF_SHM_FLAG_HUGEPAGE) {
+        char mount_point[PATH_LENGTH];
+        m_data->huge_page_size = df_shm_huge_page_size(&m_data->config);
+        if(m_data->huge_page_size > PAGE_SIZE &&
+           df_shm_find_hugetlbfs(m_data->huge_page_size, mount_point, PATH_LENGTH) == 0) {
+            // a truncated path would put the files somewhere else; fall back instead
+            int len = snprintf(m_data->huge_base_path, PATH_LENGTH, "%s/%s_posixshm.%d", mount_point, 
+                m_data->config.name_prefix, m_data->my_pid);
+            if(len < 0 || len >= PATH_LENGTH) {
+                m_data->huge_base_path[0] = '\0';
+                fprintf(stderr, "Warning: hugetlbfs path under %s is too long; "
+                    "using transparent huge pages. %s:%d\n", mount_point, __FILE__, __LINE__);
+            }
+        }
+        else {
+            fprintf(stderr, "Warning: no hugetlbfs mounted for page size %lu; "
+                "using transparent huge pages. %s:%d\n", m_data->huge_page_size, __FILE__, __LINE__);
+        }
+    }
     *method_data = m_data;
     return 0;
 }
 
-int df_shm_method_posixshm_create_region (void *method_data, 
-                                          size_t size, 
-                                          void *starting_addr,
-                                          void **return_data, 
-                                          void **attach_address
-                                         )
+/*
+ * Create the shm object 'name' of 'size' bytes in pages of page_size (plus the
+ * header of a growable region) and map it to local address space. Return 0 on
+ * success and -1 on error.
+ */
+static int posixshm_create_object (shm_posixshm_region_data_t region_data,
+                                   const df_shm_config *config,
+                                   const char *name,
+                                   size_t size,
+                                   size_t page_size,
+                                   void *starting_addr
+                                  )
 {
-    shm_posixshm_method_data_t m_data = (shm_posixshm_method_data_t) method_data;
+    region_data->file_name = strdup(name);
+    region_data->page_size = page_size;
 
-    // create per-region data
-    shm_posixshm_region_data_t region_data = (shm_posixshm_region_data_t) 
-        malloc(sizeof(shm_posixshm_region_data));
-    if(!region_data) {
-        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
-        return -1;    
-    }
-    
-    // generate a unique file name(base_path.counter)
-    char temp[50];
-    //itoa(m_data->counter, temp, 10);
-    sprintf(temp, "%d\0", m_data->counter);
-    int name_len = strlen(m_data->base_path) + strlen(temp) + 2;    
-    region_data->file_name = (char *) malloc(name_len);
-    strcpy(region_data->file_name, m_data->base_path);
-    strcat(region_data->file_name, ".");
-    strcat(region_data->file_name, temp);
-    
     // create posix shm object
-    int fd = shm_open(region_data->file_name, O_CREAT | O_RDWR, DEFAULT_OPEN_MODE);
+    int excl = config->flags & DF_SHM_FLAG_EXCL;
+    int fd = posixshm_open(region_data->file_name, O_CREAT | O_RDWR | (excl? O_EXCL : 0), 
+        config->mode, page_size);
     if(fd == -1) {
-        fprintf(stderr, "Error: calling shm_open() on %s failed: %d %s:%d\n", 
-            region_data->file_name, errno, __FILE__, __LINE__);
+        int err = errno;
+        if(!excl || err != EEXIST) {
+            fprintf(stderr, "Error: calling shm_open() on %s failed: %d %s:%d\n", 
+                region_data->file_name, err, __FILE__, __LINE__);
+        }
         free(region_data->file_name);
-        free(region_data);
+        errno = err;
         return -1;
     }
     
-    // size the shm object
-    if(ftruncate(fd, size) == -1) {
-        fprintf(stderr, "Error: ftruncate() file %s to size %lu failed: %d %s:%d\n", 
-            region_data->file_name, size, errno, __FILE__, __LINE__);
+    // size the shm object; an existing object is never shrunk, since other
+    // processes may have it mapped
+    region_data->header_length = df_shm_header_length(config);
+    size_t length = region_data->header_length + df_shm_round_size(size, page_size);
+    struct stat st;
+    if(fstat(fd, &st) == -1) {
+        fprintf(stderr, "Error: fstat() on %s failed: %d %s:%d\n", 
+            region_data->file_name, errno, __FILE__, __LINE__);
+        close(fd);
         free(region_data->file_name);
-        free(region_data);
         return -1;
     }
-    region_data->file_length = size;
-    
-    if(starting_addr != NULL && (uint64_t)starting_addr % PAGE_SIZE) {
-        fprintf(stderr, "Warning: the starting address (%p) is not page-aligned. %s:%d\n", 
-            starting_addr, __FILE__, __LINE__);    
+    if((size_t) st.st_size < length && ftruncate(fd, length) == -1) {
+        fprintf(stderr, "Error: ftruncate() file %s to size %lu failed: %d %s:%d\n", 
+            region_data->file_name, length, errno, __FILE__, __LINE__);
+        close(fd);
+        posixshm_unlink(region_data->file_name, page_size);
+        free(region_data->file_name);
+        return -1;
     }
+    region_data->file_length = length;
     
     // map the file to local address space
-    region_data->attach_addr = mmap(starting_addr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if(region_data->attach_addr == NULL) {
-        fprintf(stderr, "Error: mmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+    region_data->attach_addr = df_shm_map_region_fd(config, fd, length, starting_addr,
+        &region_data->mapped_length);
+    if(region_data->attach_addr == MAP_FAILED) {
+        close(fd);
+        posixshm_unlink(region_data->file_name, page_size);
         free(region_data->file_name);
-        free(region_data);
         return -1;
     }    
-    region_data->mapped_length = size;
-    if(region_data->attach_addr != starting_addr) {
-        fprintf(stderr, "Warning: shared memory region attached to %p instead of %p. %s:%d\n", 
-            region_data->attach_addr, starting_addr, __FILE__, __LINE__);
+    if(df_shm_reserve_mapping(config, fd, region_data->attach_addr, 0, length) != 0) {
+        df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length);
+        close(fd);
+        posixshm_unlink(region_data->file_name, page_size);
+        free(region_data->file_name);
+        return -1;
     }
+    if(region_data->header_length) {
+        df_shm_init_header(region_data->attach_addr, length - region_data->header_length);
+    }
+    region_data->generation = 0;
     
     // close the file descrptor
     if(close(fd) == -1) {
         fprintf(stderr, "Error: close() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
-        munmap(region_data->attach_addr, region_data->mapped_length);
-        if(shm_unlink(region_data->file_name) == -1) {
+        df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length);
+        if(posixshm_unlink(region_data->file_name, page_size) == -1) {
             fprintf(stderr, "Error: shm_unlink() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
         }
         free(region_data->file_name);
-        free(region_data);
         return -1;    
     }
+    return 0;
+}
+
+int df_shm_method_posixshm_create_region (void *method_data, 
+                                          size_t size, 
+                                          void *starting_addr,
+                                          void **return_data, 
+                                          void **attach_address
+                                         )
+{
+    shm_posixshm_method_data_t m_data = (shm_posixshm_method_data_t) method_data;
+
+    // create per-region data
+    shm_posixshm_region_data_t region_data = (shm_posixshm_region_data_t) 
+        malloc(sizeof(shm_posixshm_region_data));
+    if(!region_data) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return -1;    
+    }
+    
+    // generate a unique file name(base_path.counter)
+    char name[PATH_LENGTH + 16];
+    int counter = __atomic_fetch_add(&m_data->counter, 1, __ATOMIC_RELAXED);
+    int rc = -1;
+    if(m_data->huge_base_path[0] && !m_data->config.max_region_size) {
+        // mapping fails if there are not enough free huge pages
+        sprintf(name, "%s.%d", m_data->huge_base_path, counter);
+        rc = posixshm_create_object(region_data, &m_data->config, name, size, 
+            m_data->huge_page_size, starting_addr);
+        if(rc) {
+            fprintf(stderr, "Warning: cannot create region of %lu bytes on hugetlbfs; "
+                "using transparent huge pages. %s:%d\n", size, __FILE__, __LINE__);
+        }
+    }
+    if(rc) {
+        sprintf(name, "%s.%d", m_data->base_path, counter);
+        rc = posixshm_create_object(region_data, &m_data->config, name, size, PAGE_SIZE, 
+            starting_addr);
+    }
+    if(rc) {
+        free(region_data);
+        return -1;
+    }
+    df_shm_advise_mapping(&m_data->config, region_data->attach_addr, 
+        region_data->file_length, region_data->page_size);
     
     *return_data = region_data;
-    *attach_address = region_data->attach_addr;
+    *attach_address = (char *) region_data->attach_addr + region_data->header_length;
     return 0;
 }
 
@@ -161,61 +269,16 @@ int df_shm_method_posixshm_create_named_region (void *method_data,
         return -1;
     }
 
-    region_data->file_name = strdup((char *)name);
-
-    // create posix shm object
-    int fd = shm_open(region_data->file_name, O_CREAT | O_RDWR, DEFAULT_OPEN_MODE);
-    if(fd == -1) {
-        fprintf(stderr, "Error: calling shm_open() on %s failed: %d %s:%d\n",
-            region_data->file_name, errno, __FILE__, __LINE__);
-        free(region_data->file_name);
-        free(region_data);
-        return -1;
-    }
-
-    // size the shm object
-    if(ftruncate(fd, size) == -1) {
-        fprintf(stderr, "Error: ftruncate() file %s to size %lu failed: %d %s:%d\n",
-            region_data->file_name, size, errno, __FILE__, __LINE__);
-        free(region_data->file_name);
-        free(region_data);
-        return -1;
-    }
-    region_data->file_length = size;
-
-    if(starting_addr != NULL && (uint64_t)starting_addr % PAGE_SIZE) {
-        fprintf(stderr, "Warning: the starting address (%p) is not page-aligned. %s:%d\n",
-            starting_addr, __FILE__, __LINE__);
-    }
-
-    // map the file to local address space
-    region_data->attach_addr = mmap(starting_addr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if(region_data->attach_addr == NULL) {
-        fprintf(stderr, "Error: mmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
-        free(region_data->file_name);
-        free(region_data);
-        return -1;
-    }
-    region_data->mapped_length = size;
-    if(region_data->attach_addr != starting_addr) {
-        fprintf(stderr, "Warning: shared memory region attached to %p instead of %p. %s:%d\n",
-            region_data->attach_addr, starting_addr, __FILE__, __LINE__);
-    }
-
-    // close the file descrptor
-    if(close(fd) == -1) {
-        fprintf(stderr, "Error: close() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
-        munmap(region_data->attach_addr, region_data->mapped_length);
-        if(shm_unlink(region_data->file_name) == -1) {
-            fprintf(stderr, "Error: shm_unlink() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
-        }
-        free(region_data->file_name);
+    if(posixshm_create_object(region_data, &m_data->config, (char *)name, size, PAGE_SIZE, 
+        starting_addr) != 0) {
         free(region_data);
         return -1;
     }
+    df_shm_advise_mapping(&m_data->config, region_data->attach_addr, 
+        region_data->file_length, region_data->page_size);
 
     *return_data = region_data;
-    *attach_address = region_data->attach_addr;
+    *attach_address = (char *) region_data->attach_addr + region_data->header_length;
     return 0;
 }
 
@@ -223,6 +286,7 @@ int df_shm_method_posixshm_create_named_region (void *method_data,
  * the contact info of a posix shm region has the following fields:
  * - file_name (strlen bytes terminated by '\0')
  * - file size (sizeof(size_t) bytes)
+ * - page size (sizeof(size_t) bytes)
  */
 void * df_shm_method_posixshm_region_contact (void *method_data, df_shm_region_t region, int *length)
 {
@@ -230,7 +294,7 @@ void * df_shm_method_posixshm_region_contact (void *method_data, df_shm_region_t
 
     void *contact_string;
     int file_name_len = strlen(region_data->file_name) + 1;
-    int len = file_name_len + sizeof(size_t);
+    int len = file_name_len + 2 * sizeof(size_t);
     contact_string = malloc(len);
     if(!contact_string) {
         fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
@@ -238,6 +302,8 @@ void * df_shm_method_posixshm_region_contact (void *method_data, df_shm_region_t
     }
     strcpy(contact_string, region_data->file_name);
     memcpy(((char *)contact_string + file_name_len), &(region_data->file_length), sizeof(size_t));
+    memcpy(((char *)contact_string + file_name_len + sizeof(size_t)), &(region_data->page_size), 
+        sizeof(size_t));
     *length = len;
     return contact_string;
 }
@@ -248,13 +314,12 @@ int df_shm_method_posixshm_destroy_region (void *method_data, df_shm_region_t re
     shm_posixshm_region_data_t region_data = (shm_posixshm_region_data_t) region->method_data;
 
     // unmap the shm region
-    if(munmap(region_data->attach_addr, region_data->mapped_length) == -1) {
-        fprintf(stderr, "Error: munmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+    if(df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length) != 0) {
         return -1;    
     }
 
     // remove the backstore file
-    if(shm_unlink(region_data->file_name) == -1) {
+    if(posixshm_unlink(region_data->file_name, region_data->page_size) == -1) {
         fprintf(stderr, "Error: calling unlink() on %s returns %d. %s:%d\n", region_data->file_name, 
             errno, __FILE__, __LINE__);
         return -1;    
@@ -264,16 +329,18 @@ int df_shm_method_posixshm_destroy_region (void *method_data, df_shm_region_t re
     return 0;
 }
 
-int df_shm_method_posixshm_attach_region (void *method_data, 
-                                          void *contact_info, 
-                                          size_t size, 
-                                          void *starting_addr, 
-                                          void **return_data, 
-                                          void **attach_address
-                                         )
+/*
+ * Open and map a shm object created by another process. 
+ */
+static int posixshm_attach_object (shm_posixshm_method_data_t m_data,
+                                   char *file_name,
+                                   size_t page_size,
+                                   size_t size,
+                                   void *starting_addr,
+                                   void **return_data,
+                                   void **attach_address
+                                  )
 {
-    shm_posixshm_method_data_t m_data = (shm_posixshm_method_data_t) method_data;
-
     // create per-region data
     shm_posixshm_region_data_t region_data = (shm_posixshm_region_data_t) 
         malloc(sizeof(shm_posixshm_region_data));
@@ -281,12 +348,10 @@ int df_shm_method_posixshm_attach_region (void *method_data,
         fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         return -1;    
     }
-    
-    // TODO: get shm segment info from contact info
-    char *file_name = (char *) contact_info;
+    region_data->page_size = page_size;
 
     // open the shm object
-    int fd = shm_open(file_name, O_RDWR, DEFAULT_OPEN_MODE);
+    int fd = posixshm_open(file_name, O_RDWR, 0, region_data->page_size);
     if(fd == -1) {
         fprintf(stderr, "Error: calling shm_open() on %s failed: %d %s:%d\n", 
             file_name, errno, __FILE__, __LINE__);
@@ -294,51 +359,94 @@ int df_shm_method_posixshm_attach_region (void *method_data,
         return -1;
     }
     region_data->file_name = strdup(file_name);
-
-    // TODO: pass file length through contact_info    
-    region_data->file_length = *(size_t *) ((char *)contact_info + strlen(file_name) + 1);
     
-    if(starting_addr != NULL && (uint64_t)starting_addr % PAGE_SIZE) {
-        fprintf(stderr, "Warning: the starting address (%p) is not page-aligned. %s:%d\n", 
-            starting_addr, __FILE__, __LINE__);    
+    // map the file to local address space in the same page size as creator
+    region_data->header_length = df_shm_header_length(&m_data->config);
+    size_t length = region_data->header_length + df_shm_round_size(size, region_data->page_size);
+    region_data->file_length = length;
+    if(df_shm_check_fd_length(fd, file_name, length) != 0) {
+        close(fd);
+        free(region_data->file_name);
+        free(region_data);
+        return -1;
     }
-    
-    // map the file to local address space
-    region_data->attach_addr = mmap(starting_addr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if(region_data->attach_addr == NULL) {
-        fprintf(stderr, "Error: mmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+    region_data->attach_addr = df_shm_map_region_fd(&m_data->config, fd, length, starting_addr,
+        &region_data->mapped_length);
+    if(region_data->attach_addr == MAP_FAILED) {
+        close(fd);
         free(region_data->file_name);
         free(region_data);
         return -1;
     }    
-    region_data->mapped_length = size;
-    if(region_data->attach_addr != starting_addr) {
-        fprintf(stderr, "Warning: shared memory region attached to %p instead of %p. %s:%d\n", 
-            region_data->attach_addr, starting_addr, __FILE__, __LINE__);
+    if(region_data->header_length && df_shm_check_header(region_data->attach_addr) != 0) {
+        df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length);
+        close(fd);
+        free(region_data->file_name);
+        free(region_data);
+        return -1;
     }
+    region_data->generation = UINT64_MAX; // look at the header on the first refresh
     
     // close the file descrptor
     if(close(fd) == -1) {
         fprintf(stderr, "Error: close() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
-        munmap(region_data->attach_addr, region_data->mapped_length);
+        df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length);
         free(region_data->file_name);
         free(region_data);
         return -1;    
     }
+    df_shm_advise_mapping(&m_data->config, region_data->attach_addr, 
+        region_data->file_length, region_data->page_size);
 
     *return_data = region_data;
-    *attach_address = region_data->attach_addr;
+    *attach_address = (char *) region_data->attach_addr + region_data->header_length;
     return 0;
 }
 
+int df_shm_method_posixshm_attach_region (void *method_data, 
+                                          void *contact_info, 
+                                          size_t size, 
+                                          void *starting_addr, 
+                                          void **return_data, 
+                                          void **attach_address
+                                         )
+{
+    shm_posixshm_method_data_t m_data = (shm_posixshm_method_data_t) method_data;
+
+    // get file name and page size from contact info
+    char *file_name = (char *) contact_info;
+    size_t page_size;
+    memcpy(&page_size, file_name + strlen(file_name) + 1 + sizeof(size_t), sizeof(size_t));
+
+    return posixshm_attach_object(m_data, file_name, page_size, size, starting_addr, 
+        return_data, attach_address);
+}
+
+/*
+ * Attach a shm region using the shm object specified by 'name'.
+ */
+int df_shm_method_posixshm_attach_named_region (void *method_data, 
+                                                void *name, 
+                                                int name_size,
+                                                size_t size, 
+                                                void *starting_addr, 
+                                                void **return_data, 
+                                                void **attach_address
+                                               )
+{
+    shm_posixshm_method_data_t m_data = (shm_posixshm_method_data_t) method_data;
+
+    return posixshm_attach_object(m_data, (char *) name, PAGE_SIZE, size, starting_addr, 
+        return_data, attach_address);
+}
+
 int df_shm_method_posixshm_detach_region (void *method_data, df_shm_region_t region)
 {
     shm_posixshm_method_data_t m_data = (shm_posixshm_method_data_t) method_data;    
     shm_posixshm_region_data_t region_data = (shm_posixshm_region_data_t) region->method_data;
 
     // unmap the shm region
-    if(munmap(region_data->attach_addr, region_data->mapped_length) == -1) {
-        fprintf(stderr, "Error: munmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+    if(df_shm_unmap_region(region_data->attach_addr, region_data->mapped_length) != 0) {
         return -1;    
     }
     free(region_data->file_name);
@@ -346,12 +454,88 @@ int df_shm_method_posixshm_detach_region (void *method_data, df_shm_region_t reg
     return 0;    
 }
 
+int df_shm_method_posixshm_resize_region (void *method_data, df_shm_region_t region, size_t new_size)
+{
+    shm_posixshm_method_data_t m_data = (shm_posixshm_method_data_t) method_data;    
+    shm_posixshm_region_data_t region_data = (shm_posixshm_region_data_t) region->method_data;
+
+    if(!region_data->header_length) {
+        fprintf(stderr, "Error: region is not growable; set max_region_size. %s:%d\n", 
+            __FILE__, __LINE__);
+        return -1;
+    }
+    size_t length = region_data->header_length + df_shm_round_size(new_size, region_data->page_size);
+    if(length <= region_data->file_length) {
+        return 0;
+    }
+    int fd = posixshm_open(region_data->file_name, O_RDWR, 0, region_data->page_size);
+    if(fd == -1) {
+        fprintf(stderr, "Error: calling shm_open() on %s failed: %d %s:%d\n", 
+            region_data->file_name, errno, __FILE__, __LINE__);
+        return -1;
+    }
+
+    // extend the shm object first so that peers never map past its end
+    if(ftruncate(fd, length) == -1) {
+        fprintf(stderr, "Error: ftruncate() file %s to size %lu failed: %d %s:%d\n", 
+            region_data->file_name, length, errno, __FILE__, __LINE__);
+        close(fd);
+        return -1;
+    }
+    if(df_shm_grow_mapping(&m_data->config, fd, region_data->attach_addr, 
+           region_data->file_length, length, region_data->page_size) != 0 ||
+       df_shm_reserve_mapping(&m_data->config, fd, (char *) region_data->attach_addr + 
+           region_data->file_length, region_data->file_length, length - region_data->file_length) != 0) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    region_data->file_length = length;
+    df_shm_publish_size(region_data->attach_addr, length - region_data->header_length);
+    region_data->generation = df_shm_header_generation(region_data->attach_addr, &new_size);
+    return 0;
+}
+
+int df_shm_method_posixshm_refresh_region (void *method_data, df_shm_region_t region, size_t *size)
+{
+    shm_posixshm_method_data_t m_data = (shm_posixshm_method_data_t) method_data;    
+    shm_posixshm_region_data_t region_data = (shm_posixshm_region_data_t) region->method_data;
+
+    if(!region_data->header_length) {
+        *size = region->size;
+        return 0;
+    }
+    size_t new_size;
+    uint64_t generation = df_shm_header_generation(region_data->attach_addr, &new_size);
+    size_t length = region_data->header_length + new_size;
+    if(generation != region_data->generation && length > region_data->file_length) {
+        int fd = posixshm_open(region_data->file_name, O_RDWR, 0, region_data->page_size);
+        if(fd == -1) {
+            fprintf(stderr, "Error: calling shm_open() on %s failed: %d %s:%d\n", 
+                region_data->file_name, errno, __FILE__, __LINE__);
+            return -1;
+        }
+        int rc = df_shm_grow_mapping(&m_data->config, fd, region_data->attach_addr, 
+            region_data->file_length, length, region_data->page_size);
+        close(fd);
+        if(rc) {
+            return -1;
+        }
+        region_data->file_length = length;
+    }
+    region_data->generation = generation;
+    *size = region_data->file_length - region_data->header_length;
+    return 0;
+}
+
 int df_shm_method_posixshm_finalize (void *method_data)
 {
     shm_posixshm_method_data_t m_data = (shm_posixshm_method_data_t) method_data;    
+    if(m_data->config.flags & DF_SHM_FLAG_FIXED_ADDR) {
+        df_shm_window_close();
+    }
     free(m_data);
     return 0;
 }
   
 #endif /* HAVE_POSIX_SHM */
-
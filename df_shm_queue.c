@@ -8,16 +8,101 @@
  * written by Fang Zheng (fzheng@cc.gatech.edu)
  */
 
+#define _GNU_SOURCE // syscall()
 #include "df_config.h"
 #include <stdint.h> 
 #include <stdio.h> 
 #include <stdlib.h> 
 #include <string.h> 
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
 #include <sys/uio.h>
+#include <sys/syscall.h>
 #include <assert.h>
 #include "df_shm_queue.h"
     
+/*
+ * Tell the queue set the sender's queue belongs to that a slot has been published.
+ * The fence orders the slot's status store before reading the ready bit; it pairs
+ * with the receiver clearing bits before it looks at the queues (see df_shm_queue_set.c),
+ * so that either the receiver sees the slot or we see the bit cleared and set it.
+ * The bit is only written when it is clear, so a busy queue doesn't keep the
+ * bitmap's cache line bouncing.
+ */
+static inline void signal_queue_set (df_queue_ep_t ep)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(!(__atomic_load_n(ep->ready_word, __ATOMIC_RELAXED) & ep->ready_mask)) {
+        __atomic_fetch_or(ep->ready_word, ep->ready_mask, __ATOMIC_SEQ_CST);
+    }
+}
+
+/*
+ * Return a pidfd of process pid, or -1 if the kernel has no pidfds.
+ */
+static int open_pidfd (pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return (int) syscall(SYS_pidfd_open, pid, 0);
+#else
+    return -1;
+#endif
+}
+
+/*
+ * Return 1 if the process at the other end of ep's queue may still use it, and 0 if
+ * it has exited or destroyed its endpoint. A peer which has not got its endpoint yet
+ * is taken as alive, and so is this process (the peer is another thread).
+ */
+static int peer_alive (df_queue_ep_t ep)
+{
+    df_queue_t queue = ep->queue;
+    pid_t pid = __atomic_load_n(ep->is_sender? &queue->receiver_pid : &queue->sender_pid,
+        __ATOMIC_ACQUIRE);
+    if(pid == DF_QUEUE_EP_CLOSED) {
+        return 0;
+    }
+    if(pid == 0 || pid == getpid()) {
+        return 1;
+    }
+    if(pid != ep->peer_pid) {
+        if(ep->peer_pidfd >= 0) {
+            close(ep->peer_pidfd);
+        }
+        ep->peer_pid = pid;
+        ep->peer_pidfd = open_pidfd(pid);
+    }
+    if(ep->peer_pidfd >= 0) {
+        // a pidfd becomes readable when the process exits, before it is reaped
+        struct pollfd pfd = {ep->peer_pidfd, POLLIN, 0};
+        return poll(&pfd, 1, 0) == 1? 0 : 1;
+    }
+    // a process which has exited but is not reaped yet still counts as alive here
+    return (kill(pid, 0) == 0 || errno != ESRCH)? 1 : 0;
+}
+
+/*
+ * Spin until slot has status. The peer is checked every DF_SHM_PEER_CHECK_SPINS spins
+ * only, so a slot which is ready at once costs nothing more than the status load.
+ * Return 0 when the slot has status and DF_QUEUE_PEER_GONE if the peer is gone.
+ */
+static inline int wait_for_slot (df_queue_ep_t ep, df_queue_slot_t slot, enum SLOT_FLAG status)
+{
+    uint32_t spins = 0;
+    while(__atomic_load_n(&slot->status, __ATOMIC_ACQUIRE) != status) {
+        if(DF_SHM_PEER_CHECK_SPINS && ++ spins == DF_SHM_PEER_CHECK_SPINS) {
+            spins = 0;
+            // the peer may have filled or emptied the slot just before leaving
+            if(!peer_alive(ep) && __atomic_load_n(&slot->status, __ATOMIC_ACQUIRE) != status) {
+                return DF_QUEUE_PEER_GONE;
+            }
+        }
+    }
+    return 0;
+}
+
 /*
  * Calculate how many bytes a queue slot with specified configuration would occupy.
  */
@@ -64,6 +149,8 @@ df_queue_t df_create_queue (void *addr, uint32_t max_num_slots, size_t max_paylo
     queue->max_payload_size = max_payload_size;
     queue->slot_size = df_calculate_slot_size(max_payload_size);
     queue->total_size = df_calculate_queue_size(max_num_slots, max_payload_size);
+    queue->sender_pid = 0;
+    queue->receiver_pid = 0;
 
     // initialize slots
     df_queue_slot_t slot;
@@ -126,6 +213,13 @@ df_queue_ep_t df_internal_get_queue_ep (df_queue_t queue, int is_sender)
     ep->slot_index = 0;
     ep->queue = queue;
     ep->is_sender= is_sender;    
+    ep->ready_word = NULL;
+    ep->ready_mask = 0;
+    ep->peer_pid = 0;
+    ep->peer_pidfd = -1;
+
+    // let the peer know which process to watch
+    __atomic_store_n(is_sender? &queue->sender_pid : &queue->receiver_pid, getpid(), __ATOMIC_RELEASE);
     return ep;
 }
 
@@ -158,6 +252,14 @@ int df_destroy_ep (df_queue_ep_t ep)
 {
     assert(ep != NULL);
     
+    // mark this side closed unless another process has taken it over since; release
+    // ordering keeps our last enqueue or release before it
+    pid_t self = getpid();
+    __atomic_compare_exchange_n(ep->is_sender? &ep->queue->sender_pid : &ep->queue->receiver_pid,
+        &self, DF_QUEUE_EP_CLOSED, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    if(ep->peer_pidfd >= 0) {
+        close(ep->peer_pidfd);
+    }
     free(ep->slots);    
     free(ep);
     return 0;
@@ -184,7 +286,9 @@ int df_enqueue_vector (df_queue_ep_t ep, struct iovec *vec, int veccnt)
         df_queue_slot_t current_slot = ep->slots[ep->slot_index];
         
         // make sure the slot is empty
-        while(current_slot->status != SLOT_EMPTY) { }
+        if(wait_for_slot(ep, current_slot, SLOT_EMPTY) != 0) {
+            return DF_QUEUE_PEER_GONE;
+        }
 
         // copy data into the slot
         char *dest = current_slot->data;
@@ -194,11 +298,11 @@ int df_enqueue_vector (df_queue_ep_t ep, struct iovec *vec, int veccnt)
         }
         current_slot->size = size;
 
-        // TODO: memory fence
-        //__sync_synchronize();
-
-        // mark the slot as full
-        current_slot->status = SLOT_FULL;
+        // mark the slot as full; release ordering publishes payload and size with it
+        __atomic_store_n(&current_slot->status, SLOT_FULL, __ATOMIC_RELEASE);
+        if(ep->ready_word) {
+            signal_queue_set(ep);
+        }
         
         // advance to next slot
         ep->slot_index = (ep->slot_index + 1) % ep->queue->max_num_slots;
@@ -233,7 +337,7 @@ int df_is_enqueue_possible (df_queue_ep_t ep)
     assert(ep->queue != NULL);
     assert(ep->queue->initialized);
     
-    return (ep->slots[ep->slot_index]->status == SLOT_EMPTY)? 1: 0;
+    return (__atomic_load_n(&ep->slots[ep->slot_index]->status, __ATOMIC_ACQUIRE) == SLOT_EMPTY)? 1: 0;
 }
  
 /*
@@ -257,7 +361,7 @@ int df_try_enqueue_vector (df_queue_ep_t ep, struct iovec *vec, int veccnt)
         df_queue_slot_t current_slot = ep->slots[ep->slot_index];
         
         // test if the slot is empty
-        if(current_slot->status != SLOT_EMPTY) { 
+        if(__atomic_load_n(&current_slot->status, __ATOMIC_ACQUIRE) != SLOT_EMPTY) { 
             return -1;
         }
 
@@ -269,11 +373,11 @@ int df_try_enqueue_vector (df_queue_ep_t ep, struct iovec *vec, int veccnt)
         }
         current_slot->size = size;
 
-        // TODO: memory fence
-        //__sync_synchronize();
-
-        // mark the slot as full
-        current_slot->status = SLOT_FULL;
+        // mark the slot as full; release ordering publishes payload and size with it
+        __atomic_store_n(&current_slot->status, SLOT_FULL, __ATOMIC_RELEASE);
+        if(ep->ready_word) {
+            signal_queue_set(ep);
+        }
         
         // advance to next slot
         ep->slot_index = (ep->slot_index + 1) % ep->queue->max_num_slots;
@@ -311,11 +415,10 @@ int df_dequeue (df_queue_ep_t ep, void **data, size_t *length)
 
     df_queue_slot_t current_slot = ep->slots[ep->slot_index];
         
-    // make sure the slot is full
-    while(current_slot->status != SLOT_FULL) { }
-
-    // TODO: memory fence
-    //__sync_synchronize();
+    // make sure the slot is full; acquire ordering makes the payload visible
+    if(wait_for_slot(ep, current_slot, SLOT_FULL) != 0) {
+        return DF_QUEUE_PEER_GONE;
+    }
 
     *data = (void *) current_slot->data;
     *length = current_slot->size;      
@@ -335,12 +438,9 @@ void df_release (df_queue_ep_t ep)
 
     df_queue_slot_t current_slot = ep->slots[ep->slot_index];
     current_slot->size = 0;
-    
-    // TODO: memory fence
-    //__sync_synchronize();
 
-    // mark the slot as empty
-    current_slot->status = SLOT_EMPTY;    
+    // mark the slot as empty; release ordering keeps our reads of the payload before it
+    __atomic_store_n(&current_slot->status, SLOT_EMPTY, __ATOMIC_RELEASE);
     
     // advance to wait for new data on the next slot
     ep->slot_index = (ep->slot_index + 1) % ep->queue->max_num_slots;
@@ -357,7 +457,7 @@ int df_is_dequeue_possible (df_queue_ep_t ep)
     assert(ep->queue->initialized);
     assert(ep->is_sender == 0);
     
-    return (ep->slots[ep->slot_index]->status == SLOT_FULL)? 1: 0;
+    return (__atomic_load_n(&ep->slots[ep->slot_index]->status, __ATOMIC_ACQUIRE) == SLOT_FULL)? 1: 0;
 }
  
 /*
@@ -376,14 +476,11 @@ int df_try_dequeue (df_queue_ep_t ep, void **data, size_t *length)
 
     df_queue_slot_t current_slot = ep->slots[ep->slot_index];
         
-    // make sure the slot is full
-    if(current_slot->status != SLOT_FULL) { 
+    // make sure the slot is full; acquire ordering makes the payload visible
+    if(__atomic_load_n(&current_slot->status, __ATOMIC_ACQUIRE) != SLOT_FULL) { 
         return -1;
     }
 
-    // TODO: memory fence
-    //__sync_synchronize();
-
     *data = (void *) current_slot->data;
     *length = current_slot->size;  
     return 0;    
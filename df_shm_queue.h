@@ -18,6 +18,7 @@ extern "C" {
 #include <stdint.h> 
 #include <unistd.h>
 #include <stddef.h>
+#include <sys/uio.h>
     
 /*
  * slot status: empty (ready for writing) or full (ready for reading)
@@ -39,6 +40,17 @@ typedef struct _df_queue_slot {
 #ifndef CACHE_LINE_SIZE
 #define CACHE_LINE_SIZE 64
 #endif
+/*
+ * sender_pid or receiver_pid of a side whose endpoint has been destroyed
+ */
+#define DF_QUEUE_EP_CLOSED ((pid_t) -1)
+
+/*
+ * returned by the blocking calls when the process at the other end of the queue has
+ * exited or destroyed its endpoint while they wait
+ */
+#define DF_QUEUE_PEER_GONE 2
+
 /*
  * the queue data structure laid out in memory
  */
@@ -48,7 +60,9 @@ typedef struct _df_queue {
     size_t max_payload_size;      // size limit of payload
     size_t slot_size;             // size limit of slot
     size_t total_size;            // total size of the queue (including this header)
-    char padding[CACHE_LINE_SIZE - sizeof(int32_t) - sizeof(uint32_t) - 2*sizeof(size_t)];
+    pid_t sender_pid;             // process of the sender endpoint; 0 before it has one
+    pid_t receiver_pid;           // process of the receiver endpoint; 0 before it has one
+    char padding[CACHE_LINE_SIZE - sizeof(int32_t) - sizeof(uint32_t) - 2*sizeof(size_t) - 2*sizeof(pid_t)];
      
     char slots[0];                // where slots are
 } df_queue, *df_queue_t;
@@ -61,6 +75,10 @@ typedef struct _df_queue_endpoint {
     df_queue *queue;              // point to starting address of queue in shared memory 
     df_queue_slot_t *slots;       // cached starting addresses of each every slots
     int is_sender;                // sender side (1) or receiver side (0)
+    uint64_t *ready_word;         // sender side: word of a queue set's ready bitmap, or NULL
+    uint64_t ready_mask;          // sender side: this queue's bit in *ready_word
+    pid_t peer_pid;               // peer process peer_pidfd refers to
+    int peer_pidfd;               // pidfd of peer_pid, or -1
 } df_queue_ep, *df_queue_ep_t;
 
 /*
@@ -92,20 +110,22 @@ df_queue_ep_t df_get_queue_sender_ep (df_queue_t queue);
 df_queue_ep_t df_get_queue_receiver_ep (df_queue_t queue);
  
 /*
- * Destroy an endpoint handle. Return 0 on success and non-zero on error.
+ * Destroy an endpoint handle, which tells the peer this side is gone. The queue must
+ * still be mapped. Return 0 on success and non-zero on error.
  */ 
 int df_destroy_ep (df_queue_ep_t ep);
  
 /*
  * Enqueue a vector of buffers into queue. It gets the next empy slot in queue, and copies
  * the buffers into that slot, and mark the slot as "full". This is a blocking call. Return
- * 0 on success and non-zero otherwise.
+ * 0 on success, DF_QUEUE_PEER_GONE if the receiver is gone while waiting for an empty slot,
+ * and other non-zero values on error.
  */ 
 int df_enqueue_vector (df_queue_ep_t ep, struct iovec *vec, int veccnt);
 
 /* 
- * Enqueue a single buffer into queue. This is a blocking call. Return 0 on success and 
- * non-zero otherwise.
+ * Enqueue a single buffer into queue. This is a blocking call. Return 0 on success,
+ * DF_QUEUE_PEER_GONE if the receiver is gone and other non-zero values on error.
  */
 int df_enqueue (df_queue_ep_t ep, void *data, size_t length); 
  
@@ -127,7 +147,8 @@ int df_try_enqueue (df_queue_ep_t ep, void *data, size_t length);
  * Dequeue datafrom the next full slot in queue. data contains a reference to the data payload.
  * *length contains the length of the payload. It is the receiver's responsibility to copy the data
  * to its own receive buffer if it wants to retain the data. This is a blocking call. Return 0 on 
- * success and non-zero on error.
+ * success, DF_QUEUE_PEER_GONE if the sender is gone while waiting for a full slot, and other
+ * non-zero values on error.
  */ 
 int df_dequeue (df_queue_ep_t ep, void **data, size_t *length);
 
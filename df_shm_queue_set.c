@@ -0,0 +1,262 @@
+/*
+ * DataFabrics shared memory transport for inter-process and inter-thread
+ * communication on mulitcore.
+ *
+ * This file implements a queue set: a ready bitmap in shared memory, set by
+ * senders after they publish a slot and taken by the receiver to find the queues
+ * worth looking at.
+ *
+ * The receiver moves ready bits from the set into its local pending bitmap with
+ * an atomic exchange of each non-zero word, and clears a pending bit only after
+ * finding the queue empty. A sender publishes its slot before reading the ready
+ * bit (see signal_queue_set() in df_shm_queue.c), and the receiver takes the
+ * bits before looking at the queues, with a full fence on each side. So a sender
+ * either sees its bit taken and sets it again, or the receiver sees the slot;
+ * no message is left behind with its bit clear.
+ */
+
+#include "df_config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include "df_shm_queue_set.h"
+
+#define BITS_PER_WORD 64
+
+size_t df_calculate_queue_set_size (uint32_t max_num_queues)
+{
+    assert(max_num_queues > 0);
+
+    size_t num_words = (max_num_queues + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    size_t total_size = sizeof(df_queue_set) + num_words * sizeof(uint64_t);
+    if(total_size % CACHE_LINE_SIZE) {
+        total_size += CACHE_LINE_SIZE - (total_size % CACHE_LINE_SIZE);
+    }
+    return total_size;
+}
+
+df_queue_set_t df_create_queue_set (void *addr, uint32_t max_num_queues)
+{
+    assert(max_num_queues > 0);
+    assert(addr != NULL);
+
+    df_queue_set_t set = (df_queue_set_t) addr;
+    set->initialized = 0;
+    set->max_num_queues = max_num_queues;
+    set->num_words = (max_num_queues + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    set->total_size = df_calculate_queue_set_size(max_num_queues);
+    memset(set->ready, 0, set->num_words * sizeof(uint64_t));
+
+    __atomic_store_n(&set->initialized, 1, __ATOMIC_RELEASE);
+    return set;
+}
+
+int df_destroy_queue_set (df_queue_set_t set)
+{
+    if(set) {
+        set->initialized = 0;
+        return 0;
+    }
+    else {
+        fprintf(stderr, "Error: queue set is NULL. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+}
+
+df_queue_set_receiver_t df_get_queue_set_receiver (df_queue_set_t set)
+{
+    assert(set != NULL);
+
+    if(!__atomic_load_n(&set->initialized, __ATOMIC_ACQUIRE)) {
+        fprintf(stderr, "Error: queue set is not initialized. %s:%d\n", __FILE__, __LINE__);
+        return NULL;
+    }
+    df_queue_set_receiver_t receiver = (df_queue_set_receiver_t) malloc(sizeof(df_queue_set_receiver));
+    if(!receiver) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return NULL;
+    }
+    receiver->eps = (df_queue_ep_t *) calloc(set->max_num_queues, sizeof(df_queue_ep_t));
+    receiver->pending = (uint64_t *) calloc(set->num_words, sizeof(uint64_t));
+    if(!receiver->eps || !receiver->pending) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        free(receiver->eps);
+        free(receiver->pending);
+        free(receiver);
+        return NULL;
+    }
+    receiver->set = set;
+    receiver->cursor = 0;
+    return receiver;
+}
+
+int df_destroy_queue_set_receiver (df_queue_set_receiver_t receiver)
+{
+    assert(receiver != NULL);
+
+    free(receiver->eps);
+    free(receiver->pending);
+    free(receiver);
+    return 0;
+}
+
+int df_queue_set_add (df_queue_set_receiver_t receiver, df_queue_ep_t ep)
+{
+    assert(receiver != NULL);
+    assert(ep != NULL);
+
+    if(ep->is_sender) {
+        fprintf(stderr, "Error: only receiver-side endpoints can be added to a queue set. %s:%d\n",
+            __FILE__, __LINE__);
+        return -1;
+    }
+    int index;
+    for(index = 0; index < receiver->set->max_num_queues; index ++) {
+        if(!receiver->eps[index]) {
+            receiver->eps[index] = ep;
+            // look at the queue once in case it has messages from before its sender was bound
+            receiver->pending[index / BITS_PER_WORD] |= 1UL << (index % BITS_PER_WORD);
+            return index;
+        }
+    }
+    fprintf(stderr, "Error: queue set is full (%u queues). %s:%d\n", receiver->set->max_num_queues,
+        __FILE__, __LINE__);
+    return -1;
+}
+
+int df_queue_set_remove (df_queue_set_receiver_t receiver, int index)
+{
+    assert(receiver != NULL);
+
+    if(index < 0 || index >= receiver->set->max_num_queues || !receiver->eps[index]) {
+        fprintf(stderr, "Error: no queue at index %d of the queue set. %s:%d\n", index,
+            __FILE__, __LINE__);
+        return -1;
+    }
+    receiver->eps[index] = NULL;
+    receiver->pending[index / BITS_PER_WORD] &= ~(1UL << (index % BITS_PER_WORD));
+    return 0;
+}
+
+int df_queue_set_bind_sender (df_queue_set_t set, int index, df_queue_ep_t ep)
+{
+    assert(set != NULL);
+    assert(ep != NULL);
+
+    if(!ep->is_sender) {
+        fprintf(stderr, "Error: only sender-side endpoints can be bound to a queue set. %s:%d\n",
+            __FILE__, __LINE__);
+        return -1;
+    }
+    if(!__atomic_load_n(&set->initialized, __ATOMIC_ACQUIRE)) {
+        fprintf(stderr, "Error: queue set is not initialized. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    if(index < 0 || index >= set->max_num_queues) {
+        fprintf(stderr, "Error: index %d is out of the queue set's range (%u). %s:%d\n", index,
+            set->max_num_queues, __FILE__, __LINE__);
+        return -1;
+    }
+    ep->ready_word = &set->ready[index / BITS_PER_WORD];
+    ep->ready_mask = 1UL << (index % BITS_PER_WORD);
+
+    // have the receiver look at the queue for messages enqueued before binding
+    __atomic_fetch_or(ep->ready_word, ep->ready_mask, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+int df_queue_set_unbind_sender (df_queue_ep_t ep)
+{
+    assert(ep != NULL);
+
+    ep->ready_word = NULL;
+    ep->ready_mask = 0;
+    return 0;
+}
+
+/*
+ * Move the ready bits of the set into the receiver's pending bitmap. Idle words
+ * are only read, so they stay shared in the senders' caches.
+ */
+static void take_ready_bits (df_queue_set_receiver_t receiver)
+{
+    df_queue_set_t set = receiver->set;
+    uint32_t w;
+    for(w = 0; w < set->num_words; w ++) {
+        if(__atomic_load_n(&set->ready[w], __ATOMIC_RELAXED)) {
+            receiver->pending[w] |= __atomic_exchange_n(&set->ready[w], 0, __ATOMIC_SEQ_CST);
+        }
+    }
+    // pairs with the fence in signal_queue_set(); the queues are read after this
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/*
+ * Return the first index no less than start whose pending bit is set, or -1 if none.
+ */
+static int next_pending (df_queue_set_receiver_t receiver, uint32_t start)
+{
+    uint32_t num_words = receiver->set->num_words;
+    uint32_t w = start / BITS_PER_WORD;
+    if(w >= num_words) {
+        return -1;
+    }
+    uint64_t word = receiver->pending[w] & (~0UL << (start % BITS_PER_WORD));
+    while(!word) {
+        if(++ w == num_words) {
+            return -1;
+        }
+        word = receiver->pending[w];
+    }
+    return w * BITS_PER_WORD + __builtin_ctzl(word);
+}
+
+int df_queue_set_try_dequeue (df_queue_set_receiver_t receiver, df_queue_ep_t *ep, void **data,
+                              size_t *length)
+{
+    assert(receiver != NULL);
+    assert(ep != NULL);
+
+    // go on from the queue after the last one served; new ready bits are taken in
+    // when the search wraps around, so every ready queue gets a turn each round
+    int taken = 0;
+    int index = next_pending(receiver, receiver->cursor);
+    while(1) {
+        if(index < 0) {
+            if(taken) {
+                receiver->cursor = 0;
+                return -1;
+            }
+            take_ready_bits(receiver);
+            taken = 1;
+            index = next_pending(receiver, 0);
+            continue;
+        }
+        df_queue_ep_t queue_ep = receiver->eps[index];
+        if(queue_ep) {
+            int rc = df_try_dequeue(queue_ep, data, length);
+            if(rc == 0) {
+                *ep = queue_ep;
+                receiver->cursor = index + 1;
+                return 0;
+            }
+            else if(rc > 0) {
+                return 1;
+            }
+        }
+        // the queue is empty; it becomes pending again when its sender sets its bit
+        receiver->pending[index / BITS_PER_WORD] &= ~(1UL << (index % BITS_PER_WORD));
+        index = next_pending(receiver, index + 1);
+    }
+}
+
+int df_queue_set_dequeue (df_queue_set_receiver_t receiver, df_queue_ep_t *ep, void **data,
+                          size_t *length)
+{
+    int rc;
+    while((rc = df_queue_set_try_dequeue(receiver, ep, data, length)) < 0) { }
+    return rc;
+}
@@ -0,0 +1,131 @@
+#ifndef _DF_SHM_QUEUE_SET_H_
+#define _DF_SHM_QUEUE_SET_H_
+/*
+ * DataFabrics shared memory transport for inter-process and inter-thread
+ * communication on mulitcore.
+ *
+ * This header file defines a queue set, which lets one receiver wait on many
+ * queues without polling each of them. The set keeps a ready bitmap in shared
+ * memory with one bit per queue; a sender bound to the set sets its queue's bit
+ * after publishing a slot. The receiver finds ready queues by scanning the bitmap
+ * a word at a time and takes messages from them round-robin, so the cost of a
+ * receive grows with the number of active queues rather than with the number of
+ * queues in the set.
+ *
+ * A set has a single receiver. Senders may be in other processes; they need the
+ * set's address in their own mapping and their queue's index in the set.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "df_config.h"
+#include <stdint.h>
+#include <unistd.h>
+#include <stddef.h>
+#include "df_shm_queue.h"
+
+/*
+ * the queue set data structure laid out in memory
+ */
+typedef struct _df_queue_set {
+    int32_t initialized;
+    uint32_t max_num_queues;      // number of bits in the ready bitmap
+    uint32_t num_words;           // number of words in the ready bitmap
+    size_t total_size;            // total size of the set (including this header)
+    char padding[CACHE_LINE_SIZE - sizeof(int32_t) - 2*sizeof(uint32_t) - sizeof(size_t)];
+
+    uint64_t ready[0];            // bit i is set when queue i may have a full slot
+} df_queue_set, *df_queue_set_t;
+
+/*
+ * bookkeeping data structure in the receiver's local memory
+ */
+typedef struct _df_queue_set_receiver {
+    df_queue_set *set;            // point to starting address of set in shared memory
+    df_queue_ep_t *eps;           // receiver-side endpoint of each queue, NULL if not in the set
+    uint64_t *pending;            // ready bits taken from the set but not yet found empty
+    uint32_t cursor;              // index at which the next search for a ready queue starts
+} df_queue_set_receiver, *df_queue_set_receiver_t;
+
+/*
+ * Calculate how many bytes a queue set of max_num_queues queues would occupy.
+ */
+size_t df_calculate_queue_set_size (uint32_t max_num_queues);
+
+/*
+ * Create a queue set for up to max_num_queues queues at specified memory location,
+ * which is usually in a shm region shared with the senders. Return a handle of
+ * df_queue_set (which is at addr) on success; otherwise return NULL.
+ */
+df_queue_set_t df_create_queue_set (void *addr, uint32_t max_num_queues);
+
+/*
+ * Destroy a queue set. Return 0 on success and non-zero on error.
+ */
+int df_destroy_queue_set (df_queue_set_t set);
+
+/*
+ * Get the receiver handle of a queue set. Return NULL on error.
+ */
+df_queue_set_receiver_t df_get_queue_set_receiver (df_queue_set_t set);
+
+/*
+ * Destroy a receiver handle. The endpoints in it are not destroyed. Return 0 on
+ * success and non-zero on error.
+ */
+int df_destroy_queue_set_receiver (df_queue_set_receiver_t receiver);
+
+/*
+ * Add the queue of receiver-side endpoint ep to the set. Return the queue's index in
+ * the set, which its sender passes to df_queue_set_bind_sender(), or -1 on error
+ * (e.g. the set is full).
+ */
+int df_queue_set_add (df_queue_set_receiver_t receiver, df_queue_ep_t ep);
+
+/*
+ * Remove the queue at index from the set. Its sender should be unbound first, since a
+ * new queue added to the set may get the same index. Return 0 on success and non-zero
+ * on error.
+ */
+int df_queue_set_remove (df_queue_set_receiver_t receiver, int index);
+
+/*
+ * Bind sender-side endpoint ep to the queue at index in set, which is the set's
+ * address in the sender's mapping. Every later enqueue through ep marks the queue
+ * ready. Messages enqueued before binding are found too. Return 0 on success and
+ * non-zero on error.
+ */
+int df_queue_set_bind_sender (df_queue_set_t set, int index, df_queue_ep_t ep);
+
+/*
+ * Stop marking the queue ready on enqueues through ep. Return 0 on success and
+ * non-zero on error.
+ */
+int df_queue_set_unbind_sender (df_queue_ep_t ep);
+
+/*
+ * Dequeue data from the next ready queue in the set, going round-robin over the
+ * ready queues. *ep is set to the endpoint of the queue, *data points to the data
+ * payload and *length contains the length of the payload. The receiver calls
+ * df_release(*ep) when it is done with the data, before the next dequeue from
+ * the set. This is a blocking call. Return 0 on success and non-zero on error.
+ */
+int df_queue_set_dequeue (df_queue_set_receiver_t receiver, df_queue_ep_t *ep, void **data,
+                          size_t *length);
+
+/*
+ * Test-and-dequeue from the set. If a queue in the set has a full slot then dequeue
+ * from it as df_queue_set_dequeue() does, and return 0 on success or 1 on error. If
+ * no queue has a full slot, return -1 immediately.
+ * return value: 0: dequeue successful; -1: no full slot; 1: tried dequeue but failed.
+ */
+int df_queue_set_try_dequeue (df_queue_set_receiver_t receiver, df_queue_ep_t *ep, void **data,
+                              size_t *length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,261 @@
+/*
+ * DataFabrics shared memory transport for inter-process and inter-thread
+ * communication on mulitcore.
+ *
+ * This file implements recycling of shm regions: each size class has a stack of
+ * idle regions which are still mapped and registered with the underlying method,
+ * so a create of a pooled size costs no system calls. A background thread creates
+ * regions ahead of time up to a per-class target.
+ */
+
+#include "df_config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "df_shm.h"
+#include "df_shm_region_pool.h"
+
+/*
+ * idle regions of a size class
+ */
+typedef struct _pool_class {
+    df_shm_region_t *regions;  // stack of idle regions
+    int count;
+    int capacity;
+    int target;                // number of regions the prefill thread keeps ready
+} pool_class;
+
+struct _df_shm_region_pool {
+    df_shm_method_t method;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;       // signals the prefill thread
+    pool_class classes[DF_SHM_POOL_NUM_CLASSES];
+    size_t pooled_bytes;       // bytes of idle regions (and of the one being prefilled)
+    size_t max_bytes;
+    int thread_started;
+    int stop;
+    pthread_t thread;
+};
+
+static int class_index (size_t size)
+{
+    int c = 0;
+    while(((size_t) PAGE_SIZE << c) < size) {
+        c ++;
+        if(c == DF_SHM_POOL_NUM_CLASSES) {
+            return -1;
+        }
+    }
+    return c;
+}
+
+size_t df_shm_region_pool_class_size (size_t size)
+{
+    int c = class_index(size);
+    return c < 0? 0 : (size_t) PAGE_SIZE << c;
+}
+
+df_shm_region_pool_t df_shm_region_pool_create (df_shm_method_t method, size_t max_bytes)
+{
+    df_shm_region_pool_t pool = (df_shm_region_pool_t) calloc(1, sizeof(struct _df_shm_region_pool));
+    if(!pool) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return NULL;
+    }
+    pool->method = method;
+    pool->max_bytes = max_bytes;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    return pool;
+}
+
+/*
+ * Push r onto the stack of class c. Called with the pool lock held. Return 0 on
+ * success and -1 on error.
+ */
+static int class_push (pool_class *pc, df_shm_region_t r)
+{
+    if(pc->count == pc->capacity) {
+        int new_capacity = pc->capacity? 2 * pc->capacity : 8;
+        df_shm_region_t *regions = (df_shm_region_t *) realloc(pc->regions,
+            new_capacity * sizeof(df_shm_region_t));
+        if(!regions) {
+            fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+            return -1;
+        }
+        pc->regions = regions;
+        pc->capacity = new_capacity;
+    }
+    pc->regions[pc->count ++] = r;
+    return 0;
+}
+
+df_shm_region_t df_shm_region_pool_get (df_shm_region_pool_t pool, size_t size)
+{
+    int c = class_index(size);
+    if(c < 0) {
+        return NULL;
+    }
+    df_shm_region_t r = NULL;
+    pool_class *pc = &pool->classes[c];
+    pthread_mutex_lock(&pool->lock);
+    if(pc->count > 0) {
+        r = pc->regions[-- pc->count];
+        pool->pooled_bytes -= r->pool_size;
+        if(pc->count < pc->target) {
+            pthread_cond_signal(&pool->cond);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return r;
+}
+
+int df_shm_region_pool_put (df_shm_region_pool_t pool, df_shm_region_t r)
+{
+    int c = class_index(r->pool_size);
+    if(c < 0) {
+        return -1;
+    }
+    int rc = -1;
+    pthread_mutex_lock(&pool->lock);
+    if(!pool->stop && pool->pooled_bytes + r->pool_size <= pool->max_bytes &&
+       class_push(&pool->classes[c], r) == 0) {
+        pool->pooled_bytes += r->pool_size;
+        rc = 0;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return rc;
+}
+
+/*
+ * Create a region of size bytes through the underlying method for the pool.
+ */
+static df_shm_region_t pool_new_region (df_shm_method_t method, size_t size)
+{
+    df_shm_region_t r = (df_shm_region_t) calloc(1, sizeof(df_shm_region));
+    if(!r) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return NULL;
+    }
+    int rc = (*method->create_region_func) (method->method_data, size, NULL,
+        (void **)&(r->method_data), (void **)&(r->starting_addr));
+    if(rc) {
+        fprintf(stderr, "Error: method's create_region callback returns error: %d. %s:%d\n",
+            rc, __FILE__, __LINE__);
+        free(r);
+        return NULL;
+    }
+    r->size = size;
+    r->creator_id = getpid();
+    r->shm_method = method;
+    r->pool_size = size;
+    return r;
+}
+
+/*
+ * Find a class whose idle regions are below target and for which there is room in
+ * the pool. Called with the pool lock held. Return -1 if there is none.
+ */
+static int find_class_to_fill (df_shm_region_pool_t pool)
+{
+    int c;
+    for(c = 0; c < DF_SHM_POOL_NUM_CLASSES; c ++) {
+        pool_class *pc = &pool->classes[c];
+        if(pc->count < pc->target &&
+           pool->pooled_bytes + ((size_t) PAGE_SIZE << c) <= pool->max_bytes) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+static void *prefill_thread (void *arg)
+{
+    df_shm_region_pool_t pool = (df_shm_region_pool_t) arg;
+    pthread_mutex_lock(&pool->lock);
+    while(!pool->stop) {
+        int c = find_class_to_fill(pool);
+        if(c < 0) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+            continue;
+        }
+        // reserve the room before dropping the lock to create the region
+        size_t size = (size_t) PAGE_SIZE << c;
+        pool->pooled_bytes += size;
+        pthread_mutex_unlock(&pool->lock);
+        df_shm_region_t r = pool_new_region(pool->method, size);
+        pthread_mutex_lock(&pool->lock);
+        if(!r || class_push(&pool->classes[c], r) != 0) {
+            // stop filling this class rather than retrying in a loop
+            pool->pooled_bytes -= size;
+            pool->classes[c].target = pool->classes[c].count;
+            if(r) {
+                (*pool->method->destroy_region_func) (pool->method->method_data, r);
+                free(r);
+            }
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int df_shm_region_pool_prefill (df_shm_region_pool_t pool, size_t size, int count)
+{
+    int c = class_index(size);
+    if(c < 0 || count < 0) {
+        fprintf(stderr, "Error: regions of %lu bytes are not pooled. %s:%d\n",
+            size, __FILE__, __LINE__);
+        return -1;
+    }
+    if(!pool->method->create_region_func) {
+        fprintf(stderr, "Warning: method's create_region callback is not registered. %s:%d\n",
+            __FILE__, __LINE__);
+        return -1;
+    }
+    int rc = 0;
+    pthread_mutex_lock(&pool->lock);
+    if(!pool->thread_started) {
+        rc = pthread_create(&pool->thread, NULL, prefill_thread, pool);
+        if(rc) {
+            fprintf(stderr, "Error: pthread_create() returns %d. %s:%d\n", rc, __FILE__, __LINE__);
+        }
+        else {
+            pool->thread_started = 1;
+        }
+    }
+    if(rc == 0) {
+        pool->classes[c].target = count;
+        pthread_cond_signal(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return rc? -1 : 0;
+}
+
+void df_shm_region_pool_destroy (df_shm_region_pool_t pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    if(pool->thread_started) {
+        pthread_join(pool->thread, NULL);
+    }
+
+    df_shm_method_t method = pool->method;
+    int c, i;
+    for(c = 0; c < DF_SHM_POOL_NUM_CLASSES; c ++) {
+        pool_class *pc = &pool->classes[c];
+        for(i = 0; i < pc->count; i ++) {
+            if(method->destroy_region_func) {
+                (*method->destroy_region_func) (method->method_data, pc->regions[i]);
+            }
+            free(pc->regions[i]);
+        }
+        free(pc->regions);
+    }
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
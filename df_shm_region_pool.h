@@ -0,0 +1,49 @@
+#ifndef _DF_SHM_REGION_POOL_H_
+#define _DF_SHM_REGION_POOL_H_
+
+#include "df_shm.h"
+
+/*
+ * Pool of destroyed regions of a shm method handle which are kept mapped and
+ * handed back by later creates of the same size class. A size class is a power
+ * of 2 number of pages. Not part of the public interface.
+ */
+
+#define DF_SHM_POOL_NUM_CLASSES 32
+
+/*
+ * Create a pool for method which keeps at most max_bytes of idle regions. Return
+ * NULL on error.
+ */
+df_shm_region_pool_t df_shm_region_pool_create (df_shm_method_t method, size_t max_bytes);
+
+/*
+ * Stop the prefill thread and destroy all regions in the pool and the pool itself.
+ */
+void df_shm_region_pool_destroy (df_shm_region_pool_t pool);
+
+/*
+ * Return the size class (in bytes) a region of 'size' bytes is created with, or 0
+ * if regions of this size are not pooled.
+ */
+size_t df_shm_region_pool_class_size (size_t size);
+
+/*
+ * Take a region of the size class of 'size' out of the pool. Return NULL if there
+ * is none.
+ */
+df_shm_region_t df_shm_region_pool_get (df_shm_region_pool_t pool, size_t size);
+
+/*
+ * Put region r (created with its size class as size) into the pool. Return 0 on
+ * success and non-zero if the pool is full; the caller then destroys r.
+ */
+int df_shm_region_pool_put (df_shm_region_pool_t pool, df_shm_region_t r);
+
+/*
+ * Let the prefill thread keep count regions of the size class of 'size' ready.
+ * The thread is started on first use. Return 0 on success and -1 on error.
+ */
+int df_shm_region_pool_prefill (df_shm_region_pool_t pool, size_t size, int count);
+
+#endif
@@ -0,0 +1,238 @@
+/*
+ * DataFabrics shared memory transport for inter-process and inter-thread
+ * communication on mulitcore.
+ *
+ * This file implements the region bookkeeping of a shm method handle: region
+ * sets are open addressing hash tables (linear probing) keyed by region handle,
+ * and the address index is a balanced tree (tsearch()) of regions ordered by
+ * address range.
+ */
+
+#include "df_config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <search.h>
+#include "df_shm.h"
+#include "df_shm_registry.h"
+
+#define INITIAL_SET_CAPACITY 16
+
+static inline size_t hash_region (df_shm_region_t r, size_t capacity)
+{
+    // Fibonacci hashing of the handle address; capacity is a power of 2
+    uint64_t h = ((uint64_t)(uintptr_t) r >> 4) * 0x9E3779B97F4A7C15ULL;
+    return (size_t) (h >> 32) & (capacity - 1);
+}
+
+size_t df_shm_region_shard_index (df_shm_region_t r)
+{
+    uint64_t h = ((uint64_t)(uintptr_t) r >> 4) * 0x9E3779B97F4A7C15ULL;
+    return (size_t) (h >> 59) % DF_SHM_REGION_SHARDS;
+}
+
+int df_shm_region_set_init (df_shm_region_set *set)
+{
+    set->slots = (df_shm_region_t *) calloc(INITIAL_SET_CAPACITY, sizeof(df_shm_region_t));
+    if(!set->slots) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    set->capacity = INITIAL_SET_CAPACITY;
+    set->count = 0;
+    return 0;
+}
+
+void df_shm_region_set_free (df_shm_region_set *set)
+{
+    free(set->slots);
+    set->slots = NULL;
+    set->capacity = 0;
+    set->count = 0;
+}
+
+static void region_set_insert (df_shm_region_t *slots, size_t capacity, df_shm_region_t r)
+{
+    size_t i = hash_region(r, capacity);
+    while(slots[i]) {
+        i = (i + 1) & (capacity - 1);
+    }
+    slots[i] = r;
+}
+
+/*
+ * Double the capacity of the set. Return 0 on success and -1 on error.
+ */
+static int region_set_grow (df_shm_region_set *set)
+{
+    size_t new_capacity = 2 * set->capacity;
+    df_shm_region_t *new_slots = (df_shm_region_t *) calloc(new_capacity, sizeof(df_shm_region_t));
+    if(!new_slots) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    size_t i;
+    for(i = 0; i < set->capacity; i ++) {
+        if(set->slots[i]) {
+            region_set_insert(new_slots, new_capacity, set->slots[i]);
+        }
+    }
+    free(set->slots);
+    set->slots = new_slots;
+    set->capacity = new_capacity;
+    return 0;
+}
+
+int df_shm_region_set_add (df_shm_region_set *set, df_shm_region_t r)
+{
+    // keep the load factor at most 1/2
+    if(2 * (set->count + 1) > set->capacity && region_set_grow(set) != 0) {
+        return -1;
+    }
+    region_set_insert(set->slots, set->capacity, r);
+    set->count ++;
+    return 0;
+}
+
+int df_shm_region_set_remove (df_shm_region_set *set, df_shm_region_t r)
+{
+    size_t mask = set->capacity - 1;
+    size_t i = hash_region(r, set->capacity);
+    while(set->slots[i] != r) {
+        if(!set->slots[i]) {
+            fprintf(stderr, "Warning: the region is not found in set. %s:%d\n", __FILE__, __LINE__);
+            return 1;
+        }
+        i = (i + 1) & mask;
+    }
+
+    // backward-shift deletion: move later entries of the probe run into the hole
+    size_t hole = i;
+    size_t j = (i + 1) & mask;
+    while(set->slots[j]) {
+        size_t home = hash_region(set->slots[j], set->capacity);
+        // move slots[j] if its home is not cyclically within (hole, j]
+        if(((j - home) & mask) >= ((j - hole) & mask)) {
+            set->slots[hole] = set->slots[j];
+            hole = j;
+        }
+        j = (j + 1) & mask;
+    }
+    set->slots[hole] = NULL;
+    set->count --;
+    return 0;
+}
+
+int df_shm_region_set_contains (df_shm_region_set *set, df_shm_region_t r)
+{
+    size_t mask = set->capacity - 1;
+    size_t i = hash_region(r, set->capacity);
+    while(set->slots[i]) {
+        if(set->slots[i] == r) {
+            return 1;
+        }
+        i = (i + 1) & mask;
+    }
+    return 0;
+}
+
+df_shm_region_t *df_shm_region_set_list (df_shm_region_set *set, size_t *count)
+{
+    *count = 0;
+    if(set->count == 0) {
+        return NULL;
+    }
+    df_shm_region_t *list = (df_shm_region_t *) malloc(set->count * sizeof(df_shm_region_t));
+    if(!list) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return NULL;
+    }
+    size_t i;
+    for(i = 0; i < set->capacity; i ++) {
+        if(set->slots[i]) {
+            list[(*count) ++] = set->slots[i];
+        }
+    }
+    return list;
+}
+
+/*
+ * Order regions by address range; overlapping ranges compare equal.
+ */
+static int compare_range (const void *a, const void *b)
+{
+    const df_shm_region *ra = (const df_shm_region *) a;
+    const df_shm_region *rb = (const df_shm_region *) b;
+    const char *start_a = (const char *) ra->starting_addr;
+    const char *start_b = (const char *) rb->starting_addr;
+    size_t size_a = ra->size? ra->size : 1;
+    size_t size_b = rb->size? rb->size : 1;
+    if(start_a + size_a <= start_b) {
+        return -1;
+    }
+    if(start_b + size_b <= start_a) {
+        return 1;
+    }
+    return 0;
+}
+
+int df_shm_addr_index_add (void **root, df_shm_region_t r)
+{
+    r->same_addr_next = NULL;
+    void *node = tsearch(r, root, compare_range);
+    if(!node) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    df_shm_region_t head = *(df_shm_region_t *) node;
+    if(head != r) {
+        if(head->starting_addr != r->starting_addr) {
+            fprintf(stderr, "Warning: region at %p overlaps region at %p; it is not indexed. %s:%d\n",
+                r->starting_addr, head->starting_addr, __FILE__, __LINE__);
+            return 0;
+        }
+        // another handle of the same mapping
+        r->same_addr_next = head->same_addr_next;
+        head->same_addr_next = r;
+    }
+    return 0;
+}
+
+void df_shm_addr_index_remove (void **root, df_shm_region_t r)
+{
+    void *node = tfind(r, root, compare_range);
+    if(!node) {
+        return;
+    }
+    df_shm_region_t head = *(df_shm_region_t *) node;
+    if(head == r) {
+        // the other handles may have other sizes, so the tree is searched again
+        // for each of them rather than handing the node over
+        tdelete(r, root, compare_range);
+        df_shm_region_t q = r->same_addr_next;
+        r->same_addr_next = NULL;
+        while(q) {
+            df_shm_region_t next = q->same_addr_next;
+            df_shm_addr_index_add(root, q);
+            q = next;
+        }
+        return;
+    }
+    df_shm_region_t p = head;
+    while(p->same_addr_next && p->same_addr_next != r) {
+        p = p->same_addr_next;
+    }
+    if(p->same_addr_next == r) {
+        p->same_addr_next = r->same_addr_next;
+    }
+}
+
+df_shm_region_t df_shm_addr_index_find (void *root, const void *addr)
+{
+    df_shm_region key;
+    key.starting_addr = (void *) addr;
+    key.size = 1;
+    void *node = tfind(&key, &root, compare_range);
+    return node? *(df_shm_region_t *) node : NULL;
+}
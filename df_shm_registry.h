@@ -0,0 +1,66 @@
+#ifndef _DF_SHM_REGISTRY_H_
+#define _DF_SHM_REGISTRY_H_
+
+#include "df_shm.h"
+
+/*
+ * Bookkeeping of the regions of a shm method handle: hash sets of region handles
+ * for constant-time insertion and removal, and an index of regions ordered by
+ * address to map pointers back to regions. Not part of the public interface.
+ * None of these functions lock; callers serialize access to a set or index.
+ */
+
+/*
+ * Initialize an empty region set. Return 0 on success and -1 on error.
+ */
+int df_shm_region_set_init (df_shm_region_set *set);
+
+/*
+ * Free the memory of a region set (not the regions in it).
+ */
+void df_shm_region_set_free (df_shm_region_set *set);
+
+/*
+ * Add region r to the set. Return 0 on success and -1 on error.
+ */
+int df_shm_region_set_add (df_shm_region_set *set, df_shm_region_t r);
+
+/*
+ * Remove region r from the set. Return 0 on success and non-zero if r is not in the set.
+ */
+int df_shm_region_set_remove (df_shm_region_set *set, df_shm_region_t r);
+
+/*
+ * Return 1 if region r is in the set and 0 otherwise.
+ */
+int df_shm_region_set_contains (df_shm_region_set *set, df_shm_region_t r);
+
+/*
+ * Return a malloc()-ed array of the regions in the set and its length in *count.
+ * Return NULL if the set is empty or on error.
+ */
+df_shm_region_t *df_shm_region_set_list (df_shm_region_set *set, size_t *count);
+
+/*
+ * Return the shard (0 .. DF_SHM_REGION_SHARDS-1) region r belongs to.
+ */
+size_t df_shm_region_shard_index (df_shm_region_t r);
+
+/*
+ * Add region r to the address index rooted at *root. Regions mapped at the same
+ * address (e.g. an anonymous region attached by its creator) share an entry.
+ * Return 0 on success and -1 on error.
+ */
+int df_shm_addr_index_add (void **root, df_shm_region_t r);
+
+/*
+ * Remove region r from the address index rooted at *root.
+ */
+void df_shm_addr_index_remove (void **root, df_shm_region_t r);
+
+/*
+ * Find the region containing addr in the address index. Return NULL if none.
+ */
+df_shm_region_t df_shm_addr_index_find (void *root, const void *addr);
+
+#endif
@@ -18,9 +18,10 @@
 #include <string.h>
 #include <errno.h>
 #include "df_shm.h"
+#include "df_shm_mapping.h"
 
-#define DEFAULT_SYSV_SHM_FLAG 0600
-#define PATH_LENGTH 100
+#define PATH_LENGTH (DF_SHM_PATH_LENGTH + 64)
+#define MAX_KEY_ATTEMPTS 1024
 
 /*
  * global method level bookkeeping data
@@ -28,7 +29,9 @@
 typedef struct _shm_sysv_method_data {
     int default_flag;
     char path[PATH_LENGTH];
-    int token_id;
+    int token_id;      // advanced atomically so that threads get distinct keys
+    df_shm_config config;
+    size_t huge_page_size;
     pid_t my_pid;
 } shm_sysv_method_data, *shm_sysv_method_data_t;
  
@@ -38,25 +41,36 @@ typedef struct _shm_sysv_method_data {
 typedef struct _shm_sysv_region_data {
     key_t key;
     int id;
+    size_t page_size;
     void *attach_addr;
 } shm_sysv_region_data, *shm_sysv_region_data_t; 
  
 int df_shm_method_sysv_init (void *input_data, void **method_data)
 {
-    // TODO: get config parameters from input_data. ignore it now.
     shm_sysv_method_data_t m_data = (shm_sysv_method_data_t) 
         malloc(sizeof(shm_sysv_method_data));
     if(!m_data) {
         fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         return -1;    
     }
-    m_data->default_flag = DEFAULT_SYSV_SHM_FLAG;
+    df_shm_load_config(&m_data->config, input_data);
+    if(m_data->config.flags & DF_SHM_FLAG_FIXED_ADDR) {
+        fprintf(stderr, "Warning: fixed-address mapping is not supported by the SysV shm method. %s:%d\n",
+            __FILE__, __LINE__);
+        m_data->config.flags &= ~DF_SHM_FLAG_FIXED_ADDR;
+    }
+    m_data->huge_page_size = 0;
+    if(m_data->config.flags & DF_SHM_FLAG_HUGEPAGE) {
+        m_data->huge_page_size = df_shm_huge_page_size(&m_data->config);
+    }
+    m_data->default_flag = m_data->config.mode;
     m_data->my_pid = getpid();
     
     // create a per-process file with unique path used to generate unique shm keys
-    int token_id = 1;
-    sprintf(m_data->path, "/tmp/df_shm_sysv.%d", m_data->my_pid);
-    int fd = open(m_data->path, m_data->default_flag | O_CREAT | O_RDWR);
+    m_data->token_id = 0;
+    sprintf(m_data->path, "%s/%s_sysv.%d", m_data->config.backing_dir, m_data->config.name_prefix,
+        m_data->my_pid);
+    int fd = open(m_data->path, O_CREAT | O_RDWR, m_data->config.mode);
     if(fd != -1) { // file created
         close(fd);
         fprintf(stderr, "Debug: process (%d) created path %s. %s:%d\n", 
@@ -73,6 +87,51 @@ int df_shm_method_sysv_init (void *input_data, void **method_data)
     return 0;
 }
 
+/*
+ * Get a new shared memory segment of 'size' bytes for key. If huge pages are 
+ * configured, try a SHM_HUGETLB segment first and fall back to a regular one
+ * (e.g. if no huge pages are reserved or the process lacks permission).
+ * shm_flags is IPC_CREAT, optionally with IPC_EXCL; with IPC_EXCL, -1 is returned
+ * with errno EEXIST if the key is taken.
+ */
+static int sysv_create_segment (shm_sysv_method_data_t m_data, 
+                                shm_sysv_region_data_t region_data, 
+                                size_t size,
+                                int shm_flags)
+{
+#ifdef SHM_HUGETLB
+    if(m_data->huge_page_size > PAGE_SIZE) {
+        int huge_flag = SHM_HUGETLB;
+#ifdef SHM_HUGE_SHIFT
+        if(m_data->config.huge_page_size) {
+            // request a non-default huge page size: log2(page size) << SHM_HUGE_SHIFT
+            huge_flag |= (__builtin_ctzl(m_data->huge_page_size) << SHM_HUGE_SHIFT);
+        }
+#endif
+        region_data->id = shmget(region_data->key, df_shm_round_size(size, m_data->huge_page_size), 
+            shm_flags | huge_flag | m_data->default_flag);
+        if(region_data->id != -1) {
+            region_data->page_size = m_data->huge_page_size;
+            return 0;
+        }
+        if(errno == EEXIST) {
+            return -1;
+        }
+        fprintf(stderr, "Warning: shmget(SHM_HUGETLB) returns %d; using transparent huge pages. %s:%d\n", 
+            errno, __FILE__, __LINE__);
+    }
+#endif
+    region_data->id = shmget(region_data->key, size, shm_flags | m_data->default_flag);
+    if(region_data->id == -1) {
+        if(errno != EEXIST || !(shm_flags & IPC_EXCL)) {
+            fprintf(stderr, "Error: shmget() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+        }
+        return -1;
+    }
+    region_data->page_size = PAGE_SIZE;
+    return 0;
+}
+
 int df_shm_method_sysv_create_region (void *method_data, 
                                       size_t size, 
                                       void *starting_addr, 
@@ -89,19 +148,27 @@ int df_shm_method_sysv_create_region (void *method_data,
         return -1;    
     }
     
-    // generate a unique key
-    region_data->key = ftok(m_data->path, m_data->token_id);
-    if(region_data->key == (key_t) -1) {
-        fprintf(stderr, "Error: calling ftok() failed: %d %s:%d\n", errno, __FILE__, __LINE__);
-        free(region_data);
-        return -1;
+    // generate a unique key and get a shared memory segment; keys which are taken
+    // (by this or any other process) are skipped
+    int rc = -1, attempt;
+    for(attempt = 0; attempt < MAX_KEY_ATTEMPTS; attempt ++) {
+        int token = __atomic_fetch_add(&m_data->token_id, 1, __ATOMIC_RELAXED);
+        key_t key = ftok(m_data->path, token % 255 + 1);
+        if(key == (key_t) -1) {
+            fprintf(stderr, "Error: calling ftok() failed: %d %s:%d\n", errno, __FILE__, __LINE__);
+            break;
+        }
+        // ftok() only takes 8 bits of the token; fold in the rest
+        region_data->key = key ^ (key_t) (token / 255);
+        rc = sysv_create_segment(m_data, region_data, size, IPC_CREAT | IPC_EXCL);
+        if(rc == 0 || errno != EEXIST) {
+            break;
+        }
     }
-    m_data->token_id ++;    
-    
-    // get a shared memory segment
-    region_data->id = shmget(region_data->key, size, IPC_CREAT | O_EXCL | m_data->default_flag);
-    if(region_data->id == -1) {
-        fprintf(stderr, "Error: shmget() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+    if(rc != 0) {
+        if(attempt == MAX_KEY_ATTEMPTS) {
+            fprintf(stderr, "Error: cannot find a free key. %s:%d\n", __FILE__, __LINE__);
+        }
         free(region_data);
         return -1;
     }    
@@ -123,6 +190,8 @@ int df_shm_method_sysv_create_region (void *method_data,
             attach_addr, starting_addr, __FILE__, __LINE__);
     }
     region_data->attach_addr = attach_addr;
+    df_shm_advise_mapping(&m_data->config, attach_addr, 
+        df_shm_round_size(size, region_data->page_size), region_data->page_size);
     *attach_address = attach_addr;
     *return_data = region_data;
     return 0;
@@ -154,9 +223,7 @@ int df_shm_method_sysv_create_named_region (void *method_data,
     region_data->key = *((key_t *)name);
 
     // get a shared memory segment
-    region_data->id = shmget(region_data->key, size, IPC_CREAT | O_EXCL | m_data->default_flag);
-    if(region_data->id == -1) {
-        fprintf(stderr, "Error: shmget() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+    if(sysv_create_segment(m_data, region_data, size, IPC_CREAT) != 0) {
         free(region_data);
         return -1;
     }
@@ -178,27 +245,32 @@ int df_shm_method_sysv_create_named_region (void *method_data,
             attach_addr, starting_addr, __FILE__, __LINE__);
     }
     region_data->attach_addr = attach_addr;
+    df_shm_advise_mapping(&m_data->config, attach_addr, 
+        df_shm_round_size(size, region_data->page_size), region_data->page_size);
     *attach_address = attach_addr;
     *return_data = region_data;
     return 0;
 }
 
 /*
- * the contact info of a mmap shm region has the following fields:
+ * the contact info of a sysv shm region has the following fields:
  * - key (sizeof(key_t) bytes)
+ * - page size (sizeof(size_t) bytes)
  */
 void * df_shm_method_sysv_region_contact (void *method_data, df_shm_region_t region, int *length)
 {
     shm_sysv_region_data_t region_data = (shm_sysv_region_data_t) region->method_data;
 
-    int *contact_string;
-    contact_string = (int *) malloc(sizeof(int));
+    char *contact_string;
+    int len = sizeof(key_t) + sizeof(size_t);
+    contact_string = (char *) malloc(len);
     if(!contact_string) {
         fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         return NULL;
     }
-    *contact_string = region_data->key;
-    *length = sizeof(key_t);
+    memcpy(contact_string, &region_data->key, sizeof(key_t));
+    memcpy(contact_string + sizeof(key_t), &region_data->page_size, sizeof(size_t));
+    *length = len;
     return contact_string;
 }
 
@@ -223,16 +295,18 @@ int df_shm_method_sysv_destroy_region (void *method_data, df_shm_region_t region
     return 0;
 }
 
-int df_shm_method_sysv_attach_region (void *method_data, 
-                                      void *contact_info, 
-                                      size_t size, 
-                                      void *starting_addr, 
-                                      void **return_data, 
-                                      void **attach_address
-                                     )
+/*
+ * Attach the shm segment of 'key' created by another process.
+ */
+static int sysv_attach_segment (shm_sysv_method_data_t m_data,
+                                key_t key,
+                                size_t page_size,
+                                size_t size,
+                                void *starting_addr,
+                                void **return_data,
+                                void **attach_address
+                               )
 {
-    shm_sysv_method_data_t m_data = (shm_sysv_method_data_t) method_data;
-
     // create per-region data
     shm_sysv_region_data_t region_data = (shm_sysv_region_data_t) 
         malloc(sizeof(shm_sysv_region_data));
@@ -240,9 +314,8 @@ int df_shm_method_sysv_attach_region (void *method_data,
         fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         return -1;    
     }
-    
-    // TODO: get shm segment info from contact info
-    region_data->key = *(key_t *) contact_info;
+    region_data->key = key;
+    region_data->page_size = page_size;
     
     if(starting_addr != NULL && (uint64_t)starting_addr % SHMLBA) { 
         fprintf(stderr, "Warning: the starting address (%p) is not page-aligned. %s:%d\n", 
@@ -257,7 +330,7 @@ int df_shm_method_sysv_attach_region (void *method_data,
     }
 
     // attach the created shm segment
-     void *attach_addr = shmat(region_data->id, starting_addr, 0 | SHM_RND);
+    void *attach_addr = shmat(region_data->id, starting_addr, 0 | SHM_RND);
     if(attach_addr == (void *) -1) {
         fprintf(stderr, "Error: shmat() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
         free(region_data);
@@ -268,11 +341,52 @@ int df_shm_method_sysv_attach_region (void *method_data,
             attach_addr, starting_addr, __FILE__, __LINE__);
     }
     region_data->attach_addr = attach_addr;
+    df_shm_advise_mapping(&m_data->config, attach_addr, 
+        df_shm_round_size(size, region_data->page_size), region_data->page_size);
     *return_data = region_data;
     *attach_address = attach_addr;
     return 0;
 }
 
+int df_shm_method_sysv_attach_region (void *method_data, 
+                                      void *contact_info, 
+                                      size_t size, 
+                                      void *starting_addr, 
+                                      void **return_data, 
+                                      void **attach_address
+                                     )
+{
+    shm_sysv_method_data_t m_data = (shm_sysv_method_data_t) method_data;
+
+    // get shm segment info from contact info
+    key_t key;
+    size_t page_size;
+    memcpy(&key, contact_info, sizeof(key_t));
+    memcpy(&page_size, (char *)contact_info + sizeof(key_t), sizeof(size_t));
+
+    return sysv_attach_segment(m_data, key, page_size, size, starting_addr, 
+        return_data, attach_address);
+}
+
+/*
+ * Attach a shm region based on the 'name' parameter, which specifies the key
+ * of shm region.
+ */
+int df_shm_method_sysv_attach_named_region (void *method_data, 
+                                            void *name, 
+                                            int name_size,
+                                            size_t size, 
+                                            void *starting_addr, 
+                                            void **return_data, 
+                                            void **attach_address
+                                           )
+{
+    shm_sysv_method_data_t m_data = (shm_sysv_method_data_t) method_data;
+
+    return sysv_attach_segment(m_data, *((key_t *)name), PAGE_SIZE, size, starting_addr, 
+        return_data, attach_address);
+}
+
 int df_shm_method_sysv_detach_region (void *method_data, df_shm_region_t region)
 {
     shm_sysv_method_data_t m_data = (shm_sysv_method_data_t) method_data;    
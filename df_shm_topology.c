@@ -0,0 +1,283 @@
+/*
+ * DataFabrics shared memory transport for inter-process and inter-thread
+ * communication on mulitcore.
+ *
+ * This file implements cpu topology discovery from sysfs and pinning. Cores and
+ * caches are identified by the smallest cpu number sharing them, which is unique
+ * across the system, unlike core_id which restarts in every package.
+ */
+
+#define _GNU_SOURCE // sched_setaffinity(), sched_getcpu()
+#include "df_config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "df_shm_topology.h"
+
+#define SYSFS_CPU_PATH "/sys/devices/system/cpu"
+#define MAX_CACHE_INDEX 16
+#define PATH_LENGTH 256
+#define LIST_LENGTH 4096
+
+static const char *placement_names[DF_NUM_PLACEMENTS] = {
+    "same-cpu", "smt-sibling", "same-l3", "cross-l3", "cross-socket"
+};
+
+/*
+ * Read the first line of file path into buf. Return 0 on success and -1 on error.
+ */
+static int read_line (const char *path, char *buf, int length)
+{
+    FILE *f = fopen(path, "r");
+    if(!f) {
+        return -1;
+    }
+    if(!fgets(buf, length, f)) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+static int read_int (const char *path)
+{
+    char buf[64];
+    if(read_line(path, buf, sizeof(buf)) != 0) {
+        return -1;
+    }
+    return atoi(buf);
+}
+
+/*
+ * Parse a cpu list such as "0-3,8,10-11". If cpus is not NULL, store up to max_cpus
+ * cpu numbers in it. Return the number of cpus in the list, or -1 if it is malformed.
+ */
+static int parse_cpu_list (const char *list, int *cpus, int max_cpus)
+{
+    int count = 0;
+    const char *p = list;
+    while(*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if(end == p || first < 0) {
+            return -1;
+        }
+        p = end;
+        if(*p == '-') {
+            p ++;
+            last = strtol(p, &end, 10);
+            if(end == p || last < first) {
+                return -1;
+            }
+            p = end;
+        }
+        long cpu;
+        for(cpu = first; cpu <= last; cpu ++) {
+            if(cpus && count < max_cpus) {
+                cpus[count] = (int) cpu;
+            }
+            count ++;
+        }
+        if(*p == ',') {
+            p ++;
+        }
+        else if(*p) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+/*
+ * Return the smallest cpu in the cpu list file path, or -1 on error.
+ */
+static int first_cpu_in_list (const char *path)
+{
+    char list[LIST_LENGTH];
+    int cpu;
+    if(read_line(path, list, sizeof(list)) != 0 || parse_cpu_list(list, &cpu, 1) < 1) {
+        return -1;
+    }
+    return cpu;
+}
+
+/*
+ * Find the last level data or unified cache of cpu and fill in info->llc and
+ * info->llc_level.
+ */
+static void find_llc (df_cpu_info *info)
+{
+    char path[PATH_LENGTH];
+    char type[32];
+    int index;
+    info->llc = info->llc_level = -1;
+    for(index = 0; index < MAX_CACHE_INDEX; index ++) {
+        snprintf(path, sizeof(path), SYSFS_CPU_PATH "/cpu%d/cache/index%d/type", info->cpu, index);
+        if(read_line(path, type, sizeof(type)) != 0) {
+            break;
+        }
+        if(!strcmp(type, "Instruction")) {
+            continue;
+        }
+        snprintf(path, sizeof(path), SYSFS_CPU_PATH "/cpu%d/cache/index%d/level", info->cpu, index);
+        int level = read_int(path);
+        if(level <= info->llc_level) {
+            continue;
+        }
+        snprintf(path, sizeof(path), SYSFS_CPU_PATH "/cpu%d/cache/index%d/shared_cpu_list",
+            info->cpu, index);
+        int first = first_cpu_in_list(path);
+        if(first >= 0) {
+            info->llc = first;
+            info->llc_level = level;
+        }
+    }
+}
+
+df_topology_t df_topology_discover (void)
+{
+    char list[LIST_LENGTH];
+    char path[PATH_LENGTH];
+    int num_cpus;
+    if(read_line(SYSFS_CPU_PATH "/online", list, sizeof(list)) != 0 ||
+       (num_cpus = parse_cpu_list(list, NULL, 0)) < 1) {
+        fprintf(stderr, "Error: cannot read the online cpus from %s. %s:%d\n", SYSFS_CPU_PATH,
+            __FILE__, __LINE__);
+        return NULL;
+    }
+    df_topology_t topology = (df_topology_t) malloc(sizeof(df_topology));
+    int *cpu_numbers = (int *) malloc(num_cpus * sizeof(int));
+    if(!topology || !cpu_numbers) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        free(topology);
+        free(cpu_numbers);
+        return NULL;
+    }
+    topology->cpus = (df_cpu_info *) malloc(num_cpus * sizeof(df_cpu_info));
+    if(!topology->cpus) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        free(topology);
+        free(cpu_numbers);
+        return NULL;
+    }
+    topology->num_cpus = num_cpus;
+    parse_cpu_list(list, cpu_numbers, num_cpus);
+
+    int i;
+    for(i = 0; i < num_cpus; i ++) {
+        df_cpu_info *info = &topology->cpus[i];
+        info->cpu = cpu_numbers[i];
+        snprintf(path, sizeof(path), SYSFS_CPU_PATH "/cpu%d/topology/thread_siblings_list", info->cpu);
+        info->core = first_cpu_in_list(path);
+        snprintf(path, sizeof(path), SYSFS_CPU_PATH "/cpu%d/topology/physical_package_id", info->cpu);
+        info->package = read_int(path);
+        find_llc(info);
+    }
+    free(cpu_numbers);
+    return topology;
+}
+
+void df_topology_free (df_topology_t topology)
+{
+    if(topology) {
+        free(topology->cpus);
+        free(topology);
+    }
+}
+
+df_cpu_info *df_topology_cpu (df_topology_t topology, int cpu)
+{
+    int i;
+    for(i = 0; i < topology->num_cpus; i ++) {
+        if(topology->cpus[i].cpu == cpu) {
+            return &topology->cpus[i];
+        }
+    }
+    return NULL;
+}
+
+int df_topology_placement (df_topology_t topology, int cpu_a, int cpu_b)
+{
+    df_cpu_info *a = df_topology_cpu(topology, cpu_a);
+    df_cpu_info *b = df_topology_cpu(topology, cpu_b);
+    if(!a || !b) {
+        return -1;
+    }
+    if(cpu_a == cpu_b) {
+        return DF_PLACEMENT_SAME_CPU;
+    }
+    if(a->package < 0 || b->package < 0) {
+        return -1;
+    }
+    if(a->package != b->package) {
+        return DF_PLACEMENT_CROSS_SOCKET;
+    }
+    if(a->core >= 0 && a->core == b->core) {
+        return DF_PLACEMENT_SMT_SIBLING;
+    }
+    if(a->llc < 0 || b->llc < 0) {
+        return -1;
+    }
+    return a->llc == b->llc? DF_PLACEMENT_SAME_L3 : DF_PLACEMENT_CROSS_L3;
+}
+
+int df_topology_find_pair (df_topology_t topology, enum DF_PLACEMENT placement, int *cpu_a, int *cpu_b)
+{
+    int i, j;
+    for(i = 0; i < topology->num_cpus; i ++) {
+        for(j = i; j < topology->num_cpus; j ++) {
+            int a = topology->cpus[i].cpu, b = topology->cpus[j].cpu;
+            if(df_topology_placement(topology, a, b) == (int) placement) {
+                *cpu_a = a;
+                *cpu_b = b;
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+const char *df_placement_name (enum DF_PLACEMENT placement)
+{
+    if((int) placement < 0 || placement >= DF_NUM_PLACEMENTS) {
+        return NULL;
+    }
+    return placement_names[placement];
+}
+
+int df_placement_from_name (const char *name)
+{
+    int p;
+    for(p = 0; p < DF_NUM_PLACEMENTS; p ++) {
+        if(!strcmp(name, placement_names[p])) {
+            return p;
+        }
+    }
+    return -1;
+}
+
+int df_pin_thread (int cpu)
+{
+    cpu_set_t set;
+    if(cpu < 0 || cpu >= CPU_SETSIZE) {
+        fprintf(stderr, "Error: cpu %d is out of range. %s:%d\n", cpu, __FILE__, __LINE__);
+        return -1;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    // pid 0 is the calling thread
+    if(sched_setaffinity(0, sizeof(set), &set) != 0) {
+        fprintf(stderr, "Error: cannot pin to cpu %d. %s:%d\n", cpu, __FILE__, __LINE__);
+        return -1;
+    }
+    return 0;
+}
+
+int df_current_cpu (void)
+{
+    return sched_getcpu();
+}
@@ -0,0 +1,108 @@
+#ifndef _DF_SHM_TOPOLOGY_H_
+#define _DF_SHM_TOPOLOGY_H_
+/*
+ * DataFabrics shared memory transport for inter-process and inter-thread
+ * communication on mulitcore.
+ *
+ * This header file defines cpu topology discovery and pinning helpers. The
+ * topology of the online cpus (hardware thread, core, last level cache and
+ * socket) is read from /sys/devices/system/cpu, so that the two ends of a queue
+ * can be placed on cpus with a known relation: SMT siblings of one core, cores
+ * sharing an L3, cores behind different L3s of one socket, or different sockets.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "df_config.h"
+#include <unistd.h>
+
+/*
+ * where a cpu is, by ids which are unique across the system; -1 if unknown
+ */
+typedef struct _df_cpu_info {
+    int cpu;                      // logical cpu number
+    int core;                     // smallest cpu number of the cpus of the same core
+    int llc;                      // smallest cpu number of the cpus sharing the last level cache
+    int llc_level;                // level of the last level cache (3 on most machines)
+    int package;                  // physical package (socket) id
+} df_cpu_info;
+
+/*
+ * topology of the online cpus
+ */
+typedef struct _df_topology {
+    int num_cpus;
+    df_cpu_info *cpus;            // in increasing cpu number
+} df_topology, *df_topology_t;
+
+/*
+ * relation of two cpus, from the closest to the farthest
+ */
+enum DF_PLACEMENT {
+    DF_PLACEMENT_SAME_CPU = 0,    // one hardware thread
+    DF_PLACEMENT_SMT_SIBLING = 1, // two hardware threads of one core
+    DF_PLACEMENT_SAME_L3 = 2,     // two cores sharing the last level cache
+    DF_PLACEMENT_CROSS_L3 = 3,    // two cores of one socket with different last level caches
+    DF_PLACEMENT_CROSS_SOCKET = 4, // two sockets
+    DF_NUM_PLACEMENTS
+};
+
+/*
+ * Discover the topology of the online cpus. Fields which cannot be read are set
+ * to -1. Return NULL on error.
+ */
+df_topology_t df_topology_discover (void);
+
+/*
+ * Free a topology returned by df_topology_discover().
+ */
+void df_topology_free (df_topology_t topology);
+
+/*
+ * Return the information of cpu, or NULL if it is not online.
+ */
+df_cpu_info *df_topology_cpu (df_topology_t topology, int cpu);
+
+/*
+ * Return the relation of cpus cpu_a and cpu_b, or -1 if either is not online or
+ * the relation is not known.
+ */
+int df_topology_placement (df_topology_t topology, int cpu_a, int cpu_b);
+
+/*
+ * Find two cpus with the given relation; the lowest numbered pair is chosen.
+ * Return 0 on success and -1 if the machine has no such pair.
+ */
+int df_topology_find_pair (df_topology_t topology, enum DF_PLACEMENT placement, int *cpu_a, int *cpu_b);
+
+/*
+ * Return a short name of a placement ("same-cpu", "smt-sibling", "same-l3",
+ * "cross-l3", "cross-socket"), or NULL if placement is out of range.
+ */
+const char *df_placement_name (enum DF_PLACEMENT placement);
+
+/*
+ * Parse a placement name as returned by df_placement_name(). Return -1 if the
+ * name is not known.
+ */
+int df_placement_from_name (const char *name);
+
+/*
+ * Pin the calling thread to cpu. Threads it creates afterwards inherit the
+ * pinning, so a single-threaded process can pin itself with it. Return 0 on
+ * success and -1 on error.
+ */
+int df_pin_thread (int cpu);
+
+/*
+ * Return the cpu the calling thread runs on, or -1 on error.
+ */
+int df_current_cpu (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
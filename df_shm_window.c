@@ -0,0 +1,354 @@
+/*
+ * DataFabrics shared memory transport for inter-process and inter-thread
+ * communication on mulitcore.
+ *
+ * This file implements the fixed-address window: the window is reserved with a
+ * PROT_NONE mapping so that nothing else in the process is placed in it, regions
+ * are mapped over the reservation with MAP_FIXED, and addresses are handed out by
+ * a bump allocator in a small POSIX shm object shared by all processes using the
+ * same window.
+ *
+ * The allocator records the pids of the processes which have the window open, and
+ * opening and closing it are serialized with flock() on the object. A process which
+ * dies without closing the window leaves its pid behind; once none of the recorded
+ * processes is alive nothing is mapped in the window any more, so the next process
+ * to open it starts the allocator afresh instead of finding the window exhausted.
+ */
+
+#include "df_config.h"
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <search.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "df_shm.h"
+#include "df_shm_window.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+#define WINDOW_ALIGNMENT (2UL * 1024 * 1024)  // regions start on (huge) page boundaries
+#define ALLOCATOR_NAME_LENGTH (DF_SHM_NAME_LENGTH + 64)
+
+#define MAX_WINDOW_USERS ((PAGE_SIZE - 2 * sizeof(uint64_t)) / sizeof(pid_t))
+
+/*
+ * state of the allocator, shared by all processes using the window
+ */
+typedef struct _window_allocator {
+    uint64_t next;     // offset of the first unallocated byte of the window
+    uint64_t users;    // number of processes in pids; updated under the flock() of the object
+    pid_t pids[MAX_WINDOW_USERS];  // processes which have the window open
+} window_allocator;
+
+/*
+ * a range of the window claimed by a mapping of this process
+ */
+typedef struct _window_claim {
+    char *start;
+    size_t length;
+} window_claim;
+
+static pthread_mutex_t window_lock = PTHREAD_MUTEX_INITIALIZER;
+static int window_refs = 0;
+static char *window_base = NULL;
+static size_t window_size = 0;
+static window_allocator *allocator = NULL;
+static char allocator_name[ALLOCATOR_NAME_LENGTH];
+static void *claims = NULL;  // tsearch() tree of window_claim ordered by address
+
+/*
+ * Order claims by address range; overlapping ranges compare equal.
+ */
+static int compare_claim (const void *a, const void *b)
+{
+    const window_claim *ca = (const window_claim *) a;
+    const window_claim *cb = (const window_claim *) b;
+    if(ca->start + ca->length <= cb->start) {
+        return -1;
+    }
+    if(cb->start + cb->length <= ca->start) {
+        return 1;
+    }
+    return 0;
+}
+
+static int in_window (const void *addr, size_t length)
+{
+    const char *p = (const char *) addr;
+    return window_base && p >= window_base && length <= window_size &&
+        (size_t) (p - window_base) <= window_size - length;
+}
+
+/*
+ * Open the allocator object and lock it. Return the fd or -1 on error.
+ */
+static int lock_allocator (const df_shm_config *config)
+{
+    while(1) {
+        int fd = shm_open(allocator_name, O_CREAT | O_RDWR, config->mode);
+        if(fd == -1) {
+            fprintf(stderr, "Error: calling shm_open() on %s failed: %d %s:%d\n",
+                allocator_name, errno, __FILE__, __LINE__);
+            return -1;
+        }
+        struct stat st;
+        if(flock(fd, LOCK_EX) == -1 || fstat(fd, &st) == -1) {
+            fprintf(stderr, "Error: cannot lock %s: %d %s:%d\n", allocator_name, errno,
+                __FILE__, __LINE__);
+            close(fd);
+            return -1;
+        }
+        if(st.st_nlink > 0) {
+            return fd;
+        }
+        // the last user removed the object while this process waited for the lock
+        close(fd);
+    }
+}
+
+/*
+ * Drop the pids of processes which are gone from the allocator. If none is left,
+ * nothing is mapped in the window and allocation starts over.
+ */
+static void reclaim_allocator (window_allocator *a)
+{
+    uint64_t i, live = 0;
+    for(i = 0; i < a->users; i ++) {
+        if(a->pids[i] > 0 && (kill(a->pids[i], 0) == 0 || errno != ESRCH)) {
+            a->pids[live ++] = a->pids[i];
+        }
+    }
+    a->users = live;
+    if(live == 0) {
+        __atomic_store_n(&a->next, 0, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Map the shared allocator of the window and add this process to its users.
+ * Return 0 on success and -1 on error.
+ */
+static int open_allocator (const df_shm_config *config)
+{
+    sprintf(allocator_name, "/%s_window.%lx", config->name_prefix,
+        (unsigned long) config->fixed_window_base);
+    int fd = lock_allocator(config);
+    if(fd == -1) {
+        return -1;
+    }
+    // a new object is zero-filled, i.e. nothing is allocated yet
+    if(ftruncate(fd, PAGE_SIZE) == -1) {
+        fprintf(stderr, "Error: ftruncate() file %s failed: %d %s:%d\n",
+            allocator_name, errno, __FILE__, __LINE__);
+        close(fd);
+        return -1;
+    }
+    // map it through another open file: the lock lasts as long as any reference to
+    // the locked one, and a mapping is such a reference
+    int map_fd = shm_open(allocator_name, O_RDWR, 0);
+    void *addr = map_fd == -1? MAP_FAILED :
+        mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, map_fd, 0);
+    if(addr == MAP_FAILED) {
+        fprintf(stderr, "Error: cannot map %s: %d. %s:%d\n", allocator_name, errno, __FILE__, __LINE__);
+        if(map_fd != -1) {
+            close(map_fd);
+        }
+        close(fd);
+        return -1;
+    }
+    close(map_fd);
+    window_allocator *a = (window_allocator *) addr;
+    reclaim_allocator(a);
+    if(a->users == MAX_WINDOW_USERS) {
+        fprintf(stderr, "Error: fixed-address window has %lu processes already. %s:%d\n",
+            MAX_WINDOW_USERS, __FILE__, __LINE__);
+        munmap(addr, PAGE_SIZE);
+        close(fd);
+        return -1;
+    }
+    a->pids[a->users ++] = getpid();
+    allocator = a;
+    close(fd);  // unlocks the object
+    return 0;
+}
+
+/*
+ * Remove this process from the users of the allocator, and the allocator itself
+ * if it was the last user, then unmap it.
+ */
+static void close_allocator (void)
+{
+    window_allocator *a = allocator;
+    int fd = shm_open(allocator_name, O_RDWR, 0);
+    if(fd != -1 && flock(fd, LOCK_EX) == 0) {
+        pid_t pid = getpid();
+        uint64_t i;
+        for(i = 0; i < a->users; i ++) {
+            if(a->pids[i] == pid) {
+                a->pids[i] = a->pids[-- a->users];
+                break;
+            }
+        }
+        // the last process out removes the allocator so the next users start afresh
+        if(a->users == 0) {
+            shm_unlink(allocator_name);
+        }
+    }
+    if(fd != -1) {
+        close(fd);
+    }
+    munmap(a, PAGE_SIZE);
+    allocator = NULL;
+}
+
+int df_shm_window_open (const df_shm_config *config)
+{
+    int rc = 0;
+    pthread_mutex_lock(&window_lock);
+    if(window_refs > 0) {
+        if((char *) config->fixed_window_base != window_base || config->fixed_window_size != window_size) {
+            fprintf(stderr, "Error: another fixed-address window (%p) is in use. %s:%d\n",
+                window_base, __FILE__, __LINE__);
+            rc = -1;
+        }
+        else {
+            window_refs ++;
+        }
+        pthread_mutex_unlock(&window_lock);
+        return rc;
+    }
+
+    // fail rather than replace anything already mapped in the window
+    void *base = config->fixed_window_base;
+    void *addr = mmap(base, config->fixed_window_size, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+    if(addr != base) {
+        fprintf(stderr, "Error: cannot reserve fixed-address window at %p of %lu bytes: %d. %s:%d\n",
+            base, config->fixed_window_size, addr == MAP_FAILED? errno : EEXIST, __FILE__, __LINE__);
+        if(addr != MAP_FAILED) {
+            // kernels without MAP_FIXED_NOREPLACE treat the address as a hint
+            munmap(addr, config->fixed_window_size);
+        }
+        pthread_mutex_unlock(&window_lock);
+        return -1;
+    }
+    window_base = (char *) base;
+    window_size = config->fixed_window_size;
+    if(open_allocator(config) != 0) {
+        munmap(window_base, window_size);
+        window_base = NULL;
+        window_size = 0;
+        pthread_mutex_unlock(&window_lock);
+        return -1;
+    }
+    window_refs = 1;
+    pthread_mutex_unlock(&window_lock);
+    return 0;
+}
+
+void df_shm_window_close (void)
+{
+    pthread_mutex_lock(&window_lock);
+    if(window_refs == 0 || -- window_refs > 0) {
+        pthread_mutex_unlock(&window_lock);
+        return;
+    }
+    close_allocator();
+    munmap(window_base, window_size);
+    window_base = NULL;
+    window_size = 0;
+    while(claims) {
+        window_claim *c = *(window_claim **) claims;
+        tdelete(c, &claims, compare_claim);
+        free(c);
+    }
+    pthread_mutex_unlock(&window_lock);
+}
+
+void *df_shm_window_alloc (size_t length)
+{
+    if(!allocator) {
+        fprintf(stderr, "Error: fixed-address window is not open. %s:%d\n", __FILE__, __LINE__);
+        return NULL;
+    }
+    length = (length + WINDOW_ALIGNMENT - 1) & ~(WINDOW_ALIGNMENT - 1);
+    uint64_t offset = __atomic_fetch_add(&allocator->next, length, __ATOMIC_RELAXED);
+    if(offset > window_size || window_size - offset < length) {
+        fprintf(stderr, "Error: fixed-address window of %lu bytes is exhausted. %s:%d\n",
+            window_size, __FILE__, __LINE__);
+        return NULL;
+    }
+    return window_base + offset;
+}
+
+int df_shm_window_claim (void *addr, size_t length)
+{
+    window_claim *c = (window_claim *) malloc(sizeof(window_claim));
+    if(!c) {
+        fprintf(stderr, "Error: cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    c->start = (char *) addr;
+    c->length = length;
+
+    pthread_mutex_lock(&window_lock);
+    if(!in_window(addr, length)) {
+        pthread_mutex_unlock(&window_lock);
+        fprintf(stderr, "Error: range %p of %lu bytes is outside the fixed-address window. %s:%d\n",
+            addr, length, __FILE__, __LINE__);
+        free(c);
+        return -1;
+    }
+    void *node = tsearch(c, &claims, compare_claim);
+    if(!node || *(window_claim **) node != c) {
+        pthread_mutex_unlock(&window_lock);
+        fprintf(stderr, "Error: range %p of %lu bytes is already mapped in this process. %s:%d\n",
+            addr, length, __FILE__, __LINE__);
+        free(c);
+        return -1;
+    }
+    pthread_mutex_unlock(&window_lock);
+    return 0;
+}
+
+int df_shm_window_unmap (void *addr, size_t length)
+{
+    pthread_mutex_lock(&window_lock);
+    if(!in_window(addr, length)) {
+        pthread_mutex_unlock(&window_lock);
+        if(munmap(addr, length) == -1) {
+            fprintf(stderr, "Error: munmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+            return -1;
+        }
+        return 0;
+    }
+
+    // put the range back into the reservation instead of leaving a hole in it
+    if(mmap(addr, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+        -1, 0) == MAP_FAILED) {
+        pthread_mutex_unlock(&window_lock);
+        fprintf(stderr, "Error: mmap() returns %d. %s:%d\n", errno, __FILE__, __LINE__);
+        return -1;
+    }
+    window_claim key;
+    key.start = (char *) addr;
+    key.length = length;
+    void *node = tfind(&key, &claims, compare_claim);
+    if(node) {
+        window_claim *c = *(window_claim **) node;
+        tdelete(c, &claims, compare_claim);
+        free(c);
+    }
+    pthread_mutex_unlock(&window_lock);
+    return 0;
+}
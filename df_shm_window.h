@@ -0,0 +1,46 @@
+#ifndef _DF_SHM_WINDOW_H_
+#define _DF_SHM_WINDOW_H_
+
+#include "df_shm.h"
+
+/*
+ * The fixed-address window (DF_SHM_FLAG_FIXED_ADDR): every participating process
+ * reserves the same range of virtual address space, and regions are placed in it
+ * at addresses handed out by an allocator shared by all processes, so a region is
+ * mapped at the same address everywhere. There is at most one window per process.
+ * Not part of the public interface.
+ */
+
+/*
+ * Reserve the window of the configuration in this process and open the shared
+ * allocator. Calls are counted; the window is released by the last
+ * df_shm_window_close(). Return 0 on success and -1 on error, e.g. if part of the
+ * range is already mapped.
+ */
+int df_shm_window_open (const df_shm_config *config);
+
+/*
+ * Drop a reference to the window taken by df_shm_window_open().
+ */
+void df_shm_window_close (void);
+
+/*
+ * Allocate length bytes of the window for a new region. Return NULL if the window
+ * is exhausted or not open.
+ */
+void *df_shm_window_alloc (size_t length);
+
+/*
+ * Claim [addr, addr + length) of the window for a mapping in this process. Return
+ * 0 on success and -1 if the range is outside the window or overlaps a claimed one.
+ */
+int df_shm_window_claim (void *addr, size_t length);
+
+/*
+ * Unmap [addr, addr + length). A range of the window goes back to the reservation
+ * (and can be claimed again); other ranges are munmap()-ed. Return 0 on success
+ * and -1 on error.
+ */
+int df_shm_window_unmap (void *addr, size_t length);
+
+#endif
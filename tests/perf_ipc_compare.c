@@ -0,0 +1,706 @@
+/*
+ * This test program compares shm queues with the kernel IPC mechanisms a
+ * shared memory transport has to beat on the same machine. The same two
+ * workloads run over every transport between a parent and a forked child:
+ * ping-pong (one-way latency, half the round trip time) and streaming from
+ * the parent to the child (throughput, timed until the child acknowledges
+ * the last message). For every message size one row per transport is
+ * printed, so the numbers can be read side by side.
+ *
+ * shm queues are run on each shm method with each way of waiting:
+ * - spin: df_enqueue()/df_dequeue(), which busy-poll the slots
+ * - yield: df_try_enqueue()/df_try_dequeue(), yielding the cpu between tries
+ * - eventfd: df_try_dequeue() and blocking in read() on an eventfd, which the
+ *   sender signals after every message (a full queue is waited out by yielding)
+ * The kernel transports are pipes, Unix-domain stream and seqpacket socket
+ * pairs and POSIX message queues. Pipe and socket buffers and message queue
+ * depths are grown to hold as many messages as the shm queues where the system
+ * limits allow. Transports which cannot carry a message size (seqpacket above
+ * the socket buffer size, message queues above msgsize_max) print n/a.
+ *
+ */
+
+#define _GNU_SOURCE // F_SETPIPE_SZ
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <mqueue.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "df_shm.h"
+#include "df_shm_queue.h"
+#include "df_config.h"
+
+#define FIELD_WIDTH 14
+#define FLOAT_PRECISION 3
+#define MAX_TRANSPORTS 32
+
+// test parameters
+size_t min_msg_size = 8;
+size_t max_msg_size = 1024 * 1024;
+uint32_t num_slots = 16;
+uint64_t bytes_per_run = 256 * 1024 * 1024;
+uint64_t max_msgs = 1000000;
+uint64_t max_round_trips = 10000;
+const char *shm_methods = "SMPA";
+const char *wait_modes = "sye";
+const char *kernel_transports = "psqm";
+// fault in regions up front so that page faults stay off the measured path
+df_shm_config shm_config = { DF_SHM_FLAG_POPULATE };
+
+enum TRANSPORT_KIND {
+    TRANSPORT_DF_QUEUE,
+    TRANSPORT_PIPE,
+    TRANSPORT_STREAM,
+    TRANSPORT_SEQPACKET,
+    TRANSPORT_MQUEUE
+};
+
+enum WAIT_MODE {
+    WAIT_SPIN,
+    WAIT_YIELD,
+    WAIT_EVENTFD
+};
+
+/*
+ * A transport between side 0 (the parent) and side 1 (the child). Resources
+ * are indexed by direction; side s sends in direction s and receives in
+ * direction 1 - s.
+ */
+typedef struct _transport {
+    char name[32];
+    enum TRANSPORT_KIND kind;
+    enum DF_SHM_METHOD method;
+    enum WAIT_MODE wait_mode;
+    df_shm_method_t df_shm_handle;
+
+    // created before fork
+    df_shm_region_t region;
+    df_queue_t queues[2];
+    int efds[2];                  // eventfd doorbells
+    int fds[2][2];                // pipe per direction; a socket pair uses fds[0]
+    mqd_t mqs[2];
+    size_t mq_msgsize;
+
+    // what this side uses
+    df_queue_ep_t send_ep;
+    df_queue_ep_t recv_ep;
+    int send_fd;
+    int recv_fd;
+    mqd_t send_mq;
+    mqd_t recv_mq;
+} transport;
+
+transport transports[MAX_TRANSPORTS];
+int num_transports = 0;
+
+void print_usage(char *program_name)
+{
+    fprintf(stderr, "Usage: %s [options] [shm_methods]\n"
+                    " shm_methods is a string of the following letters (default SMPA)\n"
+                    " - S: System V shared memory\n"
+                    " - M: mmap() backed by a file in /tmp\n"
+                    " - P: POSIX shared memory object\n"
+                    " - A: anonymous shared mapping\n"
+                    " options:\n"
+                    " -s size   smallest message size (default 8)\n"
+                    " -S size   largest message size (default 1M); sizes grow by 4x\n"
+                    " -q slots  number of queue slots (default 16)\n"
+                    " -b bytes  bytes to stream per transport and size (default 256M)\n"
+                    " -n count  most messages to stream (default 1000000)\n"
+                    " -r count  most round trips (default 10000)\n"
+                    " -w modes  shm queue wait modes: s(pin), y(ield), e(ventfd) (default sye)\n"
+                    " -k list   kernel transports: p(ipe), s(tream socket), q (seqpacket socket),\n"
+                    "           m(essage queue) (default psqm); empty for none\n"
+                    " sizes take K, M and G suffixes\n",
+                    program_name
+           );
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+size_t parse_size(const char *s)
+{
+    char *end;
+    size_t size = strtoul(s, &end, 10);
+    switch(*end) {
+        case 'G': case 'g': size <<= 10;
+        case 'M': case 'm': size <<= 10;
+        case 'K': case 'k': size <<= 10;
+    }
+    return size;
+}
+
+/*
+ * Read a number from a file in /proc; return default_value if it cannot be read.
+ */
+long read_limit(const char *path, long default_value)
+{
+    FILE *f = fopen(path, "r");
+    long value;
+    if(!f) {
+        return default_value;
+    }
+    if(fscanf(f, "%ld", &value) != 1) {
+        value = default_value;
+    }
+    fclose(f);
+    return value;
+}
+
+int write_full(int fd, const char *buf, size_t length)
+{
+    while(length > 0) {
+        ssize_t n = write(fd, buf, length);
+        if(n <= 0) {
+            if(n < 0 && errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        length -= n;
+    }
+    return 0;
+}
+
+int read_full(int fd, char *buf, size_t length)
+{
+    while(length > 0) {
+        ssize_t n = read(fd, buf, length);
+        if(n <= 0) {
+            if(n < 0 && errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        length -= n;
+    }
+    return 0;
+}
+
+void add_transport(const char *name, enum TRANSPORT_KIND kind, enum DF_SHM_METHOD method,
+    enum WAIT_MODE wait_mode, df_shm_method_t df_shm_handle)
+{
+    transport *t = &transports[num_transports ++];
+    memset(t, 0, sizeof(transport));
+    snprintf(t->name, sizeof(t->name), "%s", name);
+    t->kind = kind;
+    t->method = method;
+    t->wait_mode = wait_mode;
+    t->df_shm_handle = df_shm_handle;
+}
+
+/*
+ * Create the resources of transport t for messages of msg_size bytes. Return 0
+ * on success, 1 if the transport cannot carry such messages and -1 on error.
+ */
+int open_transport(transport *t, size_t msg_size)
+{
+    int d;
+    t->efds[0] = t->efds[1] = -1;
+    t->fds[0][0] = t->fds[0][1] = t->fds[1][0] = t->fds[1][1] = -1;
+    t->mqs[0] = t->mqs[1] = (mqd_t) -1;
+
+    switch(t->kind) {
+        case TRANSPORT_DF_QUEUE: {
+            size_t queue_size = df_calculate_queue_size(num_slots, msg_size);
+            size_t region_size = 2 * queue_size;
+            if(region_size % PAGE_SIZE) {
+                region_size += PAGE_SIZE - (region_size % PAGE_SIZE);
+            }
+            t->region = df_create_shm_region(t->df_shm_handle, region_size, NULL);
+            if(!t->region) {
+                fprintf(stderr, "Cannot create region. %s:%d\n", __FILE__, __LINE__);
+                return -1;
+            }
+            for(d = 0; d < 2; d ++) {
+                t->queues[d] = df_create_queue((char *) t->region->starting_addr + d * queue_size,
+                    num_slots, msg_size);
+                if(t->wait_mode == WAIT_EVENTFD) {
+                    t->efds[d] = eventfd(0, 0);
+                    if(t->efds[d] == -1) {
+                        fprintf(stderr, "Cannot create eventfd. %s:%d\n", __FILE__, __LINE__);
+                        return -1;
+                    }
+                }
+            }
+            return 0;
+        }
+        case TRANSPORT_PIPE:
+            for(d = 0; d < 2; d ++) {
+                if(pipe(t->fds[d]) != 0) {
+                    fprintf(stderr, "Cannot create pipe. %s:%d\n", __FILE__, __LINE__);
+                    return -1;
+                }
+                // grow the pipe to hold as many messages as a queue, as far as the limit allows
+                long pipe_size = num_slots * msg_size;
+                long pipe_max = read_limit("/proc/sys/fs/pipe-max-size", 1024 * 1024);
+                if(pipe_size > fcntl(t->fds[d][1], F_GETPIPE_SZ)) {
+                    fcntl(t->fds[d][1], F_SETPIPE_SZ, pipe_size < pipe_max? pipe_size : pipe_max);
+                }
+            }
+            return 0;
+        case TRANSPORT_STREAM:
+        case TRANSPORT_SEQPACKET: {
+            int type = t->kind == TRANSPORT_STREAM? SOCK_STREAM : SOCK_SEQPACKET;
+            if(socketpair(AF_UNIX, type, 0, t->fds[0]) != 0) {
+                fprintf(stderr, "Cannot create socket pair. %s:%d\n", __FILE__, __LINE__);
+                return -1;
+            }
+            // grow the socket buffers to hold as many messages as a queue
+            int buf_size = num_slots * msg_size > (1 << 30)? (1 << 30) : num_slots * msg_size;
+            int actual_size = 0;
+            socklen_t optlen = sizeof(actual_size);
+            getsockopt(t->fds[0][0], SOL_SOCKET, SO_SNDBUF, &actual_size, &optlen);
+            if(buf_size > actual_size) {
+                for(d = 0; d < 2; d ++) {
+                    setsockopt(t->fds[0][d], SOL_SOCKET, SO_SNDBUF, &buf_size, sizeof(buf_size));
+                    setsockopt(t->fds[0][d], SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
+                }
+                getsockopt(t->fds[0][0], SOL_SOCKET, SO_SNDBUF, &actual_size, &optlen);
+            }
+            // a seqpacket message has to fit into the send buffer at once
+            if(type == SOCK_SEQPACKET && msg_size + 64 > (size_t) actual_size) {
+                return 1;
+            }
+            return 0;
+        }
+        case TRANSPORT_MQUEUE: {
+            long msgsize_max = read_limit("/proc/sys/fs/mqueue/msgsize_max", 8192);
+            long msg_max = read_limit("/proc/sys/fs/mqueue/msg_max", 10);
+            if(msg_size > (size_t) msgsize_max) {
+                return 1;
+            }
+            struct mq_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.mq_maxmsg = num_slots < msg_max? num_slots : msg_max;
+            attr.mq_msgsize = msg_size;
+            t->mq_msgsize = msg_size;
+            for(d = 0; d < 2; d ++) {
+                char name[64];
+                snprintf(name, sizeof(name), "/df_shm_perf_ipc.%d.%d", getpid(), d);
+                t->mqs[d] = mq_open(name, O_RDWR | O_CREAT | O_EXCL, 0600, &attr);
+                if(t->mqs[d] == (mqd_t) -1) {
+                    // most likely RLIMIT_MSGQUEUE
+                    return 1;
+                }
+                // the child inherits the descriptor, so the name is not needed any more
+                mq_unlink(name);
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Pick the ends of transport t which side uses, and close the other side's ends
+ * so that a peer which exits is noticed as end of file.
+ */
+int start_transport(transport *t, int side)
+{
+    switch(t->kind) {
+        case TRANSPORT_DF_QUEUE:
+            t->send_ep = df_get_queue_sender_ep(t->queues[side]);
+            t->recv_ep = df_get_queue_receiver_ep(t->queues[1 - side]);
+            if(!t->send_ep || !t->recv_ep) {
+                fprintf(stderr, "Cannot get queue endpoints. %s:%d\n", __FILE__, __LINE__);
+                return -1;
+            }
+            t->send_fd = t->efds[side];
+            t->recv_fd = t->efds[1 - side];
+            break;
+        case TRANSPORT_PIPE:
+            t->send_fd = t->fds[side][1];
+            t->recv_fd = t->fds[1 - side][0];
+            close(t->fds[side][0]);
+            close(t->fds[1 - side][1]);
+            break;
+        case TRANSPORT_STREAM:
+        case TRANSPORT_SEQPACKET:
+            t->send_fd = t->recv_fd = t->fds[0][side];
+            close(t->fds[0][1 - side]);
+            break;
+        case TRANSPORT_MQUEUE:
+            t->send_mq = t->mqs[side];
+            t->recv_mq = t->mqs[1 - side];
+            break;
+    }
+    return 0;
+}
+
+/*
+ * Release what this side holds of transport t. Only side 0 destroys the queues
+ * and the region, after side 1 has exited.
+ */
+void stop_transport(transport *t, int side)
+{
+    int d;
+    switch(t->kind) {
+        case TRANSPORT_DF_QUEUE:
+            df_destroy_ep(t->send_ep);
+            df_destroy_ep(t->recv_ep);
+            for(d = 0; d < 2; d ++) {
+                if(t->efds[d] != -1) close(t->efds[d]);
+            }
+            if(side == 0) {
+                df_destroy_queue(t->queues[0]);
+                df_destroy_queue(t->queues[1]);
+                df_destroy_shm_region(t->region);
+            }
+            break;
+        case TRANSPORT_PIPE:
+        case TRANSPORT_STREAM:
+        case TRANSPORT_SEQPACKET:
+            close(t->send_fd);
+            if(t->recv_fd != t->send_fd) close(t->recv_fd);
+            break;
+        case TRANSPORT_MQUEUE:
+            mq_close(t->mqs[0]);
+            mq_close(t->mqs[1]);
+            break;
+    }
+}
+
+/*
+ * Close the resources of a transport which open_transport() gave up on halfway.
+ */
+void abandon_transport(transport *t)
+{
+    int d;
+    for(d = 0; d < 2; d ++) {
+        if(t->efds[d] != -1) close(t->efds[d]);
+        if(t->fds[d][0] != -1) close(t->fds[d][0]);
+        if(t->fds[d][1] != -1) close(t->fds[d][1]);
+        if(t->mqs[d] != (mqd_t) -1) mq_close(t->mqs[d]);
+    }
+    if(t->kind == TRANSPORT_DF_QUEUE && t->region) {
+        df_destroy_shm_region(t->region);
+    }
+}
+
+int transport_send(transport *t, char *buf, size_t length)
+{
+    int rc;
+    switch(t->kind) {
+        case TRANSPORT_DF_QUEUE:
+            if(t->wait_mode == WAIT_SPIN) {
+                return df_enqueue(t->send_ep, buf, length);
+            }
+            while((rc = df_try_enqueue(t->send_ep, buf, length)) == -1) {
+                sched_yield();
+            }
+            if(rc == 0 && t->wait_mode == WAIT_EVENTFD) {
+                uint64_t one = 1;
+                rc = write(t->send_fd, &one, sizeof(one)) == sizeof(one)? 0 : -1;
+            }
+            return rc;
+        case TRANSPORT_PIPE:
+        case TRANSPORT_STREAM:
+            return write_full(t->send_fd, buf, length);
+        case TRANSPORT_SEQPACKET:
+            return send(t->send_fd, buf, length, 0) == (ssize_t) length? 0 : -1;
+        case TRANSPORT_MQUEUE:
+            return mq_send(t->send_mq, buf, length, 0);
+    }
+    return -1;
+}
+
+/*
+ * Receive a message of exactly length bytes into buf. Return 0 on success.
+ */
+int transport_recv(transport *t, char *buf, size_t length)
+{
+    void *msg;
+    size_t msg_length;
+    int rc;
+    switch(t->kind) {
+        case TRANSPORT_DF_QUEUE:
+            if(t->wait_mode == WAIT_SPIN) {
+                rc = df_dequeue(t->recv_ep, &msg, &msg_length);
+            }
+            else {
+                while((rc = df_try_dequeue(t->recv_ep, &msg, &msg_length)) == -1) {
+                    if(t->wait_mode == WAIT_EVENTFD) {
+                        // the doorbell counts messages posted since the last read;
+                        // retry the queue after every wakeup
+                        uint64_t count;
+                        if(read(t->recv_fd, &count, sizeof(count)) != sizeof(count) && errno != EINTR) {
+                            return -1;
+                        }
+                    }
+                    else {
+                        sched_yield();
+                    }
+                }
+            }
+            if(rc != 0) {
+                return -1;
+            }
+            // copy out like the kernel transports do
+            memcpy(buf, msg, msg_length < length? msg_length : length);
+            df_release(t->recv_ep);
+            return msg_length == length? 0 : -1;
+        case TRANSPORT_PIPE:
+        case TRANSPORT_STREAM:
+            return read_full(t->recv_fd, buf, length);
+        case TRANSPORT_SEQPACKET:
+            return recv(t->recv_fd, buf, length, 0) == (ssize_t) length? 0 : -1;
+        case TRANSPORT_MQUEUE:
+            return mq_receive(t->recv_mq, buf, t->mq_msgsize, NULL) == (ssize_t) length? 0 : -1;
+    }
+    return -1;
+}
+
+/*
+ * The child: echo round trips, then receive the stream and acknowledge its end.
+ */
+int child_side(transport *t, size_t msg_size, uint64_t num_round_trips, uint64_t num_msgs)
+{
+    char *buf = (char *) malloc(msg_size);
+    uint64_t i;
+    memset(buf, 'b', msg_size);
+    if(start_transport(t, 1) != 0) {
+        return -1;
+    }
+    // one extra round trip to get both sides going
+    for(i = 0; i < num_round_trips + 1; i ++) {
+        if(transport_recv(t, buf, msg_size) != 0 || transport_send(t, buf, msg_size) != 0) {
+            return -1;
+        }
+    }
+    for(i = 0; i < num_msgs; i ++) {
+        if(transport_recv(t, buf, msg_size) != 0) {
+            return -1;
+        }
+        if(msg_size >= sizeof(uint64_t)) {
+            uint64_t seq;
+            memcpy(&seq, buf, sizeof(seq));
+            if(seq != i) {
+                fprintf(stderr, "%s: Message %lu out of order. %s:%d\n", t->name, i, __FILE__, __LINE__);
+                return -1;
+            }
+        }
+    }
+    if(transport_send(t, buf, msg_size) != 0) {
+        return -1;
+    }
+    stop_transport(t, 1);
+    free(buf);
+    return 0;
+}
+
+/*
+ * The parent: time the round trips and the stream. Return 0 on success.
+ */
+int parent_side(transport *t, size_t msg_size, uint64_t num_round_trips, uint64_t num_msgs,
+    double *latency, double *stream_time)
+{
+    char *buf = (char *) malloc(msg_size);
+    uint64_t i;
+    double start_time;
+    int rc = -1;
+    memset(buf, 'a', msg_size);
+    if(start_transport(t, 0) != 0) {
+        goto out;
+    }
+    if(transport_send(t, buf, msg_size) != 0 || transport_recv(t, buf, msg_size) != 0) {
+        goto out;
+    }
+    start_time = now();
+    for(i = 0; i < num_round_trips; i ++) {
+        if(transport_send(t, buf, msg_size) != 0 || transport_recv(t, buf, msg_size) != 0) {
+            goto out;
+        }
+    }
+    *latency = (now() - start_time) / (2.0 * num_round_trips);
+
+    start_time = now();
+    for(i = 0; i < num_msgs; i ++) {
+        if(msg_size >= sizeof(uint64_t)) {
+            memcpy(buf, &i, sizeof(i));
+        }
+        if(transport_send(t, buf, msg_size) != 0) {
+            goto out;
+        }
+    }
+    if(transport_recv(t, buf, msg_size) != 0) {
+        goto out;
+    }
+    *stream_time = now() - start_time;
+    rc = 0;
+out:
+    free(buf);
+    return rc;
+}
+
+/*
+ * Run both workloads over transport t and print a row. Return 0 on success.
+ */
+int run_transport(transport *t, size_t msg_size)
+{
+    uint64_t num_msgs = bytes_per_run / msg_size;
+    if(num_msgs > max_msgs) num_msgs = max_msgs;
+    if(num_msgs < 64) num_msgs = 64;
+    // large messages get fewer round trips, but at least a few
+    uint64_t num_round_trips = num_msgs / 2;
+    if(num_round_trips > max_round_trips) num_round_trips = max_round_trips;
+    if(num_round_trips < 16) num_round_trips = 16;
+
+    int rc = open_transport(t, msg_size);
+    if(rc != 0) {
+        abandon_transport(t);
+        if(rc == 1) {
+            fprintf(stdout, "%-*lu%-*s%*s%*s%*s\n", 10, msg_size, 18, t->name,
+                FIELD_WIDTH, "n/a", FIELD_WIDTH, "n/a", FIELD_WIDTH, "n/a");
+            return 0;
+        }
+        return -1;
+    }
+    fflush(stdout);
+    pid_t child = fork();
+    if(child == -1) {
+        fprintf(stderr, "Cannot fork. %s:%d\n", __FILE__, __LINE__);
+        abandon_transport(t);
+        return -1;
+    }
+    if(child == 0) {
+        _exit(child_side(t, msg_size, num_round_trips, num_msgs)? 1 : 0);
+    }
+
+    double latency = 0, stream_time = 0;
+    rc = parent_side(t, msg_size, num_round_trips, num_msgs, &latency, &stream_time);
+    if(rc != 0) {
+        // a failed parent may leave the child blocked on shared memory
+        kill(child, SIGKILL);
+    }
+    int status;
+    waitpid(child, &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        rc = -1;
+    }
+    stop_transport(t, 0);
+    if(rc != 0) {
+        fprintf(stderr, "%s failed with %lu-byte messages. %s:%d\n", t->name, msg_size, __FILE__, __LINE__);
+        return -1;
+    }
+    fprintf(stdout, "%-*lu%-*s%*.*f%*.*f%*.0f\n", 10, msg_size, 18, t->name,
+        FIELD_WIDTH, FLOAT_PRECISION, latency * 1e6,
+        FIELD_WIDTH, FLOAT_PRECISION, num_msgs * msg_size / stream_time / 1e9,
+        FIELD_WIDTH, num_msgs / stream_time);
+    fflush(stdout);
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    int opt;
+    while((opt = getopt(argc, argv, "s:S:q:b:n:r:w:k:")) != -1) {
+        switch(opt) {
+            case 's': min_msg_size = parse_size(optarg); break;
+            case 'S': max_msg_size = parse_size(optarg); break;
+            case 'q': num_slots = atoi(optarg); break;
+            case 'b': bytes_per_run = parse_size(optarg); break;
+            case 'n': max_msgs = parse_size(optarg); break;
+            case 'r': max_round_trips = parse_size(optarg); break;
+            case 'w': wait_modes = optarg; break;
+            case 'k': kernel_transports = optarg; break;
+            default:
+                print_usage(argv[0]);
+                return -1;
+        }
+    }
+    if(optind < argc - 1 || min_msg_size == 0 || max_msg_size < min_msg_size || num_slots == 0 ||
+       max_round_trips == 0) {
+        print_usage(argv[0]);
+        return -1;
+    }
+    if(optind == argc - 1) {
+        shm_methods = argv[optind];
+    }
+    // a peer that goes away shows up as a failed write instead of SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+
+    df_shm_method_t df_shm_handles[4];
+    int num_handles = 0;
+    const char *m, *w;
+    for(m = shm_methods; *m; m ++) {
+        enum DF_SHM_METHOD method;
+        const char *method_name;
+        switch(*m) {
+            case 'S': method = DF_SHM_METHOD_SYSV; method_name = "sysv"; break;
+            case 'M': method = DF_SHM_METHOD_MMAP; method_name = "mmap"; break;
+            case 'P': method = DF_SHM_METHOD_POSIX_SHM; method_name = "posix"; break;
+            case 'A': method = DF_SHM_METHOD_ANON; method_name = "anon"; break;
+            default:
+                print_usage(argv[0]);
+                return -1;
+        }
+        if(num_handles == 4) {
+            print_usage(argv[0]);
+            return -1;
+        }
+        df_shm_method_t handle = df_shm_init(method, &shm_config);
+        if(!handle) {
+            fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n", method, __FILE__, __LINE__);
+            return -1;
+        }
+        df_shm_handles[num_handles ++] = handle;
+        for(w = wait_modes; *w; w ++) {
+            char name[32];
+            enum WAIT_MODE wait_mode;
+            switch(*w) {
+                case 's': wait_mode = WAIT_SPIN; break;
+                case 'y': wait_mode = WAIT_YIELD; break;
+                case 'e': wait_mode = WAIT_EVENTFD; break;
+                default:
+                    print_usage(argv[0]);
+                    return -1;
+            }
+            snprintf(name, sizeof(name), "df-%s-%s", method_name,
+                wait_mode == WAIT_SPIN? "spin" : wait_mode == WAIT_YIELD? "yield" : "eventfd");
+            add_transport(name, TRANSPORT_DF_QUEUE, method, wait_mode, handle);
+        }
+    }
+    for(m = kernel_transports; *m; m ++) {
+        switch(*m) {
+            case 'p': add_transport("pipe", TRANSPORT_PIPE, 0, 0, NULL); break;
+            case 's': add_transport("unix-stream", TRANSPORT_STREAM, 0, 0, NULL); break;
+            case 'q': add_transport("unix-seqpacket", TRANSPORT_SEQPACKET, 0, 0, NULL); break;
+            case 'm': add_transport("mqueue", TRANSPORT_MQUEUE, 0, 0, NULL); break;
+            default:
+                print_usage(argv[0]);
+                return -1;
+        }
+    }
+
+    fprintf(stdout, "DataFabrics SHM Queue vs Kernel IPC Benchmark (%u slots)\n", num_slots);
+    fprintf(stdout, "%-*s%-*s%*s%*s%*s\n", 10, "# Size", 18, "Transport",
+        FIELD_WIDTH, "Latency (us)", FIELD_WIDTH, "GB/s", FIELD_WIDTH, "Msgs/s");
+    int rc = 0;
+    size_t msg_size;
+    for(msg_size = min_msg_size; msg_size <= max_msg_size && rc == 0; msg_size *= 4) {
+        int i;
+        for(i = 0; i < num_transports && rc == 0; i ++) {
+            rc = run_transport(&transports[i], msg_size);
+        }
+        fprintf(stdout, "\n");
+    }
+
+    int i;
+    for(i = 0; i < num_handles; i ++) {
+        df_shm_finalize(df_shm_handles[i]);
+    }
+    return rc;
+}
@@ -1,125 +1,193 @@
 /*
- * This test program benchmarks latency of DF's shm queue.
- * There are two processes and two queues between them.
- * The benchmark measures round-trip latency: the first 
- * process sends a message to the second process on one
- * queue, and then the second process sends back a message
- * to the first process on the other queue.
+ * This test program benchmarks streaming bandwidth of DF's shm queue.
+ * There are two processes and one queue between them. The producer
+ * enqueues messages back to back and the consumer drains them, either
+ * copying each payload out of the queue (default) or consuming it in
+ * place (zero-copy, -z). The consumer times the stream and reports
+ * GB/s and messages/s for every combination of shm method, number of
+ * slots and message size.
  *
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <time.h>
 #include <string.h>
-#include <mpi.h>
+#include "df_shm_bootstrap.h"
 #include "df_shm.h"
 #include "df_shm_queue.h"
 #include "df_config.h"
 
-#ifndef CHOSEN_SHM_METHOD
-#define CHOSEN_SHM_METHOD DF_SHM_METHOD_MMAP
-#endif
-#define FIELD_WIDTH 20
-#define FLOAT_PRECISION 2
+#define FIELD_WIDTH 14
+#define MAX_SLOT_COUNTS 16
 
 // test parameters
-enum DF_SHM_METHOD shm_method = CHOSEN_SHM_METHOD;
-size_t max_payload_size = 2048;
-size_t num_slots = 5;
-uint32_t num_msgs = 1000000;
-uint32_t num_msgs_skip = 1000;
+char methods[8] = "SMP";
+size_t min_msg_size = 1;
+size_t max_msg_size = 64UL * 1024 * 1024;
+uint32_t slot_counts[MAX_SLOT_COUNTS] = { 4, 16, 64 };
+int num_slot_counts = 3;
+size_t bytes_per_run = 1UL << 30;       // bytes streamed per configuration
+uint64_t min_msgs = 64;                 // but no fewer and no more messages than these
+uint64_t max_msgs = 1000000;
+size_t max_region_size = 1UL << 30;     // larger configurations are skipped
+int zero_copy = 0;
+// fault in regions up front so that page faults stay off the measured path
+df_shm_config shm_config = { DF_SHM_FLAG_POPULATE };
+
+df_bootstrap_t bootstrap;
+
+double wtime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
-void sender(size_t);
-void receiver(size_t);
+void producer(char, uint32_t, size_t, uint64_t);
+void consumer(char, uint32_t, size_t, uint64_t);
 
 void print_usage(char *program_name)
 {
-    fprintf(stderr, "Usage: %s shm_method\n"
-                    " shm_method can be one of the following three options\n"
+    fprintf(stderr, "Usage: %s [options] shm_methods\n"
+                    " shm_methods is one or more of the following letters, e.g. SMP\n"
                     " - S: System V shared memory\n"
                     " - M: mmap() backed by a file in /tmp\n"
-                    " - P: POSIX shared memory object\n",
+                    " - P: POSIX shared memory object\n"
+                    " options:\n"
+                    " -s size   smallest message size (default 1)\n"
+                    " -S size   largest message size (default 64M)\n"
+                    " -q n,n,.. numbers of queue slots (default 4,16,64)\n"
+                    " -b size   bytes streamed per configuration (default 1G)\n"
+                    " -n count  most messages streamed per configuration (default 1000000)\n"
+                    " -m size   skip configurations whose region exceeds size (default 1G)\n"
+                    " -z        consume messages in place instead of copying them out\n"
+                    " sizes may end with K, M or G\n",
                     program_name
            );
 }
 
-int main (int argc, char *argv[])
+size_t parse_size(const char *s)
 {
-    int rank, size;
-
-    MPI_Init (&argc, &argv);      
-    MPI_Comm_rank (MPI_COMM_WORLD, &rank);        
-    MPI_Comm_size (MPI_COMM_WORLD, &size);        
-    if(size != 2) {
-        fprintf(stderr, "The test requires 2 MPI processes.\n");    
-        MPI_Finalize();
-        return -1;
+    char *end;
+    size_t size = strtoul(s, &end, 10);
+    switch(*end) {
+        case 'G': case 'g': size <<= 10;
+        case 'M': case 'm': size <<= 10;
+        case 'K': case 'k': size <<= 10;
     }
+    return size;
+}
 
-    if(argc != 2) {
-        if(rank == 0) print_usage(argv[0]);
-        MPI_Finalize();
+enum DF_SHM_METHOD method_of(char c)
+{
+    switch(c) {
+        case 'S': return DF_SHM_METHOD_SYSV;
+        case 'M': return DF_SHM_METHOD_MMAP;
+        case 'P': return DF_SHM_METHOD_POSIX_SHM;
+        default: return -1;
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    int rank;
+
+    bootstrap = df_bootstrap_init(NULL, 2);
+    if(!bootstrap) {
+        fprintf(stderr, "The test requires 2 processes in a bootstrap group.\n");
         return -1;
     }
-    else {
-        if(!strcmp(argv[1], "S")) {
-            shm_method = DF_SHM_METHOD_SYSV;
-        }
-        else if(!strcmp(argv[1], "M")){
-            shm_method = DF_SHM_METHOD_MMAP;
-        }
-        else if(!strcmp(argv[1], "P")){
-            shm_method = DF_SHM_METHOD_POSIX_SHM;
-        }
-        else {
-            if(rank == 0) print_usage(argv[0]);
-            MPI_Finalize();
-            return -1;
+    rank = df_bootstrap_rank(bootstrap);
+
+    int opt;
+    char *s;
+    while((opt = getopt(argc, argv, "s:S:q:b:n:m:z")) != -1) {
+        switch(opt) {
+            case 's': min_msg_size = parse_size(optarg); break;
+            case 'S': max_msg_size = parse_size(optarg); break;
+            case 'b': bytes_per_run = parse_size(optarg); break;
+            case 'n': max_msgs = parse_size(optarg); break;
+            case 'm': max_region_size = parse_size(optarg); break;
+            case 'z': zero_copy = 1; break;
+            case 'q':
+                num_slot_counts = 0;
+                for(s = strtok(optarg, ","); s && num_slot_counts < MAX_SLOT_COUNTS; s = strtok(NULL, ",")) {
+                    slot_counts[num_slot_counts ++] = atoi(s);
+                }
+                break;
+            default:
+                if(rank == 0) print_usage(argv[0]);
+                df_bootstrap_finalize(bootstrap);
+                return -1;
         }
     }
-
-
-    if(rank == 0) {
-        fprintf(stdout, "DataFabrics SHM Queue Latency Benchmark\n");
-        fprintf(stdout, "%-*s%*s\n", 10, "# Size", FIELD_WIDTH, "Latency (us)");
+    if(optind != argc - 1 || strlen(argv[optind]) >= sizeof(methods) ||
+       strspn(argv[optind], "SMP") != strlen(argv[optind]) || min_msg_size == 0) {
+        if(rank == 0) print_usage(argv[0]);
+        df_bootstrap_finalize(bootstrap);
+        return -1;
+    }
+    strcpy(methods, argv[optind]);
+
+    // the consumer times the stream, so it prints the results
+    if(rank == 1) {
+        fprintf(stdout, "DataFabrics SHM Queue Bandwidth Benchmark (%s receive)\n",
+            zero_copy? "zero-copy" : "copy-out");
+        fprintf(stdout, "%-8s%*s%*s%*s%*s%*s\n", "# Method", 8, "Slots", FIELD_WIDTH, "Size",
+            FIELD_WIDTH, "Messages", FIELD_WIDTH, "GB/s", FIELD_WIDTH, "Msgs/s");
         fflush(stdout);
     }
 
+    char *m;
+    int q;
     size_t msg_size;
-    for(msg_size = 1; msg_size < max_payload_size; msg_size *= 2) {
-        if(rank == 0) {
-            sender(msg_size);
-        }
-        else {
-            receiver(msg_size);
+    for(m = methods; *m; m ++) {
+        for(q = 0; q < num_slot_counts; q ++) {
+            for(msg_size = min_msg_size; msg_size <= max_msg_size; msg_size *= 2) {
+                uint64_t num_msgs = bytes_per_run / msg_size;
+                if(num_msgs < min_msgs) num_msgs = min_msgs;
+                if(num_msgs > max_msgs) num_msgs = max_msgs;
+                if(df_calculate_queue_size(slot_counts[q], msg_size) > max_region_size) {
+                    if(rank == 1) {
+                        fprintf(stdout, "%-8c%*u%*lu%*s\n", *m, 8, slot_counts[q], FIELD_WIDTH,
+                            msg_size, FIELD_WIDTH, "skipped");
+                    }
+                    continue;
+                }
+                if(rank == 0) {
+                    producer(*m, slot_counts[q], msg_size, num_msgs);
+                }
+                else {
+                    consumer(*m, slot_counts[q], msg_size, num_msgs);
+                }
+            }
         }
     }
 
-    MPI_Finalize();
+    df_bootstrap_finalize(bootstrap);
     return 0;
 }
 
-void sender(size_t msg_size)
+df_shm_method_t init_method(enum DF_SHM_METHOD shm_method)
 {
-    static df_shm_method_t df_shm_handle = NULL;
-    static int first_time = 1;
-
-    if(first_time) {
-        // choose the underlying shm method
-        df_shm_handle = df_shm_init(shm_method, NULL);
-        if(!df_shm_handle) {
-            fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n", 
-                shm_method, __FILE__, __LINE__);
-            exit(-1);
-        }
-        first_time = 0;
+    df_shm_method_t df_shm_handle = df_shm_init(shm_method, &shm_config);
+    if(!df_shm_handle) {
+        fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n",
+            shm_method, __FILE__, __LINE__);
+        exit(-1);
     }
+    return df_shm_handle;
+}
+
+void producer(char method, uint32_t num_slots, size_t msg_size, uint64_t num_msgs)
+{
+    df_shm_method_t df_shm_handle = init_method(method_of(method));
 
-    // create a shm region and two FIFO queues in the region
-    // size of each shm region is calculated according to the queue size
-    size_t queue_size = df_calculate_queue_size(num_slots, max_payload_size);
-    size_t region_size = 2 * queue_size + 3 * sizeof(uint64_t); // meta-data at beginning
+    // the region holds just the queue
+    size_t region_size = df_calculate_queue_size(num_slots, msg_size);
     if(region_size % PAGE_SIZE) {
         region_size += PAGE_SIZE - (region_size % PAGE_SIZE);
     }
@@ -128,258 +196,135 @@ void sender(size_t msg_size)
         fprintf(stderr, "Cannot create region. %s:%d\n", __FILE__, __LINE__);
         exit(-1);
     }
+    df_queue_t queue = df_create_queue(shm_region->starting_addr, num_slots, msg_size);
+    df_queue_ep_t send_ep = df_get_queue_sender_ep(queue);
 
-    // the shm region is laid out in memory as follows:
-    // starting addr:
-    // creator pid (8 byte)
-    // starting offset to the starting address of send queue (8 byte)
-    // starting offset to the starting address of recv queue (8 byte)
-    // send queue (starting address cacheline aligned)
-    // recv queue (starting address cacheline aligned)
-    char *ptr = (char *) shm_region->starting_addr; // start of region, should be page-aligned
-    *((uint64_t *) ptr) = (uint64_t) shm_region->creator_id;
-    ptr += sizeof(uint64_t);
-    char *send_q_start = (char *) shm_region->starting_addr + 2 * sizeof(uint64_t);
-    if((uint64_t)send_q_start % CACHE_LINE_SIZE) {
-        send_q_start += CACHE_LINE_SIZE - ((uint64_t)send_q_start % CACHE_LINE_SIZE);
-    }
-    *((uint64_t *) ptr) = (uint64_t) (send_q_start - (char *) shm_region->starting_addr);
-    ptr += sizeof(uint64_t);
-    char *recv_q_start = send_q_start + queue_size;
-    if((uint64_t)recv_q_start % CACHE_LINE_SIZE) {
-        recv_q_start += CACHE_LINE_SIZE - ((uint64_t)recv_q_start % CACHE_LINE_SIZE);
-    }
-    *((uint64_t *) ptr) = (uint64_t) (recv_q_start - (char *) shm_region->starting_addr);
-    
-    //printf("Sender: pid: %d. send q start %lu. recv queue start %lu\n",
-    //    shm_region->creator_id, 
-    //    send_q_start - (char *) shm_region->starting_addr, 
-    //    recv_q_start - (char *) shm_region->starting_addr
-    //    );
-
-    // send queue is for this process to send data to target process
-    df_queue_t send_q = df_create_queue (send_q_start, num_slots, max_payload_size);
-    df_queue_ep_t send_ep = df_get_queue_sender_ep(send_q);
-
-    // recv queue is for this process to receive data sent by target process
-    df_queue_t recv_q = df_create_queue (recv_q_start, num_slots, max_payload_size);
-    df_queue_ep_t recv_ep = df_get_queue_receiver_ep(recv_q);
-
-    // generate shm region contact info
+    // send the contact info to the consumer through the bootstrap service
     int contact_length;
-    void *contact_info;
-    contact_info = df_shm_region_contact_info(df_shm_handle, shm_region, &contact_length);
+    void *contact_info = df_shm_region_contact_info(df_shm_handle, shm_region, &contact_length);
     if(!contact_info) {
         fprintf(stderr, "Cannot create contact info for shm region. %s:%d\n",
             __FILE__, __LINE__);
         exit(-1);
     }
+    pid_t creator_pid = shm_region->creator_id;
+    df_bootstrap_send(bootstrap, 1, &contact_length, sizeof(contact_length));
+    df_bootstrap_send(bootstrap, 1, contact_info, contact_length);
+    df_bootstrap_send(bootstrap, 1, &creator_pid, sizeof(creator_pid));
+    df_bootstrap_send(bootstrap, 1, &region_size, sizeof(region_size));
 
-    // send the contact info to receiver side through external mechanism
-    // in this case, we use MPI
-    int sender_pid = getpid();
-    MPI_Send(&contact_length, 1, MPI_INT, 1, 0, MPI_COMM_WORLD);
-    MPI_Send(contact_info, contact_length, MPI_BYTE, 1, 0, MPI_COMM_WORLD);
-    MPI_Send(&sender_pid, 1, MPI_INT, 1, 1, MPI_COMM_WORLD);
-    MPI_Send(&region_size, 1, MPI_INT, 1, 2, MPI_COMM_WORLD);
-
-    ///////////////////////////////////////////////////
-    // start exchange data and benchmark
-    ///////////////////////////////////////////////////
-
-    uint32_t i;
-    void *recv_msg;
-    size_t recv_length;
-    double start_time = 0, end_time = 0;
-    
-    char *send_buf, *recv_buf;
+    char *send_buf;
     if(posix_memalign((void **)&send_buf, PAGE_SIZE, msg_size) != 0) {
         fprintf(stderr, "Cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         exit(-1);
     }
-    if(posix_memalign((void **)&recv_buf, PAGE_SIZE, msg_size) != 0) {
-        fprintf(stderr, "Cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
-        exit(-1);
-    }
-    
-    // touch the data
-    size_t j;
-    for(j = 0; j < msg_size; j ++) {
-        send_buf[j] = 'a';
-        recv_buf[j] = 'a';
-    }
+    memset(send_buf, 'a', msg_size);
 
-    MPI_Barrier(MPI_COMM_WORLD);
+    df_bootstrap_barrier(bootstrap);
 
-    // send-recv loop
-    for(i = 0; i < num_msgs+num_msgs_skip; i ++) {
-        // skip the first few msgs
-        if(i == num_msgs_skip) {
-            start_time = MPI_Wtime();
+    // stream back to back; messages of 8 bytes or more carry their sequence number
+    uint64_t i;
+    for(i = 0; i < num_msgs; i ++) {
+        if(msg_size >= sizeof(uint64_t)) {
+            *(uint64_t *) send_buf = i;
         }
-        // send
         df_enqueue(send_ep, send_buf, msg_size);
-
-        // recv
-        df_dequeue(recv_ep, &recv_msg, &recv_length);
-        memcpy(recv_buf, recv_msg, msg_size);
-        df_release(recv_ep);
     }
-    end_time = MPI_Wtime();
-
-    double latency = (end_time - start_time) * 1e6 / (2.0 * num_msgs);
-    fprintf(stdout, "%-*lu%*.*f\n", 10, msg_size, FIELD_WIDTH,
-        FLOAT_PRECISION, latency);
-    fflush(stdout);
 
-    // sync with receiver so both are done with data exchange
-    // wait for receiver to detach
-    MPI_Barrier(MPI_COMM_WORLD);
+    // wait for the consumer to drain the queue and detach
+    df_bootstrap_barrier(bootstrap);
 
-    // destroy queue
     df_destroy_ep(send_ep);
-    df_destroy_queue(send_q);
-    df_destroy_ep(recv_ep);
-    df_destroy_queue(recv_q);
-
-    // destroy the shm region
+    df_destroy_queue(queue);
     if(df_destroy_shm_region(shm_region) != 0) {
         fprintf(stderr, "Cannot destory shm region. %s:%d\n",
             __FILE__, __LINE__);
         exit(-1);
     }
+    free(send_buf);
     free(contact_info);
-    if(msg_size == max_payload_size) {
-        df_shm_finalize(df_shm_handle);
-    }
-    return;
+    df_shm_finalize(df_shm_handle);
 }
 
-
-void receiver(size_t msg_size)
+void consumer(char method, uint32_t num_slots, size_t msg_size, uint64_t num_msgs)
 {
-    static df_shm_method_t df_shm_handle = NULL;
-    static int first_time = 1;
-
-    if(first_time) {
-        // choose the underlying shm method
-        df_shm_handle = df_shm_init(shm_method, NULL);
-        if(!df_shm_handle) {
-            fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n",
-                shm_method, __FILE__, __LINE__);
-            exit(-1);
-        }
-        first_time = 0;
-    }
+    df_shm_method_t df_shm_handle = init_method(method_of(method));
 
-    // wait for sender to tell me the contact info of shm region
-    MPI_Status status;
+    // wait for the producer to tell me the contact info of shm region
     int contact_length;
-    void *contact_info;
     pid_t creator_pid;
-    int region_size;
-    int rc = MPI_Recv(&contact_length, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &status);
-    if(rc != MPI_SUCCESS) {
-        fprintf(stderr, "MPI_Recv error: %d. %s:%d\n", rc, __FILE__, __LINE__);
-        exit(-1); 
+    size_t region_size;
+    if(df_bootstrap_recv(bootstrap, 0, &contact_length, sizeof(contact_length)) != 0) {
+        exit(-1);
     }
-    contact_info = malloc(contact_length);
+    void *contact_info = malloc(contact_length);
     if(!contact_info) {
         fprintf(stderr, "Cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         exit(-1);
     }
-    rc = MPI_Recv(contact_info, contact_length, MPI_BYTE, 0, 0, MPI_COMM_WORLD, &status);
-    if(rc != MPI_SUCCESS) {
-        fprintf(stderr, "MPI_Recv error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+    if(df_bootstrap_recv(bootstrap, 0, contact_info, contact_length) != 0 ||
+       df_bootstrap_recv(bootstrap, 0, &creator_pid, sizeof(creator_pid)) != 0 ||
+       df_bootstrap_recv(bootstrap, 0, &region_size, sizeof(region_size)) != 0) {
         exit(-1);
     }
-    rc = MPI_Recv(&creator_pid, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, &status);
-    if(rc != MPI_SUCCESS) {
-        fprintf(stderr, "MPI_Recv error: %d. %s:%d\n", rc, __FILE__, __LINE__);
-        exit(-1);
-    }
-    rc = MPI_Recv(&region_size, 1, MPI_INT, 0, 2, MPI_COMM_WORLD, &status);
-    if(rc != MPI_SUCCESS) {
-        fprintf(stderr, "MPI_Recv error: %d. %s:%d\n", rc, __FILE__, __LINE__);
-        exit(-1);
-    }
-
-    // attach the region
-    df_shm_region_t shm_region = df_attach_shm_region (df_shm_handle, creator_pid,
+    df_shm_region_t shm_region = df_attach_shm_region(df_shm_handle, creator_pid,
         contact_info, region_size, NULL);
     if(!shm_region) {
         fprintf(stderr, "Cannot attach shm region. %s:%d\n", __FILE__, __LINE__);
         exit(-1);
     }
-       
-    // locate queues in shm region
-    uint64_t *sender_pid = (uint64_t *) shm_region->starting_addr;
-    uint64_t *send_q_start = ((uint64_t *) shm_region->starting_addr + 1);
-    uint64_t *recv_q_start = ((uint64_t *) shm_region->starting_addr + 2);
-
-    // setup local queue endpoints
-    // Note: the receiver is receving end of send queue and sending end of recv queue
-    df_queue_t send_q = (df_queue_t)((char *)shm_region->starting_addr + *send_q_start);
-    df_queue_ep_t recv_ep = df_get_queue_receiver_ep(send_q);
-    df_queue_t recv_q = (df_queue_t)((char *)shm_region->starting_addr + *recv_q_start);
-    df_queue_ep_t send_ep = df_get_queue_sender_ep(recv_q);
+    df_queue_t queue = (df_queue_t) shm_region->starting_addr;
+    df_queue_ep_t recv_ep = df_get_queue_receiver_ep(queue);
 
-
-    ///////////////////////////////////////////////////
-    // start exchange data and benchmark
-    ///////////////////////////////////////////////////
-
-    uint32_t i;
-    void *recv_msg;
-    size_t recv_length;
-    double start_time = 0, end_time = 0;
-
-    char *send_buf, *recv_buf;
-    if(posix_memalign((void **)&send_buf, PAGE_SIZE, msg_size) != 0) {
-        fprintf(stderr, "Cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
-        exit(-1);
-    }
+    char *recv_buf;
     if(posix_memalign((void **)&recv_buf, PAGE_SIZE, msg_size) != 0) {
         fprintf(stderr, "Cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         exit(-1);
     }
+    memset(recv_buf, 'b', msg_size);
 
-    // touch the data
-    size_t j;
-    for(j = 0; j < msg_size; j ++) {
-        send_buf[j] = 'b';
-        recv_buf[j] = 'b';
-    }
+    // time from the end of a short warm-up to the last message
+    uint64_t num_msgs_skip = num_msgs / 8 < 1000? num_msgs / 8 : 1000;
+    double start_time = 0, end_time = 0;
+    uint64_t i;
+    void *recv_msg;
+    size_t recv_length;
 
-    MPI_Barrier(MPI_COMM_WORLD);
+    df_bootstrap_barrier(bootstrap);
 
-    // send-recv loop
-    for(i = 0; i < num_msgs+num_msgs_skip; i ++) {
-        // recv
+    for(i = 0; i < num_msgs; i ++) {
+        if(i == num_msgs_skip) {
+            start_time = wtime();
+        }
         df_dequeue(recv_ep, &recv_msg, &recv_length);
-        memcpy(recv_buf, recv_msg, msg_size);
+        if(recv_length != msg_size ||
+           (msg_size >= sizeof(uint64_t) && *(uint64_t *) recv_msg != i)) {
+            fprintf(stderr, "Message %lu is out of order. %s:%d\n", i, __FILE__, __LINE__);
+            exit(-1);
+        }
+        if(!zero_copy) {
+            memcpy(recv_buf, recv_msg, msg_size);
+        }
         df_release(recv_ep);
-
-        // send
-        df_enqueue(send_ep, send_buf, msg_size);
     }
+    end_time = wtime();
+
+    double seconds = end_time - start_time;
+    uint64_t timed_msgs = num_msgs - num_msgs_skip;
+    fprintf(stdout, "%-8c%*u%*lu%*lu%*.3f%*.0f\n", method, 8, num_slots, FIELD_WIDTH, msg_size,
+        FIELD_WIDTH, num_msgs, FIELD_WIDTH, timed_msgs * msg_size / seconds / 1e9,
+        FIELD_WIDTH, timed_msgs / seconds);
+    fflush(stdout);
 
-    // cleanup queue eps
-    df_destroy_ep(send_ep);
     df_destroy_ep(recv_ep);
-    
-    // detach the shm region
     if(df_detach_shm_region(shm_region) != 0) {
         fprintf(stderr, "Cannot detach shm region. %s:%d\n", __FILE__, __LINE__);
         exit(-1);
     }
 
-    // tell sender we have detached the region
-    MPI_Barrier(MPI_COMM_WORLD);
+    // tell the producer we have detached the region
+    df_bootstrap_barrier(bootstrap);
+    free(recv_buf);
     free(contact_info);
-    if(msg_size == max_payload_size) {
-        df_shm_finalize(df_shm_handle);
-    }
-    return;
+    df_shm_finalize(df_shm_handle);
 }
-
@@ -6,21 +6,38 @@
  * queue, and then the second process sends back a message
  * to the first process on the other queue.
  *
+ * Every round trip is timed on its own with the cpu's cycle counter, which is
+ * calibrated against CLOCK_MONOTONIC at start-up, into a buffer allocated and
+ * touched before the timed loop, so the loop neither allocates nor makes system
+ * calls. Besides the mean, the minimum, median, 90th, 99th and 99.9th percentile
+ * and maximum are reported, all as one-way latency (half the round trip time).
+ * The sorted samples can be dumped as a histogram with -H.
+ *
+ * With -P the two processes pin themselves to a pair of cpus with the given
+ * relation (SMT siblings, cores sharing an L3, ...), found from the cpu topology,
+ * and the results are labeled with it; with -m the sweep is run on one pair of
+ * each relation the machine has in turn. Otherwise placement is left to the OS.
+ *
  */
 
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <time.h>
 #include <string.h>
-#include <mpi.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "df_shm_bootstrap.h"
 #include "df_shm.h"
 #include "df_shm_queue.h"
+#include "df_shm_topology.h"
 #include "df_config.h"
 
 #ifndef CHOSEN_SHM_METHOD
 #define CHOSEN_SHM_METHOD DF_SHM_METHOD_MMAP
 #endif
-#define FIELD_WIDTH 20
+#define FIELD_WIDTH 12
 #define FLOAT_PRECISION 2
 
 // test parameters
@@ -29,74 +46,264 @@ size_t max_payload_size = 2048;
 size_t num_slots = 5;
 uint32_t num_msgs = 1000000;
 uint32_t num_msgs_skip = 1000;
+const char *histogram_file = NULL;
+int placement = -1;
+int placement_matrix = 0;         // run every relation the machine has
+// fault in and lock regions up front so that page faults stay off the measured path
+df_shm_config shm_config = { DF_SHM_FLAG_POPULATE | DF_SHM_FLAG_MLOCK };
+
+df_bootstrap_t bootstrap;
+double ns_per_tick = 1.0;
+
+double wtime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Read the cycle counter: the time stamp counter on x86, the virtual counter on
+ * aarch64, and CLOCK_MONOTONIC (through the vDSO) elsewhere. The read is fenced
+ * on both sides so that it is not reordered with the queue operations it times.
+ */
+static inline uint64_t read_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_lfence();
+    uint64_t ticks = __rdtsc();
+    _mm_lfence();
+    return ticks;
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ __volatile__ ("isb\n\tmrs %0, cntvct_el0\n\tisb" : "=r" (ticks) : : "memory");
+    return ticks;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/*
+ * Measure the length of a tick against CLOCK_MONOTONIC over 100 ms.
+ */
+void calibrate_ticks()
+{
+    double start_time = wtime(), end_time;
+    uint64_t start_ticks = read_ticks(), end_ticks;
+    do {
+        end_time = wtime();
+        end_ticks = read_ticks();
+    } while(end_time - start_time < 0.1);
+    ns_per_tick = (end_time - start_time) * 1e9 / (end_ticks - start_ticks);
+}
+
+int compare_ticks(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y? -1 : x > y;
+}
+
+/*
+ * Return the one-way latency in us at quantile q of n sorted round trip times.
+ */
+double percentile(uint64_t *samples, uint32_t n, double q)
+{
+    uint32_t rank = (uint32_t) (q * n + 0.999999);
+    if(rank > 0) rank --;
+    if(rank >= n) rank = n - 1;
+    return samples[rank] * ns_per_tick / 2e3;
+}
+
+/*
+ * Append the histogram of n sorted round trip times to histogram_file: one line
+ * per distinct one-way latency in ns, with the number of samples.
+ */
+void dump_histogram(size_t msg_size, uint64_t *samples, uint32_t n)
+{
+    FILE *f = fopen(histogram_file, "a");
+    if(!f) {
+        fprintf(stderr, "Cannot open %s. %s:%d\n", histogram_file, __FILE__, __LINE__);
+        return;
+    }
+    fprintf(f, "# Size %lu: latency (ns) count\n", msg_size);
+    uint32_t i = 0;
+    while(i < n) {
+        uint64_t ns = (uint64_t) (samples[i] * ns_per_tick / 2);
+        uint32_t count = 0;
+        while(i < n && (uint64_t) (samples[i] * ns_per_tick / 2) == ns) {
+            count ++;
+            i ++;
+        }
+        fprintf(f, "%lu %u\n", ns, count);
+    }
+    fclose(f);
+}
 
 void sender(size_t);
 void receiver(size_t);
 
 void print_usage(char *program_name)
 {
-    fprintf(stderr, "Usage: %s shm_method\n"
-                    " shm_method can be one of the following three options\n"
+    fprintf(stderr, "Usage: %s [options] shm_method\n"
+                    " shm_method can be one of the following four options\n"
                     " - S: System V shared memory\n"
                     " - M: mmap() backed by a file in /tmp\n"
-                    " - P: POSIX shared memory object\n",
+                    " - P: POSIX shared memory object\n"
+                    " - F: memfd passed over a Unix domain socket\n"
+                    " options:\n"
+                    " -n count  round trips timed per message size (default 1000000)\n"
+                    " -H file   append the latency histogram of every message size to file\n"
+                    " -P name   pin the processes to two cpus with relation name: same-cpu,\n"
+                    "           smt-sibling, same-l3, cross-l3 or cross-socket\n"
+                    " -m        run on one pair of cpus of each relation the machine has\n",
                     program_name
            );
 }
 
+/*
+ * Pin this process to its cpu of a pair of the given relation (unless it is
+ * negative) and run the benchmark for every message size. Return 0 on success
+ * and -1 if the processes cannot be placed.
+ */
+int run_placement(int rank, int relation)
+{
+    // both processes see the same topology and pick the same pair of cpus
+    char placement_label[64] = "placed by the OS";
+    if(relation >= 0) {
+        int cpus[2];
+        df_topology_t topology = df_topology_discover();
+        if(!topology || df_topology_find_pair(topology, relation, &cpus[0], &cpus[1]) != 0 ||
+           df_pin_thread(cpus[rank]) != 0) {
+            if(rank == 0) {
+                fprintf(stderr, "Cannot place processes on cpus of relation %s. %s:%d\n",
+                    df_placement_name(relation), __FILE__, __LINE__);
+            }
+            df_topology_free(topology);
+            return -1;
+        }
+        snprintf(placement_label, sizeof(placement_label), "%s: cpus %d and %d",
+            df_placement_name(relation), cpus[0], cpus[1]);
+        df_topology_free(topology);
+    }
+
+    if(rank == 0) {
+        fprintf(stdout, "DataFabrics SHM Queue Latency Benchmark (one-way latency in us, %s)\n",
+            placement_label);
+        fprintf(stdout, "%-*s%*s%*s%*s%*s%*s%*s%*s\n", 10, "# Size", FIELD_WIDTH, "Avg",
+            FIELD_WIDTH, "Min", FIELD_WIDTH, "P50", FIELD_WIDTH, "P90", FIELD_WIDTH, "P99",
+            FIELD_WIDTH, "P99.9", FIELD_WIDTH, "Max");
+        fflush(stdout);
+    }
+
+    size_t msg_size;
+    for(msg_size = 1; msg_size < max_payload_size; msg_size *= 2) {
+        if(rank == 0) {
+            sender(msg_size);
+        }
+        else {
+            receiver(msg_size);
+        }
+    }
+    return 0;
+}
+
 int main (int argc, char *argv[])
 {
-    int rank, size;
-
-    MPI_Init (&argc, &argv);      
-    MPI_Comm_rank (MPI_COMM_WORLD, &rank);        
-    MPI_Comm_size (MPI_COMM_WORLD, &size);        
-    if(size != 2) {
-        fprintf(stderr, "The test requires 2 MPI processes.\n");    
-        MPI_Finalize();
+    int rank;
+
+    bootstrap = df_bootstrap_init(NULL, 2);
+    if(!bootstrap) {
+        fprintf(stderr, "The test requires 2 processes in a bootstrap group.\n");
         return -1;
     }
-
-    if(argc != 2) {
+    rank = df_bootstrap_rank(bootstrap);
+
+    int opt;
+    while((opt = getopt(argc, argv, "n:H:P:m")) != -1) {
+        switch(opt) {
+            case 'n': num_msgs = strtoul(optarg, NULL, 0); break;
+            case 'H': histogram_file = optarg; break;
+            case 'P':
+                placement = df_placement_from_name(optarg);
+                if(placement < 0) {
+                    if(rank == 0) print_usage(argv[0]);
+                    df_bootstrap_finalize(bootstrap);
+                    return -1;
+                }
+                break;
+            case 'm': placement_matrix = 1; break;
+            default:
+                if(rank == 0) print_usage(argv[0]);
+                df_bootstrap_finalize(bootstrap);
+                return -1;
+        }
+    }
+    if(optind != argc - 1 || num_msgs == 0 || (placement >= 0 && placement_matrix)) {
         if(rank == 0) print_usage(argv[0]);
-        MPI_Finalize();
+        df_bootstrap_finalize(bootstrap);
         return -1;
     }
     else {
-        if(!strcmp(argv[1], "S")) {
+        const char *method = argv[optind];
+        if(!strcmp(method, "S")) {
             shm_method = DF_SHM_METHOD_SYSV;
         }
-        else if(!strcmp(argv[1], "M")){
+        else if(!strcmp(method, "M")){
             shm_method = DF_SHM_METHOD_MMAP;
         }
-        else if(!strcmp(argv[1], "P")){
+        else if(!strcmp(method, "P")){
             shm_method = DF_SHM_METHOD_POSIX_SHM;
         }
+        else if(!strcmp(method, "F")){
+            shm_method = DF_SHM_METHOD_MEMFD;
+        }
         else {
             if(rank == 0) print_usage(argv[0]);
-            MPI_Finalize();
+            df_bootstrap_finalize(bootstrap);
             return -1;
         }
     }
 
-
     if(rank == 0) {
-        fprintf(stdout, "DataFabrics SHM Queue Latency Benchmark\n");
-        fprintf(stdout, "%-*s%*s\n", 10, "# Size", FIELD_WIDTH, "Latency (us)");
-        fflush(stdout);
+        calibrate_ticks();
     }
-
-    size_t msg_size;
-    for(msg_size = 1; msg_size < max_payload_size; msg_size *= 2) {
-        if(rank == 0) {
-            sender(msg_size);
+    if(!placement_matrix) {
+        if(run_placement(rank, placement) != 0) {
+            df_bootstrap_finalize(bootstrap);
+            return -1;
         }
-        else {
-            receiver(msg_size);
+    }
+    else {
+        // both processes see the same topology and skip the same relations
+        df_topology_t topology = df_topology_discover();
+        if(!topology) {
+            if(rank == 0) {
+                fprintf(stderr, "Cannot discover the cpu topology. %s:%d\n", __FILE__, __LINE__);
+            }
+            df_bootstrap_finalize(bootstrap);
+            return -1;
+        }
+        int p, cpus[2];
+        // two processes spinning on one cpu say little about the machine; leave it out
+        for(p = DF_PLACEMENT_SMT_SIBLING; p < DF_NUM_PLACEMENTS; p ++) {
+            if(df_topology_find_pair(topology, p, &cpus[0], &cpus[1]) != 0) {
+                if(rank == 0) {
+                    fprintf(stdout, "# no two cpus of relation %s\n", df_placement_name(p));
+                }
+                continue;
+            }
+            if(run_placement(rank, p) != 0) {
+                df_topology_free(topology);
+                df_bootstrap_finalize(bootstrap);
+                return -1;
+            }
         }
+        df_topology_free(topology);
     }
 
-    MPI_Finalize();
+    df_bootstrap_finalize(bootstrap);
     return 0;
 }
 
@@ -107,7 +314,7 @@ void sender(size_t msg_size)
 
     if(first_time) {
         // choose the underlying shm method
-        df_shm_handle = df_shm_init(shm_method, NULL);
+        df_shm_handle = df_shm_init(shm_method, &shm_config);
         if(!df_shm_handle) {
             fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n", 
                 shm_method, __FILE__, __LINE__);
@@ -176,12 +383,12 @@ void sender(size_t msg_size)
     }
 
     // send the contact info to receiver side through external mechanism
-    // in this case, we use MPI
+    // in this case, we use the bootstrap service
     int sender_pid = getpid();
-    MPI_Send(&contact_length, 1, MPI_INT, 1, 0, MPI_COMM_WORLD);
-    MPI_Send(contact_info, contact_length, MPI_BYTE, 1, 0, MPI_COMM_WORLD);
-    MPI_Send(&sender_pid, 1, MPI_INT, 1, 1, MPI_COMM_WORLD);
-    MPI_Send(&region_size, 1, MPI_INT, 1, 2, MPI_COMM_WORLD);
+    df_bootstrap_send(bootstrap, 1, &contact_length, sizeof(contact_length));
+    df_bootstrap_send(bootstrap, 1, contact_info, contact_length);
+    df_bootstrap_send(bootstrap, 1, &sender_pid, sizeof(sender_pid));
+    df_bootstrap_send(bootstrap, 1, &region_size, sizeof(region_size));
 
     ///////////////////////////////////////////////////
     // start exchange data and benchmark
@@ -209,14 +416,24 @@ void sender(size_t msg_size)
         recv_buf[j] = 'a';
     }
 
-    MPI_Barrier(MPI_COMM_WORLD);
+    // one sample per timed round trip, faulted in before the loop
+    uint64_t *samples = (uint64_t *) malloc(num_msgs * sizeof(uint64_t));
+    if(!samples) {
+        fprintf(stderr, "Cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    memset(samples, 0, num_msgs * sizeof(uint64_t));
+
+    df_bootstrap_barrier(bootstrap);
 
     // send-recv loop
+    uint64_t start_ticks;
     for(i = 0; i < num_msgs+num_msgs_skip; i ++) {
         // skip the first few msgs
         if(i == num_msgs_skip) {
-            start_time = MPI_Wtime();
+            start_time = wtime();
         }
+        start_ticks = read_ticks();
         // send
         df_enqueue(send_ep, send_buf, msg_size);
 
@@ -224,17 +441,31 @@ void sender(size_t msg_size)
         df_dequeue(recv_ep, &recv_msg, &recv_length);
         memcpy(recv_buf, recv_msg, msg_size);
         df_release(recv_ep);
+        if(i >= num_msgs_skip) {
+            samples[i - num_msgs_skip] = read_ticks() - start_ticks;
+        }
     }
-    end_time = MPI_Wtime();
+    end_time = wtime();
 
+    qsort(samples, num_msgs, sizeof(uint64_t), compare_ticks);
     double latency = (end_time - start_time) * 1e6 / (2.0 * num_msgs);
-    fprintf(stdout, "%-*lu%*.*f\n", 10, msg_size, FIELD_WIDTH,
-        FLOAT_PRECISION, latency);
+    fprintf(stdout, "%-*lu%*.*f%*.*f%*.*f%*.*f%*.*f%*.*f%*.*f\n", 10, msg_size,
+        FIELD_WIDTH, FLOAT_PRECISION, latency,
+        FIELD_WIDTH, FLOAT_PRECISION, percentile(samples, num_msgs, 0),
+        FIELD_WIDTH, FLOAT_PRECISION, percentile(samples, num_msgs, 0.5),
+        FIELD_WIDTH, FLOAT_PRECISION, percentile(samples, num_msgs, 0.9),
+        FIELD_WIDTH, FLOAT_PRECISION, percentile(samples, num_msgs, 0.99),
+        FIELD_WIDTH, FLOAT_PRECISION, percentile(samples, num_msgs, 0.999),
+        FIELD_WIDTH, FLOAT_PRECISION, percentile(samples, num_msgs, 1));
     fflush(stdout);
+    if(histogram_file) {
+        dump_histogram(msg_size, samples, num_msgs);
+    }
+    free(samples);
 
     // sync with receiver so both are done with data exchange
     // wait for receiver to detach
-    MPI_Barrier(MPI_COMM_WORLD);
+    df_bootstrap_barrier(bootstrap);
 
     // destroy queue
     df_destroy_ep(send_ep);
@@ -263,7 +494,7 @@ void receiver(size_t msg_size)
 
     if(first_time) {
         // choose the underlying shm method
-        df_shm_handle = df_shm_init(shm_method, NULL);
+        df_shm_handle = df_shm_init(shm_method, &shm_config);
         if(!df_shm_handle) {
             fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n",
                 shm_method, __FILE__, __LINE__);
@@ -273,14 +504,13 @@ void receiver(size_t msg_size)
     }
 
     // wait for sender to tell me the contact info of shm region
-    MPI_Status status;
     int contact_length;
     void *contact_info;
     pid_t creator_pid;
-    int region_size;
-    int rc = MPI_Recv(&contact_length, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &status);
-    if(rc != MPI_SUCCESS) {
-        fprintf(stderr, "MPI_Recv error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+    size_t region_size;
+    int rc = df_bootstrap_recv(bootstrap, 0, &contact_length, sizeof(contact_length));
+    if(rc != 0) {
+        fprintf(stderr, "Bootstrap receive error: %d. %s:%d\n", rc, __FILE__, __LINE__);
         exit(-1); 
     }
     contact_info = malloc(contact_length);
@@ -288,19 +518,19 @@ void receiver(size_t msg_size)
         fprintf(stderr, "Cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         exit(-1);
     }
-    rc = MPI_Recv(contact_info, contact_length, MPI_BYTE, 0, 0, MPI_COMM_WORLD, &status);
-    if(rc != MPI_SUCCESS) {
-        fprintf(stderr, "MPI_Recv error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+    rc = df_bootstrap_recv(bootstrap, 0, contact_info, contact_length);
+    if(rc != 0) {
+        fprintf(stderr, "Bootstrap receive error: %d. %s:%d\n", rc, __FILE__, __LINE__);
         exit(-1);
     }
-    rc = MPI_Recv(&creator_pid, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, &status);
-    if(rc != MPI_SUCCESS) {
-        fprintf(stderr, "MPI_Recv error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+    rc = df_bootstrap_recv(bootstrap, 0, &creator_pid, sizeof(creator_pid));
+    if(rc != 0) {
+        fprintf(stderr, "Bootstrap receive error: %d. %s:%d\n", rc, __FILE__, __LINE__);
         exit(-1);
     }
-    rc = MPI_Recv(&region_size, 1, MPI_INT, 0, 2, MPI_COMM_WORLD, &status);
-    if(rc != MPI_SUCCESS) {
-        fprintf(stderr, "MPI_Recv error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+    rc = df_bootstrap_recv(bootstrap, 0, &region_size, sizeof(region_size));
+    if(rc != 0) {
+        fprintf(stderr, "Bootstrap receive error: %d. %s:%d\n", rc, __FILE__, __LINE__);
         exit(-1);
     }
 
@@ -313,7 +543,6 @@ void receiver(size_t msg_size)
     }
        
     // locate queues in shm region
-    uint64_t *sender_pid = (uint64_t *) shm_region->starting_addr;
     uint64_t *send_q_start = ((uint64_t *) shm_region->starting_addr + 1);
     uint64_t *recv_q_start = ((uint64_t *) shm_region->starting_addr + 2);
 
@@ -332,7 +561,6 @@ void receiver(size_t msg_size)
     uint32_t i;
     void *recv_msg;
     size_t recv_length;
-    double start_time = 0, end_time = 0;
 
     char *send_buf, *recv_buf;
     if(posix_memalign((void **)&send_buf, PAGE_SIZE, msg_size) != 0) {
@@ -351,7 +579,7 @@ void receiver(size_t msg_size)
         recv_buf[j] = 'b';
     }
 
-    MPI_Barrier(MPI_COMM_WORLD);
+    df_bootstrap_barrier(bootstrap);
 
     // send-recv loop
     for(i = 0; i < num_msgs+num_msgs_skip; i ++) {
@@ -375,7 +603,7 @@ void receiver(size_t msg_size)
     }
 
     // tell sender we have detached the region
-    MPI_Barrier(MPI_COMM_WORLD);
+    df_bootstrap_barrier(bootstrap);
     free(contact_info);
     if(msg_size == max_payload_size) {
         df_shm_finalize(df_shm_handle);
@@ -0,0 +1,352 @@
+/*
+ * This test program benchmarks how shm queue pairs interfere with each other.
+ * N producer/consumer pairs of processes are forked, each pair with a queue in
+ * each direction. All pairs first stream messages producer to consumer at the
+ * same time, then measure ping-pong round trips at the same time. The run is
+ * repeated for N = 1, 2, 4, ... up to the given number of pairs, and aggregate
+ * and per-pair throughput and latency are reported. By default every pair has
+ * its own region; with -1 all queues are packed back to back into one region
+ * to expose false sharing and prefetcher effects between neighbouring queues.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "df_shm.h"
+#include "df_shm_queue.h"
+#include "df_config.h"
+
+#define FIELD_WIDTH 14
+#define FLOAT_PRECISION 3
+
+// test parameters
+enum DF_SHM_METHOD shm_method = DF_SHM_METHOD_ANON;
+int max_pairs = 0;                // 0: half the online cpus, so every process has one
+size_t msg_size = 64;
+uint32_t num_slots = 16;
+uint64_t num_msgs = 1000000;
+uint64_t num_round_trips = 10000;
+int single_region = 0;
+int verbose = 0;
+
+/*
+ * what each pair measured
+ */
+typedef struct _pair_result {
+    double stream_start;          // consumer's clock around the stream
+    double stream_end;
+    double rtt_sum;               // round trip times in seconds
+    double rtt_max;
+    int failed;
+} pair_result;
+
+/*
+ * memory shared by the parent and all children
+ */
+typedef struct _control {
+    uint32_t arrived;             // barrier of all children
+    uint32_t generation;
+    pair_result results[0];
+} control;
+
+control *ctl;
+
+void print_usage(char *program_name)
+{
+    fprintf(stderr, "Usage: %s [options] shm_method\n"
+                    " shm_method can be one of the following options\n"
+                    " - S: System V shared memory\n"
+                    " - M: mmap() backed by a file in /tmp\n"
+                    " - P: POSIX shared memory object\n"
+                    " - A: anonymous shared mapping\n"
+                    " options:\n"
+                    " -N pairs  largest number of pairs (default half the online cpus)\n"
+                    " -s size   message size in bytes (default 64)\n"
+                    " -q slots  number of queue slots (default 16)\n"
+                    " -n count  messages streamed per pair (default 1000000)\n"
+                    " -r count  round trips per pair (default 10000)\n"
+                    " -1        pack all queues into one region\n"
+                    " -v        print the results of every pair\n",
+                    program_name
+           );
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+/*
+ * Wait until all num_procs children have arrived. Waiting yields the cpu so that
+ * oversubscribed runs make progress.
+ */
+void barrier(int num_procs)
+{
+    uint32_t generation = __atomic_load_n(&ctl->generation, __ATOMIC_ACQUIRE);
+    if(__atomic_add_fetch(&ctl->arrived, 1, __ATOMIC_ACQ_REL) == (uint32_t) num_procs) {
+        __atomic_store_n(&ctl->arrived, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&ctl->generation, generation + 1, __ATOMIC_RELEASE);
+        return;
+    }
+    while(__atomic_load_n(&ctl->generation, __ATOMIC_ACQUIRE) == generation) {
+        sched_yield();
+    }
+}
+
+void producer(df_queue_t fwd_q, df_queue_t rev_q, pair_result *result, int num_procs)
+{
+    df_queue_ep_t send_ep = df_get_queue_sender_ep(fwd_q);
+    df_queue_ep_t recv_ep = df_get_queue_receiver_ep(rev_q);
+    char *buf = (char *) malloc(msg_size);
+    memset(buf, 'a', msg_size);
+
+    // stream
+    barrier(num_procs);
+    uint64_t i;
+    for(i = 0; i < num_msgs; i ++) {
+        df_enqueue(send_ep, buf, msg_size);
+    }
+    barrier(num_procs);
+
+    // ping-pong
+    void *msg;
+    size_t length;
+    double rtt_sum = 0, rtt_max = 0;
+    for(i = 0; i < num_round_trips; i ++) {
+        double t = now();
+        df_enqueue(send_ep, buf, msg_size);
+        df_dequeue(recv_ep, &msg, &length);
+        df_release(recv_ep);
+        t = now() - t;
+        rtt_sum += t;
+        if(t > rtt_max) rtt_max = t;
+    }
+    result->rtt_sum = rtt_sum;
+    result->rtt_max = rtt_max;
+    barrier(num_procs);
+
+    df_destroy_ep(send_ep);
+    df_destroy_ep(recv_ep);
+    free(buf);
+}
+
+void consumer(df_queue_t fwd_q, df_queue_t rev_q, pair_result *result, int num_procs)
+{
+    df_queue_ep_t recv_ep = df_get_queue_receiver_ep(fwd_q);
+    df_queue_ep_t send_ep = df_get_queue_sender_ep(rev_q);
+    char *buf = (char *) malloc(msg_size);
+    memset(buf, 'b', msg_size);
+
+    // stream
+    void *msg;
+    size_t length;
+    barrier(num_procs);
+    result->stream_start = now();
+    uint64_t i;
+    for(i = 0; i < num_msgs; i ++) {
+        df_dequeue(recv_ep, &msg, &length);
+        if(length != msg_size) {
+            result->failed = 1;
+        }
+        memcpy(buf, msg, length);
+        df_release(recv_ep);
+    }
+    result->stream_end = now();
+    barrier(num_procs);
+
+    // ping-pong
+    for(i = 0; i < num_round_trips; i ++) {
+        df_dequeue(recv_ep, &msg, &length);
+        memcpy(buf, msg, length);
+        df_release(recv_ep);
+        df_enqueue(send_ep, buf, msg_size);
+    }
+    barrier(num_procs);
+
+    df_destroy_ep(send_ep);
+    df_destroy_ep(recv_ep);
+    free(buf);
+}
+
+/*
+ * Run num_pairs pairs and print their results. Return 0 on success.
+ */
+int run_pairs(df_shm_method_t df_shm_handle, int num_pairs)
+{
+    // every pair has a forward and a reverse queue; queue sizes are multiples of
+    // the cache line size, so packed queues share no cache lines
+    size_t queue_size = df_calculate_queue_size(num_slots, msg_size);
+    size_t pair_size = 2 * queue_size;
+    int num_regions = single_region? 1 : num_pairs;
+    size_t region_size = single_region? num_pairs * pair_size : pair_size;
+    if(region_size % PAGE_SIZE) {
+        region_size += PAGE_SIZE - (region_size % PAGE_SIZE);
+    }
+    df_shm_region_t *regions = (df_shm_region_t *) malloc(num_regions * sizeof(df_shm_region_t));
+    df_queue_t *queues = (df_queue_t *) malloc(2 * num_pairs * sizeof(df_queue_t));
+    int i;
+    for(i = 0; i < num_regions; i ++) {
+        regions[i] = df_create_shm_region(df_shm_handle, region_size, NULL);
+        if(!regions[i]) {
+            fprintf(stderr, "Cannot create region. %s:%d\n", __FILE__, __LINE__);
+            return -1;
+        }
+    }
+    for(i = 0; i < num_pairs; i ++) {
+        char *base = single_region? (char *) regions[0]->starting_addr + i * pair_size :
+            (char *) regions[i]->starting_addr;
+        queues[2 * i] = df_create_queue(base, num_slots, msg_size);
+        queues[2 * i + 1] = df_create_queue(base + queue_size, num_slots, msg_size);
+    }
+    memset(ctl, 0, sizeof(control) + num_pairs * sizeof(pair_result));
+
+    // the children use the regions through the mappings inherited from the parent
+    pid_t *children = (pid_t *) malloc(2 * num_pairs * sizeof(pid_t));
+    for(i = 0; i < 2 * num_pairs; i ++) {
+        children[i] = fork();
+        if(children[i] == -1) {
+            fprintf(stderr, "Cannot fork. %s:%d\n", __FILE__, __LINE__);
+            return -1;
+        }
+        if(children[i] == 0) {
+            int pair = i / 2;
+            if(i % 2) {
+                consumer(queues[2 * pair], queues[2 * pair + 1], &ctl->results[pair], 2 * num_pairs);
+            }
+            else {
+                producer(queues[2 * pair], queues[2 * pair + 1], &ctl->results[pair], 2 * num_pairs);
+            }
+            _exit(0);
+        }
+    }
+    int failed = 0;
+    for(i = 0; i < 2 * num_pairs; i ++) {
+        int status;
+        waitpid(children[i], &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed = 1;
+        }
+    }
+
+    // aggregate throughput spans from the first stream starting to the last one ending
+    double start = 0, end = 0, min_rate = 0, max_rate = 0, rtt_sum = 0, rtt_max = 0;
+    for(i = 0; i < num_pairs; i ++) {
+        pair_result *r = &ctl->results[i];
+        double rate = num_msgs * msg_size / (r->stream_end - r->stream_start) / 1e9;
+        if(i == 0 || r->stream_start < start) start = r->stream_start;
+        if(i == 0 || r->stream_end > end) end = r->stream_end;
+        if(i == 0 || rate < min_rate) min_rate = rate;
+        if(i == 0 || rate > max_rate) max_rate = rate;
+        rtt_sum += r->rtt_sum;
+        if(r->rtt_max > rtt_max) rtt_max = r->rtt_max;
+        failed |= r->failed;
+        if(verbose) {
+            fprintf(stdout, "  pair %-*d%*.*f%*s%*s%*s%*.*f%*.*f\n", 4, i, FIELD_WIDTH, FLOAT_PRECISION,
+                rate, FIELD_WIDTH, "", FIELD_WIDTH, "", FIELD_WIDTH, "", FIELD_WIDTH, FLOAT_PRECISION,
+                r->rtt_sum * 1e6 / num_round_trips, FIELD_WIDTH, FLOAT_PRECISION, r->rtt_max * 1e6);
+        }
+    }
+    double total_msgs = (double) num_pairs * num_msgs;
+    fprintf(stdout, "%-*d%*.*f%*.*f%*.*f%*.*f%*.*f%*.*f\n", 10, num_pairs,
+        FIELD_WIDTH, FLOAT_PRECISION, total_msgs * msg_size / (end - start) / 1e9,
+        FIELD_WIDTH, 0, total_msgs / (end - start),
+        FIELD_WIDTH, FLOAT_PRECISION, min_rate,
+        FIELD_WIDTH, FLOAT_PRECISION, max_rate,
+        FIELD_WIDTH, FLOAT_PRECISION, rtt_sum * 1e6 / (num_pairs * num_round_trips),
+        FIELD_WIDTH, FLOAT_PRECISION, rtt_max * 1e6);
+    fflush(stdout);
+
+    for(i = 0; i < 2 * num_pairs; i ++) {
+        df_destroy_queue(queues[i]);
+    }
+    for(i = 0; i < num_regions; i ++) {
+        df_destroy_shm_region(regions[i]);
+    }
+    free(children);
+    free(queues);
+    free(regions);
+    return failed? -1 : 0;
+}
+
+int main (int argc, char *argv[])
+{
+    int opt;
+    while((opt = getopt(argc, argv, "N:s:q:n:r:1v")) != -1) {
+        switch(opt) {
+            case 'N': max_pairs = atoi(optarg); break;
+            case 's': msg_size = strtoul(optarg, NULL, 0); break;
+            case 'q': num_slots = atoi(optarg); break;
+            case 'n': num_msgs = strtoull(optarg, NULL, 0); break;
+            case 'r': num_round_trips = strtoull(optarg, NULL, 0); break;
+            case '1': single_region = 1; break;
+            case 'v': verbose = 1; break;
+            default:
+                print_usage(argv[0]);
+                return -1;
+        }
+    }
+    if(optind != argc - 1 || strlen(argv[optind]) != 1 || msg_size == 0 || num_slots == 0 ||
+       num_round_trips == 0) {
+        print_usage(argv[0]);
+        return -1;
+    }
+    switch(argv[optind][0]) {
+        case 'S': shm_method = DF_SHM_METHOD_SYSV; break;
+        case 'M': shm_method = DF_SHM_METHOD_MMAP; break;
+        case 'P': shm_method = DF_SHM_METHOD_POSIX_SHM; break;
+        case 'A': shm_method = DF_SHM_METHOD_ANON; break;
+        default:
+            print_usage(argv[0]);
+            return -1;
+    }
+    if(max_pairs < 1) {
+        max_pairs = sysconf(_SC_NPROCESSORS_ONLN) / 2;
+        if(max_pairs < 1) max_pairs = 1;
+    }
+
+    df_shm_method_t df_shm_handle = df_shm_init(shm_method, NULL);
+    if(!df_shm_handle) {
+        fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n", shm_method, __FILE__, __LINE__);
+        return -1;
+    }
+    ctl = (control *) mmap(NULL, sizeof(control) + max_pairs * sizeof(pair_result),
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(ctl == MAP_FAILED) {
+        fprintf(stderr, "Cannot map control block. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    fprintf(stdout, "DataFabrics SHM Queue Pair Scaling Benchmark (%lu-byte messages, %u slots, %s)\n",
+        msg_size, num_slots, single_region? "one shared region" : "one region per pair");
+    fprintf(stdout, "%-*s%*s%*s%*s%*s%*s%*s\n", 10, "# Pairs", FIELD_WIDTH, "Total GB/s",
+        FIELD_WIDTH, "Total msgs/s", FIELD_WIDTH, "Min pair GB/s", FIELD_WIDTH, "Max pair GB/s",
+        FIELD_WIDTH, "Avg RTT (us)", FIELD_WIDTH, "Max RTT (us)");
+    int num_pairs;
+    int rc = 0;
+    for(num_pairs = 1; rc == 0; num_pairs *= 2) {
+        // always finish with the largest number of pairs
+        if(num_pairs > max_pairs) {
+            num_pairs = max_pairs;
+        }
+        rc = run_pairs(df_shm_handle, num_pairs);
+        if(num_pairs == max_pairs) {
+            break;
+        }
+    }
+
+    munmap(ctl, sizeof(control) + max_pairs * sizeof(pair_result));
+    df_shm_finalize(df_shm_handle);
+    if(rc != 0) {
+        fprintf(stderr, "Some pairs failed. %s:%d\n", __FILE__, __LINE__);
+    }
+    return rc;
+}
@@ -0,0 +1,497 @@
+/*
+ * This test program benchmarks the shm queue API inside one process, with the
+ * producer and the consumer running as threads pinned to given cpus, so that it
+ * needs neither MPI nor a second process and can be built and run by CMake.
+ * It covers
+ * - enqueue/dequeue: streaming with df_enqueue() and df_dequeue()/df_release()
+ * - try_enqueue/try_dequeue: streaming with df_try_enqueue() and df_try_dequeue()
+ * - enqueue_vector: streaming with df_enqueue_vector() of 4 buffers per message
+ * - round trip: ping-pong over a queue in each direction
+ * - region create/destroy, region attach/detach and queue create/ep: the setup
+ *   path, timed in the main thread
+ * Every benchmark is run a number of times after a warm-up run and the median,
+ * minimum and maximum time per operation are reported; the spread between them
+ * shows how far a single run can be trusted.
+ *
+ * The threads are pinned to two given cpus, to a pair of cpus with a given
+ * relation (SMT siblings, cores sharing an L3, cores behind different L3s or
+ * different sockets), or with -m to one pair of each relation the machine has
+ * in turn. Every result is labeled with the relation of the two cpus.
+ *
+ * If the two threads share a cpu, the try variants yield between tries; the
+ * blocking calls spin and are then limited by the scheduler's time slice.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/uio.h>
+#include "df_shm.h"
+#include "df_shm_queue.h"
+#include "df_shm_topology.h"
+#include "df_config.h"
+
+#define FIELD_WIDTH 14
+#define FLOAT_PRECISION 1
+#define MAX_REPS 100
+#define NUM_IOVECS 4
+
+// test parameters
+enum DF_SHM_METHOD shm_method = DF_SHM_METHOD_ANON;
+size_t msg_size = 64;
+uint32_t num_slots = 16;
+uint64_t num_msgs = 1000000;
+uint64_t num_round_trips = 100000;
+int num_cycles = 1000;
+int num_reps = 5;
+int producer_cpu = -1;            // -1: cpu 0
+int consumer_cpu = -1;            // -1: cpu 1, or cpu 0 on a single cpu
+int placement = -1;               // pick the cpus by their relation
+int placement_matrix = 0;         // run every relation the machine has
+
+df_shm_method_t df_shm_handle;
+df_queue_t fwd_q, rev_q;
+pthread_barrier_t start_barrier;
+int shared_cpu = 0;
+const char *placement_label = "unknown";
+
+/*
+ * one timed run of a streaming or ping-pong benchmark
+ */
+typedef struct _run {
+    void (*producer)(df_queue_ep_t send_ep, df_queue_ep_t recv_ep, char *buf);
+    void (*consumer)(df_queue_ep_t send_ep, df_queue_ep_t recv_ep, char *buf);
+    double start_time;            // set by the producer
+    double end_time;              // set by whichever side finishes last
+} run;
+
+void print_usage(char *program_name)
+{
+    fprintf(stderr, "Usage: %s [options] [shm_method]\n"
+                    " shm_method can be one of the following options\n"
+                    " - A: anonymous shared mapping (default)\n"
+                    " - P: POSIX shared memory object\n"
+                    " options:\n"
+                    " -s size   message size in bytes (default 64)\n"
+                    " -q slots  number of queue slots (default 16)\n"
+                    " -n count  messages streamed per run (default 1000000)\n"
+                    " -r count  round trips per run (default 100000)\n"
+                    " -c count  region and queue set-ups per run (default 1000)\n"
+                    " -R count  runs of every benchmark after a warm-up run (default 5)\n"
+                    " -p cpu    cpu of the producer thread (default 0)\n"
+                    " -C cpu    cpu of the consumer thread (default 1)\n"
+                    " -P name   place the threads on two cpus with relation name: same-cpu,\n"
+                    "           smt-sibling, same-l3, cross-l3 or cross-socket\n"
+                    " -m        run the benchmarks for every relation of two different cpus\n"
+                    "           the machine has\n",
+                    program_name
+           );
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+/*
+ * Called between unsuccessful tries: let a thread on the same cpu run.
+ */
+static inline void try_again(void)
+{
+    if(shared_cpu) {
+        sched_yield();
+    }
+}
+
+void stream_producer(df_queue_ep_t send_ep, df_queue_ep_t recv_ep, char *buf)
+{
+    uint64_t i;
+    for(i = 0; i < num_msgs; i ++) {
+        df_enqueue(send_ep, buf, msg_size);
+    }
+}
+
+void stream_consumer(df_queue_ep_t send_ep, df_queue_ep_t recv_ep, char *buf)
+{
+    void *msg;
+    size_t length;
+    uint64_t i;
+    for(i = 0; i < num_msgs; i ++) {
+        df_dequeue(recv_ep, &msg, &length);
+        memcpy(buf, msg, length);
+        df_release(recv_ep);
+    }
+}
+
+void try_producer(df_queue_ep_t send_ep, df_queue_ep_t recv_ep, char *buf)
+{
+    uint64_t i;
+    for(i = 0; i < num_msgs; i ++) {
+        while(df_try_enqueue(send_ep, buf, msg_size) == -1) {
+            try_again();
+        }
+    }
+}
+
+void try_consumer(df_queue_ep_t send_ep, df_queue_ep_t recv_ep, char *buf)
+{
+    void *msg;
+    size_t length;
+    uint64_t i;
+    for(i = 0; i < num_msgs; i ++) {
+        while(df_try_dequeue(recv_ep, &msg, &length) == -1) {
+            try_again();
+        }
+        memcpy(buf, msg, length);
+        df_release(recv_ep);
+    }
+}
+
+void vector_producer(df_queue_ep_t send_ep, df_queue_ep_t recv_ep, char *buf)
+{
+    // the message is gathered from NUM_IOVECS pieces, or one if it is too small
+    struct iovec vec[NUM_IOVECS];
+    int veccnt = msg_size >= NUM_IOVECS? NUM_IOVECS : 1;
+    size_t piece = msg_size / veccnt;
+    int v;
+    for(v = 0; v < veccnt; v ++) {
+        vec[v].iov_base = buf + v * piece;
+        vec[v].iov_len = v == veccnt - 1? msg_size - v * piece : piece;
+    }
+    uint64_t i;
+    for(i = 0; i < num_msgs; i ++) {
+        df_enqueue_vector(send_ep, vec, veccnt);
+    }
+}
+
+void pingpong_producer(df_queue_ep_t send_ep, df_queue_ep_t recv_ep, char *buf)
+{
+    void *msg;
+    size_t length;
+    uint64_t i;
+    for(i = 0; i < num_round_trips; i ++) {
+        df_enqueue(send_ep, buf, msg_size);
+        df_dequeue(recv_ep, &msg, &length);
+        memcpy(buf, msg, length);
+        df_release(recv_ep);
+    }
+}
+
+void pingpong_consumer(df_queue_ep_t send_ep, df_queue_ep_t recv_ep, char *buf)
+{
+    void *msg;
+    size_t length;
+    uint64_t i;
+    for(i = 0; i < num_round_trips; i ++) {
+        df_dequeue(recv_ep, &msg, &length);
+        memcpy(buf, msg, length);
+        df_release(recv_ep);
+        df_enqueue(send_ep, buf, msg_size);
+    }
+}
+
+void *producer_thread(void *arg)
+{
+    run *r = (run *) arg;
+    df_pin_thread(producer_cpu);
+    df_queue_ep_t send_ep = df_get_queue_sender_ep(fwd_q);
+    df_queue_ep_t recv_ep = df_get_queue_receiver_ep(rev_q);
+    char *buf = (char *) malloc(msg_size);
+    memset(buf, 'a', msg_size);
+    pthread_barrier_wait(&start_barrier);
+    r->start_time = now();
+    r->producer(send_ep, recv_ep, buf);
+    r->end_time = now();
+    pthread_barrier_wait(&start_barrier);
+    df_destroy_ep(send_ep);
+    df_destroy_ep(recv_ep);
+    free(buf);
+    return NULL;
+}
+
+void *consumer_thread(void *arg)
+{
+    run *r = (run *) arg;
+    df_pin_thread(consumer_cpu);
+    df_queue_ep_t recv_ep = df_get_queue_receiver_ep(fwd_q);
+    df_queue_ep_t send_ep = df_get_queue_sender_ep(rev_q);
+    char *buf = (char *) malloc(msg_size);
+    memset(buf, 'b', msg_size);
+    pthread_barrier_wait(&start_barrier);
+    r->consumer(send_ep, recv_ep, buf);
+    double end_time = now();
+    // the producer of a stream is done before the consumer
+    pthread_barrier_wait(&start_barrier);
+    if(end_time > r->end_time) {
+        r->end_time = end_time;
+    }
+    df_destroy_ep(send_ep);
+    df_destroy_ep(recv_ep);
+    free(buf);
+    return NULL;
+}
+
+/*
+ * Run the threads of r once and return the elapsed time in seconds, or a
+ * negative value on error.
+ */
+double run_threads(run *r)
+{
+    pthread_t producer, consumer;
+    r->start_time = r->end_time = 0;
+    if(pthread_create(&producer, NULL, producer_thread, r) != 0 ||
+       pthread_create(&consumer, NULL, consumer_thread, r) != 0) {
+        fprintf(stderr, "Cannot create threads. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    return r->end_time - r->start_time;
+}
+
+/*
+ * Time num_cycles region and queue set-ups in the main thread. times[0..2] get the
+ * seconds spent in region create/destroy, region attach/detach and queue
+ * create/endpoints.
+ */
+int run_setup(size_t region_size, double *times)
+{
+    int i;
+    times[0] = times[1] = times[2] = 0;
+    for(i = 0; i < num_cycles; i ++) {
+        double t0 = now();
+        df_shm_region_t region = df_create_shm_region(df_shm_handle, region_size, NULL);
+        if(!region) {
+            fprintf(stderr, "Cannot create region. %s:%d\n", __FILE__, __LINE__);
+            return -1;
+        }
+        double t1 = now();
+        int contact_length;
+        void *contact_info = df_shm_region_contact_info(df_shm_handle, region, &contact_length);
+        df_shm_region_t attached = contact_info? df_attach_shm_region(df_shm_handle, getpid(),
+            contact_info, region_size, NULL) : NULL;
+        if(!attached) {
+            fprintf(stderr, "Cannot attach region. %s:%d\n", __FILE__, __LINE__);
+            return -1;
+        }
+        double t2 = now();
+        df_queue_t q = df_create_queue(region->starting_addr, num_slots, msg_size);
+        df_queue_ep_t send_ep = df_get_queue_sender_ep(q);
+        df_queue_ep_t recv_ep = df_get_queue_receiver_ep(
+            (df_queue_t) attached->starting_addr);
+        df_destroy_ep(send_ep);
+        df_destroy_ep(recv_ep);
+        df_destroy_queue(q);
+        double t3 = now();
+        df_detach_shm_region(attached);
+        free(contact_info);
+        double t4 = now();
+        df_destroy_shm_region(region);
+        double t5 = now();
+        times[0] += (t1 - t0) + (t5 - t4);
+        times[1] += (t2 - t1) + (t4 - t3);
+        times[2] += t3 - t2;
+    }
+    return 0;
+}
+
+int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y? -1 : x > y;
+}
+
+/*
+ * Print the median, minimum and maximum of num_reps times per operation in ns.
+ */
+void report(const char *name, double *ns_per_op)
+{
+    qsort(ns_per_op, num_reps, sizeof(double), compare_double);
+    double median = ns_per_op[num_reps / 2];
+    fprintf(stdout, "%-*s%-*s%*.*f%*.*f%*.*f%*.*f\n", 14, placement_label, 26, name,
+        FIELD_WIDTH, FLOAT_PRECISION, median,
+        FIELD_WIDTH, FLOAT_PRECISION, ns_per_op[0],
+        FIELD_WIDTH, FLOAT_PRECISION, ns_per_op[num_reps - 1],
+        FIELD_WIDTH, 3, 1e3 / median);
+    fflush(stdout);
+}
+
+/*
+ * Run the threaded benchmarks with the producer on producer_cpu and the consumer
+ * on consumer_cpu. Return 0 on success.
+ */
+int run_benchmarks(df_topology_t topology)
+{
+    run runs[] = {
+        { stream_producer, stream_consumer },
+        { try_producer, try_consumer },
+        { vector_producer, stream_consumer },
+        { pingpong_producer, pingpong_consumer }
+    };
+    const char *run_names[] = { "enqueue/dequeue", "try_enqueue/try_dequeue", "enqueue_vector/dequeue",
+        "round trip" };
+    double ns_per_op[MAX_REPS];
+    int i, rep;
+
+    shared_cpu = producer_cpu == consumer_cpu;
+    int relation = topology? df_topology_placement(topology, producer_cpu, consumer_cpu) : -1;
+    placement_label = relation >= 0? df_placement_name(relation) : "unknown";
+    fprintf(stdout, "# producer on cpu %d, consumer on cpu %d: %s\n", producer_cpu, consumer_cpu,
+        placement_label);
+    for(i = 0; i < (int) (sizeof(runs) / sizeof(runs[0])); i ++) {
+        uint64_t ops = runs[i].producer == pingpong_producer? num_round_trips : num_msgs;
+        for(rep = -1; rep < num_reps; rep ++) {
+            double elapsed = run_threads(&runs[i]);
+            if(elapsed < 0) {
+                return -1;
+            }
+            if(rep >= 0) {
+                ns_per_op[rep] = elapsed * 1e9 / ops;
+            }
+        }
+        report(run_names[i], ns_per_op);
+    }
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    int opt;
+    while((opt = getopt(argc, argv, "s:q:n:r:c:R:p:C:P:m")) != -1) {
+        switch(opt) {
+            case 's': msg_size = strtoul(optarg, NULL, 0); break;
+            case 'q': num_slots = atoi(optarg); break;
+            case 'n': num_msgs = strtoull(optarg, NULL, 0); break;
+            case 'r': num_round_trips = strtoull(optarg, NULL, 0); break;
+            case 'c': num_cycles = atoi(optarg); break;
+            case 'R': num_reps = atoi(optarg); break;
+            case 'p': producer_cpu = atoi(optarg); break;
+            case 'C': consumer_cpu = atoi(optarg); break;
+            case 'P':
+                placement = df_placement_from_name(optarg);
+                if(placement < 0) {
+                    print_usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'm': placement_matrix = 1; break;
+            default:
+                print_usage(argv[0]);
+                return -1;
+        }
+    }
+    if(optind < argc - 1 || msg_size == 0 || num_slots == 0 || num_msgs == 0 ||
+       num_round_trips == 0 || num_cycles < 1 || num_reps < 1 || num_reps > MAX_REPS) {
+        print_usage(argv[0]);
+        return -1;
+    }
+    if(optind == argc - 1) {
+        if(!strcmp(argv[optind], "A")) {
+            shm_method = DF_SHM_METHOD_ANON;
+        }
+        else if(!strcmp(argv[optind], "P")) {
+            shm_method = DF_SHM_METHOD_POSIX_SHM;
+        }
+        else {
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    df_topology_t topology = df_topology_discover();
+    if(!topology && (placement >= 0 || placement_matrix)) {
+        fprintf(stderr, "Cannot discover the cpu topology. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    if(placement >= 0 && df_topology_find_pair(topology, placement, &producer_cpu, &consumer_cpu) != 0) {
+        fprintf(stderr, "This machine has no two cpus of relation %s. %s:%d\n",
+            df_placement_name(placement), __FILE__, __LINE__);
+        return -1;
+    }
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if(producer_cpu < 0) {
+        producer_cpu = 0;
+    }
+    if(consumer_cpu < 0) {
+        consumer_cpu = num_cpus > 1? 1 : 0;
+    }
+
+    // fault in regions up front so that page faults stay off the measured path
+    df_shm_config shm_config;
+    memset(&shm_config, 0, sizeof(shm_config));
+    shm_config.flags = DF_SHM_FLAG_POPULATE;
+    df_shm_handle = df_shm_init(shm_method, &shm_config);
+    if(!df_shm_handle) {
+        fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n", shm_method, __FILE__, __LINE__);
+        return -1;
+    }
+    size_t queue_size = df_calculate_queue_size(num_slots, msg_size);
+    size_t region_size = 2 * queue_size;
+    if(region_size % PAGE_SIZE) {
+        region_size += PAGE_SIZE - (region_size % PAGE_SIZE);
+    }
+    df_shm_region_t region = df_create_shm_region(df_shm_handle, region_size, NULL);
+    if(!region) {
+        fprintf(stderr, "Cannot create region. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    fwd_q = df_create_queue(region->starting_addr, num_slots, msg_size);
+    rev_q = df_create_queue((char *) region->starting_addr + queue_size, num_slots, msg_size);
+    pthread_barrier_init(&start_barrier, NULL, 2);
+
+    fprintf(stdout, "DataFabrics SHM Queue In-Process Benchmark (%s, %lu-byte messages, %u slots)\n",
+        shm_method == DF_SHM_METHOD_ANON? "anon" : "posix", msg_size, num_slots);
+    fprintf(stdout, "%-*s%-*s%*s%*s%*s%*s\n", 14, "# Placement", 26, "Benchmark", FIELD_WIDTH,
+        "Median ns/op", FIELD_WIDTH, "Min ns/op", FIELD_WIDTH, "Max ns/op", FIELD_WIDTH, "Mops/s");
+
+    int i, rep;
+    if(placement_matrix) {
+        int p;
+        // two threads spinning on one cpu say little about the machine; leave it out
+        for(p = DF_PLACEMENT_SMT_SIBLING; p < DF_NUM_PLACEMENTS; p ++) {
+            if(df_topology_find_pair(topology, p, &producer_cpu, &consumer_cpu) != 0) {
+                fprintf(stdout, "# no two cpus of relation %s\n", df_placement_name(p));
+                continue;
+            }
+            if(run_benchmarks(topology) != 0) {
+                return -1;
+            }
+        }
+    }
+    else if(run_benchmarks(topology) != 0) {
+        return -1;
+    }
+
+    // the set-up path runs in the main thread only
+    double ns_per_op[3][MAX_REPS];
+    double times[3];
+    placement_label = "-";
+    for(rep = -1; rep < num_reps; rep ++) {
+        if(run_setup(region_size, times) != 0) {
+            return -1;
+        }
+        if(rep >= 0) {
+            for(i = 0; i < 3; i ++) {
+                ns_per_op[i][rep] = times[i] * 1e9 / num_cycles;
+            }
+        }
+    }
+    report("region create/destroy", ns_per_op[0]);
+    report("region attach/detach", ns_per_op[1]);
+    report("queue create/ep", ns_per_op[2]);
+
+    pthread_barrier_destroy(&start_barrier);
+    df_destroy_queue(fwd_q);
+    df_destroy_queue(rev_q);
+    df_destroy_shm_region(region);
+    df_shm_finalize(df_shm_handle);
+    df_topology_free(topology);
+    return 0;
+}
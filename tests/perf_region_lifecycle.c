@@ -0,0 +1,264 @@
+/*
+ * This test program benchmarks each phase of a region's life cycle: create,
+ * contact info, first touch by the creator, attach, first touch through the
+ * attached mapping, detach and destroy. Each phase is timed on its own for
+ * sizes growing by 4x, on each shm method, with base pages or huge pages and
+ * with or without populating regions when they are created and attached.
+ *
+ * First touch writes one byte per base page through the creator's mapping,
+ * which allocates the pages unless they were populated, and then reads one
+ * byte per base page through the attached mapping, which only maps pages that
+ * already exist. The region is attached by the creating process itself, which
+ * goes through the same kernel paths as a peer attaching it.
+ *
+ * Sizes for which there is not enough available memory are skipped, and fewer
+ * iterations are run for large sizes (at least one).
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include "df_shm.h"
+#include "df_config.h"
+
+#define FIELD_WIDTH 12
+#define FLOAT_PRECISION 1
+
+// test parameters
+size_t min_region_size = 4 * 1024;
+size_t max_region_size = 16UL * 1024 * 1024 * 1024;
+int num_iters = 100;
+size_t bytes_per_size = 1024 * 1024 * 1024;  // fewer iterations for large sizes
+const char *page_configs = "nphb";
+
+/*
+ * time of each phase, summed over iterations
+ */
+enum PHASE {
+    PHASE_CREATE,
+    PHASE_CONTACT_INFO,
+    PHASE_CREATOR_TOUCH,
+    PHASE_ATTACH,
+    PHASE_ATTACHER_TOUCH,
+    PHASE_DETACH,
+    PHASE_DESTROY,
+    NUM_PHASES
+};
+
+const char *phase_names[NUM_PHASES] = {
+    "Create", "Contact", "Touch", "Attach", "Touch att", "Detach", "Destroy"
+};
+
+void print_usage(char *program_name)
+{
+    fprintf(stderr, "Usage: %s [options] [shm_methods]\n"
+                    " shm_methods is a string of the following letters (default SMP)\n"
+                    " - S: System V shared memory\n"
+                    " - M: mmap() backed by a file in /tmp\n"
+                    " - P: POSIX shared memory object\n"
+                    " - F: memfd passed over a Unix domain socket\n"
+                    " options:\n"
+                    " -s size   smallest region size (default 4K)\n"
+                    " -S size   largest region size (default 16G); sizes grow by 4x\n"
+                    " -i count  most iterations per size (default 100)\n"
+                    " -b bytes  bytes of regions to go through per size (default 1G)\n"
+                    " -c list   page configurations (default nphb):\n"
+                    "           n: base pages, p: base pages, populated,\n"
+                    "           h: huge pages, b: huge pages, populated\n"
+                    " sizes take K, M and G suffixes\n",
+                    program_name
+           );
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+size_t parse_size(const char *s)
+{
+    char *end;
+    size_t size = strtoul(s, &end, 10);
+    switch(*end) {
+        case 'G': case 'g': size <<= 10;
+        case 'M': case 'm': size <<= 10;
+        case 'K': case 'k': size <<= 10;
+    }
+    return size;
+}
+
+/*
+ * Run the life cycle of regions of region_size bytes num_iters times and add the
+ * time of each phase to times. Return 0 on success.
+ */
+int run_cycles(df_shm_method_t df_shm_handle, size_t region_size, int iters, double *times)
+{
+    int i;
+    for(i = 0; i < iters; i ++) {
+        double t[NUM_PHASES + 1];
+        size_t offset;
+        volatile char *p;
+        unsigned char sum = 0;
+
+        t[0] = now();
+        df_shm_region_t region = df_create_shm_region(df_shm_handle, region_size, NULL);
+        t[1] = now();
+        if(!region) {
+            return -1;
+        }
+        int contact_length;
+        void *contact_info = df_shm_region_contact_info(df_shm_handle, region, &contact_length);
+        t[2] = now();
+        if(!contact_info) {
+            df_destroy_shm_region(region);
+            return -1;
+        }
+        p = (volatile char *) region->starting_addr;
+        for(offset = 0; offset < region_size; offset += PAGE_SIZE) {
+            p[offset] = 1;
+        }
+        t[3] = now();
+        df_shm_region_t attached = df_attach_shm_region(df_shm_handle, getpid(), contact_info,
+            region_size, NULL);
+        t[4] = now();
+        if(!attached) {
+            free(contact_info);
+            df_destroy_shm_region(region);
+            return -1;
+        }
+        p = (volatile char *) attached->starting_addr;
+        for(offset = 0; offset < region_size; offset += PAGE_SIZE) {
+            sum += p[offset];
+        }
+        t[5] = now();
+        df_detach_shm_region(attached);
+        t[6] = now();
+        df_destroy_shm_region(region);
+        t[7] = now();
+        free(contact_info);
+
+        if(sum != (unsigned char) (region_size / PAGE_SIZE)) {
+            fprintf(stderr, "Attached mapping does not see the creator's writes. %s:%d\n",
+                __FILE__, __LINE__);
+            return -1;
+        }
+        int phase;
+        for(phase = 0; phase < NUM_PHASES; phase ++) {
+            times[phase] += t[phase + 1] - t[phase];
+        }
+    }
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    const char *shm_methods = "SMP";
+    int opt;
+    while((opt = getopt(argc, argv, "s:S:i:b:c:")) != -1) {
+        switch(opt) {
+            case 's': min_region_size = parse_size(optarg); break;
+            case 'S': max_region_size = parse_size(optarg); break;
+            case 'i': num_iters = atoi(optarg); break;
+            case 'b': bytes_per_size = parse_size(optarg); break;
+            case 'c': page_configs = optarg; break;
+            default:
+                print_usage(argv[0]);
+                return -1;
+        }
+    }
+    if(optind < argc - 1 || min_region_size == 0 || max_region_size < min_region_size ||
+       num_iters < 1) {
+        print_usage(argv[0]);
+        return -1;
+    }
+    if(optind == argc - 1) {
+        shm_methods = argv[optind];
+    }
+    // leave half of the available memory to everything else
+    size_t avail_bytes = (size_t) sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE) / 2;
+
+    fprintf(stdout, "DataFabrics SHM Region Life Cycle Benchmark (us per phase)\n");
+    fprintf(stdout, "%-*s%-*s%*s", 10, "# Method", 16, "Pages", 14, "Size");
+    int phase;
+    for(phase = 0; phase < NUM_PHASES; phase ++) {
+        fprintf(stdout, "%*s", FIELD_WIDTH, phase_names[phase]);
+    }
+    fprintf(stdout, "\n");
+
+    int rc = 0;
+    const char *m, *c;
+    for(m = shm_methods; *m && rc == 0; m ++) {
+        enum DF_SHM_METHOD method;
+        switch(*m) {
+            case 'S': method = DF_SHM_METHOD_SYSV; break;
+            case 'M': method = DF_SHM_METHOD_MMAP; break;
+            case 'P': method = DF_SHM_METHOD_POSIX_SHM; break;
+            case 'F': method = DF_SHM_METHOD_MEMFD; break;
+            default:
+                print_usage(argv[0]);
+                return -1;
+        }
+        for(c = page_configs; *c && rc == 0; c ++) {
+            df_shm_config shm_config;
+            const char *config_name;
+            memset(&shm_config, 0, sizeof(shm_config));
+            switch(*c) {
+                case 'n': config_name = "base"; break;
+                case 'p':
+                    config_name = "base+populate";
+                    shm_config.flags = DF_SHM_FLAG_POPULATE;
+                    break;
+                case 'h':
+                    config_name = "huge";
+                    shm_config.flags = DF_SHM_FLAG_HUGEPAGE;
+                    break;
+                case 'b':
+                    config_name = "huge+populate";
+                    shm_config.flags = DF_SHM_FLAG_HUGEPAGE | DF_SHM_FLAG_POPULATE;
+                    break;
+                default:
+                    print_usage(argv[0]);
+                    return -1;
+            }
+            df_shm_method_t df_shm_handle = df_shm_init(method, &shm_config);
+            if(!df_shm_handle) {
+                fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n", method, __FILE__, __LINE__);
+                return -1;
+            }
+            size_t region_size;
+            for(region_size = min_region_size; region_size <= max_region_size; region_size *= 4) {
+                fprintf(stdout, "%-*c%-*s%*lu", 10, *m, 16, config_name, 14, region_size);
+                int iters = bytes_per_size / region_size;
+                if(iters > num_iters) iters = num_iters;
+                if(iters < 1) iters = 1;
+                double times[NUM_PHASES];
+                memset(times, 0, sizeof(times));
+                if(region_size > avail_bytes ||
+                   run_cycles(df_shm_handle, region_size, iters, times) != 0) {
+                    // not enough memory or the method's limits (e.g. shmmax) are exceeded
+                    for(phase = 0; phase < NUM_PHASES; phase ++) {
+                        fprintf(stdout, "%*s", FIELD_WIDTH, "n/a");
+                    }
+                }
+                else {
+                    for(phase = 0; phase < NUM_PHASES; phase ++) {
+                        fprintf(stdout, "%*.*f", FIELD_WIDTH, FLOAT_PRECISION, times[phase] * 1e6 / iters);
+                    }
+                }
+                fprintf(stdout, "\n");
+                fflush(stdout);
+            }
+            if(df_shm_finalize(df_shm_handle) != 0) {
+                fprintf(stderr, "Cannot finalize shm method %d. %s:%d\n", method, __FILE__, __LINE__);
+                rc = -1;
+            }
+        }
+    }
+    return rc;
+}
@@ -0,0 +1,183 @@
+/*
+ * This test program benchmarks concurrent region management through one shm
+ * method handle. Each of T threads repeatedly creates a region, gets its contact
+ * info, attaches it, looks up an address in it, detaches and destroys it. The
+ * run is repeated for T = 1, 2, 4, ... up to the given maximum number of threads
+ * and the aggregate rate of region life cycles is reported. If a pool size is
+ * given, destroyed regions are recycled through the method's region pool, which
+ * is prefilled with one region per thread.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include "df_shm.h"
+#include "df_config.h"
+
+#define FIELD_WIDTH 20
+#define FLOAT_PRECISION 2
+
+// test parameters
+enum DF_SHM_METHOD shm_method = DF_SHM_METHOD_MMAP;
+int max_threads = 4;
+int num_iters = 1000;
+size_t region_size = PAGE_SIZE;
+size_t pool_bytes = 0;
+
+df_shm_method_t df_shm_handle;
+pthread_barrier_t start_barrier;
+int num_errors = 0;
+
+void print_usage(char *program_name)
+{
+    fprintf(stderr, "Usage: %s shm_method [max_threads [iterations [pool_bytes]]]\n"
+                    " shm_method can be one of the following options\n"
+                    " - S: System V shared memory\n"
+                    " - M: mmap() backed by a file in /tmp\n"
+                    " - P: POSIX shared memory object\n"
+                    " - F: memfd passed over a Unix domain socket\n"
+                    " - A: anonymous shared mapping\n",
+                    program_name
+           );
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+/*
+ * Run num_iters region life cycles; arg points to the start and end time of the
+ * thread.
+ */
+void *worker(void *arg)
+{
+    double *times = (double *) arg;
+    int i;
+    pthread_barrier_wait(&start_barrier);
+    times[0] = now();
+    for(i = 0; i < num_iters; i ++) {
+        df_shm_region_t region = df_create_shm_region(df_shm_handle, region_size, NULL);
+        if(!region) {
+            __atomic_add_fetch(&num_errors, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        int contact_length;
+        void *contact_info = df_shm_region_contact_info(df_shm_handle, region, &contact_length);
+        df_shm_region_t attached = contact_info? df_attach_shm_region(df_shm_handle, getpid(),
+            contact_info, region_size, NULL) : NULL;
+        if(!attached) {
+            __atomic_add_fetch(&num_errors, 1, __ATOMIC_RELAXED);
+        }
+        else {
+            // write through one mapping and read through the other
+            *(int *) region->starting_addr = i;
+            size_t offset;
+            if(*(int *) attached->starting_addr != i ||
+               !df_shm_lookup_addr(df_shm_handle, (char *) region->starting_addr + 8, &offset) ||
+               offset != 8) {
+                __atomic_add_fetch(&num_errors, 1, __ATOMIC_RELAXED);
+            }
+            df_detach_shm_region(attached);
+        }
+        free(contact_info);
+        df_destroy_shm_region(region);
+    }
+    times[1] = now();
+    return NULL;
+}
+
+int main (int argc, char *argv[])
+{
+    if(argc < 2 || argc > 5) {
+        print_usage(argv[0]);
+        return -1;
+    }
+    if(!strcmp(argv[1], "S")) {
+        shm_method = DF_SHM_METHOD_SYSV;
+    }
+    else if(!strcmp(argv[1], "M")) {
+        shm_method = DF_SHM_METHOD_MMAP;
+    }
+    else if(!strcmp(argv[1], "P")) {
+        shm_method = DF_SHM_METHOD_POSIX_SHM;
+    }
+    else if(!strcmp(argv[1], "F")) {
+        shm_method = DF_SHM_METHOD_MEMFD;
+    }
+    else if(!strcmp(argv[1], "A")) {
+        shm_method = DF_SHM_METHOD_ANON;
+    }
+    else {
+        print_usage(argv[0]);
+        return -1;
+    }
+    if(argc > 2) {
+        max_threads = atoi(argv[2]);
+    }
+    if(argc > 3) {
+        num_iters = atoi(argv[3]);
+    }
+    if(argc > 4) {
+        pool_bytes = strtoul(argv[4], NULL, 0);
+    }
+    if(max_threads < 1 || num_iters < 1) {
+        print_usage(argv[0]);
+        return -1;
+    }
+
+    df_shm_handle = df_shm_init(shm_method, NULL);
+    if(!df_shm_handle) {
+        fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n", shm_method, __FILE__, __LINE__);
+        return -1;
+    }
+    if(pool_bytes && (df_shm_enable_region_pool(df_shm_handle, pool_bytes) != 0 ||
+       df_shm_prefill_region_pool(df_shm_handle, region_size, max_threads) != 0)) {
+        fprintf(stderr, "Cannot set up region pool. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    pthread_t *threads = (pthread_t *) malloc(max_threads * sizeof(pthread_t));
+    double *times = (double *) malloc(2 * max_threads * sizeof(double));
+
+    fprintf(stdout, "%-*s%*s%*s\n", 10, "# Threads", FIELD_WIDTH, "Cycles/s",
+        FIELD_WIDTH, "us/cycle/thread");
+    int num_threads, i;
+    for(num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+        pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+        for(i = 0; i < num_threads; i ++) {
+            pthread_create(&threads[i], NULL, worker, &times[2 * i]);
+        }
+        pthread_barrier_wait(&start_barrier);
+        // the run spans from the first thread starting to the last one finishing
+        double start = 0.0, end = 0.0;
+        for(i = 0; i < num_threads; i ++) {
+            pthread_join(threads[i], NULL);
+            if(i == 0 || times[2 * i] < start) start = times[2 * i];
+            if(i == 0 || times[2 * i + 1] > end) end = times[2 * i + 1];
+        }
+        double elapsed = end - start;
+        pthread_barrier_destroy(&start_barrier);
+
+        double cycles = (double) num_threads * num_iters;
+        fprintf(stdout, "%-*d%*.*f%*.*f\n", 10, num_threads,
+            FIELD_WIDTH, FLOAT_PRECISION, cycles / elapsed,
+            FIELD_WIDTH, FLOAT_PRECISION, elapsed * 1.0e6 / num_iters);
+        fflush(stdout);
+    }
+
+    free(threads);
+    free(times);
+    df_shm_finalize(df_shm_handle);
+    if(num_errors) {
+        fprintf(stderr, "%d region life cycles failed. %s:%d\n", num_errors, __FILE__, __LINE__);
+        return -1;
+    }
+    return 0;
+}
@@ -1,6 +1,14 @@
 #!/bin/sh
 
-hostname >myhostfile
+# run two copies of a test, which meet through the bootstrap service
+run2() {
+    "$@" &
+    first=$!
+    "$@"
+    rc=$?
+    wait $first || rc=1
+    return $rc
+}
 
 ulimit -c unlimited
 
@@ -8,8 +16,8 @@ ulimit -c unlimited
 echo "================= Run Test 1 ==================="
 echo " shared memroy region test"
 echo "================================================"
-mpirun -np 2 -hostfile ./myhostfile ./test_shm_region
-echo
+run2 ./test_shm_region && \
+run2 ./test_shm_region F
 if [ $? -eq 0 ]
 then
     echo "Test 1 Passed"
@@ -23,8 +31,7 @@ echo
 echo "================= Run Test 2 ==================="
 echo " shared memroy queue test"
 echo "================================================"
-mpirun -np 2 -hostfile ./myhostfile ./test_queue_sendrecv
-echo
+run2 ./test_queue_sendrecv
 if [ $? -eq 0 ]
 then
     echo "Test 2 Passed"
@@ -33,34 +40,278 @@ else
 fi
 echo "================================================"
 
-# Test 3: shared memory queue latency benchmark
+# Test 3: shared memory buffer pool test
 echo
 echo "================= Run Test 3 ==================="
+echo " shared memroy buffer pool test"
+echo "================================================"
+run2 ./test_bufpool_sendrecv
+if [ $? -eq 0 ]
+then
+    echo "Test 3 Passed"
+else
+    echo "Test 3 Failed"
+fi
+echo "================================================"
+
+# Test 4: anonymous shared memory fork/thread test
+echo
+echo "================= Run Test 4 ==================="
+echo " anonymous shared memroy fork and thread test"
+echo "================================================"
+./test_anon_fork
+if [ $? -eq 0 ]
+then
+    echo "Test 4 Passed"
+else
+    echo "Test 4 Failed"
+fi
+echo "================================================"
+
+# Test 5: growable shared memory region test
+echo
+echo "================= Run Test 5 ==================="
+echo " growable shared memroy region test"
+echo "================================================"
+run2 ./test_shm_resize M && \
+run2 ./test_shm_resize P && \
+run2 ./test_shm_resize F
+if [ $? -eq 0 ]
+then
+    echo "Test 5 Passed"
+else
+    echo "Test 5 Failed"
+fi
+echo "================================================"
+
+# Test 6: fixed-address shared memory region test
+echo
+echo "================= Run Test 6 ==================="
+echo " fixed-address shared memroy region test"
+echo "================================================"
+run2 ./test_shm_fixed_addr M 2>/dev/null && \
+run2 ./test_shm_fixed_addr P 2>/dev/null && \
+run2 ./test_shm_fixed_addr F 2>/dev/null
+if [ $? -eq 0 ]
+then
+    echo "Test 6 Passed"
+else
+    echo "Test 6 Failed"
+fi
+echo "================================================"
+
+# Test 7: C++ shared memory container test
+echo
+echo "================= Run Test 7 ==================="
+echo " shared memroy C++ container test"
+echo "================================================"
+run2 ./test_shm_containers M 2>/dev/null && \
+run2 ./test_shm_containers F 2>/dev/null
+if [ $? -eq 0 ]
+then
+    echo "Test 7 Passed"
+else
+    echo "Test 7 Failed"
+fi
+echo "================================================"
+
+# Test 8: C++ typed queue test
+echo
+echo "================= Run Test 8 ==================="
+echo " shared memroy C++ typed queue test"
+echo "================================================"
+run2 ./test_typed_queue M 2>/dev/null && \
+run2 ./test_typed_queue F 2>/dev/null
+if [ $? -eq 0 ]
+then
+    echo "Test 8 Passed"
+else
+    echo "Test 8 Failed"
+fi
+echo "================================================"
+
+# Test 9: queue directory test
+echo
+echo "================= Run Test 9 ==================="
+echo " shared memroy queue directory test"
+echo "================================================"
+./test_queue_directory P 2>/dev/null && ./test_queue_directory M 2>/dev/null
+if [ $? -eq 0 ]
+then
+    echo "Test 9 Passed"
+else
+    echo "Test 9 Failed"
+fi
+echo "================================================"
+
+# Test 10: bootstrap service test
+echo
+echo "================= Run Test 10 ==================="
+echo " bootstrap service test"
+echo "================================================"
+./test_bootstrap 128
+if [ $? -eq 0 ]
+then
+    echo "Test 10 Passed"
+else
+    echo "Test 10 Failed"
+fi
+echo "================================================"
+
+# Test 11: shared memory queue latency benchmark
+echo
+echo "================= Run Test 11 ==================="
 echo " shared memroy queue latency benchmark"
 echo "================================================"
 echo
 echo " latency result with SystemV shm"
 echo
-mpirun -np 2 -hostfile ./myhostfile ./perf_queue_latency S 2>/dev/null
+run2 ./perf_queue_latency S 2>/dev/null && \
+echo && echo && \
+echo " latency result with mmap shm" && \
+echo && \
+run2 ./perf_queue_latency M 2>/dev/null && \
+echo && echo && \
+echo " latency result with POSIX shm" && \
+echo && \
+run2 ./perf_queue_latency P 2>/dev/null && \
+echo && echo && \
+echo " latency result with memfd shm" && \
+echo && \
+run2 ./perf_queue_latency F 2>/dev/null
+status=$?
 echo
+if [ $status -eq 0 ]
+then
+    echo "Test 11 Passed"
+else
+    echo "Test 11 Failed"
+fi
+echo "================================================"
+
+# Test 12: shared memory queue bandwidth benchmark
 echo
-echo " latency result with mmap shm"
+echo "================= Run Test 12 ==================="
+echo " shared memroy queue bandwidth benchmark"
+echo "================================================"
+run2 ./perf_queue_bw -S 16M -q 16 -b 256M SMP 2>/dev/null && \
+run2 ./perf_queue_bw -S 16M -q 16 -b 256M -z SMP 2>/dev/null
+if [ $? -eq 0 ]
+then
+    echo "Test 12 Passed"
+else
+    echo "Test 12 Failed"
+fi
+echo "================================================"
+
+# Test 13: shared memory queue pair scaling benchmark
 echo
-mpirun -np 2 -hostfile ./myhostfile ./perf_queue_latency M 2>/dev/null
+echo "================= Run Test 13 ==================="
+echo " shared memroy queue pair scaling benchmark"
+echo "================================================"
+./perf_queue_pairs A 2>/dev/null && ./perf_queue_pairs -1 A 2>/dev/null
+if [ $? -eq 0 ]
+then
+    echo "Test 13 Passed"
+else
+    echo "Test 13 Failed"
+fi
+echo "================================================"
+
+# Test 14: concurrent region management benchmark
+echo
+echo "================= Run Test 14 ==================="
+echo " concurrent shm region life cycle benchmark"
+echo "================================================"
+./perf_region_mt M 4 2>/dev/null && ./perf_region_mt P 4 2>/dev/null
+if [ $? -eq 0 ]
+then
+    echo "Test 14 Passed"
+else
+    echo "Test 14 Failed"
+fi
+echo "================================================"
+
+# Test 15: shm queue vs kernel IPC benchmark
 echo
+echo "================= Run Test 15 ==================="
+echo " shared memroy queue vs kernel IPC benchmark"
+echo "================================================"
+./perf_ipc_compare -S 64K 2>/dev/null
+if [ $? -eq 0 ]
+then
+    echo "Test 15 Passed"
+else
+    echo "Test 15 Failed"
+fi
+echo "================================================"
+
+# Test 16: region life cycle benchmark
 echo
-echo " latency result with POSIX shm"
+echo "================= Run Test 16 ==================="
+echo " shm region life cycle phase benchmark"
+echo "================================================"
+./perf_region_lifecycle -S 16M SMP 2>/dev/null
+if [ $? -eq 0 ]
+then
+    echo "Test 16 Passed"
+else
+    echo "Test 16 Failed"
+fi
+echo "================================================"
+
+# Test 17: in-process queue benchmark
 echo
-mpirun -np 2 -hostfile ./myhostfile ./perf_queue_latency P 2>/dev/null
+echo "================= Run Test 17 ==================="
+echo " shared memroy queue in-process benchmark"
+echo "================================================"
+./perf_queue_threads A 2>/dev/null && ./perf_queue_threads P 2>/dev/null
+if [ $? -eq 0 ]
+then
+    echo "Test 17 Passed"
+else
+    echo "Test 17 Failed"
+fi
+echo "================================================"
+
+# Test 18: cpu topology discovery and pinning
 echo
+echo "================= Run Test 18 ==================="
+echo " cpu topology discovery and pinning"
+echo "================================================"
+./test_topology 2>/dev/null && ./perf_queue_threads -m A 2>/dev/null
 if [ $? -eq 0 ]
 then
-    echo "Test 3 Passed"
+    echo "Test 18 Passed"
 else
-    echo "Test 3 Failed"
+    echo "Test 18 Failed"
 fi
 echo "================================================"
 
+# Test 19: queue set
+echo
+echo "================= Run Test 19 ==================="
+echo " shared memroy queue set"
+echo "================================================"
+./test_queue_set 2>/dev/null
+if [ $? -eq 0 ]
+then
+    echo "Test 19 Passed"
+else
+    echo "Test 19 Failed"
+fi
+echo "================================================"
 
-# cleanup
-rm -rf myhostfile
+# Test 20: peer liveness
+echo
+echo "================= Run Test 20 ==================="
+echo " blocking queue calls on a dead peer"
+echo "================================================"
+./test_queue_peer 2>/dev/null
+if [ $? -eq 0 ]
+then
+    echo "Test 20 Passed"
+else
+    echo "Test 20 Failed"
+fi
+echo "================================================"
@@ -0,0 +1,187 @@
+/*
+ * This test program excercises DF's anonymous shm method: a region created
+ * before fork() is attached by the child through its contact info and by a
+ * thread of the parent through its name; both receive messages from the parent
+ * through shm queues in the region. The child's detach unmaps the region in the
+ * child even though it inherited the parent's handle, and once the region is
+ * destroyed its contact info does not attach a new region created after it.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include "df_shm.h"
+#include "df_shm_queue.h"
+#include "df_config.h"
+
+// test parameters
+size_t num_slots = 4;
+size_t max_payload_size = 64;
+uint64_t num_msgs = 10000;
+char region_name[] = "test_anon_fork";
+
+df_shm_method_t df_shm_handle;
+
+/*
+ * Attach the region, receive num_msgs messages from the queue at queue_offset and
+ * detach. Return 0 on success.
+ */
+int receive(df_shm_region_t shm_region, size_t queue_offset, const char *who)
+{
+    df_queue_t queue = (df_queue_t) OFFSET2ADDR(shm_region, queue_offset);
+    df_queue_ep_t recv_ep = df_get_queue_receiver_ep(queue);
+    uint64_t i;
+    for(i = 0; i < num_msgs; i ++) {
+        void *msg;
+        size_t length;
+        if(df_dequeue(recv_ep, &msg, &length) != 0) {
+            fprintf(stderr, "%s: Error in dequeue. %s:%d\n", who, __FILE__, __LINE__);
+            return -1;
+        }
+        if(length != sizeof(uint64_t) || *(uint64_t *) msg != i) {
+            fprintf(stderr, "%s: Error message doesn't match. %s:%d\n", who, __FILE__, __LINE__);
+            return -1;
+        }
+        df_release(recv_ep);
+    }
+    fprintf(stderr, "%s received %lu messages.\n", who, num_msgs);
+    df_destroy_ep(recv_ep);
+    if(df_detach_shm_region(shm_region) != 0) {
+        fprintf(stderr, "%s: Cannot detach shm region. %s:%d\n", who, __FILE__, __LINE__);
+        return -1;
+    }
+    return 0;
+}
+
+void *thread_receiver(void *arg)
+{
+    size_t queue_offset = *(size_t *) arg;
+    df_shm_region_t shm_region = df_attach_named_shm_region(df_shm_handle, region_name,
+        strlen(region_name) + 1, PAGE_SIZE, NULL);
+    if(!shm_region) {
+        fprintf(stderr, "Thread: Cannot attach shm region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    if(receive(shm_region, queue_offset, "Thread") != 0) {
+        exit(-1);
+    }
+    return NULL;
+}
+
+int main (int argc, char *argv[])
+{
+    df_shm_handle = df_shm_init(DF_SHM_METHOD_ANON, NULL);
+    if(!df_shm_handle) {
+        fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n",
+            DF_SHM_METHOD_ANON, __FILE__, __LINE__);
+        return -1;
+    }
+
+    // create a region with one queue to the child process and one to the thread
+    size_t queue_size = df_calculate_queue_size(num_slots, max_payload_size);
+    size_t child_q_offset = CACHE_LINE_SIZE;
+    size_t thread_q_offset = child_q_offset + queue_size;
+    if(thread_q_offset % CACHE_LINE_SIZE) {
+        thread_q_offset += CACHE_LINE_SIZE - (thread_q_offset % CACHE_LINE_SIZE);
+    }
+    if(thread_q_offset + queue_size > PAGE_SIZE) {
+        fprintf(stderr, "Queues do not fit in a page. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    df_shm_region_t shm_region = df_create_named_shm_region(df_shm_handle, region_name,
+        strlen(region_name) + 1, PAGE_SIZE, NULL);
+    if(!shm_region) {
+        fprintf(stderr, "Cannot create region. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    df_queue_t child_q = df_create_queue(OFFSET2ADDR(shm_region, child_q_offset),
+        num_slots, max_payload_size);
+    df_queue_t thread_q = df_create_queue(OFFSET2ADDR(shm_region, thread_q_offset),
+        num_slots, max_payload_size);
+    int contact_length;
+    void *contact_info = df_shm_region_contact_info(df_shm_handle, shm_region, &contact_length);
+    if(!child_q || !thread_q || !contact_info) {
+        fprintf(stderr, "Cannot create queues or contact info. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    // the child inherits the mapping and attaches it through the contact info
+    pid_t parent_pid = getpid();
+    pid_t child = fork();
+    if(child == -1) {
+        fprintf(stderr, "Cannot fork. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    if(child == 0) {
+        df_shm_method_t child_handle = df_shm_init(DF_SHM_METHOD_ANON, NULL);
+        df_shm_region_t child_region = df_attach_shm_region(child_handle, parent_pid,
+            contact_info, PAGE_SIZE, NULL);
+        if(!child_region) {
+            fprintf(stderr, "Child: Cannot attach shm region. %s:%d\n", __FILE__, __LINE__);
+            _exit(1);
+        }
+        int rc = receive(child_region, child_q_offset, "Child");
+        df_shm_finalize(child_handle);
+        if(rc == 0 && msync(shm_region->starting_addr, PAGE_SIZE, MS_ASYNC) == 0) {
+            fprintf(stderr, "Child: region is still mapped after detaching it. %s:%d\n",
+                __FILE__, __LINE__);
+            rc = -1;
+        }
+        _exit(rc? 1 : 0);
+    }
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, thread_receiver, &thread_q_offset);
+
+    // send to both receivers
+    df_queue_ep_t child_ep = df_get_queue_sender_ep(child_q);
+    df_queue_ep_t thread_ep = df_get_queue_sender_ep(thread_q);
+    uint64_t i;
+    for(i = 0; i < num_msgs; i ++) {
+        if(df_enqueue(child_ep, &i, sizeof(i)) != 0 || df_enqueue(thread_ep, &i, sizeof(i)) != 0) {
+            fprintf(stderr, "Sender: Error in enqueue. %s:%d\n", __FILE__, __LINE__);
+            return -1;
+        }
+    }
+    fprintf(stderr, "Sender sent %lu messages to each receiver.\n", num_msgs);
+
+    int status;
+    pthread_join(thread, NULL);
+    waitpid(child, &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Child failed. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    df_destroy_ep(child_ep);
+    df_destroy_ep(thread_ep);
+    df_destroy_queue(child_q);
+    df_destroy_queue(thread_q);
+    if(df_destroy_shm_region(shm_region) != 0) {
+        fprintf(stderr, "Cannot destory shm region. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    // the new region may take the table entry of the destroyed one
+    df_shm_region_t new_region = df_create_shm_region(df_shm_handle, PAGE_SIZE, NULL);
+    if(!new_region) {
+        fprintf(stderr, "Cannot create region. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    fprintf(stderr, "Expect an error on attaching the destroyed region:\n");
+    if(df_attach_shm_region(df_shm_handle, parent_pid, contact_info, PAGE_SIZE, NULL)) {
+        fprintf(stderr, "Contact info of a destroyed region attached another one. %s:%d\n",
+            __FILE__, __LINE__);
+        return -1;
+    }
+    df_destroy_shm_region(new_region);
+    free(contact_info);
+    df_shm_finalize(df_shm_handle);
+    return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * This test program excercises the bootstrap service: the parent forks a group of
+ * processes which meet at a rendezvous name, gather each other's pids, pass a
+ * token around a ring with point-to-point messages and synchronize at barriers,
+ * which are checked with a counter in memory shared by all processes.
+ * Rank 0 reports how long wiring up the group took.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "df_shm_bootstrap.h"
+
+// test parameters
+int num_procs = 128;
+int num_rounds = 10;
+char name[64];
+uint64_t *counter;     // shared by all processes
+
+double wtime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int member(double start_time)
+{
+    df_bootstrap_t b = df_bootstrap_init(name, num_procs);
+    if(!b) {
+        fprintf(stderr, "Cannot join bootstrap group. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    int rank = df_bootstrap_rank(b);
+    int size = df_bootstrap_size(b);
+
+    // every process learns every pid in rank order
+    int32_t pid = getpid();
+    int32_t *pids = (int32_t *) malloc(size * sizeof(int32_t));
+    if(df_bootstrap_allgather(b, &pid, sizeof(pid), pids) != 0 || pids[rank] != pid) {
+        fprintf(stderr, "Rank %d: Wrong allgather result. %s:%d\n", rank, __FILE__, __LINE__);
+        return -1;
+    }
+    int i;
+    for(i = 0; i < size; i ++) {
+        if(i != rank && pids[i] == pid) {
+            fprintf(stderr, "Rank %d: Duplicate pid. %s:%d\n", rank, __FILE__, __LINE__);
+            return -1;
+        }
+    }
+    if(rank == 0) {
+        fprintf(stderr, "%d processes joined and exchanged pids in %.3f ms.\n", size,
+            (wtime() - start_time) * 1000);
+    }
+
+    // pass a token around the ring; each process adds its rank
+    int next = (rank + 1) % size;
+    int prev = (rank + size - 1) % size;
+    int round;
+    for(round = 0; round < num_rounds; round ++) {
+        uint64_t token = 0;
+        if(rank == 0) {
+            if(df_bootstrap_send(b, next, &token, sizeof(token)) != 0 ||
+               df_bootstrap_recv(b, prev, &token, sizeof(token)) != 0 ||
+               token != (uint64_t) size * (size - 1) / 2) {
+                fprintf(stderr, "Rank 0: Wrong token %lu. %s:%d\n", token, __FILE__, __LINE__);
+                return -1;
+            }
+        }
+        else {
+            if(df_bootstrap_recv(b, prev, &token, sizeof(token)) != 0) {
+                return -1;
+            }
+            token += rank;
+            if(df_bootstrap_send(b, next, &token, sizeof(token)) != 0) {
+                return -1;
+            }
+        }
+        // nobody leaves the barrier before everyone has counted this round
+        __atomic_add_fetch(counter, 1, __ATOMIC_SEQ_CST);
+        if(df_bootstrap_barrier(b) != 0 ||
+           __atomic_load_n(counter, __ATOMIC_SEQ_CST) < (uint64_t) size * (round + 1)) {
+            fprintf(stderr, "Rank %d: Barrier failed. %s:%d\n", rank, __FILE__, __LINE__);
+            return -1;
+        }
+    }
+
+    free(pids);
+    df_bootstrap_finalize(b);
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    if(argc > 1) {
+        num_procs = atoi(argv[1]);
+    }
+    snprintf(name, sizeof(name), "df_shm_test_bootstrap.%d", getpid());
+
+    counter = (uint64_t *) mmap(NULL, sizeof(uint64_t), PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(counter == MAP_FAILED) {
+        fprintf(stderr, "Cannot map shared counter. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    *counter = 0;
+
+    double start_time = wtime();
+    pid_t *children = (pid_t *) malloc(num_procs * sizeof(pid_t));
+    int i;
+    for(i = 0; i < num_procs; i ++) {
+        children[i] = fork();
+        if(children[i] == -1) {
+            fprintf(stderr, "Cannot fork. %s:%d\n", __FILE__, __LINE__);
+            return -1;
+        }
+        if(children[i] == 0) {
+            _exit(member(start_time)? 1 : 0);
+        }
+    }
+
+    int failed = 0;
+    for(i = 0; i < num_procs; i ++) {
+        int status;
+        waitpid(children[i], &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed = 1;
+        }
+    }
+    free(children);
+    if(failed) {
+        fprintf(stderr, "Some processes failed. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    fprintf(stderr, "%d processes passed a token %d times around the ring.\n", num_procs, num_rounds);
+    return 0;
+}
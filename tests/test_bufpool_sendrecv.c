@@ -0,0 +1,282 @@
+/*
+ * This test program excercises DF's shm buffer pool routines: the sender
+ * fills pool buffers in place and passes only their descriptors through a
+ * shm queue; the receiver checks the payloads and returns the buffers.
+ *
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include "df_shm_bootstrap.h"
+#include "df_shm.h"
+#include "df_shm_queue.h"
+#include "df_shm_bufpool.h"
+#include "df_config.h"
+
+// test parameters
+enum DF_SHM_METHOD shm_method = DF_SHM_METHOD_POSIX_SHM;
+size_t num_slots = 4;
+uint32_t num_buffers = 8;
+size_t buffer_size = 256 * 1024;
+uint64_t num_msgs = 10000;
+
+df_bootstrap_t bootstrap;
+
+void sender();
+void receiver();
+
+/*
+ * payload of the i-th message: length varies from 1 byte up to buffer_size
+ */
+size_t msg_length(uint64_t i)
+{
+    return 1 + (i * 7919) % buffer_size;
+}
+
+char msg_byte(uint64_t i)
+{
+    return (char) ('a' + i % 26);
+}
+
+int main (int argc, char *argv[])
+{
+    int rank, size = 2;
+
+    bootstrap = df_bootstrap_init(NULL, 2);
+    if(!bootstrap) {
+        fprintf(stderr, "The test requires 2 processes in a bootstrap group.\n");
+        return -1;
+    }
+    rank = df_bootstrap_rank(bootstrap);
+    printf( "Hello world from process %d of %d\n", rank, size );
+
+    if(rank==0) {
+        sender();
+    }
+    else {
+        receiver();
+    }
+    df_bootstrap_finalize(bootstrap);
+    return 0;
+}
+
+void sender()
+{
+    // choose the underlying shm method
+    df_shm_method_t df_shm_handle = df_shm_init(shm_method, NULL);
+    if(!df_shm_handle) {
+        fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n",
+            shm_method, __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // create a shm region with a descriptor queue and a buffer pool in it
+    // the shm region is laid out in memory as follows:
+    // offset of queue (8 byte)
+    // offset of buffer pool (8 byte)
+    // queue (cacheline aligned)
+    // buffer pool (cacheline aligned)
+    size_t queue_size = df_calculate_queue_size(num_slots, sizeof(df_bufpool_desc_t));
+    size_t pool_size = df_calculate_bufpool_size(num_buffers, buffer_size);
+    size_t queue_offset = CACHE_LINE_SIZE;
+    size_t pool_offset = queue_offset + queue_size;
+    if(pool_offset % CACHE_LINE_SIZE) {
+        pool_offset += CACHE_LINE_SIZE - (pool_offset % CACHE_LINE_SIZE);
+    }
+    size_t region_size = pool_offset + pool_size;
+    if(region_size % PAGE_SIZE) {
+        region_size += PAGE_SIZE - (region_size % PAGE_SIZE);
+    }
+    df_shm_region_t shm_region = df_create_shm_region(df_shm_handle, region_size, NULL);
+    if(!shm_region) {
+        fprintf(stderr, "Cannot create region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    uint64_t *header = (uint64_t *) shm_region->starting_addr;
+    header[0] = queue_offset;
+    header[1] = pool_offset;
+
+    df_queue_t queue = df_create_queue(OFFSET2ADDR(shm_region, queue_offset),
+        num_slots, sizeof(df_bufpool_desc_t));
+    df_queue_ep_t send_ep = df_get_queue_sender_ep(queue);
+    df_bufpool_t pool = df_create_bufpool(OFFSET2ADDR(shm_region, pool_offset),
+        num_buffers, buffer_size);
+    if(!queue || !send_ep || !pool) {
+        fprintf(stderr, "Cannot create queue or buffer pool. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // generate shm region contact info
+    int contact_length;
+    void *contact_info;
+    contact_info = df_shm_region_contact_info(df_shm_handle, shm_region, &contact_length);
+    if(!contact_info) {
+        fprintf(stderr, "Cannot create contact info for shm region. %s:%d\n",
+            __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // send the contact info to receiver side through external mechanism
+    // in this case, we use the bootstrap service
+    int sender_pid = getpid();
+    df_bootstrap_send(bootstrap, 1, &contact_length, sizeof(contact_length));
+    df_bootstrap_send(bootstrap, 1, contact_info, contact_length);
+    df_bootstrap_send(bootstrap, 1, &sender_pid, sizeof(sender_pid));
+    df_bootstrap_send(bootstrap, 1, &region_size, sizeof(region_size));
+
+    // wait for receiver to attach region
+    df_bootstrap_barrier(bootstrap);
+
+    // fill pool buffers in place and pass their descriptors to receiver
+    uint64_t i;
+    for(i = 0; i < num_msgs; i ++) {
+        df_bufpool_desc_t desc;
+        while(df_bufpool_get(pool, &desc) != 0) {
+            sched_yield(); // all buffers are in flight; wait for receiver to return some
+        }
+        size_t length = msg_length(i);
+        memset(DF_BUFPOOL_DESC2ADDR(pool, desc), msg_byte(i), length);
+        if(df_enqueue_buffer(send_ep, pool, desc, length) != 0) {
+            fprintf(stderr, "Sender: Error in enqueue. %s:%d\n", __FILE__, __LINE__);
+            exit(-1);
+        }
+    }
+    fprintf(stderr, "Sender sent %lu buffers.\n", num_msgs);
+
+    // wait for receiver to return all buffers and detach
+    df_bootstrap_barrier(bootstrap);
+
+    // all buffers should be back in the pool
+    df_bufpool_desc_t descs[num_buffers];
+    for(i = 0; i < num_buffers; i ++) {
+        if(df_bufpool_get(pool, &descs[i]) != 0) {
+            fprintf(stderr, "Sender: buffer %lu is not returned to pool. %s:%d\n",
+                i, __FILE__, __LINE__);
+            exit(-1);
+        }
+    }
+    if(df_bufpool_get(pool, &descs[0]) != -1) {
+        fprintf(stderr, "Sender: pool is not empty. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    df_destroy_ep(send_ep);
+    df_destroy_queue(queue);
+    df_destroy_bufpool(pool);
+
+    // destroy the shm region
+    if(df_destroy_shm_region(shm_region) != 0) {
+        fprintf(stderr, "Cannot destory shm region. %s:%d\n",
+            __FILE__, __LINE__);
+        exit(-1);
+    }
+    free(contact_info);
+    df_shm_finalize(df_shm_handle);
+    return;
+}
+
+
+void receiver()
+{
+    // choose the underlying shm method
+    df_shm_method_t df_shm_handle = df_shm_init(shm_method, NULL);
+    if(!df_shm_handle) {
+        fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n",
+            shm_method, __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // wait for sender to tell me the contact info of shm region
+    int contact_length;
+    void *contact_info;
+    pid_t creator_pid;
+    size_t region_size;
+    int rc = df_bootstrap_recv(bootstrap, 0, &contact_length, sizeof(contact_length));
+    if(rc != 0) {
+        fprintf(stderr, "Bootstrap receive error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+        exit(-1);
+    }
+    contact_info = malloc(contact_length);
+    if(!contact_info) {
+        fprintf(stderr, "Cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    rc = df_bootstrap_recv(bootstrap, 0, contact_info, contact_length);
+    if(rc != 0) {
+        fprintf(stderr, "Bootstrap receive error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+        exit(-1);
+    }
+    rc = df_bootstrap_recv(bootstrap, 0, &creator_pid, sizeof(creator_pid));
+    if(rc != 0) {
+        fprintf(stderr, "Bootstrap receive error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+        exit(-1);
+    }
+    rc = df_bootstrap_recv(bootstrap, 0, &region_size, sizeof(region_size));
+    if(rc != 0) {
+        fprintf(stderr, "Bootstrap receive error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // attach the region
+    df_shm_region_t shm_region = df_attach_shm_region (df_shm_handle, creator_pid,
+        contact_info, region_size, NULL);
+    if(!shm_region) {
+        fprintf(stderr, "Cannot attach shm region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // locate queue and buffer pool in shm region
+    uint64_t *header = (uint64_t *) shm_region->starting_addr;
+    df_queue_t queue = (df_queue_t) OFFSET2ADDR(shm_region, header[0]);
+    df_bufpool_t pool = (df_bufpool_t) OFFSET2ADDR(shm_region, header[1]);
+    df_queue_ep_t recv_ep = df_get_queue_receiver_ep(queue);
+
+    // tell sender that it's time to exchange data
+    df_bootstrap_barrier(bootstrap);
+
+    // receive buffers, check them in place and return them to the pool
+    uint64_t i;
+    for(i = 0; i < num_msgs; i ++) {
+        df_bufpool_desc_t desc;
+        void *data;
+        size_t length;
+        if(df_dequeue_buffer(recv_ep, pool, &desc, &data, &length) != 0) {
+            fprintf(stderr, "Receiver: Error in dequeue. %s:%d\n", __FILE__, __LINE__);
+            exit(-1);
+        }
+        if(length != msg_length(i)) {
+            fprintf(stderr, "Receiver: Error buffer length %lu doesn't match %lu. %s:%d\n",
+                length, msg_length(i), __FILE__, __LINE__);
+            exit(-1);
+        }
+        char *p = (char *) data;
+        size_t j;
+        for(j = 0; j < length; j ++) {
+            if(p[j] != msg_byte(i)) {
+                fprintf(stderr, "Receiver: Error buffer content doesn't match. %s:%d\n",
+                    __FILE__, __LINE__);
+                exit(-1);
+            }
+        }
+        df_bufpool_put(pool, desc);
+    }
+    fprintf(stderr, "Receiver received %lu buffers.\n", num_msgs);
+
+    df_destroy_ep(recv_ep);
+
+    // detach the shm region
+    if(df_detach_shm_region(shm_region) != 0) {
+        fprintf(stderr, "Cannot detach shm region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // tell sender we have detached the region
+    df_bootstrap_barrier(bootstrap);
+    free(contact_info);
+    df_shm_finalize(df_shm_handle);
+    return;
+}
@@ -0,0 +1,190 @@
+/*
+ * This test program excercises the queue directory: the parent opens a directory
+ * and forks a ring of children; each child creates a queue, publishes it by name,
+ * attaches the queue of the next child by name and sends it its rank, and checks
+ * the rank received from the previous child. No contact info is passed between
+ * the processes. The parent also checks publishing a name twice and unpublishing.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include "df_shm.h"
+#include "df_shm_queue.h"
+#include "df_shm_directory.h"
+#include "df_config.h"
+
+// test parameters
+enum DF_SHM_METHOD shm_method = DF_SHM_METHOD_POSIX_SHM;
+int num_children = 8;
+size_t num_slots = 4;
+size_t max_payload_size = 64;
+char dir_name[64];
+
+df_shm_method_t init_method()
+{
+    df_shm_method_t df_shm_handle = df_shm_init(shm_method, NULL);
+    if(!df_shm_handle) {
+        fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n",
+            shm_method, __FILE__, __LINE__);
+        exit(-1);
+    }
+    return df_shm_handle;
+}
+
+/*
+ * Create a region holding one queue. Return the queue.
+ */
+df_queue_t create_queue(df_shm_method_t df_shm_handle, df_shm_region_t *region)
+{
+    *region = df_create_shm_region(df_shm_handle, df_calculate_queue_size(num_slots, max_payload_size), NULL);
+    if(!*region) {
+        fprintf(stderr, "Cannot create shm region. %s:%d\n", __FILE__, __LINE__);
+        return NULL;
+    }
+    return df_create_queue((*region)->starting_addr, num_slots, max_payload_size);
+}
+
+int child(int rank)
+{
+    df_shm_method_t df_shm_handle = init_method();
+    df_directory_t dir = df_open_directory(df_shm_handle, dir_name, 0);
+    if(!dir) {
+        fprintf(stderr, "Child %d: Cannot open directory. %s:%d\n", rank, __FILE__, __LINE__);
+        return -1;
+    }
+
+    char name[DF_DIRECTORY_NAME_LENGTH];
+    df_shm_region_t region;
+    df_queue_t queue = create_queue(df_shm_handle, &region);
+    snprintf(name, sizeof(name), "q%d", rank);
+    if(!queue || df_publish_queue(dir, name, region, queue) != 0) {
+        fprintf(stderr, "Child %d: Cannot publish queue. %s:%d\n", rank, __FILE__, __LINE__);
+        return -1;
+    }
+
+    // the next child may not have published its queue yet
+    df_shm_region_t next_region;
+    df_queue_t next_queue;
+    snprintf(name, sizeof(name), "q%d", (rank + 1) % num_children);
+    while(!(next_queue = df_attach_queue(dir, df_shm_handle, name, &next_region))) {
+        usleep(1000);
+    }
+    df_queue_ep_t send_ep = df_get_queue_sender_ep(next_queue);
+    if(df_enqueue(send_ep, &rank, sizeof(rank)) != 0) {
+        fprintf(stderr, "Child %d: Error in enqueue. %s:%d\n", rank, __FILE__, __LINE__);
+        return -1;
+    }
+
+    df_queue_ep_t recv_ep = df_get_queue_receiver_ep(queue);
+    void *msg;
+    size_t length;
+    if(df_dequeue(recv_ep, &msg, &length) != 0 || length != sizeof(int) ||
+       *(int *) msg != (rank + num_children - 1) % num_children) {
+        fprintf(stderr, "Child %d: Wrong message. %s:%d\n", rank, __FILE__, __LINE__);
+        return -1;
+    }
+    df_release(recv_ep);
+
+    // the previous child has attached the queue since it sent to it
+    snprintf(name, sizeof(name), "q%d", rank);
+    df_destroy_ep(send_ep);
+    df_destroy_ep(recv_ep);
+    if(df_unpublish_queue(dir, name) != 0 || df_detach_shm_region(next_region) != 0 ||
+       df_destroy_shm_region(region) != 0 || df_close_directory(dir) != 0) {
+        fprintf(stderr, "Child %d: Cannot clean up. %s:%d\n", rank, __FILE__, __LINE__);
+        return -1;
+    }
+    df_shm_finalize(df_shm_handle);
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    // optionally choose the shm method: M (mmap) or P (POSIX shm)
+    if(argc > 1) {
+        switch(argv[1][0]) {
+            case 'M': shm_method = DF_SHM_METHOD_MMAP; break;
+            case 'P': shm_method = DF_SHM_METHOD_POSIX_SHM; break;
+            default:
+                fprintf(stderr, "Unknown shm method %s.\n", argv[1]);
+                return -1;
+        }
+    }
+    if(shm_method == DF_SHM_METHOD_MMAP) {
+        snprintf(dir_name, sizeof(dir_name), "/tmp/df_shm_test_directory.%d", getpid());
+    }
+    else {
+        snprintf(dir_name, sizeof(dir_name), "/df_shm_test_directory.%d", getpid());
+    }
+
+    df_shm_method_t df_shm_handle = init_method();
+    df_directory_t dir = df_open_directory(df_shm_handle, dir_name, 0);
+    if(!dir) {
+        fprintf(stderr, "Cannot open directory. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    pid_t children[num_children];
+    int i;
+    for(i = 0; i < num_children; i ++) {
+        children[i] = fork();
+        if(children[i] == -1) {
+            fprintf(stderr, "Cannot fork. %s:%d\n", __FILE__, __LINE__);
+            return -1;
+        }
+        if(children[i] == 0) {
+            // the child maps its own regions through its own method handle
+            _exit(child(i)? 1 : 0);
+        }
+    }
+
+    // a name is published once and is gone after unpublishing
+    df_shm_region_t region;
+    df_queue_t queue = create_queue(df_shm_handle, &region);
+    df_queue_info info;
+    if(!queue || df_publish_queue(dir, "parent", region, queue) != 0) {
+        fprintf(stderr, "Cannot publish queue. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    fprintf(stderr, "Publishing a name twice is expected to fail:\n");
+    if(df_publish_queue(dir, "parent", region, queue) == 0) {
+        fprintf(stderr, "Published a name twice. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    if(df_lookup_queue(dir, "parent", &info) != 0 || info.creator_id != getpid() ||
+       info.max_num_slots != num_slots || info.max_payload_size != max_payload_size) {
+        fprintf(stderr, "Wrong directory entry. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    if(df_unpublish_queue(dir, "parent") != 0 || df_lookup_queue(dir, "parent", &info) == 0) {
+        fprintf(stderr, "Cannot unpublish queue. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    int failed = 0;
+    for(i = 0; i < num_children; i ++) {
+        int status;
+        waitpid(children[i], &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Child %d failed. %s:%d\n", i, __FILE__, __LINE__);
+            failed = 1;
+        }
+    }
+    if(failed) {
+        return -1;
+    }
+    fprintf(stderr, "%d processes exchanged messages through queues found by name.\n", num_children);
+
+    df_destroy_queue(queue);
+    if(df_destroy_shm_region(region) != 0 || df_close_directory(dir) != 0) {
+        fprintf(stderr, "Cannot clean up. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    df_shm_finalize(df_shm_handle);
+    return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * This test program checks that blocking queue calls give up when the peer
+ * process is gone instead of spinning forever: a receiver which dies without
+ * destroying its endpoint leaves the sender waiting for an empty slot, a sender
+ * which destroys its endpoint and exits leaves the receiver waiting for the next
+ * message after the ones it sent, and a sender which is killed leaves the
+ * receiver waiting in the same way. Dead children are not reaped until the
+ * parent's call has returned.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "df_shm.h"
+#include "df_shm_queue.h"
+#include "df_config.h"
+
+// test parameters
+size_t num_slots = 4;
+size_t max_payload_size = 64;
+uint64_t num_msgs = 3;
+
+/*
+ * Child: get an endpoint of the queue, tell the parent through the pipe, then send
+ * num_msgs messages and exit cleanly (how 0), die without cleaning up (how 1), or
+ * wait to be killed (how 2).
+ */
+void child(df_queue_t queue, int is_sender, int how, int fd)
+{
+    df_queue_ep_t ep = is_sender? df_get_queue_sender_ep(queue) : df_get_queue_receiver_ep(queue);
+    if(!ep) {
+        _exit(1);
+    }
+    uint64_t i;
+    for(i = 0; is_sender && i < num_msgs; i ++) {
+        df_enqueue(ep, &i, sizeof(i));
+    }
+    char c = 0;
+    if(write(fd, &c, 1) != 1) {
+        _exit(1);
+    }
+    if(how == 0) {
+        df_destroy_ep(ep);
+        _exit(0);
+    }
+    else if(how == 1) {
+        _exit(0);
+    }
+    while(1) {
+        pause();
+    }
+}
+
+/*
+ * Fork a child which does how with its end of a fresh queue at addr; the parent
+ * takes the other end and waits as far as it can. Return 0 if the parent's blocking
+ * call reports the peer gone after getting all messages sent.
+ */
+int run_case(void *addr, int child_sends, int how, const char *name)
+{
+    df_queue_t queue = df_create_queue(addr, num_slots, max_payload_size);
+    int fds[2];
+    if(!queue || pipe(fds) != 0) {
+        fprintf(stderr, "%s: Cannot create queue or pipe. %s:%d\n", name, __FILE__, __LINE__);
+        return -1;
+    }
+    pid_t pid = fork();
+    if(pid == -1) {
+        fprintf(stderr, "%s: Cannot fork. %s:%d\n", name, __FILE__, __LINE__);
+        return -1;
+    }
+    if(pid == 0) {
+        close(fds[0]);
+        child(queue, child_sends, how, fds[1]);
+    }
+    close(fds[1]);
+    char c;
+    if(read(fds[0], &c, 1) != 1) {
+        fprintf(stderr, "%s: Child failed to start. %s:%d\n", name, __FILE__, __LINE__);
+        return -1;
+    }
+    close(fds[0]);
+    if(how == 2) {
+        kill(pid, SIGKILL);
+    }
+
+    int rc = 0;
+    uint64_t i;
+    if(child_sends) {
+        df_queue_ep_t ep = df_get_queue_receiver_ep(queue);
+        for(i = 0; ; i ++) {
+            void *msg;
+            size_t length;
+            rc = df_dequeue(ep, &msg, &length);
+            if(rc != 0) {
+                break;
+            }
+            if(length != sizeof(uint64_t) || *(uint64_t *) msg != i) {
+                fprintf(stderr, "%s: Error message doesn't match. %s:%d\n", name, __FILE__, __LINE__);
+                return -1;
+            }
+            df_release(ep);
+        }
+        df_destroy_ep(ep);
+    }
+    else {
+        // fills the queue, then waits for a slot the receiver never frees
+        df_queue_ep_t ep = df_get_queue_sender_ep(queue);
+        for(i = 0; ; i ++) {
+            rc = df_enqueue(ep, &i, sizeof(i));
+            if(rc != 0) {
+                break;
+            }
+        }
+        df_destroy_ep(ep);
+    }
+    if(rc != DF_QUEUE_PEER_GONE || i != (child_sends? num_msgs : num_slots)) {
+        fprintf(stderr, "%s: Got %d after %lu messages. %s:%d\n", name, rc, i, __FILE__, __LINE__);
+        return -1;
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    df_destroy_queue(queue);
+    fprintf(stderr, "%s: peer gone after %lu messages.\n", name, i);
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    df_shm_method_t df_shm_handle = df_shm_init(DF_SHM_METHOD_ANON, NULL);
+    if(!df_shm_handle) {
+        fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n",
+            DF_SHM_METHOD_ANON, __FILE__, __LINE__);
+        return -1;
+    }
+    df_shm_region_t shm_region = df_create_shm_region(df_shm_handle, PAGE_SIZE, NULL);
+    if(!shm_region) {
+        fprintf(stderr, "Cannot create region. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    void *addr = shm_region->starting_addr;
+    if(run_case(addr, 0, 1, "Receiver died") != 0 ||
+       run_case(addr, 1, 0, "Sender closed") != 0 ||
+       run_case(addr, 1, 2, "Sender killed") != 0) {
+        return -1;
+    }
+    if(df_destroy_shm_region(shm_region) != 0) {
+        fprintf(stderr, "Cannot destory shm region. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    df_shm_finalize(df_shm_handle);
+    return 0;
+}
@@ -8,7 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
-#include <mpi.h>
+#include "df_shm_bootstrap.h"
 #include "df_shm.h"
 #include "df_shm_queue.h"
 #include "df_config.h"
@@ -20,21 +20,21 @@ size_t num_slots = 5;
 uint64_t num_msgs = 1000000;
 size_t msg_size = 16;
 
+df_bootstrap_t bootstrap;
+
 void sender();
 void receiver();
 
 int main (int argc, char *argv[])
 {
-    int rank, size;
+    int rank, size = 2;
 
-    MPI_Init (&argc, &argv);      
-    MPI_Comm_rank (MPI_COMM_WORLD, &rank);        
-    MPI_Comm_size (MPI_COMM_WORLD, &size);        
-    if(size != 2) {
-        fprintf(stderr, "The test requires 2 MPI processes.\n");    
-        MPI_Finalize();
+    bootstrap = df_bootstrap_init(NULL, 2);
+    if(!bootstrap) {
+        fprintf(stderr, "The test requires 2 processes in a bootstrap group.\n");
         return -1;
     }
+    rank = df_bootstrap_rank(bootstrap);
     printf( "Hello world from process %d of %d\n", rank, size );
 
     if(rank==0) {
@@ -43,7 +43,7 @@ int main (int argc, char *argv[])
     else {
         receiver();
     }
-    MPI_Finalize();
+    df_bootstrap_finalize(bootstrap);
     return 0;
 }
 
@@ -117,15 +117,15 @@ void sender()
     }
 
     // send the contact info to receiver side through external mechanism
-    // in this case, we use MPI
+    // in this case, we use the bootstrap service
     int sender_pid = getpid();
-    MPI_Send(&contact_length, 1, MPI_INT, 1, 0, MPI_COMM_WORLD);
-    MPI_Send(contact_info, contact_length, MPI_BYTE, 1, 0, MPI_COMM_WORLD);
-    MPI_Send(&sender_pid, 1, MPI_INT, 1, 1, MPI_COMM_WORLD);
-    MPI_Send(&region_size, 1, MPI_INT, 1, 2, MPI_COMM_WORLD);
+    df_bootstrap_send(bootstrap, 1, &contact_length, sizeof(contact_length));
+    df_bootstrap_send(bootstrap, 1, contact_info, contact_length);
+    df_bootstrap_send(bootstrap, 1, &sender_pid, sizeof(sender_pid));
+    df_bootstrap_send(bootstrap, 1, &region_size, sizeof(region_size));
 
     // wait for receiver to attach region 
-    MPI_Barrier(MPI_COMM_WORLD);
+    df_bootstrap_barrier(bootstrap);
 
     // send messages to receiver from shm queue
     char send_buf[msg_size];
@@ -159,7 +159,7 @@ void sender()
 
     // sync with receiver so both are done with data exchange
     // wait for receiver to detach
-    MPI_Barrier(MPI_COMM_WORLD);
+    df_bootstrap_barrier(bootstrap);
 
     // destroy queue
     df_destroy_ep(send_ep);
@@ -190,14 +190,13 @@ void receiver()
     }
 
     // wait for sender to tell me the contact info of shm region
-    MPI_Status status;
     int contact_length;
     void *contact_info;
     pid_t creator_pid;
-    int region_size;
-    int rc = MPI_Recv(&contact_length, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &status);
-    if(rc != MPI_SUCCESS) {
-        fprintf(stderr, "MPI_Recv error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+    size_t region_size;
+    int rc = df_bootstrap_recv(bootstrap, 0, &contact_length, sizeof(contact_length));
+    if(rc != 0) {
+        fprintf(stderr, "Bootstrap receive error: %d. %s:%d\n", rc, __FILE__, __LINE__);
         exit(-1); 
     }
     contact_info = malloc(contact_length);
@@ -205,19 +204,19 @@ void receiver()
         fprintf(stderr, "Cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         exit(-1);
     }
-    rc = MPI_Recv(contact_info, contact_length, MPI_BYTE, 0, 0, MPI_COMM_WORLD, &status);
-    if(rc != MPI_SUCCESS) {
-        fprintf(stderr, "MPI_Recv error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+    rc = df_bootstrap_recv(bootstrap, 0, contact_info, contact_length);
+    if(rc != 0) {
+        fprintf(stderr, "Bootstrap receive error: %d. %s:%d\n", rc, __FILE__, __LINE__);
         exit(-1);
     }
-    rc = MPI_Recv(&creator_pid, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, &status);
-    if(rc != MPI_SUCCESS) {
-        fprintf(stderr, "MPI_Recv error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+    rc = df_bootstrap_recv(bootstrap, 0, &creator_pid, sizeof(creator_pid));
+    if(rc != 0) {
+        fprintf(stderr, "Bootstrap receive error: %d. %s:%d\n", rc, __FILE__, __LINE__);
         exit(-1);
     }
-    rc = MPI_Recv(&region_size, 1, MPI_INT, 0, 2, MPI_COMM_WORLD, &status);
-    if(rc != MPI_SUCCESS) {
-        fprintf(stderr, "MPI_Recv error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+    rc = df_bootstrap_recv(bootstrap, 0, &region_size, sizeof(region_size));
+    if(rc != 0) {
+        fprintf(stderr, "Bootstrap receive error: %d. %s:%d\n", rc, __FILE__, __LINE__);
         exit(-1);
     }
 
@@ -245,7 +244,7 @@ void receiver()
     df_queue_ep_t send_ep = df_get_queue_sender_ep(recv_q);
 
     // tell sender that it's time to exchange data through queues
-    MPI_Barrier(MPI_COMM_WORLD);
+    df_bootstrap_barrier(bootstrap);
 
     // receive messages from sender
     char recv_buf[msg_size];
@@ -288,7 +287,7 @@ void receiver()
     }
 
     // tell sender we have detached the region
-    MPI_Barrier(MPI_COMM_WORLD);
+    df_bootstrap_barrier(bootstrap);
     free(contact_info);
     df_shm_finalize(df_shm_handle);
     return;
@@ -0,0 +1,267 @@
+/*
+ * This test program excercises queue sets. First, in one process, messages
+ * left on a few queues of a set are received round-robin across those queues,
+ * and an idle set reports nothing to dequeue. Then sender processes each bind
+ * their share of the set's queues and send on all of them, while the parent
+ * receives everything through the set and checks each queue's messages arrive
+ * in order.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include "df_shm.h"
+#include "df_shm_queue.h"
+#include "df_shm_queue_set.h"
+#include "df_config.h"
+
+// test parameters
+uint32_t num_queues = 200;
+int num_senders = 4;
+size_t num_slots = 4;
+size_t max_payload_size = 64;
+uint64_t num_msgs = 50;            // per queue
+
+/*
+ * message: which queue it was sent on and its sequence number there
+ */
+typedef struct _test_msg {
+    uint32_t queue;
+    uint64_t seq;
+} test_msg;
+
+size_t queue_offset(uint32_t q)
+{
+    size_t queue_size = df_calculate_queue_size(num_slots, max_payload_size);
+    return df_calculate_queue_set_size(num_queues) + q * queue_size;
+}
+
+/*
+ * Receive messages left on queues 2, 5 and 130 through the set in one process.
+ * Return 0 on success.
+ */
+int test_round_robin(df_shm_region_t shm_region)
+{
+    uint32_t active[3] = {2, 5, 130};
+    df_queue_set_t set = (df_queue_set_t) shm_region->starting_addr;
+    df_queue_set_receiver_t receiver = df_get_queue_set_receiver(set);
+    df_queue_ep_t send_eps[3], recv_eps[3];
+    int i, j;
+    for(i = 0; i < 3; i ++) {
+        df_queue_t queue = df_create_queue(OFFSET2ADDR(shm_region, queue_offset(active[i])),
+            num_slots, max_payload_size);
+        send_eps[i] = df_get_queue_sender_ep(queue);
+        recv_eps[i] = df_get_queue_receiver_ep(queue);
+    }
+    // queues 0, 1 and 2 of the set; the first message is enqueued before binding
+    for(i = 0; i < 3; i ++) {
+        test_msg msg = {active[i], 0};
+        if(df_enqueue(send_eps[i], &msg, sizeof(msg)) != 0) {
+            fprintf(stderr, "Error in enqueue. %s:%d\n", __FILE__, __LINE__);
+            return -1;
+        }
+        if(df_queue_set_add(receiver, recv_eps[i]) != i || df_queue_set_bind_sender(set, i, send_eps[i]) != 0) {
+            fprintf(stderr, "Cannot add queue %u to the set. %s:%d\n", active[i], __FILE__, __LINE__);
+            return -1;
+        }
+    }
+    for(i = 0; i < 3; i ++) {
+        for(j = 1; j < num_slots; j ++) {
+            test_msg msg = {active[i], j};
+            df_enqueue(send_eps[i], &msg, sizeof(msg));
+        }
+    }
+
+    // each round takes one message from each queue
+    df_queue_ep_t ep;
+    void *data;
+    size_t length;
+    for(j = 0; j < num_slots; j ++) {
+        for(i = 0; i < 3; i ++) {
+            if(df_queue_set_try_dequeue(receiver, &ep, &data, &length) != 0) {
+                fprintf(stderr, "Nothing to dequeue from the set. %s:%d\n", __FILE__, __LINE__);
+                return -1;
+            }
+            test_msg *msg = (test_msg *) data;
+            if(ep != recv_eps[i] || length != sizeof(test_msg) || msg->queue != active[i] || msg->seq != j) {
+                fprintf(stderr, "Got message %lu of queue %u instead of %d of queue %u. %s:%d\n",
+                    msg->seq, msg->queue, j, active[i], __FILE__, __LINE__);
+                return -1;
+            }
+            df_release(ep);
+        }
+    }
+    if(df_queue_set_try_dequeue(receiver, &ep, &data, &length) != -1) {
+        fprintf(stderr, "Dequeued from an idle set. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    // a removed queue is not looked at, and its index is reused
+    test_msg msg = {active[1], num_slots};
+    df_enqueue(send_eps[1], &msg, sizeof(msg));
+    if(df_queue_set_remove(receiver, 1) != 0 ||
+       df_queue_set_try_dequeue(receiver, &ep, &data, &length) != -1 ||
+       df_queue_set_add(receiver, recv_eps[1]) != 1 ||
+       df_queue_set_dequeue(receiver, &ep, &data, &length) != 0 || ep != recv_eps[1]) {
+        fprintf(stderr, "Removing and adding back a queue failed. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    df_release(ep);
+
+    for(i = 0; i < 3; i ++) {
+        df_queue_set_unbind_sender(send_eps[i]);
+        df_destroy_ep(send_eps[i]);
+        df_destroy_ep(recv_eps[i]);
+    }
+    df_destroy_queue_set_receiver(receiver);
+    fprintf(stderr, "Round-robin over ready queues passed.\n");
+    return 0;
+}
+
+/*
+ * Attach the region and send num_msgs messages on each of the queues of sender rank.
+ */
+int send_all(df_shm_method_t df_shm_handle, pid_t parent_pid, void *contact_info, size_t region_size,
+             int rank)
+{
+    df_shm_region_t shm_region = df_attach_shm_region(df_shm_handle, parent_pid, contact_info,
+        region_size, NULL);
+    if(!shm_region) {
+        fprintf(stderr, "Sender %d: Cannot attach shm region. %s:%d\n", rank, __FILE__, __LINE__);
+        return -1;
+    }
+    df_queue_set_t set = (df_queue_set_t) shm_region->starting_addr;
+    uint32_t per_sender = num_queues / num_senders;
+    df_queue_ep_t eps[per_sender];
+    uint32_t q;
+    for(q = 0; q < per_sender; q ++) {
+        uint32_t index = rank * per_sender + q;
+        df_queue_t queue = (df_queue_t) OFFSET2ADDR(shm_region, queue_offset(index));
+        eps[q] = df_get_queue_sender_ep(queue);
+        if(!eps[q] || df_queue_set_bind_sender(set, index, eps[q]) != 0) {
+            fprintf(stderr, "Sender %d: Cannot bind queue %u. %s:%d\n", rank, index, __FILE__, __LINE__);
+            return -1;
+        }
+    }
+    uint64_t i;
+    for(i = 0; i < num_msgs; i ++) {
+        for(q = 0; q < per_sender; q ++) {
+            test_msg msg = {rank * per_sender + q, i};
+            if(df_enqueue(eps[q], &msg, sizeof(msg)) != 0) {
+                fprintf(stderr, "Sender %d: Error in enqueue. %s:%d\n", rank, __FILE__, __LINE__);
+                return -1;
+            }
+        }
+    }
+    for(q = 0; q < per_sender; q ++) {
+        df_destroy_ep(eps[q]);
+    }
+    return df_detach_shm_region(shm_region);
+}
+
+int main (int argc, char *argv[])
+{
+    df_shm_method_t df_shm_handle = df_shm_init(DF_SHM_METHOD_ANON, NULL);
+    if(!df_shm_handle) {
+        fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n",
+            DF_SHM_METHOD_ANON, __FILE__, __LINE__);
+        return -1;
+    }
+
+    // the set at the start of the region, followed by its queues
+    size_t region_size = queue_offset(num_queues);
+    df_shm_region_t shm_region = df_create_shm_region(df_shm_handle, region_size, NULL);
+    if(!shm_region) {
+        fprintf(stderr, "Cannot create region. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    df_queue_set_t set = df_create_queue_set(shm_region->starting_addr, num_queues);
+    if(!set || test_round_robin(shm_region) != 0) {
+        return -1;
+    }
+    df_destroy_queue_set(set);
+
+    // a fresh set whose queues are all in use
+    set = df_create_queue_set(shm_region->starting_addr, num_queues);
+    df_queue_set_receiver_t receiver = df_get_queue_set_receiver(set);
+    df_queue_ep_t recv_eps[num_queues];
+    uint64_t next_seq[num_queues];
+    uint32_t q;
+    for(q = 0; q < num_queues; q ++) {
+        df_queue_t queue = df_create_queue(OFFSET2ADDR(shm_region, queue_offset(q)), num_slots,
+            max_payload_size);
+        recv_eps[q] = df_get_queue_receiver_ep(queue);
+        next_seq[q] = 0;
+        if(df_queue_set_add(receiver, recv_eps[q]) != q) {
+            fprintf(stderr, "Cannot add queue %u to the set. %s:%d\n", q, __FILE__, __LINE__);
+            return -1;
+        }
+    }
+    int contact_length;
+    void *contact_info = df_shm_region_contact_info(df_shm_handle, shm_region, &contact_length);
+
+    pid_t parent_pid = getpid();
+    pid_t children[num_senders];
+    int rank;
+    for(rank = 0; rank < num_senders; rank ++) {
+        children[rank] = fork();
+        if(children[rank] == -1) {
+            fprintf(stderr, "Cannot fork. %s:%d\n", __FILE__, __LINE__);
+            return -1;
+        }
+        if(children[rank] == 0) {
+            df_shm_method_t child_handle = df_shm_init(DF_SHM_METHOD_ANON, NULL);
+            int rc = send_all(child_handle, parent_pid, contact_info, region_size, rank);
+            df_shm_finalize(child_handle);
+            _exit(rc? 1 : 0);
+        }
+    }
+
+    uint64_t total = (uint64_t) num_queues * num_msgs, i;
+    for(i = 0; i < total; i ++) {
+        df_queue_ep_t ep;
+        void *data;
+        size_t length;
+        if(df_queue_set_dequeue(receiver, &ep, &data, &length) != 0) {
+            fprintf(stderr, "Error in dequeue. %s:%d\n", __FILE__, __LINE__);
+            return -1;
+        }
+        test_msg *msg = (test_msg *) data;
+        if(length != sizeof(test_msg) || msg->queue >= num_queues || ep != recv_eps[msg->queue] ||
+           msg->seq != next_seq[msg->queue]) {
+            fprintf(stderr, "Message doesn't match. %s:%d\n", __FILE__, __LINE__);
+            return -1;
+        }
+        next_seq[msg->queue] ++;
+        df_release(ep);
+    }
+    fprintf(stderr, "Received %lu messages on %u queues from %d senders.\n", total, num_queues,
+        num_senders);
+
+    int rc = 0;
+    for(rank = 0; rank < num_senders; rank ++) {
+        int status;
+        waitpid(children[rank], &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Sender %d failed. %s:%d\n", rank, __FILE__, __LINE__);
+            rc = -1;
+        }
+    }
+
+    for(q = 0; q < num_queues; q ++) {
+        df_destroy_ep(recv_eps[q]);
+    }
+    df_destroy_queue_set_receiver(receiver);
+    df_destroy_queue_set(set);
+    free(contact_info);
+    if(df_destroy_shm_region(shm_region) != 0) {
+        fprintf(stderr, "Cannot destory shm region. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    df_shm_finalize(df_shm_handle);
+    return rc;
+}
@@ -0,0 +1,222 @@
+/*
+ * This test program excercises the C++ containers of df_shm_containers.hpp: the
+ * first process lays out an arena in a shm region and builds a hash map, a vector
+ * and a list of pooled nodes linked with offset_ptr; the second process attaches
+ * the region (at a different address if the kernel places it elsewhere), checks
+ * the data structures and adds entries which the first process then finds.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include "df_shm_bootstrap.h"
+#include "df_shm.h"
+#include "df_shm_containers.hpp"
+
+// test parameters
+enum DF_SHM_METHOD shm_method = DF_SHM_METHOD_MMAP;
+size_t region_size = 64 * 1024 * 1024;
+uint64_t num_entries = 100000;
+int num_nodes = 1000;
+
+df_bootstrap_t bootstrap;
+
+struct list_node {
+    df::offset_ptr<list_node> next;
+    uint64_t value;
+    explicit list_node (uint64_t v) : next(), value(v) {}
+};
+
+// the root object of the region through which the attacher finds everything
+struct shared_root {
+    df::hash_map<uint64_t, uint64_t> map;
+    df::vector<uint64_t> vec;
+    df::object_pool<list_node> pool;
+    df::offset_ptr<list_node> list;
+    explicit shared_root (df::region_arena *arena) : map(arena), vec(arena), pool(arena), list() {}
+};
+
+void creator();
+void attacher();
+
+int main (int argc, char *argv[])
+{
+    int rank;
+
+    bootstrap = df_bootstrap_init(NULL, 2);
+    if(!bootstrap) {
+        fprintf(stderr, "The test requires 2 processes in a bootstrap group.\n");
+        return -1;
+    }
+    rank = df_bootstrap_rank(bootstrap);
+
+    // optionally choose the shm method: M (mmap), P (POSIX shm) or F (memfd)
+    if(argc > 1) {
+        switch(argv[1][0]) {
+            case 'M': shm_method = DF_SHM_METHOD_MMAP; break;
+            case 'P': shm_method = DF_SHM_METHOD_POSIX_SHM; break;
+            case 'F': shm_method = DF_SHM_METHOD_MEMFD; break;
+            default:
+                fprintf(stderr, "Unknown shm method %s.\n", argv[1]);
+                df_bootstrap_finalize(bootstrap);
+                return -1;
+        }
+    }
+
+    if(rank==0) {
+        creator();
+    }
+    else {
+        attacher();
+    }
+
+    df_bootstrap_finalize(bootstrap);
+    return 0;
+}
+
+df_shm_method_t init_method()
+{
+    df_shm_method_t df_shm_handle = df_shm_init(shm_method, NULL);
+    if(!df_shm_handle) {
+        fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n",
+            shm_method, __FILE__, __LINE__);
+        exit(-1);
+    }
+    return df_shm_handle;
+}
+
+void creator()
+{
+    df_shm_method_t df_shm_handle = init_method();
+    df_shm_region_t region = df_create_shm_region(df_shm_handle, region_size, NULL);
+    if(!region) {
+        fprintf(stderr, "Cannot create shm region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    df::region_arena *arena = df::region_arena::create(region);
+    shared_root *root = arena->construct<shared_root>(arena);
+    arena->set_root(root);
+
+    // odd keys stay in the map, even keys are inserted and erased again
+    uint64_t i;
+    for(i = 0; i < num_entries; i ++) {
+        root->map.insert(i, i * i);
+        root->vec.push_back(i);
+    }
+    for(i = 0; i < num_entries; i += 2) {
+        if(!root->map.erase(i)) {
+            fprintf(stderr, "Cannot erase key %lu. %s:%d\n", i, __FILE__, __LINE__);
+            exit(-1);
+        }
+    }
+    int n;
+    for(n = 0; n < num_nodes; n ++) {
+        list_node *node = root->pool.create(n);
+        node->next = root->list;
+        root->list = node;
+    }
+
+    // send contact info to the attacher
+    int contact_length;
+    void *contact_info = df_shm_region_contact_info(df_shm_handle, region, &contact_length);
+    df_bootstrap_send(bootstrap, 1, &contact_length, sizeof(contact_length));
+    df_bootstrap_send(bootstrap, 1, contact_info, contact_length);
+    free(contact_info);
+
+    // wait for the attacher to add the even keys back with its own values
+    df_bootstrap_barrier(bootstrap);
+    if(root->map.size() != num_entries) {
+        fprintf(stderr, "Map has %lu entries instead of %lu. %s:%d\n", root->map.size(),
+            num_entries, __FILE__, __LINE__);
+        exit(-1);
+    }
+    for(i = 0; i < num_entries; i ++) {
+        uint64_t *v = root->map.find(i);
+        if(!v || *v != (i % 2? i * i : i + 1)) {
+            fprintf(stderr, "Wrong value of key %lu. %s:%d\n", i, __FILE__, __LINE__);
+            exit(-1);
+        }
+    }
+
+    arena->destroy(root);
+    if(df_destroy_shm_region(region) != 0) {
+        fprintf(stderr, "Cannot destroy shm region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    df_shm_finalize(df_shm_handle);
+    fprintf(stderr, "Creator built containers of %lu entries.\n", num_entries);
+}
+
+void attacher()
+{
+    df_shm_method_t df_shm_handle = init_method();
+
+    // take some address space first so the region is unlikely to land where it is
+    // in the creator
+    df_shm_region_t other = df_create_shm_region(df_shm_handle, 1024 * 1024, NULL);
+
+    int contact_length;
+    df_bootstrap_recv(bootstrap, 0, &contact_length, sizeof(contact_length));
+    void *contact_info = malloc(contact_length);
+    df_bootstrap_recv(bootstrap, 0, contact_info, contact_length);
+    df_shm_region_t region = df_attach_shm_region(df_shm_handle, 0, contact_info, region_size, NULL);
+    free(contact_info);
+    if(!region) {
+        fprintf(stderr, "Cannot attach shm region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    df::region_arena *arena = df::region_arena::attach(region);
+    if(!arena || !arena->root<shared_root>()) {
+        fprintf(stderr, "No arena in shm region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    shared_root *root = arena->root<shared_root>();
+
+    uint64_t i;
+    if(root->map.size() != num_entries / 2 || root->vec.size() != num_entries) {
+        fprintf(stderr, "Containers have %lu and %lu entries. %s:%d\n", root->map.size(),
+            root->vec.size(), __FILE__, __LINE__);
+        exit(-1);
+    }
+    for(i = 0; i < num_entries; i ++) {
+        uint64_t *v = root->map.find(i);
+        if(root->vec[i] != i || (i % 2 && (!v || *v != i * i)) || (i % 2 == 0 && v)) {
+            fprintf(stderr, "Wrong entry %lu. %s:%d\n", i, __FILE__, __LINE__);
+            exit(-1);
+        }
+    }
+    int n = num_nodes;
+    list_node *node;
+    for(node = root->list.get(); node; node = node->next.get()) {
+        if(node->value != (uint64_t) -- n) {
+            fprintf(stderr, "Wrong list node %lu. %s:%d\n", node->value, __FILE__, __LINE__);
+            exit(-1);
+        }
+    }
+    if(n != 0) {
+        fprintf(stderr, "List is missing %d nodes. %s:%d\n", n, __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // memory allocated by this process is usable by the creator
+    for(i = 0; i < num_entries; i += 2) {
+        if(!root->map.insert(i, i + 1).second) {
+            fprintf(stderr, "Cannot insert key %lu. %s:%d\n", i, __FILE__, __LINE__);
+            exit(-1);
+        }
+    }
+    df_bootstrap_barrier(bootstrap);
+
+    if(df_detach_shm_region(region) != 0) {
+        fprintf(stderr, "Cannot detach shm region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    if(other) {
+        df_destroy_shm_region(other);
+    }
+    df_shm_finalize(df_shm_handle);
+    fprintf(stderr, "Attacher checked containers of %lu entries.\n", num_entries);
+}
@@ -0,0 +1,181 @@
+/*
+ * This test program excercises fixed-address mapping (DF_SHM_FLAG_FIXED_ADDR): the
+ * first process creates a region and builds a linked list in it with raw pointers;
+ * the second process attaches the region, checks that it is at the creator's
+ * address, walks the list and appends a node to it, which the creator then finds.
+ * Attaching the region a second time in the same process must fail.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include "df_shm_bootstrap.h"
+#include "df_shm.h"
+
+// test parameters
+enum DF_SHM_METHOD shm_method = DF_SHM_METHOD_MMAP;
+size_t region_size = 1024 * 1024;
+int num_nodes = 1000;
+
+df_bootstrap_t bootstrap;
+
+typedef struct _list_node {
+    struct _list_node *next;
+    uint64_t value;
+} list_node;
+
+void creator();
+void attacher();
+
+int main (int argc, char *argv[])
+{
+    int rank;
+
+    bootstrap = df_bootstrap_init(NULL, 2);
+    if(!bootstrap) {
+        fprintf(stderr, "The test requires 2 processes in a bootstrap group.\n");
+        return -1;
+    }
+    rank = df_bootstrap_rank(bootstrap);
+
+    // optionally choose the shm method: M (mmap), P (POSIX shm) or F (memfd)
+    if(argc > 1) {
+        switch(argv[1][0]) {
+            case 'M': shm_method = DF_SHM_METHOD_MMAP; break;
+            case 'P': shm_method = DF_SHM_METHOD_POSIX_SHM; break;
+            case 'F': shm_method = DF_SHM_METHOD_MEMFD; break;
+            default:
+                fprintf(stderr, "Unknown shm method %s.\n", argv[1]);
+                df_bootstrap_finalize(bootstrap);
+                return -1;
+        }
+    }
+
+    if(rank==0) {
+        creator();
+    }
+    else {
+        attacher();
+    }
+
+    df_bootstrap_finalize(bootstrap);
+    return 0;
+}
+
+df_shm_method_t init_method()
+{
+    df_shm_config config;
+    memset(&config, 0, sizeof(config));
+    config.flags = DF_SHM_FLAG_FIXED_ADDR;
+    df_shm_method_t df_shm_handle = df_shm_init(shm_method, &config);
+    if(!df_shm_handle) {
+        fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n",
+            shm_method, __FILE__, __LINE__);
+        exit(-1);
+    }
+    return df_shm_handle;
+}
+
+void creator()
+{
+    df_shm_method_t df_shm_handle = init_method();
+    df_shm_region_t region = df_create_shm_region(df_shm_handle, region_size, NULL);
+    if(!region) {
+        fprintf(stderr, "Cannot create shm region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // the first node is the list head; link the others to it in reverse order
+    list_node *nodes = (list_node *) region->starting_addr;
+    nodes[0].next = NULL;
+    nodes[0].value = 0;
+    int i;
+    for(i = 1; i < num_nodes; i ++) {
+        nodes[i].value = i;
+        nodes[i].next = nodes[0].next;
+        nodes[0].next = &nodes[i];
+    }
+
+    // send the address and contact info to the attacher
+    uint64_t addr = (uint64_t) (uintptr_t) region->starting_addr;
+    int contact_length;
+    void *contact_info = df_shm_region_contact_info(df_shm_handle, region, &contact_length);
+    df_bootstrap_send(bootstrap, 1, &addr, sizeof(addr));
+    df_bootstrap_send(bootstrap, 1, &contact_length, sizeof(contact_length));
+    df_bootstrap_send(bootstrap, 1, contact_info, contact_length);
+    free(contact_info);
+
+    // wait for the attacher to append its node to the head of the list
+    df_bootstrap_barrier(bootstrap);
+    list_node *appended = nodes[0].next;
+    if(appended < nodes || appended >= nodes + region_size / sizeof(list_node) ||
+       appended->value != (uint64_t) num_nodes || appended->next != &nodes[num_nodes - 1]) {
+        fprintf(stderr, "Node appended by the attacher is not found. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    df_bootstrap_barrier(bootstrap);
+    if(df_destroy_shm_region(region) != 0) {
+        fprintf(stderr, "Cannot destroy shm region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    df_shm_finalize(df_shm_handle);
+    fprintf(stderr, "Creator shared a list of %d nodes at %p.\n", num_nodes, (void *) (uintptr_t) addr);
+}
+
+void attacher()
+{
+    df_shm_method_t df_shm_handle = init_method();
+
+    uint64_t addr;
+    int contact_length;
+    df_bootstrap_recv(bootstrap, 0, &addr, sizeof(addr));
+    df_bootstrap_recv(bootstrap, 0, &contact_length, sizeof(contact_length));
+    void *contact_info = malloc(contact_length);
+    df_bootstrap_recv(bootstrap, 0, contact_info, contact_length);
+    df_shm_region_t region = df_attach_shm_region(df_shm_handle, 0, contact_info, region_size, NULL);
+    if(!region || region->starting_addr != (void *) (uintptr_t) addr) {
+        fprintf(stderr, "Cannot attach shm region at %p. %s:%d\n", (void *) (uintptr_t) addr,
+            __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // the address is taken now, so a second attach fails instead of moving the region
+    fprintf(stderr, "Expect an error on attaching the region twice:\n");
+    if(df_attach_shm_region(df_shm_handle, 0, contact_info, region_size, NULL) != NULL) {
+        fprintf(stderr, "Region attached twice at the same address. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    free(contact_info);
+
+    // follow the creator's pointers
+    list_node *head = (list_node *) region->starting_addr;
+    list_node *node;
+    uint64_t count = 0, sum = 0;
+    for(node = head->next; node; node = node->next) {
+        count ++;
+        sum += node->value;
+    }
+    if(count != (uint64_t) num_nodes - 1 || sum != (uint64_t) num_nodes * (num_nodes - 1) / 2) {
+        fprintf(stderr, "List has %lu nodes summing to %lu. %s:%d\n", count, sum, __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    // link a node of our own with a pointer valid in the creator
+    list_node *mine = &head[num_nodes];
+    mine->value = num_nodes;
+    mine->next = head->next;
+    head->next = mine;
+    df_bootstrap_barrier(bootstrap);
+
+    if(df_detach_shm_region(region) != 0) {
+        fprintf(stderr, "Cannot detach shm region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    df_bootstrap_barrier(bootstrap);
+    df_shm_finalize(df_shm_handle);
+    fprintf(stderr, "Attacher walked %lu nodes.\n", count);
+}
@@ -8,31 +8,45 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <mpi.h>
+#include "df_shm_bootstrap.h"
 #include "df_shm.h"
 
 // test parameters
 enum DF_SHM_METHOD shm_method = DF_SHM_METHOD_SYSV;
 size_t region_size = 4096;
 
+df_bootstrap_t bootstrap;
+
 
 void sender();
 void receiver();
 
 int main (int argc, char *argv[])
 {
-    int rank, size;
-
-    MPI_Init (&argc, &argv);      
-    MPI_Comm_rank (MPI_COMM_WORLD, &rank);        
-    MPI_Comm_size (MPI_COMM_WORLD, &size);        
-    if(size != 2) {
-        fprintf(stderr, "The test requires 2 MPI processes.\n");    
-        MPI_Finalize();
+    int rank, size = 2;
+
+    bootstrap = df_bootstrap_init(NULL, 2);
+    if(!bootstrap) {
+        fprintf(stderr, "The test requires 2 processes in a bootstrap group.\n");
         return -1;
     }
+    rank = df_bootstrap_rank(bootstrap);
     printf( "Hello world from process %d of %d\n", rank, size );
 
+    // optionally choose the shm method: S (SysV), M (mmap), P (POSIX shm) or F (memfd)
+    if(argc > 1) {
+        switch(argv[1][0]) {
+            case 'S': shm_method = DF_SHM_METHOD_SYSV; break;
+            case 'M': shm_method = DF_SHM_METHOD_MMAP; break;
+            case 'P': shm_method = DF_SHM_METHOD_POSIX_SHM; break;
+            case 'F': shm_method = DF_SHM_METHOD_MEMFD; break;
+            default:
+                fprintf(stderr, "Unknown shm method %s.\n", argv[1]);
+                df_bootstrap_finalize(bootstrap);
+                return -1;
+        }
+    }
+
     if(rank==0) {
         sender();
     }
@@ -40,7 +54,7 @@ int main (int argc, char *argv[])
         receiver();
     }
 
-    MPI_Finalize();
+    df_bootstrap_finalize(bootstrap);
     return 0;
 }
 
@@ -84,13 +98,13 @@ void sender()
     printf("Sender's pid: %d\n", *sender_pid);
 
     // send the contact info to receiver side through external mechanism
-    // in this case, we use MPI
-    MPI_Send(&contact_length, 1, MPI_INT, 1, 0, MPI_COMM_WORLD);
-    MPI_Send(contact_info, contact_length, MPI_BYTE, 1, 0, MPI_COMM_WORLD);
-    MPI_Send(&sender_pid, 1, MPI_INT, 1, 1, MPI_COMM_WORLD);
+    // in this case, we use the bootstrap service
+    df_bootstrap_send(bootstrap, 1, &contact_length, sizeof(contact_length));
+    df_bootstrap_send(bootstrap, 1, contact_info, contact_length);
+    df_bootstrap_send(bootstrap, 1, sender_pid, sizeof(*sender_pid));
 
     // wait for receiver to attach region and write something into it
-    MPI_Barrier(MPI_COMM_WORLD);
+    df_bootstrap_barrier(bootstrap);
 
     if(*receiver_pid == -1) { 
         fprintf(stderr, "Cannot read receiver's pid. %s:%d\n",
@@ -100,7 +114,7 @@ void sender()
     printf("Sender got receiver's pid: %d\n", *receiver_pid);
 
     // wait for receiver to detach
-    MPI_Barrier(MPI_COMM_WORLD);
+    df_bootstrap_barrier(bootstrap);
 
     // destroy the shm region
     if(df_destroy_shm_region(region) != 0) {
@@ -125,13 +139,12 @@ void receiver()
     }
 
     // wait for sender to tell me the contact info of shm region
-    MPI_Status status;
     int contact_length;
     void *contact_info;
     pid_t creator_pid;
-    int rc = MPI_Recv(&contact_length, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, &status);
-    if(rc != MPI_SUCCESS) {
-        fprintf(stderr, "MPI_Recv error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+    int rc = df_bootstrap_recv(bootstrap, 0, &contact_length, sizeof(contact_length));
+    if(rc != 0) {
+        fprintf(stderr, "Bootstrap receive error: %d. %s:%d\n", rc, __FILE__, __LINE__);
         exit(-1); 
     }
     contact_info = malloc(contact_length);
@@ -139,14 +152,14 @@ void receiver()
         fprintf(stderr, "Cannot allocate memory. %s:%d\n", __FILE__, __LINE__);
         exit(-1);
     }
-    rc = MPI_Recv(contact_info, contact_length, MPI_BYTE, 0, 0, MPI_COMM_WORLD, &status);
-    if(rc != MPI_SUCCESS) {
-        fprintf(stderr, "MPI_Recv error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+    rc = df_bootstrap_recv(bootstrap, 0, contact_info, contact_length);
+    if(rc != 0) {
+        fprintf(stderr, "Bootstrap receive error: %d. %s:%d\n", rc, __FILE__, __LINE__);
         exit(-1);
     }
-    rc = MPI_Recv(&creator_pid, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, &status);
-    if(rc != MPI_SUCCESS) {
-        fprintf(stderr, "MPI_Recv error: %d. %s:%d\n", rc, __FILE__, __LINE__);
+    rc = df_bootstrap_recv(bootstrap, 0, &creator_pid, sizeof(creator_pid));
+    if(rc != 0) {
+        fprintf(stderr, "Bootstrap receive error: %d. %s:%d\n", rc, __FILE__, __LINE__);
         exit(-1);
     }
 
@@ -166,7 +179,7 @@ void receiver()
     printf("Receiver got sender's pid: %d.\n", *sender_pid);
 
     // tell sender to check what the receiver just wrote in shm region
-    MPI_Barrier(MPI_COMM_WORLD);
+    df_bootstrap_barrier(bootstrap);
 
     // detach the shm region
     if(df_detach_shm_region(region) != 0) {
@@ -175,7 +188,7 @@ void receiver()
     }
 
     // tell sender we have detached the region
-    MPI_Barrier(MPI_COMM_WORLD);
+    df_bootstrap_barrier(bootstrap);
     free(contact_info);
     df_shm_finalize(df_shm_handle);
     return;
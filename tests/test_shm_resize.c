@@ -0,0 +1,180 @@
+/*
+ * This test program excercises growable shm regions: the first process creates
+ * a region and grows it several times, writing a pattern into each new part; the
+ * second process attaches the region once and after each resize refreshes it and
+ * checks the pattern at the same (unchanged) base address.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include "df_shm_bootstrap.h"
+#include "df_shm.h"
+
+// test parameters
+enum DF_SHM_METHOD shm_method = DF_SHM_METHOD_MMAP;
+size_t initial_size = 4096;
+size_t max_size = 64 * 1024 * 1024;
+int num_resizes = 8;
+
+df_bootstrap_t bootstrap;
+
+void creator();
+void attacher();
+
+/*
+ * Size of the region after the i-th resize (0 is the initial size).
+ */
+static size_t size_at(int i)
+{
+    return initial_size << (2 * i);
+}
+
+int main (int argc, char *argv[])
+{
+    int rank;
+
+    bootstrap = df_bootstrap_init(NULL, 2);
+    if(!bootstrap) {
+        fprintf(stderr, "The test requires 2 processes in a bootstrap group.\n");
+        return -1;
+    }
+    rank = df_bootstrap_rank(bootstrap);
+
+    // optionally choose the shm method: M (mmap), P (POSIX shm) or F (memfd)
+    if(argc > 1) {
+        switch(argv[1][0]) {
+            case 'M': shm_method = DF_SHM_METHOD_MMAP; break;
+            case 'P': shm_method = DF_SHM_METHOD_POSIX_SHM; break;
+            case 'F': shm_method = DF_SHM_METHOD_MEMFD; break;
+            default:
+                fprintf(stderr, "Unknown shm method %s.\n", argv[1]);
+                df_bootstrap_finalize(bootstrap);
+                return -1;
+        }
+    }
+    if(size_at(num_resizes - 1) > max_size) {
+        fprintf(stderr, "Regions do not fit in max_size. %s:%d\n", __FILE__, __LINE__);
+        df_bootstrap_finalize(bootstrap);
+        return -1;
+    }
+
+    if(rank==0) {
+        creator();
+    }
+    else {
+        attacher();
+    }
+
+    df_bootstrap_finalize(bootstrap);
+    return 0;
+}
+
+df_shm_method_t init_method()
+{
+    df_shm_config config;
+    memset(&config, 0, sizeof(config));
+    config.max_region_size = max_size;
+    df_shm_method_t df_shm_handle = df_shm_init(shm_method, &config);
+    if(!df_shm_handle) {
+        fprintf(stderr, "Cannot initialize shm method %d. %s:%d\n",
+            shm_method, __FILE__, __LINE__);
+        exit(-1);
+    }
+    return df_shm_handle;
+}
+
+void creator()
+{
+    df_shm_method_t df_shm_handle = init_method();
+    df_shm_region_t region = df_create_shm_region(df_shm_handle, initial_size, NULL);
+    if(!region) {
+        fprintf(stderr, "Cannot create shm region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    memset(region->starting_addr, 0, initial_size);
+    *(uint64_t *) region->starting_addr = 0;
+
+    // send contact info to the attacher
+    int contact_length;
+    void *contact_info = df_shm_region_contact_info(df_shm_handle, region, &contact_length);
+    df_bootstrap_send(bootstrap, 1, &contact_length, sizeof(contact_length));
+    df_bootstrap_send(bootstrap, 1, contact_info, contact_length);
+    free(contact_info);
+    df_bootstrap_barrier(bootstrap);
+
+    void *base = region->starting_addr;
+    int i;
+    for(i = 1; i < num_resizes; i ++) {
+        if(df_resize_shm_region(region, size_at(i)) != 0 || region->starting_addr != base ||
+           region->size != size_at(i)) {
+            fprintf(stderr, "Cannot resize shm region to %lu. %s:%d\n", size_at(i), __FILE__, __LINE__);
+            exit(-1);
+        }
+        // mark the last word of the new part
+        uint64_t *last = (uint64_t *) ((char *) base + size_at(i)) - 1;
+        *last = i;
+        df_bootstrap_barrier(bootstrap);
+        df_bootstrap_barrier(bootstrap);
+    }
+    if(df_shm_lookup_addr(df_shm_handle, (char *) base + size_at(num_resizes - 1) - 1, NULL) != region) {
+        fprintf(stderr, "Grown part is not found in the address index. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    df_bootstrap_barrier(bootstrap);
+    if(df_destroy_shm_region(region) != 0) {
+        fprintf(stderr, "Cannot destroy shm region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    df_shm_finalize(df_shm_handle);
+    fprintf(stderr, "Creator grew region from %lu to %lu bytes.\n", initial_size,
+        size_at(num_resizes - 1));
+}
+
+void attacher()
+{
+    df_shm_method_t df_shm_handle = init_method();
+
+    int contact_length;
+    df_bootstrap_recv(bootstrap, 0, &contact_length, sizeof(contact_length));
+    void *contact_info = malloc(contact_length);
+    df_bootstrap_recv(bootstrap, 0, contact_info, contact_length);
+    df_shm_region_t region = df_attach_shm_region(df_shm_handle, 0, contact_info, initial_size, NULL);
+    free(contact_info);
+    if(!region) {
+        fprintf(stderr, "Cannot attach shm region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    df_bootstrap_barrier(bootstrap);
+
+    void *base = region->starting_addr;
+    int i;
+    for(i = 1; i < num_resizes; i ++) {
+        df_bootstrap_barrier(bootstrap);
+        size_t size = df_refresh_shm_region(region);
+        uint64_t *last = (uint64_t *) ((char *) base + size_at(i)) - 1;
+        if(size != size_at(i) || region->starting_addr != base || *last != (uint64_t) i) {
+            fprintf(stderr, "Refreshed region has size %lu instead of %lu. %s:%d\n",
+                size, size_at(i), __FILE__, __LINE__);
+            exit(-1);
+        }
+        df_bootstrap_barrier(bootstrap);
+    }
+    // nothing changed: refreshing is a no-op
+    if(df_refresh_shm_region(region) != size_at(num_resizes - 1)) {
+        fprintf(stderr, "Region size changed. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    if(df_detach_shm_region(region) != 0) {
+        fprintf(stderr, "Cannot detach shm region. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    df_bootstrap_barrier(bootstrap);
+    df_shm_finalize(df_shm_handle);
+    fprintf(stderr, "Attacher followed region to %lu bytes.\n", size_at(num_resizes - 1));
+}
@@ -0,0 +1,107 @@
+/*
+ * This test program checks cpu topology discovery and pinning: every online cpu
+ * is found, the relation of two cpus agrees with their core, cache and package
+ * ids and is symmetric, the pairs found for each relation have that relation,
+ * and pinning to each cpu moves the thread there. The topology is printed.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include "df_shm_topology.h"
+
+int main (int argc, char *argv[])
+{
+    df_topology_t topology = df_topology_discover();
+    if(!topology) {
+        fprintf(stderr, "Cannot discover topology. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+    if(topology->num_cpus != sysconf(_SC_NPROCESSORS_ONLN)) {
+        fprintf(stderr, "Found %d cpus instead of %ld. %s:%d\n", topology->num_cpus,
+            sysconf(_SC_NPROCESSORS_ONLN), __FILE__, __LINE__);
+        return -1;
+    }
+
+    fprintf(stdout, "%-*s%*s%*s%*s%*s\n", 8, "# Cpu", 8, "Core", 8, "LLC", 8, "Level", 10, "Package");
+    int i, j;
+    for(i = 0; i < topology->num_cpus; i ++) {
+        df_cpu_info *info = &topology->cpus[i];
+        fprintf(stdout, "%-*d%*d%*d%*d%*d\n", 8, info->cpu, 8, info->core, 8, info->llc, 8,
+            info->llc_level, 10, info->package);
+        if(df_topology_cpu(topology, info->cpu) != info || (i > 0 && info->cpu <= topology->cpus[i - 1].cpu)) {
+            fprintf(stderr, "Cpu %d is misplaced. %s:%d\n", info->cpu, __FILE__, __LINE__);
+            return -1;
+        }
+        // a core or cache is named after its smallest cpu, which belongs to it
+        if(info->core > info->cpu || (info->core >= 0 && df_topology_cpu(topology, info->core) &&
+           df_topology_cpu(topology, info->core)->core != info->core)) {
+            fprintf(stderr, "Cpu %d has a bad core id %d. %s:%d\n", info->cpu, info->core, __FILE__, __LINE__);
+            return -1;
+        }
+        if(info->llc > info->cpu) {
+            fprintf(stderr, "Cpu %d has a bad cache id %d. %s:%d\n", info->cpu, info->llc, __FILE__, __LINE__);
+            return -1;
+        }
+    }
+
+    // relations are symmetric and agree with the ids
+    for(i = 0; i < topology->num_cpus; i ++) {
+        for(j = 0; j < topology->num_cpus; j ++) {
+            df_cpu_info *a = &topology->cpus[i], *b = &topology->cpus[j];
+            int p = df_topology_placement(topology, a->cpu, b->cpu);
+            if(p != df_topology_placement(topology, b->cpu, a->cpu) ||
+               (i == j && p != DF_PLACEMENT_SAME_CPU) ||
+               (p == DF_PLACEMENT_SMT_SIBLING && a->core != b->core) ||
+               (p == DF_PLACEMENT_SAME_L3 && (a->core == b->core || a->llc != b->llc)) ||
+               (p == DF_PLACEMENT_CROSS_L3 && (a->package != b->package || a->llc == b->llc)) ||
+               (p == DF_PLACEMENT_CROSS_SOCKET && a->package == b->package)) {
+                fprintf(stderr, "Wrong relation %d of cpus %d and %d. %s:%d\n", p, a->cpu, b->cpu,
+                    __FILE__, __LINE__);
+                return -1;
+            }
+        }
+    }
+    if(df_topology_placement(topology, -1, 0) != -1 || df_topology_cpu(topology, -1) != NULL) {
+        fprintf(stderr, "Cpu -1 is found. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    int p;
+    for(p = 0; p < DF_NUM_PLACEMENTS; p ++) {
+        int a, b;
+        if(df_placement_from_name(df_placement_name(p)) != p) {
+            fprintf(stderr, "Placement name %s does not parse. %s:%d\n", df_placement_name(p),
+                __FILE__, __LINE__);
+            return -1;
+        }
+        if(df_topology_find_pair(topology, p, &a, &b) != 0) {
+            fprintf(stdout, "%-14s none\n", df_placement_name(p));
+            continue;
+        }
+        if(df_topology_placement(topology, a, b) != p) {
+            fprintf(stderr, "Pair %d, %d is not %s. %s:%d\n", a, b, df_placement_name(p), __FILE__, __LINE__);
+            return -1;
+        }
+        fprintf(stdout, "%-14s cpus %d and %d\n", df_placement_name(p), a, b);
+    }
+    if(df_placement_from_name("nowhere") != -1 || df_placement_name(DF_NUM_PLACEMENTS) != NULL) {
+        fprintf(stderr, "Unknown placement is accepted. %s:%d\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    // cpus may be online but outside this process's cpuset; only check those we get
+    for(i = 0; i < topology->num_cpus; i ++) {
+        int cpu = topology->cpus[i].cpu;
+        if(df_pin_thread(cpu) == 0 && df_current_cpu() != cpu) {
+            fprintf(stderr, "Pinned to cpu %d but running on %d. %s:%d\n", cpu, df_current_cpu(),
+                __FILE__, __LINE__);
+            return -1;
+        }
+    }
+
+    df_topology_free(topology);
+    return 0;
+}
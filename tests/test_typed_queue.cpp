@@ -0,0 +1,189 @@
+/*
+ * This test program excercises the C++ interface of df_shm.hpp: the first process
+ * creates a region holding a typed queue and an untyped queue, and sends a stream
+ * of typed messages, half filled in place through views and half copied; the
+ * second process attaches the region, receives and checks the stream through
+ * views and copies, and acknowledges it on the untyped queue. Both ends also keep
+ * two views alive at once from time to time and finish them in reverse order.
+ * All handles are released by going out of scope.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include "df_shm_bootstrap.h"
+#include "df_shm.hpp"
+
+// test parameters
+enum DF_SHM_METHOD shm_method = DF_SHM_METHOD_MMAP;
+uint64_t num_msgs = 100000;
+
+df_bootstrap_t bootstrap;
+
+struct message_t {
+    uint64_t seq;
+    double values[6];
+};
+
+typedef df::typed_queue<message_t, 64> msg_queue;
+static_assert(msg_queue::slot_size == 128, "unexpected slot geometry");
+
+const size_t ack_queue_offset = msg_queue::size_bytes;
+const size_t region_size = msg_queue::size_bytes + 4096;
+
+void creator();
+void attacher();
+
+int main (int argc, char *argv[])
+{
+    int rank;
+
+    bootstrap = df_bootstrap_init(NULL, 2);
+    if(!bootstrap) {
+        fprintf(stderr, "The test requires 2 processes in a bootstrap group.\n");
+        return -1;
+    }
+    rank = df_bootstrap_rank(bootstrap);
+
+    // optionally choose the shm method: M (mmap), P (POSIX shm) or F (memfd)
+    if(argc > 1) {
+        switch(argv[1][0]) {
+            case 'M': shm_method = DF_SHM_METHOD_MMAP; break;
+            case 'P': shm_method = DF_SHM_METHOD_POSIX_SHM; break;
+            case 'F': shm_method = DF_SHM_METHOD_MEMFD; break;
+            default:
+                fprintf(stderr, "Unknown shm method %s.\n", argv[1]);
+                df_bootstrap_finalize(bootstrap);
+                return -1;
+        }
+    }
+
+    try {
+        if(rank==0) {
+            creator();
+        }
+        else {
+            attacher();
+        }
+    }
+    catch(const std::exception &e) {
+        fprintf(stderr, "Exception: %s. %s:%d\n", e.what(), __FILE__, __LINE__);
+        exit(-1);
+    }
+
+    df_bootstrap_finalize(bootstrap);
+    return 0;
+}
+
+void creator()
+{
+    df::method method(shm_method);
+    df::region region = method.create_region(region_size);
+    msg_queue queue = msg_queue::create(region.data());
+    df::queue acks = df::queue::create((char *) region.data() + ack_queue_offset, 4, 64);
+
+    // send contact info to the attacher
+    std::vector<char> contact_info = region.contact_info();
+    int contact_length = contact_info.size();
+    df_bootstrap_send(bootstrap, 1, &contact_length, sizeof(contact_length));
+    df_bootstrap_send(bootstrap, 1, contact_info.data(), contact_length);
+
+    msg_queue::sender sender = queue.make_sender();
+    uint64_t i;
+    for(i = 0; i < num_msgs; i ++) {
+        if(i % 8 == 0 && i + 1 < num_msgs) {
+            // the second slot is published before the first
+            msg_queue::write_view first = sender.prepare();
+            {
+                msg_queue::write_view second = sender.prepare();
+                second->seq = i + 1;
+                second->values[0] = (double) (i + 1);
+            }
+            first->seq = i;
+            first->values[0] = (double) i;
+            i ++;
+        }
+        else if(i % 2) {
+            message_t m;
+            m.seq = i;
+            m.values[0] = (double) i;
+            sender.send(m);
+        }
+        else {
+            msg_queue::write_view slot = sender.prepare();
+            slot->seq = i;
+            slot.value()[0].values[0] = (double) i;
+        }
+    }
+
+    df::endpoint ack_ep = acks.receiver();
+    df::message ack = ack_ep.receive();
+    uint64_t received;
+    memcpy(&received, ack.data(), sizeof(received));
+    if(ack.size() != sizeof(received) || received != num_msgs) {
+        fprintf(stderr, "Attacher acknowledged %lu messages. %s:%d\n", received, __FILE__, __LINE__);
+        exit(-1);
+    }
+    df_bootstrap_barrier(bootstrap);
+    fprintf(stderr, "Creator sent %lu typed messages.\n", num_msgs);
+}
+
+void attacher()
+{
+    df::method method(shm_method);
+
+    int contact_length;
+    df_bootstrap_recv(bootstrap, 0, &contact_length, sizeof(contact_length));
+    std::vector<char> contact_info(contact_length);
+    df_bootstrap_recv(bootstrap, 0, contact_info.data(), contact_length);
+    df::region region = method.attach_region(contact_info, region_size);
+    msg_queue queue = msg_queue::open(region.data());
+    df::queue acks = df::queue::open((char *) region.data() + ack_queue_offset);
+
+    msg_queue::receiver receiver = queue.make_receiver();
+    uint64_t i;
+    for(i = 0; i < num_msgs; i ++) {
+        uint64_t seq;
+        double value;
+        if(i % 5 == 1 && i + 1 < num_msgs) {
+            // the second message is released before the first
+            msg_queue::read_view first = receiver.receive();
+            {
+                msg_queue::read_view second = receiver.receive();
+                seq = second->seq;
+                value = second->values[0];
+            }
+            if(first->seq != i || first->values[0] != (double) i) {
+                fprintf(stderr, "Received message %lu instead of %lu. %s:%d\n",
+                    first->seq, i, __FILE__, __LINE__);
+                exit(-1);
+            }
+            i ++;
+        }
+        else if(i % 3) {
+            msg_queue::read_view m = receiver.receive();
+            seq = m->seq;
+            value = m.value()[0].values[0];
+        }
+        else {
+            message_t m = receiver.receive_copy();
+            seq = m.seq;
+            value = m.values[0];
+        }
+        if(seq != i || value != (double) i) {
+            fprintf(stderr, "Received message %lu instead of %lu. %s:%d\n", seq, i, __FILE__, __LINE__);
+            exit(-1);
+        }
+    }
+
+    df::endpoint ack_ep = acks.sender();
+    if(!ack_ep.send(&i, sizeof(i))) {
+        fprintf(stderr, "Cannot send acknowledgement. %s:%d\n", __FILE__, __LINE__);
+        exit(-1);
+    }
+    df_bootstrap_barrier(bootstrap);
+    fprintf(stderr, "Attacher received %lu typed messages.\n", num_msgs);
+}